@@ -7,6 +7,7 @@
 #include "../intgemm/intgemm.h"
 #include "../intgemm/stats.h"
 #include "../intgemm/callbacks.h"
+#include "../intgemm/thread_pool.h"
 
 #include <algorithm>
 #include <cassert>
@@ -18,6 +19,14 @@
 #include <iomanip>
 #include <iostream>
 #include <random>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace intgemm {
 namespace {
@@ -42,40 +51,186 @@ struct RandomMatrices {
   AlignedVector<float> A, B;
 };
 
-template <class Backend> double Run(const RandomMatrices &m) {
+enum class Variant {
+  // One call to Multiply.
+  Batch,
+  // One row of A per call so nothing shares loads of B.
+  RowByRow,
+  // One call to MultiplyWide, which doesn't saturate.
+  Wide,
+  // One call to MultiplyPanels with A from PrepareAPanels.
+  Panels,
+  // One call to Multiply after flushing B from the caches.
+  ColdB,
+  // kRepeats back-to-back calls to the dispatched multiply, timed per call.
+  Repeated,
+  // PrepareA into a new buffer then Multiply, timed together.
+  PrepareThenMultiply,
+  // MultiplyFloatA, quantizing A inside the multiply.
+  FloatA
+};
+
+const int kRepeats = 100;
+
+// Miss rates of the L1 data cache, the last level cache and the data TLB from
+// hardware counters.  Reads as unavailable where perf_event_open isn't
+// allowed, as in most containers and VMs.
+class CacheCounters {
+  public:
+    enum Counter { kL1DReads, kL1DMisses, kLLReferences, kLLMisses, kDTLBReads, kDTLBMisses, kCounters };
+
+    CacheCounters() {
+#ifdef __linux__
+      const uint64_t l1d_read = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8);
+      fds_[kL1DReads] = Open(PERF_TYPE_HW_CACHE, l1d_read | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16));
+      fds_[kL1DMisses] = Open(PERF_TYPE_HW_CACHE, l1d_read | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+      fds_[kLLReferences] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+      fds_[kLLMisses] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      const uint64_t dtlb_read = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8);
+      fds_[kDTLBReads] = Open(PERF_TYPE_HW_CACHE, dtlb_read | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16));
+      fds_[kDTLBMisses] = Open(PERF_TYPE_HW_CACHE, dtlb_read | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+      for (int &fd : fds_) fd = -1;
+#endif
+    }
+
+    ~CacheCounters() {
+      for (int fd : fds_) {
+        if (fd >= 0) Close(fd);
+      }
+    }
+
+    void Start() {
+      for (int fd : fds_) Control(fd, true);
+    }
+
+    void Stop() {
+      for (int fd : fds_) Control(fd, false);
+    }
+
+    // Misses divided by accesses, negative if either counter is unavailable.
+    double L1DMissRate() const { return Rate(kL1DMisses, kL1DReads); }
+    double LLMissRate() const { return Rate(kLLMisses, kLLReferences); }
+    double DTLBMissRate() const { return Rate(kDTLBMisses, kDTLBReads); }
+
+  private:
+#ifdef __linux__
+    static int Open(uint32_t type, uint64_t config) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.type = type;
+      attr.size = sizeof(attr);
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    static void Close(int fd) { close(fd); }
+    static void Control(int fd, bool enable) {
+      if (fd < 0) return;
+      if (enable) ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+    uint64_t Value(Counter counter) const {
+      uint64_t value = 0;
+      if (fds_[counter] < 0 || read(fds_[counter], &value, sizeof(value)) != sizeof(value)) return 0;
+      return value;
+    }
+#else
+    static void Close(int) {}
+    static void Control(int, bool) {}
+    uint64_t Value(Counter) const { return 0; }
+#endif
+
+    double Rate(Counter misses, Counter accesses) const {
+      uint64_t total = Value(accesses);
+      if (fds_[misses] < 0 || !total) return -1.0;
+      return static_cast<double>(Value(misses)) / static_cast<double>(total);
+    }
+
+    int fds_[kCounters];
+};
+
+// Time one multiply, counting cache misses in counters if given.  Prepared B
+// is allocated with B_policy.
+template <class Backend> double Run(const RandomMatrices &m, Variant variant = Variant::Batch, CacheCounters *counters = nullptr, PagePolicy B_policy = PagePolicy::Default) {
   using Integer = typename Backend::Integer;
   float quant_mult = 127.0f / 2.0f;
   float unquant_mult = 1.0f / (quant_mult * quant_mult);
   AlignedVector<Integer> A_prepared(m.A_rows * m.width);
-  Backend::PrepareA(m.A.begin(), A_prepared.begin(), quant_mult, m.A_rows, m.width);
-  AlignedVector<Integer> B_prepared(m.width * m.B_cols);
+  if (variant == Variant::Panels) {
+    PrepareAPanels<Backend>(m.A.begin(), A_prepared.begin(), quant_mult, m.A_rows, m.width);
+  } else {
+    Backend::PrepareA(m.A.begin(), A_prepared.begin(), quant_mult, m.A_rows, m.width);
+  }
+  AlignedVector<Integer> B_prepared(m.width * m.B_cols, B_policy);
   Backend::PrepareB(m.B.begin(), B_prepared.begin(), quant_mult, m.width, m.B_cols);
   AlignedVector<float> output(m.A_rows * m.B_cols);
   // Burn in
   Backend::Multiply(A_prepared.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+  if (variant == Variant::ColdB) {
+    const char *B_bytes = reinterpret_cast<const char*>(B_prepared.begin());
+    for (std::size_t i = 0; i < B_prepared.size() * sizeof(Integer); i += 64) {
+      _mm_clflush(B_bytes + i);
+    }
+    _mm_mfence();
+  }
+  if (counters) counters->Start();
   auto start = std::chrono::steady_clock::now();
-  Backend::Multiply(A_prepared.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
-  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (variant == Variant::RowByRow) {
+    for (Index row = 0; row < m.A_rows; ++row) {
+      Backend::Multiply(A_prepared.begin() + row * m.width, B_prepared.begin(), 1, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin() + row * m.B_cols));
+    }
+  } else if (variant == Variant::Wide) {
+    Backend::MultiplyWide(A_prepared.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+  } else if (variant == Variant::Repeated) {
+    for (int repeat = 0; repeat < kRepeats; ++repeat) {
+      OMPParallelWrapBlocked<callbacks::UnquantizeAndWrite, Backend>(A_prepared.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+    }
+  } else if (variant == Variant::PrepareThenMultiply) {
+    AlignedVector<Integer> A_fresh(m.A_rows * m.width);
+    Backend::PrepareA(m.A.begin(), A_fresh.begin(), quant_mult, m.A_rows, m.width);
+    OMPParallelWrapBlocked<callbacks::UnquantizeAndWrite, Backend>(A_fresh.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+  } else if (variant == Variant::FloatA) {
+    MultiplyFloatA<callbacks::UnquantizeAndWrite, Backend>(m.A.begin(), m.width, B_prepared.begin(), quant_mult, m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+  } else if (variant == Variant::Panels) {
+    OMPParallelWrapPanels<callbacks::UnquantizeAndWrite, Backend>(A_prepared.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+  } else {
+    Backend::Multiply(A_prepared.begin(), B_prepared.begin(), m.A_rows, m.width, m.B_cols, callbacks::UnquantizeAndWrite(unquant_mult, output.begin()));
+  }
+  double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (counters) counters->Stop();
+  if (variant == Variant::Repeated) took /= kRepeats;
+  return took;
+}
+
+// AVX512 CPUs may lack AVX-VNNI, so it can't be compared against kCPU.
+template <class Backend> bool Supported() {
+  if (Backend::kUses == CPUType::AVXVNNI) return CPUSupportsAVXVNNI();
+  return Backend::kUses <= kCPU;
 }
 
-template <class Backend> void RunAll(RandomMatrices *matrices, RandomMatrices *matrices_end, std::vector<std::vector<double>> &stats) {
-  if (Backend::kUses > kCPU) return;
+template <class Backend> void RunAll(RandomMatrices *matrices, RandomMatrices *matrices_end, std::vector<std::vector<double>> &stats, Variant variant = Variant::Batch, PagePolicy B_policy = PagePolicy::Default) {
+  if (!Supported<Backend>()) return;
   std::size_t size = matrices_end - matrices;
   if (stats.size() < size)
     stats.resize(size);
   for (std::size_t i = 0; i < size; ++i) {
-    stats[i].push_back(Run<Backend>(matrices[i]));
+    stats[i].push_back(Run<Backend>(matrices[i], variant, nullptr, B_policy));
   }
 }
 
 struct BackendStats {
   std::vector<std::vector<double>> ssse3_8bit;
   std::vector<std::vector<double>> avx2_8bit;
+  std::vector<std::vector<double>> avxvnni_8bit;
   std::vector<std::vector<double>> avx512_8bit;
   std::vector<std::vector<double>> avx512vnni_8bit;
   std::vector<std::vector<double>> sse2_16bit;
   std::vector<std::vector<double>> avx2_16bit;
   std::vector<std::vector<double>> avx512_16bit;
+  std::vector<std::vector<double>> avx512vnni_16bit;
 };
 
 const float kOutlierThreshold = 0.75;
@@ -104,6 +259,194 @@ template <class Backend> void Print(std::vector<std::vector<double>> &stats, std
   std::cout << '\n';
 }
 
+// Compare multiplying a batch at once, where rows of A share loads of B, with
+// multiplying it one row at a time.
+template <class Backend> void RunBatch(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  std::vector<std::vector<double>> batch, row_by_row;
+  for (int sample = 0; sample < samples; ++sample) {
+    RunAll<Backend>(matrices, matrices_end, batch);
+    RunAll<Backend>(matrices, matrices_end, row_by_row, Variant::RowByRow);
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    std::cout << "Batch\t" << matrices[i].A_rows << '\t' << matrices[i].width << '\t' << matrices[i].B_cols << '\t' << Backend::kName << '\n';
+    std::cout << std::setw(16) << "batch" << '\t';
+    Summarize(batch[i]);
+    std::cout << '\n' << std::setw(16) << "row by row" << '\t';
+    Summarize(row_by_row[i]);
+    std::cout << '\n';
+  }
+}
+
+// Cost of accumulating without saturation.
+template <class Backend> void RunWide(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  std::vector<std::vector<double>> native, wide;
+  for (int sample = 0; sample < samples; ++sample) {
+    RunAll<Backend>(matrices, matrices_end, native);
+    RunAll<Backend>(matrices, matrices_end, wide, Variant::Wide);
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    std::cout << "Wide\t" << matrices[i].A_rows << '\t' << matrices[i].width << '\t' << matrices[i].B_cols << '\t' << Backend::kName << '\n';
+    std::cout << std::setw(16) << "native" << '\t';
+    Summarize(native[i]);
+    std::cout << '\n' << std::setw(16) << "wide" << '\t';
+    Summarize(wide[i]);
+    std::cout << '\n';
+  }
+}
+
+void PrintCacheRate(const char *name, double rate) {
+  std::cout << '\t' << name << ' ';
+  if (rate < 0.0) {
+    std::cout << "n/a";
+  } else {
+    std::cout << std::setprecision(3) << (rate * 100.0) << '%' << std::setprecision(6);
+  }
+}
+
+// Multiply row-major A against A in panels (see PrepareAPanels), reporting
+// throughput in billions of multiply-adds per second from the fastest sample
+// and cache miss rates of one more multiply.
+template <class Backend> void RunPanels(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  std::vector<std::vector<double>> rows, panels;
+  for (int sample = 0; sample < samples; ++sample) {
+    RunAll<Backend>(matrices, matrices_end, rows);
+    RunAll<Backend>(matrices, matrices_end, panels, Variant::Panels);
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    const RandomMatrices &m = matrices[i];
+    const double ops = static_cast<double>(m.A_rows) * m.width * m.B_cols;
+    std::cout << "Panels\t" << m.A_rows << '\t' << m.width << '\t' << m.B_cols << '\t' << Backend::kName << '\n';
+    const char *names[] = {"row-major", "panels"};
+    std::vector<double> *stats[] = {&rows[i], &panels[i]};
+    Variant variants[] = {Variant::Batch, Variant::Panels};
+    for (int v = 0; v < 2; ++v) {
+      CacheCounters counters;
+      Run<Backend>(m, variants[v], &counters);
+      std::cout << std::setw(16) << names[v] << '\t';
+      Summarize(*stats[v]);
+      std::cout << '\t' << std::setw(8) << ops / *std::min_element(stats[v]->begin(), stats[v]->end()) * 1e-9 << " GMAC/s";
+      PrintCacheRate("L1D miss", counters.L1DMissRate());
+      PrintCacheRate("LLC miss", counters.LLMissRate());
+      std::cout << '\n';
+    }
+  }
+}
+
+// Software prefetch (see PrefetchConfig) against none, with B in cache and
+// with B flushed before each multiply.
+template <class Backend> void RunPrefetch(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  const PrefetchConfig tuned = SoftwarePrefetch;
+  const PrefetchConfig none = {0, false};
+  std::vector<std::vector<double>> warm_none, warm_tuned, cold_none, cold_tuned;
+  for (int sample = 0; sample < samples; ++sample) {
+    SoftwarePrefetch = none;
+    RunAll<Backend>(matrices, matrices_end, warm_none);
+    RunAll<Backend>(matrices, matrices_end, cold_none, Variant::ColdB);
+    SoftwarePrefetch = tuned;
+    RunAll<Backend>(matrices, matrices_end, warm_tuned);
+    RunAll<Backend>(matrices, matrices_end, cold_tuned, Variant::ColdB);
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    std::cout << "Prefetch\t" << matrices[i].A_rows << '\t' << matrices[i].width << '\t' << matrices[i].B_cols << '\t' << Backend::kName
+      << "\tB_distance=" << tuned.B_distance << " A_next_row=" << tuned.A_next_row << '\n';
+    const char *names[] = {"warm, none", "warm, prefetch", "cold, none", "cold, prefetch"};
+    std::vector<double> *stats[] = {&warm_none[i], &warm_tuned[i], &cold_none[i], &cold_tuned[i]};
+    for (int v = 0; v < 4; ++v) {
+      std::cout << std::setw(16) << names[v] << '\t';
+      Summarize(*stats[v]);
+      std::cout << '\n';
+    }
+  }
+}
+
+// Back-to-back small multiplies on OpenMP (or one thread without it) against
+// a ThreadPool with as many threads as cores, spinning between calls and
+// sleeping right away.
+template <class Backend> void RunThreadPool(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  const Index threads = std::max(1u, std::thread::hardware_concurrency());
+  ThreadPool spinning(threads), sleeping(threads, false, 0);
+  std::vector<std::vector<double>> none, spin, sleep;
+  for (int sample = 0; sample < samples; ++sample) {
+    SharedThreadPool = nullptr;
+    RunAll<Backend>(matrices, matrices_end, none, Variant::Repeated);
+    SharedThreadPool = &spinning;
+    RunAll<Backend>(matrices, matrices_end, spin, Variant::Repeated);
+    SharedThreadPool = &sleeping;
+    RunAll<Backend>(matrices, matrices_end, sleep, Variant::Repeated);
+  }
+  SharedThreadPool = nullptr;
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    std::cout << "ThreadPool\t" << matrices[i].A_rows << '\t' << matrices[i].width << '\t' << matrices[i].B_cols << '\t' << Backend::kName << "\tthreads=" << threads << '\n';
+    const char *names[] = {"no pool", "pool, spin", "pool, sleep"};
+    std::vector<double> *stats[] = {&none[i], &spin[i], &sleep[i]};
+    for (int v = 0; v < 3; ++v) {
+      std::cout << std::setw(16) << names[v] << '\t';
+      Summarize(*stats[v]);
+      std::cout << '\n';
+    }
+  }
+}
+
+// PrepareA then Multiply against quantizing float A inside the multiply.
+template <class Backend> void RunFloatA(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  std::vector<std::vector<double>> separate, fused;
+  for (int sample = 0; sample < samples; ++sample) {
+    RunAll<Backend>(matrices, matrices_end, separate, Variant::PrepareThenMultiply);
+    RunAll<Backend>(matrices, matrices_end, fused, Variant::FloatA);
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    std::cout << "FloatA\t" << matrices[i].A_rows << '\t' << matrices[i].width << '\t' << matrices[i].B_cols << '\t' << Backend::kName << '\n';
+    const char *names[] = {"PrepareA+Multiply", "float A"};
+    std::vector<double> *stats[] = {&separate[i], &fused[i]};
+    for (int v = 0; v < 2; ++v) {
+      std::cout << std::setw(18) << names[v] << '\t';
+      Summarize(*stats[v]);
+      std::cout << '\n';
+    }
+  }
+}
+
+const char *PagePolicyName(PagePolicy policy) {
+  switch (policy) {
+    case PagePolicy::TransparentHuge: return "transparent";
+    case PagePolicy::ExplicitHuge: return "explicit";
+    default: return "default";
+  }
+}
+
+// Prepared B on ordinary pages against transparent and explicit huge pages,
+// with the data TLB miss rate of one more multiply.  The policy B got after
+// fallback is shown next to the one asked for.
+template <class Backend> void RunHugePages(RandomMatrices *matrices, RandomMatrices *matrices_end, int samples) {
+  if (!Supported<Backend>()) return;
+  const PagePolicy policies[] = {PagePolicy::Default, PagePolicy::TransparentHuge, PagePolicy::ExplicitHuge};
+  std::vector<std::vector<double>> stats[3];
+  for (int sample = 0; sample < samples; ++sample) {
+    for (int p = 0; p < 3; ++p) {
+      RunAll<Backend>(matrices, matrices_end, stats[p], Variant::Batch, policies[p]);
+    }
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(matrices_end - matrices); ++i) {
+    const RandomMatrices &m = matrices[i];
+    std::cout << "HugePages\t" << m.A_rows << '\t' << m.width << '\t' << m.B_cols << '\t' << Backend::kName << '\n';
+    for (int p = 0; p < 3; ++p) {
+      const AlignedVector<typename Backend::Integer> probe(m.width * m.B_cols, policies[p]);
+      CacheCounters counters;
+      Run<Backend>(m, Variant::Batch, &counters, policies[p]);
+      std::cout << std::setw(12) << PagePolicyName(policies[p]) << " -> " << std::setw(11) << PagePolicyName(probe.policy()) << '\t';
+      Summarize(stats[p][i]);
+      PrintCacheRate("dTLB miss", counters.DTLBMissRate());
+      std::cout << '\n';
+    }
+  }
+}
+
 } // namespace intgemm
 } // namespace
 
@@ -166,6 +509,14 @@ int main(int, char ** argv) {
     RunAll<avx2::Kernels16>(matrices, end, stats.avx2_16bit);
   }
 
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+  std::cerr << "AVXVNNI 8bit, 100 samples..." << std::endl;
+  for (int samples = 0; samples < kSamples; ++samples) {
+    RandomMatrices *end = (samples < 4) ? matrices_end : full_sample;
+    RunAll<avxvnni::Kernels8>(matrices, end, stats.avxvnni_8bit);
+  }
+#endif
+
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
   std::cerr << "AVX512 8bit, 100 samples..." << std::endl;
   for (int samples = 0; samples < kSamples; ++samples) {
@@ -185,6 +536,12 @@ int main(int, char ** argv) {
     RandomMatrices *end = (samples < 4) ? matrices_end : full_sample;
     RunAll<avx512vnni::Kernels8>(matrices, end, stats.avx512vnni_8bit);
   }
+
+  std::cerr << "AVX512VNNI 16bit, 100 samples..." << std::endl;
+  for (int samples = 0; samples < kSamples; ++samples) {
+    RandomMatrices *end = (samples < 4) ? matrices_end : full_sample;
+    RunAll<avx512vnni::Kernels16>(matrices, end, stats.avx512vnni_16bit);
+  }
 #endif
 
   if (stats.sse2_16bit.empty()) {
@@ -195,6 +552,9 @@ int main(int, char ** argv) {
     std::cout << "Multiply\t" << matrices[i].A_rows << '\t' << matrices[i].width << '\t' << matrices[i].B_cols << '\t' << "Samples=" << (kOutlierThreshold * stats.sse2_16bit[i].size()) << '\n';
     Print<ssse3::Kernels8>(stats.ssse3_8bit, i);
     Print<avx2::Kernels8>(stats.avx2_8bit, i);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+    Print<avxvnni::Kernels8>(stats.avxvnni_8bit, i);
+#endif
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
     Print<avx512bw::Kernels8>(stats.avx512_8bit, i);
 #endif
@@ -205,8 +565,184 @@ int main(int, char ** argv) {
     Print<avx2::Kernels16>(stats.avx2_16bit, i);
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
     Print<avx512bw::Kernels16>(stats.avx512_16bit, i);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+    Print<avx512vnni::Kernels16>(stats.avx512vnni_16bit, i);
 #endif
   }
+
+  // Batch sizes where rows of A are processed together.  The long inner
+  // dimension means B does not stay in L1 between rows.
+  RandomMatrices batches[] = {
+    {16, 4096, 512},
+    {32, 4096, 512},
+    {64, 4096, 512},
+    {128, 4096, 512}
+  };
+  RandomMatrices *batches_end = batches + sizeof(batches) / sizeof(RandomMatrices);
+  const int kBatchSamples = 20;
+  std::cerr << "Batches, " << kBatchSamples << " samples..." << std::endl;
+  RunBatch<ssse3::Kernels8>(batches, batches_end, kBatchSamples);
+  RunBatch<avx2::Kernels8>(batches, batches_end, kBatchSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+  RunBatch<avxvnni::Kernels8>(batches, batches_end, kBatchSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunBatch<avx512bw::Kernels8>(batches, batches_end, kBatchSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunBatch<avx512vnni::Kernels8>(batches, batches_end, kBatchSamples);
+#endif
+  RunBatch<sse2::Kernels16>(batches, batches_end, kBatchSamples);
+  RunBatch<avx2::Kernels16>(batches, batches_end, kBatchSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunBatch<avx512bw::Kernels16>(batches, batches_end, kBatchSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunBatch<avx512vnni::Kernels16>(batches, batches_end, kBatchSamples);
+#endif
+
+  // Widths where accumulation saturates or overflows without widening.
+  RandomMatrices wides[] = {
+    {8, 2048, 256},
+    {256, 1024, 256},
+    {512, 4096, 512}
+  };
+  RandomMatrices *wides_end = wides + sizeof(wides) / sizeof(RandomMatrices);
+  const int kWideSamples = 20;
+  std::cerr << "Wide accumulation, " << kWideSamples << " samples..." << std::endl;
+  RunWide<ssse3::Kernels8>(wides, wides_end, kWideSamples);
+  RunWide<avx2::Kernels8>(wides, wides_end, kWideSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+  RunWide<avxvnni::Kernels8>(wides, wides_end, kWideSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunWide<avx512bw::Kernels8>(wides, wides_end, kWideSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunWide<avx512vnni::Kernels8>(wides, wides_end, kWideSamples);
+#endif
+  RunWide<sse2::Kernels16>(wides, wides_end, kWideSamples);
+  RunWide<avx2::Kernels16>(wides, wides_end, kWideSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunWide<avx512bw::Kernels16>(wides, wides_end, kWideSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunWide<avx512vnni::Kernels16>(wides, wides_end, kWideSamples);
+#endif
+
+  // Panels only change the layout for kernels that multiply several rows of
+  // A at once; the rest are shown as a control.
+  RandomMatrices panel_shapes[] = {
+    {64, 4096, 512},
+    {256, 1024, 1024},
+    {11, 4096, 256}
+  };
+  RandomMatrices *panel_shapes_end = panel_shapes + sizeof(panel_shapes) / sizeof(RandomMatrices);
+  const int kPanelSamples = 20;
+  std::cerr << "Panels, " << kPanelSamples << " samples..." << std::endl;
+  RunPanels<avx2::Kernels8>(panel_shapes, panel_shapes_end, kPanelSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunPanels<avx512bw::Kernels8>(panel_shapes, panel_shapes_end, kPanelSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunPanels<avx512vnni::Kernels8>(panel_shapes, panel_shapes_end, kPanelSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunPanels<avx512bw::Kernels16>(panel_shapes, panel_shapes_end, kPanelSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunPanels<avx512vnni::Kernels16>(panel_shapes, panel_shapes_end, kPanelSamples);
+#endif
+
+  // Few rows of A against a B that streams from memory when cold.
+  RandomMatrices prefetches[] = {
+    {1, 4096, 1024},
+    {8, 4096, 512},
+    {64, 1024, 1024}
+  };
+  RandomMatrices *prefetches_end = prefetches + sizeof(prefetches) / sizeof(RandomMatrices);
+  const int kPrefetchSamples = 20;
+  std::cerr << "Prefetch, " << kPrefetchSamples << " samples..." << std::endl;
+  RunPrefetch<ssse3::Kernels8>(prefetches, prefetches_end, kPrefetchSamples);
+  RunPrefetch<avx2::Kernels8>(prefetches, prefetches_end, kPrefetchSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+  RunPrefetch<avxvnni::Kernels8>(prefetches, prefetches_end, kPrefetchSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunPrefetch<avx512bw::Kernels8>(prefetches, prefetches_end, kPrefetchSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunPrefetch<avx512vnni::Kernels8>(prefetches, prefetches_end, kPrefetchSamples);
+#endif
+  RunPrefetch<sse2::Kernels16>(prefetches, prefetches_end, kPrefetchSamples);
+  RunPrefetch<avx2::Kernels16>(prefetches, prefetches_end, kPrefetchSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunPrefetch<avx512bw::Kernels16>(prefetches, prefetches_end, kPrefetchSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunPrefetch<avx512vnni::Kernels16>(prefetches, prefetches_end, kPrefetchSamples);
+#endif
+
+  // Small multiplies where starting threads costs as much as the work.
+  RandomMatrices smalls[] = {
+    {1, 256, 256},
+    {8, 256, 256},
+    {8, 1024, 512}
+  };
+  RandomMatrices *smalls_end = smalls + sizeof(smalls) / sizeof(RandomMatrices);
+  const int kPoolSamples = 20;
+  std::cerr << "ThreadPool, " << kPoolSamples << " samples..." << std::endl;
+  RunThreadPool<avx2::Kernels8>(smalls, smalls_end, kPoolSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunThreadPool<avx512bw::Kernels8>(smalls, smalls_end, kPoolSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunThreadPool<avx512vnni::Kernels8>(smalls, smalls_end, kPoolSamples);
+#endif
+  RunThreadPool<avx2::Kernels16>(smalls, smalls_end, kPoolSamples);
+
+  // Small batches, where preparing A is a noticeable part of the work.
+  RandomMatrices float_shapes[] = {
+    {1, 512, 512},
+    {4, 1024, 1024},
+    {16, 512, 2048},
+    {64, 1024, 256}
+  };
+  RandomMatrices *float_shapes_end = float_shapes + sizeof(float_shapes) / sizeof(RandomMatrices);
+  const int kFloatASamples = 50;
+  std::cerr << "Float A, " << kFloatASamples << " samples..." << std::endl;
+  RunFloatA<ssse3::Kernels8>(float_shapes, float_shapes_end, kFloatASamples);
+  RunFloatA<avx2::Kernels8>(float_shapes, float_shapes_end, kFloatASamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunFloatA<avx512bw::Kernels8>(float_shapes, float_shapes_end, kFloatASamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunFloatA<avx512vnni::Kernels8>(float_shapes, float_shapes_end, kFloatASamples);
+#endif
+  RunFloatA<sse2::Kernels16>(float_shapes, float_shapes_end, kFloatASamples);
+  RunFloatA<avx2::Kernels16>(float_shapes, float_shapes_end, kFloatASamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunFloatA<avx512bw::Kernels16>(float_shapes, float_shapes_end, kFloatASamples);
+#endif
+
+  // Prepared B of 8 to 16 MB, many 4 KB pages.
+  RandomMatrices huge_shapes[] = {
+    {1, 4096, 4096},
+    {16, 4096, 4096},
+    {64, 2048, 4096}
+  };
+  RandomMatrices *huge_shapes_end = huge_shapes + sizeof(huge_shapes) / sizeof(RandomMatrices);
+  const int kHugeSamples = 10;
+  std::cerr << "Huge pages, " << kHugeSamples << " samples..." << std::endl;
+  RunHugePages<avx2::Kernels8>(huge_shapes, huge_shapes_end, kHugeSamples);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  RunHugePages<avx512bw::Kernels8>(huge_shapes, huge_shapes_end, kHugeSamples);
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  RunHugePages<avx512vnni::Kernels8>(huge_shapes, huge_shapes_end, kHugeSamples);
+#endif
+  RunHugePages<avx2::Kernels16>(huge_shapes, huge_shapes_end, kHugeSamples);
   return 0;
 }
 
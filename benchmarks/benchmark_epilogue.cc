@@ -0,0 +1,251 @@
+#include "../intgemm/aligned.h"
+#include "intgemm/intgemm_config.h"
+#include "../intgemm/avx512_gemm.h"
+#include "../intgemm/avx2_gemm.h"
+#include "../intgemm/ssse3_gemm.h"
+#include "../intgemm/intgemm.h"
+#include "../intgemm/callbacks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/* Activations fused into the multiply as Sequence stages against a separate
+ * pass over the output after UnquantizeAndAddBiasAndWrite, and likewise the
+ * transposed output callbacks against a transpose pass and the residual
+ * callback against passes to add the residual and take row statistics and
+ * the softmax statistics against passes for the max and the sum.  Top k
+ * and argmax selection in the callback go against writing the output then
+ * partial_sort or max_element, and scoring targets against writing the
+ * output then taking the log-sum-exp of each row.
+ */
+namespace intgemm {
+namespace {
+
+// Apply stage to size floats of C in place, the pass fusing saves.  size must
+// be a multiple of the register size.
+template <CPUType kCPUType, class Stage> struct SeparatePass;
+
+#define INTGEMM_SEPARATE_PASS(target, cpu_type) \
+template <class Stage> struct SeparatePass<cpu_type, Stage> { \
+  target static void Run(float *C, Index size, const Stage &stage) { \
+    typedef vector_t<cpu_type, float> vf; \
+    callbacks::CallbackImpl<cpu_type, Stage> impl(stage); \
+    const callbacks::OutputBufferInfo info(0, 0, 1, size); \
+    for (Index i = 0; i < size; i += sizeof(vf) / sizeof(float)) { \
+      *reinterpret_cast<vf*>(C + i) = impl(*reinterpret_cast<const vf*>(C + i), info); \
+    } \
+  } \
+};
+
+INTGEMM_SEPARATE_PASS(INTGEMM_SSE2, CPUType::SSE2)
+INTGEMM_SEPARATE_PASS(INTGEMM_AVX2, CPUType::AVX2)
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+INTGEMM_SEPARATE_PASS(INTGEMM_AVX512BW, CPUType::AVX512BW)
+#endif
+#undef INTGEMM_SEPARATE_PASS
+
+struct Problem {
+  Problem(Index A_rows_in, Index width_in, Index B_cols_in)
+    : A_rows(A_rows_in), width(width_in), B_cols(B_cols_in),
+      A(A_rows * width), B(width * B_cols), bias(B_cols), C(A_rows * B_cols) {}
+
+  const Index A_rows, width, B_cols;
+  AlignedVector<int8_t> A, B;
+  AlignedVector<float> bias, C;
+};
+
+template <class Backend> void Prepare(Problem &p) {
+  AlignedVector<float> A(p.A.size()), B(p.width * p.B_cols);
+  std::mt19937 gen;
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  for (auto& it : A) {
+    it = dist(gen);
+  }
+  for (auto& it : B) {
+    it = dist(gen);
+  }
+  for (auto& it : p.bias) {
+    it = dist(gen);
+  }
+  Backend::PrepareA(A.begin(), p.A.begin(), 64.0f, p.A_rows, p.width);
+  Backend::PrepareB(B.begin(), p.B.begin(), 64.0f, p.width, p.B_cols);
+}
+
+const int kSamples = 30;
+const float kUnquantMult = 1.0f / (64.0f * 64.0f);
+
+template <class Callback, class Backend, class After> double Time(Problem &p, const Callback &callback, After after) {
+  std::vector<double> times;
+  for (int sample = 0; sample <= kSamples; ++sample) {
+    auto start = std::chrono::steady_clock::now();
+    OMPParallelWrapBlocked<Callback, Backend>(p.A.begin(), p.B.begin(), p.A_rows, p.width, p.B_cols, callback);
+    after();
+    times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  // The first is burn in.
+  return *std::min_element(times.begin() + 1, times.end());
+}
+
+template <class Backend, CPUType kCPUType, class Stage> void Compare(Problem &p, const char *name, const Stage &stage) {
+  auto separate = Time<callbacks::UnquantizeAndAddBiasAndWrite, Backend>(p, callbacks::UnquantizeAndAddBiasAndWrite(kUnquantMult, p.bias.begin(), p.C.begin()), [&] {
+    SeparatePass<kCPUType, Stage>::Run(p.C.begin(), p.A_rows * p.B_cols, stage);
+  });
+  auto sequence = callbacks::Sequence(callbacks::Unquantize(kUnquantMult), callbacks::AddBias(p.bias.begin()), stage, callbacks::Write<float>(p.C.begin()));
+  auto fused = Time<decltype(sequence), Backend>(p, sequence, [] {});
+  std::cout << std::setw(8) << name << '\t' << std::setw(10) << separate << '\t' << std::setw(10) << fused << '\t' << std::setprecision(3) << (separate / fused) << std::setprecision(6) << '\n';
+}
+
+// C^T written by the callback against row-major C then a transpose pass.
+template <class Backend> void CompareTransposed(Problem &p) {
+  AlignedVector<float> transposed(p.A_rows * p.B_cols);
+  auto separate = Time<callbacks::UnquantizeAndWrite, Backend>(p, callbacks::UnquantizeAndWrite(kUnquantMult, p.C.begin()), [&] {
+    for (Index r = 0; r < p.A_rows; ++r) {
+      for (Index c = 0; c < p.B_cols; ++c) {
+        transposed[c * p.A_rows + r] = p.C[r * p.B_cols + c];
+      }
+    }
+  });
+  auto fused = Time<callbacks::UnquantizeAndWriteTransposed, Backend>(p, callbacks::UnquantizeAndWriteTransposed(kUnquantMult, transposed.begin()), [] {});
+  std::cout << std::setw(8) << "C^T" << '\t' << std::setw(10) << separate << '\t' << std::setw(10) << fused << '\t' << std::setprecision(3) << (separate / fused) << std::setprecision(6) << '\n';
+}
+
+// Residual add and layer norm statistics in the callback against passes for
+// each after UnquantizeAndAddBiasAndWrite.
+template <class Backend> void CompareResidual(Problem &p) {
+  AlignedVector<float> residual(p.A_rows * p.B_cols), mean(p.A_rows), variance(p.A_rows);
+  std::fill(residual.begin(), residual.end(), 0.5f);
+  auto separate = Time<callbacks::UnquantizeAndAddBiasAndWrite, Backend>(p, callbacks::UnquantizeAndAddBiasAndWrite(kUnquantMult, p.bias.begin(), p.C.begin()), [&] {
+    for (Index i = 0; i < p.A_rows * p.B_cols; ++i) {
+      p.C[i] += residual[i];
+    }
+    for (Index r = 0; r < p.A_rows; ++r) {
+      const float *row = p.C.begin() + r * p.B_cols;
+      double sum = 0.0, squares = 0.0;
+      for (Index c = 0; c < p.B_cols; ++c) {
+        sum += row[c];
+        squares += row[c] * row[c];
+      }
+      mean[r] = static_cast<float>(sum / p.B_cols);
+      variance[r] = static_cast<float>(squares / p.B_cols - mean[r] * mean[r]);
+    }
+  });
+  AlignedVector<float> statistics(callbacks::RowStatisticsSize(p.A_rows, p.B_cols));
+  auto fused = Time<callbacks::UnquantizeAndAddBiasAndResidualAndWrite, Backend>(p, callbacks::UnquantizeAndAddBiasAndResidualAndWrite(kUnquantMult, p.bias.begin(), residual.begin(), p.C.begin(), statistics.begin()), [&] {
+    callbacks::RowMeanAndVariance(statistics.begin(), p.A_rows, p.B_cols, mean.begin(), variance.begin());
+  });
+  std::cout << std::setw(8) << "Residual" << '\t' << std::setw(10) << separate << '\t' << std::setw(10) << fused << '\t' << std::setprecision(3) << (separate / fused) << std::setprecision(6) << '\n';
+}
+
+// Log-softmax from statistics taken in the callback against passes for the
+// max, the sum of exponentials and the normalization after
+// UnquantizeAndAddBiasAndWrite.
+template <class Backend> void CompareSoftmax(Problem &p) {
+  AlignedVector<float> log_sum_exp(p.A_rows);
+  auto separate = Time<callbacks::UnquantizeAndAddBiasAndWrite, Backend>(p, callbacks::UnquantizeAndAddBiasAndWrite(kUnquantMult, p.bias.begin(), p.C.begin()), [&] {
+    for (Index r = 0; r < p.A_rows; ++r) {
+      float *row = p.C.begin() + r * p.B_cols;
+      const float highest = *std::max_element(row, row + p.B_cols);
+      float sum = 0.0f;
+      for (Index c = 0; c < p.B_cols; ++c) {
+        sum += std::exp(row[c] - highest);
+      }
+      log_sum_exp[r] = highest + std::log(sum);
+    }
+    callbacks::ApplyLogSoftmax(p.C.begin(), p.A_rows, p.B_cols, log_sum_exp.begin());
+  });
+  AlignedVector<float> statistics(callbacks::RowStatisticsSize(p.A_rows, p.B_cols));
+  auto fused = Time<callbacks::UnquantizeAndAddBiasAndWriteForSoftmax, Backend>(p, callbacks::UnquantizeAndAddBiasAndWriteForSoftmax(kUnquantMult, p.bias.begin(), p.C.begin(), statistics.begin()), [&] {
+    callbacks::RowLogSumExp(statistics.begin(), p.A_rows, p.B_cols, log_sum_exp.begin());
+    callbacks::ApplyLogSoftmax(p.C.begin(), p.A_rows, p.B_cols, log_sum_exp.begin());
+  });
+  std::cout << std::setw(8) << "LogSoftmax" << '\t' << std::setw(10) << separate << '\t' << std::setw(10) << fused << '\t' << std::setprecision(3) << (separate / fused) << std::setprecision(6) << '\n';
+}
+
+template <class Backend> void CompareTopK(Problem &p, const char *name, Index k) {
+  std::vector<Index> order(p.B_cols), best(p.A_rows * k);
+  auto separate = Time<callbacks::UnquantizeAndAddBiasAndWrite, Backend>(p, callbacks::UnquantizeAndAddBiasAndWrite(kUnquantMult, p.bias.begin(), p.C.begin()), [&] {
+    for (Index r = 0; r < p.A_rows; ++r) {
+      const float *row = p.C.begin() + r * p.B_cols;
+      if (k == 1) {
+        best[r] = static_cast<Index>(std::max_element(row, row + p.B_cols) - row);
+        continue;
+      }
+      for (Index c = 0; c < p.B_cols; ++c) order[c] = c;
+      std::partial_sort(order.begin(), order.begin() + k, order.end(), [row](Index a, Index b) { return row[a] > row[b]; });
+      std::copy(order.begin(), order.begin() + k, best.begin() + r * k);
+    }
+  });
+  callbacks::TopK top_k(p.A_rows, k);
+  auto fused = Time<callbacks::UnquantizeAndAddBiasAndTopK, Backend>(p, callbacks::UnquantizeAndAddBiasAndTopK(kUnquantMult, p.bias.begin(), &top_k), [&] {
+    top_k.Merge();
+  });
+  std::cout << std::setw(8) << name << '\t' << std::setw(10) << separate << '\t' << std::setw(10) << fused << '\t' << std::setprecision(3) << (separate / fused) << std::setprecision(6) << '\n';
+}
+
+template <class Backend> void CompareScore(Problem &p) {
+  std::vector<Index> targets(p.A_rows);
+  for (Index r = 0; r < p.A_rows; ++r) targets[r] = (r * 101) % p.B_cols;
+  std::vector<float> target_scores(p.A_rows), log_sum_exp(p.A_rows);
+  auto separate = Time<callbacks::UnquantizeAndAddBiasAndWrite, Backend>(p, callbacks::UnquantizeAndAddBiasAndWrite(kUnquantMult, p.bias.begin(), p.C.begin()), [&] {
+    for (Index r = 0; r < p.A_rows; ++r) {
+      const float *row = p.C.begin() + r * p.B_cols;
+      const float highest = *std::max_element(row, row + p.B_cols);
+      float sum = 0.0f;
+      for (Index c = 0; c < p.B_cols; ++c) {
+        sum += std::exp(row[c] - highest);
+      }
+      log_sum_exp[r] = highest + std::log(sum);
+      target_scores[r] = row[targets[r]];
+    }
+  });
+  callbacks::LogSumExp state(p.A_rows);
+  auto fused = Time<callbacks::UnquantizeAndAddBiasAndScore, Backend>(p, callbacks::UnquantizeAndAddBiasAndScore(kUnquantMult, p.bias.begin(), targets.data(), target_scores.data(), &state), [&] {
+    state.Merge(log_sum_exp.data());
+  });
+  std::cout << std::setw(8) << "Score" << '\t' << std::setw(10) << separate << '\t' << std::setw(10) << fused << '\t' << std::setprecision(3) << (separate / fused) << std::setprecision(6) << '\n';
+}
+
+template <class Backend, CPUType kCPUType> void Run(Problem *problems, Problem *problems_end) {
+  if (kCPU < Backend::kUses) return;
+  for (Problem *p = problems; p != problems_end; ++p) {
+    Prepare<Backend>(*p);
+    std::cout << "Epilogue\t" << p->A_rows << '\t' << p->width << '\t' << p->B_cols << '\t' << Backend::kName << "\tseparate\tfused\tspeedup\n";
+    auto bias_only = Time<callbacks::UnquantizeAndAddBiasAndWrite, Backend>(*p, callbacks::UnquantizeAndAddBiasAndWrite(kUnquantMult, p->bias.begin(), p->C.begin()), [] {});
+    std::cout << std::setw(8) << "none" << '\t' << std::setw(10) << bias_only << '\n';
+    Compare<Backend, kCPUType>(*p, "ReLU", callbacks::ReLU());
+    Compare<Backend, kCPUType>(*p, "Sigmoid", callbacks::Sigmoid());
+    Compare<Backend, kCPUType>(*p, "Tanh", callbacks::Tanh());
+    Compare<Backend, kCPUType>(*p, "GELU", callbacks::GELU());
+    Compare<Backend, kCPUType>(*p, "SiLU", callbacks::SiLU());
+    CompareTransposed<Backend>(*p);
+    CompareResidual<Backend>(*p);
+    CompareSoftmax<Backend>(*p);
+    CompareTopK<Backend>(*p, "Top8", 8);
+    CompareTopK<Backend>(*p, "ArgMax", 1);
+    CompareScore<Backend>(*p);
+  }
+}
+
+} // namespace
+} // namespace intgemm
+
+int main() {
+  using namespace intgemm;
+  // Outputs from cache-sized to several MB, where the separate pass goes to memory.
+  Problem problems[] = {
+    {8, 256, 2048},
+    {64, 512, 2048},
+    {256, 256, 4096}
+  };
+  Problem *problems_end = problems + sizeof(problems) / sizeof(Problem);
+  Run<ssse3::Kernels8, CPUType::SSE2>(problems, problems_end);
+  Run<avx2::Kernels8, CPUType::AVX2>(problems, problems_end);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  Run<avx512bw::Kernels8, CPUType::AVX512BW>(problems, problems_end);
+#endif
+}
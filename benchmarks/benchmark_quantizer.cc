@@ -51,10 +51,39 @@ template <class Backend> void QuantizerBench(const float *in, int8_t *out, intge
   double took = std::chrono::duration<double>(end - start).count() / kTries;
   std::cout << std::setw(9) << count << ' ' << std::fixed << std::setw(9) << std::setprecision(7) << took << ' ' << Backend::kName << std::endl;
 }
+// MaxAbsolute then PrepareA, reading A twice, against PrepareADynamic.
+void BenchmarkPrepareADynamic() {
+  std::mt19937 gen;
+  std::uniform_real_distribution<float> dist(-4.f, 4.f);
+  const std::size_t kTries = 20;
+  for (std::size_t count = 1 << 12; count <= (1 << 26); count *= 4) {
+    intgemm::AlignedVector<float> in(count);
+    intgemm::AlignedVector<int8_t> out(count);
+    for (float &element : in) {
+      element = dist(gen);
+    }
+    const intgemm::Index rows = 1, cols = static_cast<intgemm::Index>(count);
+    intgemm::Int8::PrepareA(in.begin(), out.begin(), 127.0f / intgemm::MaxAbsolute(in.begin(), in.end()), rows, cols);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < kTries; ++t) {
+      intgemm::Int8::PrepareA(in.begin(), out.begin(), 127.0f / intgemm::MaxAbsolute(in.begin(), in.end()), rows, cols);
+    }
+    double separate = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / kTries;
+    intgemm::Int8::PrepareADynamic(in.begin(), out.begin(), rows, cols);
+    start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < kTries; ++t) {
+      intgemm::Int8::PrepareADynamic(in.begin(), out.begin(), rows, cols);
+    }
+    double fused = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / kTries;
+    std::cout << std::setw(9) << count << " MaxAbsolute+PrepareA = " << std::fixed << std::setprecision(7) << separate << " PrepareADynamic = " << fused << " speedup = " << std::setprecision(3) << (separate / fused) << std::endl;
+  }
+}
+
 } // namespace
 
 int main() {
   BenchmarkMaxAbsolute();
+  BenchmarkPrepareADynamic();
   for (std::size_t count = 1; count < (1ULL<<30); count *= 2) {
     intgemm::AlignedVector<float> in(count);
     intgemm::AlignedVector<int8_t> out(count);
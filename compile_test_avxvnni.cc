@@ -0,0 +1,20 @@
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#elif defined(__INTEL_COMPILER)
+__attribute__ ((target ("avx2")))
+#else
+__attribute__ ((target ("avx2,avxvnni")))
+#endif
+bool Foo() {
+  // AVX2
+  __m256i value = _mm256_set1_epi32(1);
+  value = _mm256_sign_epi8(value, value);
+  // AVX-VNNI is the VEX encoding, which has its own intrinsic names.
+  value = _mm256_dpbusds_avx_epi32(value, value, value);
+  return *(int*)&value;
+}
+
+int main() {
+  return Foo();
+}
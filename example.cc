@@ -42,7 +42,7 @@ int main() {
   {
     // For 16-bit, Jacob Devlin recommends 1024 so as to not overflow in 32-bit accumulation.
     float quant_mult = 1024.0f;
-    AlignedVector<int16_t> A_prepared(A.size());
+    AlignedVector<int16_t> A_prepared(intgemm::Int16::PreparedASize(A_rows, width));
     AlignedVector<int16_t> B_prepared(B.size());
     // Quantize A.
     intgemm::Int16::PrepareA(A.begin(), A_prepared.begin(), quant_mult, A_rows, width);
@@ -61,7 +61,7 @@ int main() {
   {
     // For 8-bit a good quantization multiplier is 127 / largest absolute value..
     float quant_mult = 127.0f / 2.0f;
-    AlignedVector<int8_t> A_prepared(A.size());
+    AlignedVector<int8_t> A_prepared(intgemm::Int8::PreparedASize(A_rows, width));
     AlignedVector<int8_t> B_prepared(B.size());
     // Quantize A.
     intgemm::Int8::PrepareA(A.begin(), A_prepared.begin(), quant_mult, A_rows, width);
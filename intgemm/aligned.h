@@ -4,19 +4,61 @@
 #ifdef _MSC_VER
 #include <malloc.h>
 #endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 // 64-byte aligned simple vector.
 
 namespace intgemm {
 
+/* Pages behind an AlignedVector.  Huge pages (2 MB) cut the TLB misses of
+ * streaming through large prepared matrices.  Either huge page policy falls
+ * back to the next one down when the pages aren't available, and both are
+ * Default off Linux.
+ */
+enum class PagePolicy {
+  // 64-byte aligned from the heap.
+  Default,
+  // 2 MB aligned and marked with madvise(MADV_HUGEPAGE) so the kernel backs
+  // it with transparent huge pages where it can.  Only for at least 2 MB.
+  TransparentHuge,
+  // Reserved huge pages from mmap(MAP_HUGETLB); see /proc/sys/vm/nr_hugepages.
+  ExplicitHuge
+};
+
 template <class T> class AlignedVector {
   public:
-    explicit AlignedVector(std::size_t size)
-      : size_(size) {
+    explicit AlignedVector(std::size_t size, PagePolicy policy = PagePolicy::Default)
+      : size_(size), mapped_(0), policy_(PagePolicy::Default) {
+#ifdef __linux__
+      const std::size_t kHugePage = 2 << 20;
+      const std::size_t bytes = size * sizeof(T);
+      if (policy == PagePolicy::ExplicitHuge && bytes) {
+        const std::size_t rounded = (bytes + kHugePage - 1) & ~(kHugePage - 1);
+        void *mem = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) {
+          mem_ = static_cast<T*>(mem);
+          mapped_ = rounded;
+          policy_ = PagePolicy::ExplicitHuge;
+          return;
+        }
+        policy = PagePolicy::TransparentHuge;
+      }
+      if (policy == PagePolicy::TransparentHuge && bytes >= kHugePage) {
+        if (posix_memalign(reinterpret_cast<void **>(&mem_), kHugePage, bytes)) {
+          throw std::bad_alloc();
+        }
+        if (!madvise(mem_, bytes, MADV_HUGEPAGE)) policy_ = PagePolicy::TransparentHuge;
+        return;
+      }
+#else
+      (void)policy;
+#endif
 #ifdef _MSC_VER
       mem_ = static_cast<T*>(_aligned_malloc(size * sizeof(T), 64));
       if (!mem_) throw std::bad_alloc();
-#else      
+#else
       if (posix_memalign(reinterpret_cast<void **>(&mem_), 64, size * sizeof(T))) {
         throw std::bad_alloc();
       }
@@ -27,6 +69,12 @@ template <class T> class AlignedVector {
     AlignedVector& operator=(const AlignedVector&) = delete;
 
     ~AlignedVector() {
+#ifdef __linux__
+      if (mapped_) {
+        munmap(mem_, mapped_);
+        return;
+      }
+#endif
 #ifdef _MSC_VER
       _aligned_free(mem_);
 #else
@@ -36,6 +84,9 @@ template <class T> class AlignedVector {
 
     std::size_t size() const { return size_; }
 
+    // The policy the memory actually got after any fallback.
+    PagePolicy policy() const { return policy_; }
+
     T &operator[](std::size_t offset) { return mem_[offset]; }
     const T &operator[](std::size_t offset) const { return mem_[offset]; }
 
@@ -50,6 +101,9 @@ template <class T> class AlignedVector {
   private:
     T *mem_;
     std::size_t size_;
+    // Bytes from mmap, 0 if from the heap.
+    std::size_t mapped_;
+    PagePolicy policy_;
 };
 
 } // namespace intgemm
@@ -55,13 +55,19 @@ struct Kernels16 {
 
   // Just quantize everything in order.
   INTGEMM_AVX2 static void Quantize(const float *input, int16_t *output, float quant_mult, Index size) {
-    assert(size % 16 == 0);
     assert(reinterpret_cast<uintptr_t>(input) % 32 == 0);
     FRegister q = set1_ps<FRegister>(quant_mult);
-    const float *end = input + size;
+    const float *end = input + (size & ~15);
     for (; input != end; input += 16, output += 16) {
       *reinterpret_cast<__m256i*>(output) = QuantizeTile16::Consecutive(q, input);
     }
+    // Quantize the remainder from a zero-padded copy.
+    const Index overhang = size & 15;
+    if (!overhang) return;
+    alignas(32) float padded[16] = {0};
+    std::memcpy(padded, input, overhang * sizeof(float));
+    __m256i result = QuantizeTile16::Consecutive(q, padded);
+    std::memcpy(output, &result, overhang * sizeof(int16_t));
   }
 
   // Tile size for B; B must be a multiple of this block size.
@@ -71,6 +77,8 @@ struct Kernels16 {
   INTGEMM_AVX2 static void PrepareB(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) {
     PrepareBFor16(input, output, avx2::QuantizeTile16(quant_mult), rows, cols);
   }*/
+  INTGEMM_QUANTIZE_ROWS(INTGEMM_AVX2, int16_t, QuantizeTile16)
+
   INTGEMM_PREPARE_B_16(INTGEMM_AVX2, avx2::QuantizeTile16)
   INTGEMM_PREPARE_B_QUANTIZED_TRANSPOSED(INTGEMM_AVX2, int16_t)
   INTGEMM_PREPARE_B_TRANSPOSED(INTGEMM_AVX2, avx2::QuantizeTile16, int16_t)
@@ -79,8 +87,18 @@ struct Kernels16 {
     avx2::SelectColumnsOfB((const __m256i*)input, (__m256i*)output, rows * 2, cols_begin, cols_end);
   }
 
+  // Rows of A that share each load of B in Multiply.  Two rows of sums don't
+  // fit in 16 registers.
+  static const Index kMultiplyRows = 1;
+  // Columns of B in each tile of the output that Multiply passes to callbacks.
+  static const Index kMultiplyCols = 8;
+  // Multiply adds in 32 bits, which wrap, so the inner dimension may be split.
+  static const bool kSaturates = false;
+
   INTGEMM_MULTIPLY16(__m256i, INTGEMM_AVX2, CPUType::AVX2)
 
+  INTGEMM_MULTIPLY16WIDE(__m256i, INTGEMM_AVX2, CPUType::AVX2)
+
   constexpr static const char *const kName = "16-bit AVX2";
 
   static const CPUType kUses = CPUType::AVX2;
@@ -203,6 +221,9 @@ struct Kernels8 {
   static const Index kBTileRow = 32;
   static const Index kBTileCol = 8;
 
+  INTGEMM_QUANTIZE_ROWS(INTGEMM_AVX2, int8_t, QuantizeTile8)
+  INTGEMM_MAX_ABSOLUTE_SERIAL(INTGEMM_AVX2)
+
   INTGEMM_PREPARE_B_8(INTGEMM_AVX2, avx2::QuantizeTile8)
   INTGEMM_PREPARE_B_QUANTIZED_TRANSPOSED(INTGEMM_AVX2, int8_t)
   INTGEMM_PREPARE_B_TRANSPOSED(INTGEMM_AVX2, avx2::QuantizeTile8, int8_t)
@@ -211,8 +232,20 @@ struct Kernels8 {
     avx2::SelectColumnsOfB((const __m256i*)input, (__m256i*)output, rows, cols_begin, cols_end);
   }
 
+  // Rows of A that share each load of B in Multiply.  Two rows of sums don't
+  // fit in 16 registers.
+  static const Index kMultiplyRows = 1;
+  // Columns of B in each tile of the output that Multiply passes to callbacks.
+  static const Index kMultiplyCols = 8;
+  // Multiply adds 8-bit products in saturating 16-bit lanes, so its sums
+  // depend on where the inner dimension is split.  Split-width paths check
+  // this.
+  static const bool kSaturates = true;
+
   INTGEMM_MULTIPLY8(__m256i, INTGEMM_AVX2, CPUType::AVX2)
 
+  INTGEMM_MULTIPLY8WIDE(__m256i, INTGEMM_AVX2, CPUType::AVX2)
+
   INTGEMM_MULTIPLY8SHIFT(__m256i, INTGEMM_AVX2, CPUType::AVX2)
 
   INTGEMM_PREPAREBIASFOR8(__m256i, INTGEMM_AVX2, CPUType::AVX2)
@@ -61,11 +61,18 @@ INTGEMM_AVX512BW inline __m512i QuantizerGrabHalves(const float *input0, const f
   return _mm512_cvtps_epi32(appended);
 }
 
-// These are only used for reshaping due to the AVX512 instructions
-// _mm512_mask_cvtsepi32_storeu_epi16 and _mm512_mask_cvtsepi32_storeu_epi8
-// being used for the quantizer.
+// These are only used for reshaping and QuantizeRows due to the AVX512
+// instructions _mm512_mask_cvtsepi32_storeu_epi16 and
+// _mm512_mask_cvtsepi32_storeu_epi8 being used for the quantizer.
 class QuantizeTile16 {
   public:
+    INTGEMM_AVX512BW static inline Register Consecutive(FRegister quant_mult, const float *input) {
+      auto g0 = QuantizerGrabHalves(input, input + 16, quant_mult);
+      auto g1 = QuantizerGrabHalves(input + 8, input + 24, quant_mult);
+      auto packed = packs_epi32(g0, g1);
+      return _mm512_permutex_epi64(packed, 0xd8 /* 0, 2, 1, 3 */);
+    }
+
     INTGEMM_AVX512BW static inline Register ConsecutiveWithWrapping(FRegister quant_mult, const float *input, Index cols_left, Index cols, Index row_step) {
       auto input0 = input;
       auto input1 = input + 16 + (cols_left <= 16 ? cols * (row_step - 1) : 0);
@@ -86,6 +93,15 @@ class QuantizeTile16 {
 
 class QuantizeTile8 {
   public:
+    INTGEMM_AVX512BW static inline Register Consecutive(FRegister quant_mult, const float *input) {
+      const __m512i neg127 = _mm512_set1_epi8(-127);
+      const __m512i shuffle_param = _mm512_set_epi32(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+      auto packed0 = packs_epi32(QuantizerGrab(input, quant_mult), QuantizerGrab(input + 16, quant_mult));
+      auto packed1 = packs_epi32(QuantizerGrab(input + 32, quant_mult), QuantizerGrab(input + 48, quant_mult));
+      auto packed = _mm512_max_epi8(_mm512_packs_epi16(packed0, packed1), neg127);
+      return _mm512_permutexvar_epi32(shuffle_param, packed);
+    }
+
     INTGEMM_AVX512BW static inline Register ConsecutiveWithWrapping(FRegister quant_mult, const float *input, Index cols_left, Index cols, Index row_step) {
       static const __m512i neg127 = _mm512_set1_epi8(-127);
       static const __m512i shuffle_param = _mm512_set_epi32(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
@@ -140,7 +156,6 @@ struct Kernels16 {
   typedef int16_t Integer;
 
   // Currently A is prepared by quantization but this could theoretically change.
-  // rows * cols must be a multiple of 16.
   /* Only INTGEMM_AVX512F is necessary but due to GCC 5.4 bug we have to set INTGEMM_AVX512BW */
   INTGEMM_AVX512BW static inline void PrepareA(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) {
     Quantize(input, output, quant_mult, rows * cols);
@@ -148,19 +163,22 @@ struct Kernels16 {
 
   // Technically output can be unaligned in Quantize.
   // But then it will need to be aligned for Multiply.
-  // size must be a multiple of 16.
   // Convert to 16-bit signed integers.
   /* Only INTGEMM_AVX512F is necessary but due to GCC 5.4 bug we have to set INTGEMM_AVX512BW */
   INTGEMM_AVX512BW static void Quantize(const float *input, int16_t *output, float quant_mult, Index size) {
-    assert(size % 16 == 0);
     assert(reinterpret_cast<uintptr_t>(input) % 64 == 0);
     // Fill with the quantization multiplier.
     const __m512 quant_mult_reg = _mm512_set1_ps(quant_mult);
-    const float *end = input + size;
+    const float *end = input + (size & ~15);
     for (; input != end; input += 16, output += 16) {
       // There doesn't seem to be an unmasked version.
       _mm512_mask_cvtsepi32_storeu_epi16(output, 0xffff, QuantizerGrab(input, quant_mult_reg));
     }
+    // Masked load and store for the remainder.
+    const Index overhang = size & 15;
+    if (!overhang) return;
+    const __mmask16 mask = static_cast<__mmask16>((1 << overhang) - 1);
+    _mm512_mask_cvtsepi32_storeu_epi16(output, mask, kernels::quantize(_mm512_maskz_loadu_ps(mask, input), quant_mult_reg));
   }
 
 
@@ -168,6 +186,8 @@ struct Kernels16 {
   static const Index kBTileRow = 32;
   static const Index kBTileCol = 8;
 
+  INTGEMM_QUANTIZE_ROWS(INTGEMM_AVX512BW, int16_t, QuantizeTile16)
+
   /* Only INTGEMM_AVX512F is necessary but due to GCC 5.4 bug we have to set INTGEMM_AVX512BW */
   INTGEMM_PREPARE_B_16(INTGEMM_AVX512BW, QuantizeTile16)
   INTGEMM_PREPARE_B_QUANTIZED_TRANSPOSED(INTGEMM_AVX512BW, int16_t)
@@ -178,8 +198,103 @@ struct Kernels16 {
     SelectColumnsOfB((const __m512i*)input, (__m512i*)output, rows * 2, cols_begin, cols_end);
   }
 
+  // Sums for one row of A against 8 columns of B.  These will be packed
+  // 32-bit integers containing sums for each column of B multiplied by the row
+  // of A.
+  struct MultiplyRowSums {
+    Register a;
+    Register sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7;
+    // The first strip of the tile, reduced within 128-bit lanes by Stash.
+    Register pack0123, pack4567;
+  };
+
+  // kRows consecutive rows of A that share every load of B.  Rows are nested
+  // members rather than an array so the compiler keeps the sums in registers.
+  template <Index kRows, bool kMore = (kRows > 0)> struct MultiplyRows {
+    MultiplyRowSums row;
+    MultiplyRows<kRows - 1> rest;
+
+    INTGEMM_AVX512BW inline void Zero(Register zeros) {
+      row.sum0 = row.sum1 = row.sum2 = row.sum3 = row.sum4 = row.sum5 = row.sum6 = row.sum7 = zeros;
+      rest.Zero(zeros);
+    }
+    INTGEMM_AVX512BW inline void Load(const Register *A_live, Index A_stride) {
+      row.a = *A_live;
+      rest.Load(A_live + A_stride, A_stride);
+    }
+    INTGEMM_AVX512BW inline void Start(Register MultiplyRowSums::*sum, Register b) {
+      row.*sum = madd_epi16(row.a, b);
+      rest.Start(sum, b);
+    }
+    INTGEMM_AVX512BW inline void Accumulate(Register MultiplyRowSums::*sum, Register b) {
+      // Multiply 16-bit, horizontally add to packed 32-bit integers.
+      row.*sum = add_epi32(row.*sum, madd_epi16(row.a, b));
+      rest.Accumulate(sum, b);
+    }
+    INTGEMM_AVX512BW inline void Stash() {
+      row.pack0123 = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3);
+      row.pack4567 = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7);
+      rest.Stash();
+    }
+    template <typename CallbackImpl> INTGEMM_AVX512BW inline void Finish(CallbackImpl &callback_impl, Index A_rowidx, Index B0_colidx, Index A_rows, Index B_cols, Index B_colidx_end) {
+      Register pack89ab = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3);
+      Register packcdef = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7);
+      auto total = PermuteSummer(row.pack0123, row.pack4567, pack89ab, packcdef);
+      callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols, B_colidx_end));
+      rest.Finish(callback_impl, A_rowidx + 1, B0_colidx, A_rows, B_cols, B_colidx_end);
+    }
+  };
+  template <Index kRows> struct MultiplyRows<kRows, false> {
+    INTGEMM_AVX512BW inline void Zero(Register) {}
+    INTGEMM_AVX512BW inline void Load(const Register *, Index) {}
+    INTGEMM_AVX512BW inline void Start(Register MultiplyRowSums::*, Register) {}
+    INTGEMM_AVX512BW inline void Accumulate(Register MultiplyRowSums::*, Register) {}
+    INTGEMM_AVX512BW inline void Stash() {}
+    template <typename CallbackImpl> INTGEMM_AVX512BW inline void Finish(CallbackImpl &, Index, Index, Index, Index, Index) {}
+  };
+
+  // Sum kRows rows of A against 8 columns of B, with A addressed as in
+  // INTGEMM_MULTIPLY_TILE16.  Each register of B is loaded once and applied
+  // to all the rows before moving to the next.
+  template <Index kRows, class Prefetch>
+  INTGEMM_AVX512BW static INTGEMM_INLINE void AccumulateStrip(MultiplyRows<kRows> &rows, const Register *A_row, Index A_stride, Index A_step, const Register *B0_col, Index k_count, const Prefetch &prefetch) {
+    rows.Load(A_row, A_stride);
+    rows.Start(&MultiplyRowSums::sum0, *B0_col);
+    rows.Start(&MultiplyRowSums::sum1, *(B0_col + 1));
+    rows.Start(&MultiplyRowSums::sum2, *(B0_col + 2));
+    rows.Start(&MultiplyRowSums::sum3, *(B0_col + 3));
+    rows.Start(&MultiplyRowSums::sum4, *(B0_col + 4));
+    rows.Start(&MultiplyRowSums::sum5, *(B0_col + 5));
+    rows.Start(&MultiplyRowSums::sum6, *(B0_col + 6));
+    rows.Start(&MultiplyRowSums::sum7, *(B0_col + 7));
+    // Iterate over shared (inner) dimension.
+    for (Index k = 1; k < k_count; ++k) {
+      const Register *B_live = B0_col + k * 8;
+      prefetch.Step(B_live, A_row + k * A_step);
+      rows.Load(A_row + k * A_step, A_stride);
+      rows.Accumulate(&MultiplyRowSums::sum0, *B_live);
+      rows.Accumulate(&MultiplyRowSums::sum1, *(B_live + 1));
+      rows.Accumulate(&MultiplyRowSums::sum2, *(B_live + 2));
+      rows.Accumulate(&MultiplyRowSums::sum3, *(B_live + 3));
+      rows.Accumulate(&MultiplyRowSums::sum4, *(B_live + 4));
+      rows.Accumulate(&MultiplyRowSums::sum5, *(B_live + 5));
+      rows.Accumulate(&MultiplyRowSums::sum6, *(B_live + 6));
+      rows.Accumulate(&MultiplyRowSums::sum7, *(B_live + 7));
+    }
+  }
+
+  // Rows of A that share each load of B in Multiply.  32 registers fit two
+  // rows of sums; three is slower.
+  static const Index kMultiplyRows = 2;
+  // Columns of B in each tile of the output that Multiply passes to callbacks.
+  static const Index kMultiplyCols = 16;
+  // Multiply adds in 32 bits, which wrap, so the inner dimension may be split.
+  static const bool kSaturates = false;
+
   /* Only INTGEMM_AVX512F is necessary but due to GCC 5.4 bug we have to set INTGEMM_AVX512BW */
-  INTGEMM_MULTIPLY16(__m512i, INTGEMM_AVX512BW, CPUType::AVX2)
+  INTGEMM_MULTIPLY_TILE16(int16_t, INTGEMM_AVX512BW)
+
+  INTGEMM_MULTIPLY16WIDE(__m512i, INTGEMM_AVX512BW, CPUType::AVX2)
 
   constexpr static const char *const kName = "16-bit AVX512";
 
@@ -229,17 +344,26 @@ struct Kernels8 {
     std::size_t fast_size = (size & ~(kBatch - 1));
     const float *fast_input_end = input + fast_size;
     int8_t *fast_output_end = output + fast_size;
+    if (ThreadPool *pool = SharedThreadPool) {
+      pool->ParallelFor(static_cast<Index>((fast_size + kQuantizeChunk - 1) / kQuantizeChunk), [=](Index chunk) {
+        const std::size_t begin = chunk * kQuantizeChunk;
+        QuantizeThread(input + begin, output + begin, quant_mult, std::min(kQuantizeChunk, fast_size - begin));
+      });
+    } else {
 #pragma omp parallel
-    {
-      QuantizeThread(input, output, quant_mult, fast_size);
+      {
+        QuantizeThread(input, output, quant_mult, fast_size);
+      }
     }
     std::size_t overhang = size & (kBatch - 1);
     if (!overhang) return; // We needed a branch anyway for the empty case.
     const __m512i neg127 = _mm512_set1_epi32(-127);
     const __m512 quant_mult_reg = _mm512_set1_ps(quant_mult);
-    __m512i asint = QuantizerGrab(fast_input_end, quant_mult_reg);
+    // Masked load so nothing past the end of input is read.
+    const __mmask16 mask = static_cast<__mmask16>((1 << overhang) - 1);
+    __m512i asint = kernels::quantize(_mm512_maskz_loadu_ps(mask, fast_input_end), quant_mult_reg);
     asint = _mm512_max_epi32(asint, neg127);
-    _mm512_mask_cvtsepi32_storeu_epi8(fast_output_end, (1 << overhang) - 1, asint);
+    _mm512_mask_cvtsepi32_storeu_epi8(fast_output_end, mask, asint);
   }
 
   // Preparing A for the signed/unsigned multiplication. Using add 127
@@ -273,6 +397,9 @@ struct Kernels8 {
   static const Index kBTileRow = 64;
   static const Index kBTileCol = 8;
 
+  INTGEMM_QUANTIZE_ROWS(INTGEMM_AVX512BW, int8_t, QuantizeTile8)
+  INTGEMM_MAX_ABSOLUTE_SERIAL(INTGEMM_AVX512BW)
+
   /* Only INTGEMM_AVX512F is necessary but due to GCC 5.4 bug we have to set INTGEMM_AVX512BW */
   INTGEMM_PREPARE_B_8(INTGEMM_AVX512BW, QuantizeTile8)
   INTGEMM_PREPARE_B_QUANTIZED_TRANSPOSED(INTGEMM_AVX512BW, int8_t)
@@ -283,119 +410,170 @@ struct Kernels8 {
     SelectColumnsOfB((const __m512i*)input, (__m512i*)output, rows, cols_begin, cols_end);
   }
 
+  // Sums for one row of A against 8 columns of B.  AVX512 has no sign
+  // instruction, so the current register of A is kept as its absolute value
+  // and a mask of negative lanes used to negate B.
+  struct MultiplyRowSums {
+    Register a_positive;
+    __mmask64 neg_mask;
+    // These will be packed 16-bit integers containing sums for each column of B multiplied by the row of A.
+    Register sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7;
+    // The first strip of the tile, reduced within 128-bit lanes by Stash.
+    Register pack0123, pack4567;
+  };
+
+  // kRows consecutive rows of A that share every load of B.  Rows are nested
+  // members rather than an array so the compiler keeps the sums in registers.
+  template <Index kRows, bool kMore = (kRows > 0)> struct MultiplyRows {
+    MultiplyRowSums row;
+    MultiplyRows<kRows - 1> rest;
+
+    INTGEMM_AVX512BW inline void Zero(Register zeros) {
+      row.sum0 = row.sum1 = row.sum2 = row.sum3 = row.sum4 = row.sum5 = row.sum6 = row.sum7 = zeros;
+      rest.Zero(zeros);
+    }
+    INTGEMM_AVX512BW inline void Load(const Register *A_live, Index A_stride) {
+      Register a = *A_live;
+      // Get a mask where a is negative.
+      row.neg_mask = _mm512_test_epi8_mask(a, _mm512_set1_epi8(-128));
+      row.a_positive = _mm512_abs_epi8(a);
+      rest.Load(A_live + A_stride, A_stride);
+    }
+    INTGEMM_AVX512BW inline void Start(Register MultiplyRowSums::*sum, Register b, Register zeros) {
+      row.*sum = maddubs_epi16(row.a_positive, _mm512_mask_sub_epi8(b, row.neg_mask, zeros, b));
+      rest.Start(sum, b, zeros);
+    }
+    INTGEMM_AVX512BW inline void Accumulate(Register MultiplyRowSums::*sum, Register b, Register zeros) {
+      // Negate by subtracting from zero with a mask.
+      Register b_signed = _mm512_mask_sub_epi8(b, row.neg_mask, zeros, b);
+      // The magic 8-bit multiply then horizontal sum into 16-bit.
+      // Now we have 16-bit results that are the sum of two multiplies.
+      // Choosing to approximate and do adds.
+      // Perhaps every so often we could accumulate by upcasting.
+      row.*sum = _mm512_adds_epi16(row.*sum, _mm512_maddubs_epi16(row.a_positive, b_signed));
+      rest.Accumulate(sum, b, zeros);
+    }
+    INTGEMM_AVX512BW inline void Stash() {
+      // Upcast to 32-bit and horizontally add.
+      Register ones = set1_epi16<Register>(1);
+      row.pack0123 = Pack0123(madd_epi16(row.sum0, ones), madd_epi16(row.sum1, ones), madd_epi16(row.sum2, ones), madd_epi16(row.sum3, ones));
+      row.pack4567 = Pack0123(madd_epi16(row.sum4, ones), madd_epi16(row.sum5, ones), madd_epi16(row.sum6, ones), madd_epi16(row.sum7, ones));
+      rest.Stash();
+    }
+    template <typename CallbackImpl> INTGEMM_AVX512BW inline void Finish(CallbackImpl &callback_impl, Index A_rowidx, Index B0_colidx, Index A_rows, Index B_cols, Index B_colidx_end) {
+      Register ones = set1_epi16<Register>(1);
+      Register pack89ab = Pack0123(madd_epi16(row.sum0, ones), madd_epi16(row.sum1, ones), madd_epi16(row.sum2, ones), madd_epi16(row.sum3, ones));
+      Register packcdef = Pack0123(madd_epi16(row.sum4, ones), madd_epi16(row.sum5, ones), madd_epi16(row.sum6, ones), madd_epi16(row.sum7, ones));
+      auto total = PermuteSummer(row.pack0123, row.pack4567, pack89ab, packcdef);
+      callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols, B_colidx_end));
+      rest.Finish(callback_impl, A_rowidx + 1, B0_colidx, A_rows, B_cols, B_colidx_end);
+    }
+  };
+  template <Index kRows> struct MultiplyRows<kRows, false> {
+    INTGEMM_AVX512BW inline void Zero(Register) {}
+    INTGEMM_AVX512BW inline void Load(const Register *, Index) {}
+    INTGEMM_AVX512BW inline void Start(Register MultiplyRowSums::*, Register, Register) {}
+    INTGEMM_AVX512BW inline void Accumulate(Register MultiplyRowSums::*, Register, Register) {}
+    INTGEMM_AVX512BW inline void Stash() {}
+    template <typename CallbackImpl> INTGEMM_AVX512BW inline void Finish(CallbackImpl &, Index, Index, Index, Index, Index) {}
+  };
+
+  // Sum kRows rows of A against 8 columns of B, with A addressed as in
+  // INTGEMM_MULTIPLY_TILE16.  Each register of B is loaded once and applied
+  // to all the rows before moving to the next.
+  template <Index kRows, class Prefetch>
+  INTGEMM_AVX512BW static INTGEMM_INLINE void AccumulateStrip(MultiplyRows<kRows> &rows, const Register *A_row, Index A_stride, Index A_step, const Register *B0_col, Index k_count, const Prefetch &prefetch) {
+    Register zeros = setzero_si<Register>();
+    // Do the first iteration to initialize the sums.
+    rows.Load(A_row, A_stride);
+    rows.Start(&MultiplyRowSums::sum0, *B0_col, zeros);
+    rows.Start(&MultiplyRowSums::sum1, *(B0_col + 1), zeros);
+    rows.Start(&MultiplyRowSums::sum2, *(B0_col + 2), zeros);
+    rows.Start(&MultiplyRowSums::sum3, *(B0_col + 3), zeros);
+    rows.Start(&MultiplyRowSums::sum4, *(B0_col + 4), zeros);
+    rows.Start(&MultiplyRowSums::sum5, *(B0_col + 5), zeros);
+    rows.Start(&MultiplyRowSums::sum6, *(B0_col + 6), zeros);
+    rows.Start(&MultiplyRowSums::sum7, *(B0_col + 7), zeros);
+    // Iterate over shared (inner) dimension.
+    for (Index k = 1; k < k_count; ++k) {
+      // Retrieve the conveniently consecutive values of B.
+      const Register *B_live = B0_col + k * 8;
+      prefetch.Step(B_live, A_row + k * A_step);
+      rows.Load(A_row + k * A_step, A_stride);
+      rows.Accumulate(&MultiplyRowSums::sum0, *B_live, zeros);
+      rows.Accumulate(&MultiplyRowSums::sum1, *(B_live + 1), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum2, *(B_live + 2), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum3, *(B_live + 3), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum4, *(B_live + 4), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum5, *(B_live + 5), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum6, *(B_live + 6), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum7, *(B_live + 7), zeros);
+    }
+  }
+
+  // Rows of A that share each load of B in Multiply.
+  static const Index kMultiplyRows = 2;
+  // Columns of B in each tile of the output that Multiply passes to callbacks.
+  static const Index kMultiplyCols = 16;
+  // Multiply adds 8-bit products in saturating 16-bit lanes, so its sums
+  // depend on where the inner dimension is split.  Split-width paths check
+  // this.
+  static const bool kSaturates = true;
+
   // Special AVX512 implementation due to having 32 registers (so I don't have to
   // allocate registers manually) and no sign instruction.
+  INTGEMM_MULTIPLY_TILE16(int8_t, INTGEMM_AVX512BW)
+
+  // Multiply without saturation: a single maddubs can reach 2 * 127^2, so the
+  // 16-bit sums are widened to 32 bits every step.  One row of A at a time.
+  // MultiplyWideBlock does columns [B_colidx_begin, B_colidx_end) of B on one
+  // thread.
   template <typename Callback>
-  INTGEMM_AVX512BW static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
-    // This is copy-paste from Multiply8_SSE2OrAVX2.
+  INTGEMM_AVX512BW static void MultiplyWideBlock(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
     assert(width % sizeof(Register) == 0);
-    assert(B_cols % 8 == 0);
+    assert(B_colidx_begin % 8 == 0);
     assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0);
     assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
-    // There's 8 results for INTGEMM_AVX2 to handle.
     auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
     const Index simd_width = width / sizeof(Register);
-    // Added for AVX512.
-    Register zeros = setzero_si<Register>();
-    // Go over 8 columns of B at a time.
-#pragma omp for
-    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
+    const Register zeros = setzero_si<Register>();
+    const Register ones = set1_epi16<Register>(1);
+    for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) {
       const Register *B0_col = reinterpret_cast<const Register*>(B) + B0_colidx * simd_width;
-      // Process one row of A at a time.  Doesn't seem to be faster to do multiple rows of A at once.
       for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) {
-        // Iterate over shared (inner) dimension.
-        const Register *A_live = reinterpret_cast<const Register *>(A + A_rowidx * width);
-        const Register *A_end = A_live + simd_width;
-        const Register *B_live = B0_col;
-
-        // Do the first iteration to initialize the sums.
-        __m512i a = *A_live;
-        __mmask64 neg_mask = _mm512_test_epi8_mask(a, _mm512_set1_epi8(-128));
-        __m512i a_positive = _mm512_abs_epi8(a);
-        // These will be packed 16-bit integers containing sums for each column of B multiplied by the row of A.
-        Register sum0 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[0], neg_mask, zeros, B_live[0]));
-        Register sum1 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[1], neg_mask, zeros, B_live[1]));
-        Register sum2 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[2], neg_mask, zeros, B_live[2]));
-        Register sum3 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[3], neg_mask, zeros, B_live[3]));
-        Register sum4 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[4], neg_mask, zeros, B_live[4]));
-        Register sum5 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[5], neg_mask, zeros, B_live[5]));
-        Register sum6 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[6], neg_mask, zeros, B_live[6]));
-        Register sum7 = maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[7], neg_mask, zeros, B_live[7]));
-
-        ++A_live;
-        B_live += 8;
-
-        // Use A as the loop variable so the add can be done where gcc likes it
-        // for branch prediction.
-        for (; A_live != A_end; ++A_live, B_live += 8) {
-          // Unique code here: can we do an inline function?
-          // Retrieve a.  We will use this as the unsigned part.
-          a = *A_live;
-          // Retrieve the conveniently consecutive values of B.
-          __m512i b0 = *B_live;
-          __m512i b1 = *(B_live + 1);
-          __m512i b2 = *(B_live + 2);
-          __m512i b3 = *(B_live + 3);
-          __m512i b4 = *(B_live + 4);
-          __m512i b5 = *(B_live + 5);
-          __m512i b6 = *(B_live + 6);
-          __m512i b7 = *(B_live + 7);
-
-          // Get a mask where a is negative.
-          // Didn't seem to make a difference definining sign bits here vs at top
-          neg_mask = _mm512_test_epi8_mask(a, _mm512_set1_epi8(-128));
-          a_positive = _mm512_abs_epi8(a);
-
-          // Negate by subtracting from zero with a mask.
-          b0 = _mm512_mask_sub_epi8(b0, neg_mask, zeros, b0);
-          b1 = _mm512_mask_sub_epi8(b1, neg_mask, zeros, b1);
-          b2 = _mm512_mask_sub_epi8(b2, neg_mask, zeros, b2);
-          b3 = _mm512_mask_sub_epi8(b3, neg_mask, zeros, b3);
-          b4 = _mm512_mask_sub_epi8(b4, neg_mask, zeros, b4);
-          b5 = _mm512_mask_sub_epi8(b5, neg_mask, zeros, b5);
-          b6 = _mm512_mask_sub_epi8(b6, neg_mask, zeros, b6);
-          b7 = _mm512_mask_sub_epi8(b7, neg_mask, zeros, b7);
-          // The magic 8-bit multiply then horizontal sum into 16-bit.
-          b0 = _mm512_maddubs_epi16(a_positive, b0);
-          b1 = _mm512_maddubs_epi16(a_positive, b1);
-          b2 = _mm512_maddubs_epi16(a_positive, b2);
-          b3 = _mm512_maddubs_epi16(a_positive, b3);
-          b4 = _mm512_maddubs_epi16(a_positive, b4);
-          b5 = _mm512_maddubs_epi16(a_positive, b5);
-          b6 = _mm512_maddubs_epi16(a_positive, b6);
-          b7 = _mm512_maddubs_epi16(a_positive, b7);
-          // Now we have 16-bit results that are the sum of two multiplies.
-          // Choosing to approximate and do adds.
-          // Perhaps every so often we could accumulate by upcasting.
-          sum0 = _mm512_adds_epi16(sum0, b0);
-          sum1 = _mm512_adds_epi16(sum1, b1);
-          sum2 = _mm512_adds_epi16(sum2, b2);
-          sum3 = _mm512_adds_epi16(sum3, b3);
-          sum4 = _mm512_adds_epi16(sum4, b4);
-          sum5 = _mm512_adds_epi16(sum5, b5);
-          sum6 = _mm512_adds_epi16(sum6, b6);
-          sum7 = _mm512_adds_epi16(sum7, b7);
-          // Unique code ends: can we do an inline function?
+        const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width);
+        // Packed 32-bit integers.
+        Register sum0 = zeros, sum1 = zeros, sum2 = zeros, sum3 = zeros, sum4 = zeros, sum5 = zeros, sum6 = zeros, sum7 = zeros;
+        for (Index k = 0; k < simd_width; ++k) {
+          Register a = A_row[k];
+          __mmask64 neg_mask = _mm512_test_epi8_mask(a, _mm512_set1_epi8(-128));
+          Register a_positive = _mm512_abs_epi8(a);
+          const Register *B_live = B0_col + k * 8;
+          sum0 = add_epi32(sum0, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[0], neg_mask, zeros, B_live[0])), ones));
+          sum1 = add_epi32(sum1, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[1], neg_mask, zeros, B_live[1])), ones));
+          sum2 = add_epi32(sum2, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[2], neg_mask, zeros, B_live[2])), ones));
+          sum3 = add_epi32(sum3, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[3], neg_mask, zeros, B_live[3])), ones));
+          sum4 = add_epi32(sum4, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[4], neg_mask, zeros, B_live[4])), ones));
+          sum5 = add_epi32(sum5, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[5], neg_mask, zeros, B_live[5])), ones));
+          sum6 = add_epi32(sum6, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[6], neg_mask, zeros, B_live[6])), ones));
+          sum7 = add_epi32(sum7, madd_epi16(maddubs_epi16(a_positive, _mm512_mask_sub_epi8(B_live[7], neg_mask, zeros, B_live[7])), ones));
         }
-        // Upcast to 32-bit and horizontally add.
-        Register ones = set1_epi16<Register>(1);
-        sum0 = madd_epi16(sum0, ones);
-        sum1 = madd_epi16(sum1, ones);
-        sum2 = madd_epi16(sum2, ones);
-        sum3 = madd_epi16(sum3, ones);
-        sum4 = madd_epi16(sum4, ones);
-        sum5 = madd_epi16(sum5, ones);
-        sum6 = madd_epi16(sum6, ones);
-        sum7 = madd_epi16(sum7, ones);
         Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
         Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
-
         auto total = PermuteSummer(pack0123, pack4567);
         callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols));
       }
     }
   }
 
+  template <typename Callback>
+  INTGEMM_AVX512BW static void MultiplyWide(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+#pragma omp for
+    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
+      MultiplyWideBlock<Callback>(A, B, A_rows, width, B_cols, B0_colidx, std::min<Index>(B0_colidx + 8, B_cols), callback);
+    }
+  }
+
   INTGEMM_MULTIPLY8SHIFT(__m512i, INTGEMM_AVX512BW, CPUType::AVX2)
 
   INTGEMM_PREPAREBIASFOR8(__m512i, INTGEMM_AVX512BW, CPUType::AVX2)
@@ -18,63 +18,161 @@ INTGEMM_AVX512VNNI static inline void VNNI8(__m512i &c, __m512i a, __m512i b) {
 #endif
 }
 
+// Same workaround for vpdpwssd.
+INTGEMM_AVX512VNNI static inline void VNNI16(__m512i &c, __m512i a, __m512i b) {
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+    asm ("vpdpwssd %2, %1, %0" : "+x"(c) : "x"(a), "mx"(b));
+#else
+    c = _mm512_dpwssd_epi32(c, a, b);
+#endif
+}
+
 struct Kernels8 : public avx512bw::Kernels8 {
+  // Sums for one row of A against 8 columns of B, as in avx512bw::Kernels8
+  // but accumulated directly in 32-bit by VNNI.
+  struct MultiplyRowSums {
+    Register a_positive;
+    __mmask64 neg_mask;
+    Register sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7;
+    // The first strip of the tile, reduced within 128-bit lanes by Stash.
+    Register pack0123, pack4567;
+  };
+
+  // kRows consecutive rows of A that share every load of B.  Rows are nested
+  // members rather than an array so the compiler keeps the sums in registers.
+  template <Index kRows, bool kMore = (kRows > 0)> struct MultiplyRows {
+    MultiplyRowSums row;
+    MultiplyRows<kRows - 1> rest;
+
+    INTGEMM_AVX512VNNI inline void Zero(Register zeros) {
+      row.sum0 = row.sum1 = row.sum2 = row.sum3 = row.sum4 = row.sum5 = row.sum6 = row.sum7 = zeros;
+      rest.Zero(zeros);
+    }
+    INTGEMM_AVX512VNNI inline void Load(const Register *A_live, Index A_stride) {
+      Register a = *A_live;
+      // Get a mask where a is negative.
+      row.neg_mask = _mm512_test_epi8_mask(a, _mm512_set1_epi8(-128));
+      row.a_positive = _mm512_abs_epi8(a);
+      rest.Load(A_live + A_stride, A_stride);
+    }
+    INTGEMM_AVX512VNNI inline void Accumulate(Register MultiplyRowSums::*sum, Register b, Register zeros) {
+      // Copy the sum to a local: the asm in VNNI8 on a member kept the rows
+      // in memory.
+      Register local = row.*sum;
+      // Negate by subtracting from zero with a mask.
+      VNNI8(local, row.a_positive, _mm512_mask_sub_epi8(b, row.neg_mask, zeros, b));
+      row.*sum = local;
+      rest.Accumulate(sum, b, zeros);
+    }
+    INTGEMM_AVX512VNNI inline void Stash() {
+      row.pack0123 = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3);
+      row.pack4567 = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7);
+      rest.Stash();
+    }
+    template <typename CallbackImpl> INTGEMM_AVX512VNNI inline void Finish(CallbackImpl &callback_impl, Index A_rowidx, Index B0_colidx, Index A_rows, Index B_cols, Index B_colidx_end) {
+      Register pack89ab = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3);
+      Register packcdef = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7);
+      auto total = PermuteSummer(row.pack0123, row.pack4567, pack89ab, packcdef);
+      callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols, B_colidx_end));
+      rest.Finish(callback_impl, A_rowidx + 1, B0_colidx, A_rows, B_cols, B_colidx_end);
+    }
+  };
+  template <Index kRows> struct MultiplyRows<kRows, false> {
+    INTGEMM_AVX512VNNI inline void Zero(Register) {}
+    INTGEMM_AVX512VNNI inline void Load(const Register *, Index) {}
+    INTGEMM_AVX512VNNI inline void Accumulate(Register MultiplyRowSums::*, Register, Register) {}
+    INTGEMM_AVX512VNNI inline void Stash() {}
+    template <typename CallbackImpl> INTGEMM_AVX512VNNI inline void Finish(CallbackImpl &, Index, Index, Index, Index, Index) {}
+  };
+
+  // Sum kRows rows of A against 8 columns of B, with A addressed as in
+  // INTGEMM_MULTIPLY_TILE16.  Each register of B is loaded once and applied
+  // to all the rows before moving to the next.
+  template <Index kRows, class Prefetch>
+  INTGEMM_AVX512VNNI static INTGEMM_INLINE void AccumulateStrip(MultiplyRows<kRows> &rows, const Register *A_row, Index A_stride, Index A_step, const Register *B0_col, Index k_count, const Prefetch &prefetch) {
+    Register zeros = setzero_si<Register>();
+    // TODO: separate first step.
+    rows.Zero(zeros);
+    // Iterate over shared (inner) dimension.
+    for (Index k = 0; k < k_count; ++k) {
+      // Retrieve the conveniently consecutive values of B.
+      const Register *B_live = B0_col + k * 8;
+      prefetch.Step(B_live, A_row + k * A_step);
+      rows.Load(A_row + k * A_step, A_stride);
+      rows.Accumulate(&MultiplyRowSums::sum0, *B_live, zeros);
+      rows.Accumulate(&MultiplyRowSums::sum1, *(B_live + 1), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum2, *(B_live + 2), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum3, *(B_live + 3), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum4, *(B_live + 4), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum5, *(B_live + 5), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum6, *(B_live + 6), zeros);
+      rows.Accumulate(&MultiplyRowSums::sum7, *(B_live + 7), zeros);
+    }
+  }
+
+  INTGEMM_MULTIPLY_TILE16(int8_t, INTGEMM_AVX512VNNI)
+
+  // VNNI already accumulates in 32 bits, so Multiply doesn't saturate.
+  static const bool kSaturates = false;
+  template <typename Callback>
+  INTGEMM_AVX512VNNI static void MultiplyWide(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    Multiply<Callback>(A, B, A_rows, width, B_cols, callback);
+  }
+  template <typename Callback>
+  INTGEMM_AVX512VNNI static void MultiplyWideBlock(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
+    MultiplyBlock<Callback>(A, B, A_rows, width, B_cols, 0, A_rows, B_colidx_begin, B_colidx_end, 0, width, callback);
+  }
+
+  // Sum one row of unsigned A against 8 columns of B for Multiply8Shift,
+  // reduced within 128-bit lanes.
+  INTGEMM_AVX512VNNI static inline void Strip8Shift(const Register *A_live, const Register *B_live, Index simd_width, Register &pack0123, Register &pack4567) {
+    const Register *A_end = A_live + simd_width;
+    Register zeros = setzero_si<Register>();
+    // TODO: separate first step.
+    Register sum0 = zeros, sum1 = zeros, sum2 = zeros, sum3 = zeros, sum4 = zeros, sum5 = zeros, sum6 = zeros, sum7 = zeros;
+    // Iterate over shared (inner) dimension.
+    for (; A_live != A_end; ++A_live, B_live += 8) {
+      Register a = *A_live;
+      //MultiplyAdd
+      VNNI8(sum0, a, *B_live);
+      VNNI8(sum1, a, *(B_live + 1));
+      VNNI8(sum2, a, *(B_live + 2));
+      VNNI8(sum3, a, *(B_live + 3));
+      VNNI8(sum4, a, *(B_live + 4));
+      VNNI8(sum5, a, *(B_live + 5));
+      VNNI8(sum6, a, *(B_live + 6));
+      VNNI8(sum7, a, *(B_live + 7));
+    }
+    pack0123 = Pack0123(sum0, sum1, sum2, sum3);
+    pack4567 = Pack0123(sum4, sum5, sum6, sum7);
+  }
+
+  // Tiles of 16 columns with the 512-bit callbacks, like Multiply.  Same
+  // contract as Multiply8ShiftBlock in INTGEMM_MULTIPLY8SHIFT, except that
+  // columns end on a multiple of 16 or at B_cols.
   template <typename Callback>
-  INTGEMM_AVX512VNNI static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+  INTGEMM_AVX512VNNI static void Multiply8ShiftBlock(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
     assert(width % sizeof(Register) == 0);
     assert(B_cols % 8 == 0);
+    assert(B_colidx_begin % 16 == 0);
+    assert(B_colidx_end % 16 == 0 || B_colidx_end == B_cols);
     assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0);
     assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
-    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
+    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX512BW, Callback>(callback);
     const Index simd_width = width / sizeof(Register);
-    Register zeros = setzero_si<Register>();
-    // Go over 8 columns of B at a time.
-#pragma omp for
-    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
+    for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 16) {
       const Register *B0_col = reinterpret_cast<const Register*>(B) + B0_colidx * simd_width;
       // Process one row of A at a time.  Doesn't seem to be faster to do multiple rows of A at once.
-      for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) {
-        // Iterate over shared (inner) dimension.
-        const Register *A_live = reinterpret_cast<const Register *>(A + A_rowidx * width);
-        const Register *A_end = A_live + simd_width;
-        const Register *B_live = B0_col;
-        // TODO: separate first step.
-        Register sum0 = zeros, sum1 = zeros, sum2 = zeros, sum3 = zeros, sum4 = zeros, sum5 = zeros, sum6 = zeros, sum7 = zeros;
-        for (; A_live != A_end; ++A_live, B_live += 8) {
-          Register a = *A_live;
-          // Retrieve the conveniently consecutive values of B.
-          Register b0 = *B_live;
-          Register b1 = *(B_live + 1);
-          Register b2 = *(B_live + 2);
-          Register b3 = *(B_live + 3);
-          Register b4 = *(B_live + 4);
-          Register b5 = *(B_live + 5);
-          Register b6 = *(B_live + 6);
-          Register b7 = *(B_live + 7);
-          // Get a mask where a is negative.
-          __mmask64 neg_mask = _mm512_test_epi8_mask(a, _mm512_set1_epi8(-128));
-          Register a_positive = _mm512_abs_epi8(a);
-          // Negate by subtracting from zero with a mask.
-          b0 = _mm512_mask_sub_epi8(b0, neg_mask, zeros, b0);
-          b1 = _mm512_mask_sub_epi8(b1, neg_mask, zeros, b1);
-          b2 = _mm512_mask_sub_epi8(b2, neg_mask, zeros, b2);
-          b3 = _mm512_mask_sub_epi8(b3, neg_mask, zeros, b3);
-          b4 = _mm512_mask_sub_epi8(b4, neg_mask, zeros, b4);
-          b5 = _mm512_mask_sub_epi8(b5, neg_mask, zeros, b5);
-          b6 = _mm512_mask_sub_epi8(b6, neg_mask, zeros, b6);
-          b7 = _mm512_mask_sub_epi8(b7, neg_mask, zeros, b7);
-          VNNI8(sum0, a_positive, b0);
-          VNNI8(sum1, a_positive, b1);
-          VNNI8(sum2, a_positive, b2);
-          VNNI8(sum3, a_positive, b3);
-          VNNI8(sum4, a_positive, b4);
-          VNNI8(sum5, a_positive, b5);
-          VNNI8(sum6, a_positive, b6);
-          VNNI8(sum7, a_positive, b7);
+      for (Index A_rowidx = A_rowidx_begin; A_rowidx < A_rowidx_end; ++A_rowidx) {
+        const Register *A_row = reinterpret_cast<const Register *>(A + A_rowidx * width);
+        Register pack0123, pack4567, pack89ab, packcdef;
+        Strip8Shift(A_row, B0_col, simd_width, pack0123, pack4567);
+        if (B0_colidx + 8 < B_cols) {
+          Strip8Shift(A_row, B0_col + simd_width * 8, simd_width, pack89ab, packcdef);
+        } else {
+          pack89ab = packcdef = setzero_si<Register>();
         }
-        Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
-        Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
-        auto total = PermuteSummer(pack0123, pack4567);
+        auto total = PermuteSummer(pack0123, pack4567, pack89ab, packcdef);
         callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols));
       }
     }
@@ -82,42 +180,9 @@ struct Kernels8 : public avx512bw::Kernels8 {
 
   template <typename Callback>
   INTGEMM_AVX512VNNI static void Multiply8Shift(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
-    assert(width % sizeof(Register) == 0);
-    assert(B_cols % 8 == 0);
-    assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0);
-    assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
-    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
-    const Index simd_width = width / sizeof(Register);
-    Register zeros = setzero_si<Register>();
-    // Go over 8 columns of B at a time.
 #pragma omp for
-    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
-      const Register *B0_col = reinterpret_cast<const Register*>(B) + B0_colidx * simd_width;
-      // Process one row of A at a time.  Doesn't seem to be faster to do multiple rows of A at once.
-      for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) {
-        // Iterate over shared (inner) dimension.
-        const Register *A_live = reinterpret_cast<const Register *>(A + A_rowidx * width);
-        const Register *A_end = A_live + simd_width;
-        const Register *B_live = B0_col;
-        // TODO: separate first step.
-        Register sum0 = zeros, sum1 = zeros, sum2 = zeros, sum3 = zeros, sum4 = zeros, sum5 = zeros, sum6 = zeros, sum7 = zeros;
-        for (; A_live != A_end; ++A_live, B_live += 8) {
-          Register a = *A_live;
-          //MultiplyAdd
-          VNNI8(sum0, a, *B_live);
-          VNNI8(sum1, a, *(B_live + 1));
-          VNNI8(sum2, a, *(B_live + 2));
-          VNNI8(sum3, a, *(B_live + 3));
-          VNNI8(sum4, a, *(B_live + 4));
-          VNNI8(sum5, a, *(B_live + 5));
-          VNNI8(sum6, a, *(B_live + 6));
-          VNNI8(sum7, a, *(B_live + 7));
-        }
-        Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
-        Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
-        auto total = PermuteSummer(pack0123, pack4567);
-        callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols));
-      }
+    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 16) {
+      Multiply8ShiftBlock(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, std::min<Index>(B0_colidx + 16, B_cols), callback);
     }
   }
 
@@ -162,6 +227,91 @@ struct Kernels8 : public avx512bw::Kernels8 {
   static const CPUType kUses = CPUType::AVX512VNNI;
 };
 
+// Quantization and the layout of B are the same as avx512bw::Kernels16.
+struct Kernels16 : public avx512bw::Kernels16 {
+  // Sums for one row of A against 8 columns of B.
+  struct MultiplyRowSums {
+    Register a;
+    Register sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7;
+    // The first strip of the tile, reduced within 128-bit lanes by Stash.
+    Register pack0123, pack4567;
+  };
+
+  // kRows consecutive rows of A that share every load of B, as in Kernels8.
+  template <Index kRows, bool kMore = (kRows > 0)> struct MultiplyRows {
+    MultiplyRowSums row;
+    MultiplyRows<kRows - 1> rest;
+
+    INTGEMM_AVX512VNNI inline void Zero(Register zeros) {
+      row.sum0 = row.sum1 = row.sum2 = row.sum3 = row.sum4 = row.sum5 = row.sum6 = row.sum7 = zeros;
+      rest.Zero(zeros);
+    }
+    INTGEMM_AVX512VNNI inline void Load(const Register *A_live, Index A_stride) {
+      row.a = *A_live;
+      rest.Load(A_live + A_stride, A_stride);
+    }
+    INTGEMM_AVX512VNNI inline void Accumulate(Register MultiplyRowSums::*sum, Register b) {
+      // Multiply 16-bit pairs and add to 32-bit sums in one instruction.  Wraps
+      // like madd_epi16 then add_epi32 in avx512bw::Kernels16.
+      // Through a local as in Kernels8.
+      Register local = row.*sum;
+      VNNI16(local, row.a, b);
+      row.*sum = local;
+      rest.Accumulate(sum, b);
+    }
+    INTGEMM_AVX512VNNI inline void Stash() {
+      row.pack0123 = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3);
+      row.pack4567 = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7);
+      rest.Stash();
+    }
+    template <typename CallbackImpl> INTGEMM_AVX512VNNI inline void Finish(CallbackImpl &callback_impl, Index A_rowidx, Index B0_colidx, Index A_rows, Index B_cols, Index B_colidx_end) {
+      Register pack89ab = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3);
+      Register packcdef = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7);
+      auto total = PermuteSummer(row.pack0123, row.pack4567, pack89ab, packcdef);
+      callback_impl(total, callbacks::OutputBufferInfo(A_rowidx, B0_colidx, A_rows, B_cols, B_colidx_end));
+      rest.Finish(callback_impl, A_rowidx + 1, B0_colidx, A_rows, B_cols, B_colidx_end);
+    }
+  };
+  template <Index kRows> struct MultiplyRows<kRows, false> {
+    INTGEMM_AVX512VNNI inline void Zero(Register) {}
+    INTGEMM_AVX512VNNI inline void Load(const Register *, Index) {}
+    INTGEMM_AVX512VNNI inline void Accumulate(Register MultiplyRowSums::*, Register) {}
+    INTGEMM_AVX512VNNI inline void Stash() {}
+    template <typename CallbackImpl> INTGEMM_AVX512VNNI inline void Finish(CallbackImpl &, Index, Index, Index, Index, Index) {}
+  };
+
+  // Rows of A that share each load of B.  Each row keeps 8 sums, the stashed
+  // first strip and A, so three rows would need 33 registers and spill.
+  static const Index kMultiplyRows = 2;
+
+  // Sum kRows rows of A against 8 columns of B, with A addressed as in
+  // INTGEMM_MULTIPLY_TILE16.
+  template <Index kRows, class Prefetch>
+  INTGEMM_AVX512VNNI static INTGEMM_INLINE void AccumulateStrip(MultiplyRows<kRows> &rows, const Register *A_row, Index A_stride, Index A_step, const Register *B0_col, Index k_count, const Prefetch &prefetch) {
+    rows.Zero(setzero_si<Register>());
+    // Iterate over shared (inner) dimension.
+    for (Index k = 0; k < k_count; ++k) {
+      const Register *B_live = B0_col + k * 8;
+      prefetch.Step(B_live, A_row + k * A_step);
+      rows.Load(A_row + k * A_step, A_stride);
+      rows.Accumulate(&MultiplyRowSums::sum0, *B_live);
+      rows.Accumulate(&MultiplyRowSums::sum1, *(B_live + 1));
+      rows.Accumulate(&MultiplyRowSums::sum2, *(B_live + 2));
+      rows.Accumulate(&MultiplyRowSums::sum3, *(B_live + 3));
+      rows.Accumulate(&MultiplyRowSums::sum4, *(B_live + 4));
+      rows.Accumulate(&MultiplyRowSums::sum5, *(B_live + 5));
+      rows.Accumulate(&MultiplyRowSums::sum6, *(B_live + 6));
+      rows.Accumulate(&MultiplyRowSums::sum7, *(B_live + 7));
+    }
+  }
+
+  INTGEMM_MULTIPLY_TILE16(int16_t, INTGEMM_AVX512VNNI)
+
+  constexpr static const char *const kName = "16-bit AVX512VNNI";
+
+  static const CPUType kUses = CPUType::AVX512VNNI;
+};
+
 } // namespace avx512vnni
 } // namespace intgemm
 
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "intgemm/intgemm_config.h"
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+#include "avx2_gemm.h"
+#include "types.h"
+
+namespace intgemm {
+namespace avxvnni {
+
+// Same as avx512vnni::VNNI8 on 256-bit registers with the VEX encoding.
+INTGEMM_AVXVNNI static inline void VNNI8(__m256i &c, __m256i a, __m256i b) {
+  c = _mm256_dpbusds_avx_epi32(c, a, b);
+}
+
+// Without saturation, for sums that are corrected afterwards.
+INTGEMM_AVXVNNI static inline void VNNI8Wrap(__m256i &c, __m256i a, __m256i b) {
+  c = _mm256_dpbusd_avx_epi32(c, a, b);
+}
+
+/* AVX2 with 256-bit vpdpbusd, for CPUs that have AVX-VNNI but not AVX512.
+ * Quantization and the layout of B are the same as avx2::Kernels8, so B
+ * prepared for either runs on both.
+ */
+struct Kernels8 : public avx2::Kernels8 {
+  /* vpdpbusd multiplies unsigned by signed.  Rather than moving the sign of
+   * each value of A onto every column of B, Multiply flips the top bit of A,
+   * computing (a + 128) * b, then subtracts 128 * b once per column of B.
+   * This returns 128 times the sums of 8 columns of B over k_count registers,
+   * as Multiply passes to the callback.
+   */
+  INTGEMM_AVXVNNI static inline Register ShiftCorrection(const Register *B_live, Index k_count) {
+    const Register a = set1_epi8<Register>(-128);
+    Register sum0 = setzero_si<Register>(), sum1 = sum0, sum2 = sum0, sum3 = sum0, sum4 = sum0, sum5 = sum0, sum6 = sum0, sum7 = sum0;
+    const Register *B_end = B_live + k_count * 8;
+    for (; B_live != B_end; B_live += 8) {
+      VNNI8Wrap(sum0, a, B_live[0]);
+      VNNI8Wrap(sum1, a, B_live[1]);
+      VNNI8Wrap(sum2, a, B_live[2]);
+      VNNI8Wrap(sum3, a, B_live[3]);
+      VNNI8Wrap(sum4, a, B_live[4]);
+      VNNI8Wrap(sum5, a, B_live[5]);
+      VNNI8Wrap(sum6, a, B_live[6]);
+      VNNI8Wrap(sum7, a, B_live[7]);
+    }
+    Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
+    Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
+    return PermuteSummer(pack0123, pack4567);
+  }
+
+  // Multiply one row of A by 8 columns of B given their ShiftCorrection.
+  // Both sums wrap the same way, so the difference is exact.
+  template <class Prefetch, typename CallbackImpl>
+  INTGEMM_AVXVNNI static inline void MultiplyRow(const Register *A_live, const Register *B_live, Index k_count, Register correction, const Prefetch &prefetch, Index A_rowidx, Index A_rows, Index B0_colidx, Index B_cols, CallbackImpl &callback_impl) {
+    const Register flip = set1_epi8<Register>(-128);
+    Register sum0 = setzero_si<Register>(), sum1 = sum0, sum2 = sum0, sum3 = sum0, sum4 = sum0, sum5 = sum0, sum6 = sum0, sum7 = sum0;
+    // Iterate over shared (inner) dimension.
+    const Register *A_end = A_live + k_count;
+    for (; A_live != A_end; ++A_live, B_live += 8) {
+      prefetch.Step(B_live, A_live);
+      Register a = xor_si(*A_live, flip);
+      VNNI8Wrap(sum0, a, B_live[0]);
+      VNNI8Wrap(sum1, a, B_live[1]);
+      VNNI8Wrap(sum2, a, B_live[2]);
+      VNNI8Wrap(sum3, a, B_live[3]);
+      VNNI8Wrap(sum4, a, B_live[4]);
+      VNNI8Wrap(sum5, a, B_live[5]);
+      VNNI8Wrap(sum6, a, B_live[6]);
+      VNNI8Wrap(sum7, a, B_live[7]);
+    }
+    Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
+    Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
+    Register total = sub_epi32(PermuteSummer(pack0123, pack4567), correction);
+    RunCallback(callback_impl, total, A_rowidx, B0_colidx, A_rows, B_cols);
+  }
+
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    assert(width % sizeof(Register) == 0);
+    assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0);
+    assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
+    const Index simd_width = width / sizeof(Register);
+    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
+    const PrefetchConfig prefetch_config = SoftwarePrefetch;
+    // Go over 8 columns of B at a time.
+    INTGEMM_OMP_FOR
+    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
+      const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx;
+      const Register correction = ShiftCorrection(B0_col, simd_width);
+      for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) {
+        const Register *A_row = reinterpret_cast<const Register *>(A + A_rowidx * width);
+        const Prefetcher prefetch(prefetch_config, A_rowidx == 0, 8 * sizeof(Register), A_rowidx + 1 < A_rows ? width : 0);
+        if (prefetch.Any()) {
+          MultiplyRow(A_row, B0_col, simd_width, correction, prefetch, A_rowidx, A_rows, B0_colidx, B_cols, callback_impl);
+        } else {
+          MultiplyRow(A_row, B0_col, simd_width, correction, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl);
+        }
+      }
+    }
+  }
+
+  // Same contract as INTGEMM_MULTIPLY_BLOCK, with one ShiftCorrection per
+  // strip of B shared by the rows of the block.
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void MultiplyBlock(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B_colidx_begin, Index B_colidx_end, Index width_begin, Index width_end, Callback callback) {
+    assert(width % sizeof(Register) == 0);
+    assert(width_begin % sizeof(Register) == 0);
+    assert(width_end % sizeof(Register) == 0);
+    assert(B_colidx_begin % 8 == 0);
+    assert(B_colidx_end % 8 == 0 || B_colidx_end == B_cols);
+    assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0);
+    assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
+    const Index simd_width = width / sizeof(Register);
+    const Index k_begin = width_begin / sizeof(Register);
+    const Index k_count = (width_end - width_begin) / sizeof(Register);
+    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
+    for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) {
+      const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx + k_begin * 8;
+      const Register correction = ShiftCorrection(B0_col, k_count);
+      for (Index A_rowidx = A_rowidx_begin; A_rowidx < A_rowidx_end; ++A_rowidx) {
+        MultiplyRow(reinterpret_cast<const Register *>(A + A_rowidx * width) + k_begin, B0_col, k_count, correction, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl);
+      }
+    }
+  }
+
+  // Multiply accumulates in 32 bits, so it doesn't saturate.
+  static const bool kSaturates = false;
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void MultiplyWide(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    Multiply<Callback>(A, B, A_rows, width, B_cols, callback);
+  }
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void MultiplyWideBlock(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
+    MultiplyBlock<Callback>(A, B, A_rows, width, B_cols, 0, A_rows, B_colidx_begin, B_colidx_end, 0, width, callback);
+  }
+
+  // A is already unsigned so it goes straight into vpdpbusds.  Same contract
+  // as Multiply8ShiftBlock in INTGEMM_MULTIPLY8SHIFT.
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void Multiply8ShiftBlock(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
+    assert(width % sizeof(Register) == 0);
+    assert(B_cols % 8 == 0);
+    assert(B_colidx_begin % 8 == 0);
+    assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0);
+    assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
+    const Index simd_width = width / sizeof(Register);
+    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
+    Register zeros = setzero_si<Register>();
+    // Go over 8 columns of B at a time.
+    for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) {
+      const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx;
+      // Process one row of A at a time.
+      for (Index A_rowidx = A_rowidx_begin; A_rowidx < A_rowidx_end; ++A_rowidx) {
+        // Iterate over shared (inner) dimension.
+        const Register *A_live = reinterpret_cast<const Register *>(A + A_rowidx * width);
+        const Register *A_end = A_live + simd_width;
+        const Register *B_live = B0_col;
+        Register sum0 = zeros, sum1 = zeros, sum2 = zeros, sum3 = zeros, sum4 = zeros, sum5 = zeros, sum6 = zeros, sum7 = zeros;
+        for (; A_live != A_end; ++A_live, B_live += 8) {
+          Register a = *A_live;
+          VNNI8(sum0, a, *B_live);
+          VNNI8(sum1, a, *(B_live + 1));
+          VNNI8(sum2, a, *(B_live + 2));
+          VNNI8(sum3, a, *(B_live + 3));
+          VNNI8(sum4, a, *(B_live + 4));
+          VNNI8(sum5, a, *(B_live + 5));
+          VNNI8(sum6, a, *(B_live + 6));
+          VNNI8(sum7, a, *(B_live + 7));
+        }
+        Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
+        Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
+        auto total = PermuteSummer(pack0123, pack4567);
+        RunCallback(callback_impl, total, A_rowidx, B0_colidx, A_rows, B_cols);
+      }
+    }
+  }
+
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void Multiply8Shift(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    INTGEMM_OMP_FOR
+    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
+      Multiply8ShiftBlock(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B0_colidx + 8, callback);
+    }
+  }
+
+  template <typename Callback>
+  INTGEMM_AVXVNNI static void PrepareBias(const int8_t *B, Index width, Index B_cols, Callback callback) {
+    assert(width % sizeof(Register) == 0);
+    assert(B_cols % 8 == 0);
+    assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0);
+    const Index simd_width = width / sizeof(Register);
+    auto callback_impl = callbacks::CallbackImpl<CPUType::AVX2, Callback>(callback);
+    Register zeros = setzero_si<Register>();
+    const Register a = set1_epi8<Register>(1);
+    // Go over 8 columns of B at a time.
+    INTGEMM_OMP_FOR
+    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) {
+      const Register *B_live = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx;
+      const Register *B_end = B_live + simd_width * 8;
+      Register sum0 = zeros, sum1 = zeros, sum2 = zeros, sum3 = zeros, sum4 = zeros, sum5 = zeros, sum6 = zeros, sum7 = zeros;
+      for (; B_live != B_end; B_live += 8) {
+        // Retrieve the conveniently consecutive values of B.
+        VNNI8(sum0, a, *B_live);
+        VNNI8(sum1, a, *(B_live + 1));
+        VNNI8(sum2, a, *(B_live + 2));
+        VNNI8(sum3, a, *(B_live + 3));
+        VNNI8(sum4, a, *(B_live + 4));
+        VNNI8(sum5, a, *(B_live + 5));
+        VNNI8(sum6, a, *(B_live + 6));
+        VNNI8(sum7, a, *(B_live + 7));
+      }
+      Register pack0123 = Pack0123(sum0, sum1, sum2, sum3);
+      Register pack4567 = Pack0123(sum4, sum5, sum6, sum7);
+      auto total = PermuteSummer(pack0123, pack4567);
+      RunCallback(callback_impl, total, 0, B0_colidx, 1, B_cols);
+    }
+  }
+
+  constexpr static const char *const kName = "8-bit AVXVNNI";
+
+  static const CPUType kUses = CPUType::AVXVNNI;
+};
+
+} // namespace avxvnni
+} // namespace intgemm
+
+#endif
@@ -1,5 +1,11 @@
 #pragma once
 
+#include "log_sum_exp.h"
+#include "top_k.h"
+#include "../types.h"
+
+#include <algorithm>
+#include <cmath>
 #include <tuple>
 
 namespace intgemm {
@@ -19,11 +25,18 @@ std::tuple<Configs...> Sequence(const Configs&... configs) {
 struct Dummy {
 };
 
+/*
+ * Callbacks that write take an optional output_stride: the number of elements
+ * from the start of one row of the output to the next, for writing into
+ * columns of a larger row-major matrix.  0 means B_cols, a dense output.  The
+ * output needn't be aligned.
+ */
 template <typename Type>
 struct Write {
   Type* output_addr;
+  Index output_stride;
 
-  Write(Type* output_addr) : output_addr(output_addr) {}
+  Write(Type* output_addr, Index output_stride = 0) : output_addr(output_addr), output_stride(output_stride) {}
 };
 
 struct Unquantize {
@@ -35,24 +48,298 @@ struct Unquantize {
 struct UnquantizeAndWrite {
   float unquant_mult;
   float* output_addr;
+  Index output_stride;
+
+  UnquantizeAndWrite(float unquant_mult, float* output_addr, Index output_stride = 0) : unquant_mult(unquant_mult), output_addr(output_addr), output_stride(output_stride) {}
+};
+
+/*
+ * Write the output transposed, as C^T: the element in row r and column c goes
+ * to output_addr[c * output_stride + r].  output_stride defaults to A_rows, a
+ * dense column-major output.  Type is int or float.
+ */
+template <typename Type>
+struct WriteTransposed {
+  Type* output_addr;
+  Index output_stride;
+
+  WriteTransposed(Type* output_addr, Index output_stride = 0) : output_addr(output_addr), output_stride(output_stride) {}
+};
+
+struct UnquantizeAndWriteTransposed {
+  float unquant_mult;
+  float* output_addr;
+  Index output_stride;
 
-  UnquantizeAndWrite(float unquant_mult, float* output_addr) : unquant_mult(unquant_mult), output_addr(output_addr) {}
+  UnquantizeAndWriteTransposed(float unquant_mult, float* output_addr, Index output_stride = 0) : unquant_mult(unquant_mult), output_addr(output_addr), output_stride(output_stride) {}
 };
 
 struct AddBiasAndWrite {
   const int* bias_addr;
   int* output_addr;
+  Index output_stride;
+
+  AddBiasAndWrite(const int* bias_addr, int* output_addr, Index output_stride = 0) :  bias_addr(bias_addr), output_addr(output_addr), output_stride(output_stride) {}
+};
+
+/*
+ * Stages that take floats and pass floats on, to chain in a Sequence between
+ * Unquantize and Write<float> so the activation costs no pass of its own:
+ *
+ *   Sequence(Unquantize(unquant_mult), AddBias(bias), GELU(), Write<float>(C))
+ *
+ * AddBias adds a float bias of B_cols values.  ReLU also takes 32-bit sums.
+ * Sigmoid, Tanh, GELU and SiLU use exp_approx_taylor and approximate
+ * reciprocals, good to about 1e-3.  GELU is the tanh approximation.
+ */
+struct AddBias {
+  const float* bias_addr;
+
+  AddBias(const float* bias_addr) : bias_addr(bias_addr) {}
+};
+
+struct ReLU {
+};
+
+struct Sigmoid {
+};
+
+struct Tanh {
+};
 
-  AddBiasAndWrite(const int* bias_addr, int* output_addr) :  bias_addr(bias_addr), output_addr(output_addr) {}
+struct GELU {
+};
+
+struct SiLU {
+};
+
+/*
+ * Adds 32-bit sums already in a row-major buffer shaped like the output.  Used
+ * to carry sums over blocks of the inner dimension.
+ */
+struct AddPartialSums {
+  const int* partial_addr;
+
+  AddPartialSums(const int* partial_addr) : partial_addr(partial_addr) {}
 };
 
 struct UnquantizeAndAddBiasAndWrite {
   float unquant_mult;
   const float* bias_addr;
   float* output_addr;
+  Index output_stride;
+
+  UnquantizeAndAddBiasAndWrite(float unquant_mult, const float* bias_addr, float* output_addr, Index output_stride = 0) : unquant_mult(unquant_mult), bias_addr(bias_addr), output_addr(output_addr), output_stride(output_stride) {}
+};
+
+/*
+ * For a residual connection followed by layer norm: unquantizes, adds the
+ * float bias (if bias_addr isn't null) and a float residual_addr of A_rows x
+ * B_cols, row-major, and writes the result.  residual_addr may be output_addr
+ * to add in place.  If statistics_addr isn't null, it also stores the sum and
+ * sum of squares of the result for each row and group of 8 columns, so
+ * RowMeanAndVariance finishes layer norm statistics without another pass over
+ * the output.  Each group is written by one thread, so statistics need no
+ * locking and come out the same however the multiply is threaded.
+ * statistics_addr needs RowStatisticsSize(A_rows, B_cols) floats.
+ * output_stride is as for Write; residual_stride likewise for the residual,
+ * with 0 meaning the same as output_stride so the in-place case takes one.
+ */
+struct UnquantizeAndAddBiasAndResidualAndWrite {
+  float unquant_mult;
+  const float* bias_addr;
+  const float* residual_addr;
+  float* output_addr;
+  float* statistics_addr;
+  Index output_stride;
+  Index residual_stride;
+
+  UnquantizeAndAddBiasAndResidualAndWrite(float unquant_mult, const float* bias_addr, const float* residual_addr, float* output_addr, float* statistics_addr = nullptr, Index output_stride = 0, Index residual_stride = 0) : unquant_mult(unquant_mult), bias_addr(bias_addr), residual_addr(residual_addr), output_addr(output_addr), statistics_addr(statistics_addr), output_stride(output_stride), residual_stride(residual_stride ? residual_stride : output_stride) {}
+};
+
+inline Index RowStatisticsSize(Index rows, Index cols) {
+  return rows * ((cols + 7) / 8) * 2;
+}
+
+/*
+ * Mean and (population) variance of each row of the output from the
+ * statistics of UnquantizeAndAddBiasAndResidualAndWrite.  Groups are added in
+ * double so the variance, E[x^2] - E[x]^2, keeps its precision.
+ */
+inline void RowMeanAndVariance(const float* statistics, Index rows, Index cols, float* mean, float* variance) {
+  const Index groups = (cols + 7) / 8;
+  for (Index r = 0; r < rows; ++r, statistics += groups * 2) {
+    double sum = 0.0, squares = 0.0;
+    for (Index g = 0; g < groups; ++g) {
+      sum += statistics[g * 2];
+      squares += statistics[g * 2 + 1];
+    }
+    const double row_mean = sum / cols;
+    mean[r] = static_cast<float>(row_mean);
+    variance[r] = static_cast<float>(std::max(0.0, squares / cols - row_mean * row_mean));
+  }
+}
+
+/*
+ * For softmax over the columns of each row, such as a vocabulary projection:
+ * unquantizes, adds the float bias (if bias_addr isn't null) and writes the
+ * logits.  It also stores the max and the sum of e^(x - max) for each row and
+ * group of 8 columns in statistics_addr, RowStatisticsSize(A_rows, B_cols)
+ * floats, so RowLogSumExp gets the normalizer without passes over the output
+ * for the max and the sum.  As with the residual statistics, each group has
+ * one writer however the columns are split between threads.  output_stride is
+ * as for Write.
+ */
+struct UnquantizeAndAddBiasAndWriteForSoftmax {
+  float unquant_mult;
+  const float* bias_addr;
+  float* output_addr;
+  float* statistics_addr;
+  Index output_stride;
 
-  UnquantizeAndAddBiasAndWrite(float unquant_mult, const float* bias_addr, float* output_addr) : unquant_mult(unquant_mult), bias_addr(bias_addr), output_addr(output_addr) {}
+  UnquantizeAndAddBiasAndWriteForSoftmax(float unquant_mult, const float* bias_addr, float* output_addr, float* statistics_addr, Index output_stride = 0) : unquant_mult(unquant_mult), bias_addr(bias_addr), output_addr(output_addr), statistics_addr(statistics_addr), output_stride(output_stride) {}
 };
 
+/*
+ * log sum_j e^(x_j) of each row from the statistics of
+ * UnquantizeAndAddBiasAndWriteForSoftmax.  Groups are rescaled to the row's
+ * max and added in double.  The group sums come from exp_approx_taylor,
+ * which clamps its input at -20, so a term more than 20 below the group max
+ * counts as about e^-20 rather than less.  The max's own term is 1, so the
+ * error is under 7e^-20 of the group sum, below float precision.
+ */
+inline void RowLogSumExp(const float* statistics, Index rows, Index cols, float* log_sum_exp) {
+  const Index groups = (cols + 7) / 8;
+  for (Index r = 0; r < rows; ++r, statistics += groups * 2) {
+    float highest = statistics[0];
+    for (Index g = 1; g < groups; ++g) {
+      highest = std::max(highest, statistics[g * 2]);
+    }
+    double sum = 0.0;
+    for (Index g = 0; g < groups; ++g) {
+      sum += statistics[g * 2 + 1] * std::exp(static_cast<double>(statistics[g * 2]) - highest);
+    }
+    log_sum_exp[r] = static_cast<float>(highest + std::log(sum));
+  }
+}
+
+// The one pass left: output -= log_sum_exp of its row for log-softmax.
+// output_stride as for the callback.
+inline void ApplyLogSoftmax(float* output, Index rows, Index cols, const float* log_sum_exp, Index output_stride = 0) {
+  const Index stride = output_stride ? output_stride : cols;
+  for (Index r = 0; r < rows; ++r, output += stride) {
+    for (Index c = 0; c < cols; ++c) {
+      output[c] -= log_sum_exp[r];
+    }
+  }
+}
+
+// The one pass left: output = e^(output - log_sum_exp) of its row for softmax.
+// output_stride as for the callback.
+inline void ApplySoftmax(float* output, Index rows, Index cols, const float* log_sum_exp, Index output_stride = 0) {
+  const Index stride = output_stride ? output_stride : cols;
+  for (Index r = 0; r < rows; ++r, output += stride) {
+    for (Index c = 0; c < cols; ++c) {
+      output[c] = std::exp(output[c] - log_sum_exp[r]);
+    }
+  }
+}
+
+/*
+ * For beam search: unquantizes, adds the float bias (if bias_addr isn't null)
+ * and keeps the top_k->K() highest scores of each row in top_k instead of
+ * writing the output.  Call top_k->Merge() after the multiply.  With K() = 1
+ * it keeps the argmax without a heap.
+ */
+struct UnquantizeAndAddBiasAndTopK {
+  float unquant_mult;
+  const float* bias_addr;
+  TopK* top_k;
+
+  UnquantizeAndAddBiasAndTopK(float unquant_mult, const float* bias_addr, TopK* top_k) : unquant_mult(unquant_mult), bias_addr(bias_addr), top_k(top_k) {}
+};
+
+/*
+ * For scoring given targets: unquantizes and adds the float bias (if bias_addr
+ * isn't null), then instead of writing the output keeps a running
+ * log-sum-exp of each row in log_sum_exp and writes the score of column
+ * targets[row] to target_scores[row].  Call log_sum_exp->Merge() after the
+ * multiply for each row's log partition function.
+ */
+struct UnquantizeAndAddBiasAndScore {
+  float unquant_mult;
+  const float* bias_addr;
+  const Index* targets;
+  float* target_scores;
+  LogSumExp* log_sum_exp;
+
+  UnquantizeAndAddBiasAndScore(float unquant_mult, const float* bias_addr, const Index* targets, float* target_scores, LogSumExp* log_sum_exp) : unquant_mult(unquant_mult), bias_addr(bias_addr), targets(targets), target_scores(target_scores), log_sum_exp(log_sum_exp) {}
+};
+
+/*
+ * Unquantizes then quantizes again with quant_mult into 8-bit integers, as
+ * PrepareA does, for A of the next layer without a float pass in between.
+ * Type is int8_t for Int8 or uint8_t for Int8Shift, which adds 127.  The
+ * output is row-major with B_cols columns, or rows output_stride apart.
+ */
+template <typename Type>
+struct UnquantizeAndRequantizeAndWrite {
+  float unquant_mult;
+  float quant_mult;
+  Type* output_addr;
+  Index output_stride;
+
+  UnquantizeAndRequantizeAndWrite(float unquant_mult, float quant_mult, Type* output_addr, Index output_stride = 0) : unquant_mult(unquant_mult), quant_mult(quant_mult), output_addr(output_addr), output_stride(output_stride) {}
+};
+
+/*
+ * As UnquantizeAndRequantizeAndWrite with a float bias added before
+ * quantizing again.
+ */
+template <typename Type>
+struct UnquantizeAndAddBiasAndRequantizeAndWrite {
+  float unquant_mult;
+  const float* bias_addr;
+  float quant_mult;
+  Type* output_addr;
+  Index output_stride;
+
+  UnquantizeAndAddBiasAndRequantizeAndWrite(float unquant_mult, const float* bias_addr, float quant_mult, Type* output_addr, Index output_stride = 0) : unquant_mult(unquant_mult), bias_addr(bias_addr), quant_mult(quant_mult), output_addr(output_addr), output_stride(output_stride) {}
+};
+
+/*
+ * The config with its float bias replaced by bias, if it adds one and bias
+ * isn't null.  Used to read a copy of the bias local to the thread.
+ */
+template <typename Config>
+Config WithBias(const Config& config, const float*) {
+  return config;
+}
+
+inline UnquantizeAndAddBiasAndWrite WithBias(const UnquantizeAndAddBiasAndWrite& config, const float* bias) {
+  return bias ? UnquantizeAndAddBiasAndWrite(config.unquant_mult, bias, config.output_addr, config.output_stride) : config;
+}
+
+inline UnquantizeAndAddBiasAndResidualAndWrite WithBias(const UnquantizeAndAddBiasAndResidualAndWrite& config, const float* bias) {
+  return bias ? UnquantizeAndAddBiasAndResidualAndWrite(config.unquant_mult, bias, config.residual_addr, config.output_addr, config.statistics_addr) : config;
+}
+
+inline UnquantizeAndAddBiasAndWriteForSoftmax WithBias(const UnquantizeAndAddBiasAndWriteForSoftmax& config, const float* bias) {
+  return bias ? UnquantizeAndAddBiasAndWriteForSoftmax(config.unquant_mult, bias, config.output_addr, config.statistics_addr) : config;
+}
+
+inline UnquantizeAndAddBiasAndTopK WithBias(const UnquantizeAndAddBiasAndTopK& config, const float* bias) {
+  return bias ? UnquantizeAndAddBiasAndTopK(config.unquant_mult, bias, config.top_k) : config;
+}
+
+inline UnquantizeAndAddBiasAndScore WithBias(const UnquantizeAndAddBiasAndScore& config, const float* bias) {
+  return bias ? UnquantizeAndAddBiasAndScore(config.unquant_mult, bias, config.targets, config.target_scores, config.log_sum_exp) : config;
+}
+
+template <typename Type>
+UnquantizeAndAddBiasAndRequantizeAndWrite<Type> WithBias(const UnquantizeAndAddBiasAndRequantizeAndWrite<Type>& config, const float* bias) {
+  return bias ? UnquantizeAndAddBiasAndRequantizeAndWrite<Type>(config.unquant_mult, bias, config.quant_mult, config.output_addr, config.output_stride) : config;
+}
+
 }
 }
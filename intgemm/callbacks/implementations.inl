@@ -12,15 +12,10 @@
   #error "Only SSE2, AVX2 and AVX512BW are supported"
 #endif
 
-#if defined(CALLBACKS_THIS_IS_SSE2)
-  #define vi vector_t<CPUType::SSE2, int>
-  #define vf vector_t<CPUType::SSE2, float>
-  #define vd vector_t<CPUType::SSE2, double>
-#else
-  #define vi vector_t<CPUType::AVX2, int>
-  #define vf vector_t<CPUType::AVX2, float>
-  #define vd vector_t<CPUType::AVX2, double>
-#endif
+// AVX512BW callbacks take all 16 columns of a tile from the AVX512 kernels.
+#define vi vector_t<CPUType::CPU_NAME, int>
+#define vf vector_t<CPUType::CPU_NAME, float>
+#define vd vector_t<CPUType::CPU_NAME, double>
 
 namespace intgemm {
 namespace callbacks {
@@ -94,7 +89,7 @@ public:
   CPU_ATTR CallbackImpl(const Write<Type>& config) : config(config) {}
 
   CPU_ATTR void operator()(vector_t<CPUType::CPU_NAME, Type> input, const OutputBufferInfo& info) {
-    kernels::write(input, config.output_addr, info.row_idx * info.cols + info.col_idx);
+    kernels::write(input, config.output_addr, OutputOffset(info, config.output_stride), OutputCount(info));
   }
 
 private:
@@ -131,13 +126,13 @@ public:
   CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
     // Workaround gcc 5 internal compiler error that can't read register members in debug.
     vf mult_reg;
-#if !defined(__OPTIMIZE__) && (__GNUC__ == 5) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+#if !defined(__OPTIMIZE__) && (__GNUC__ == 5) && !defined(__clang__) && !defined(__INTEL_COMPILER) && !defined(CALLBACKS_THIS_IS_AVX512BW)
     asm ("vmovdqa %1, %0" : "=x" (mult_reg) : "m" (unquant_mult));
 #else
     mult_reg = unquant_mult;
 #endif
     auto result = kernels::unquantize(input, mult_reg);
-    kernels::write(result, config.output_addr, info.row_idx * info.cols + info.col_idx);
+    kernels::write(result, config.output_addr, OutputOffset(info, config.output_stride), OutputCount(info));
   }
 
 private:
@@ -145,6 +140,43 @@ private:
   UnquantizeAndWrite config;
 };
 
+/*
+ * WriteTransposed
+ */
+template <typename Type>
+class CallbackImpl<CPUType::CPU_NAME, WriteTransposed<Type>> {
+public:
+  CPU_ATTR CallbackImpl(const WriteTransposed<Type>& config) : config(config) {}
+
+  CPU_ATTR void operator()(vector_t<CPUType::CPU_NAME, Type> input, const OutputBufferInfo& info) {
+    const Index stride = TransposedOutputStride(info, config.output_stride);
+    kernels::write_transposed(input, config.output_addr, info.col_idx * stride + info.row_idx, stride, OutputCount(info));
+  }
+
+private:
+  WriteTransposed<Type> config;
+};
+
+/*
+ * UnquantizeAndWriteTransposed
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndWriteTransposed> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndWriteTransposed& config) : config(config) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    const Index stride = TransposedOutputStride(info, config.output_stride);
+    auto result = kernels::unquantize(input, unquant_mult);
+    kernels::write_transposed(result, config.output_addr, info.col_idx * stride + info.row_idx, stride, OutputCount(info));
+  }
+
+private:
+  vf unquant_mult;
+  UnquantizeAndWriteTransposed config;
+};
+
 /*
  * AddBiasAndWrite
  */
@@ -153,14 +185,29 @@ public:
   CPU_ATTR CallbackImpl(const AddBiasAndWrite& config) : config(config) {}
 
   CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
-    auto result = kernels::add_bias(input, config.bias_addr, info.col_idx);
-    kernels::write(result, config.output_addr, info.row_idx * info.cols + info.col_idx);
+    auto result = kernels::add_bias(input, config.bias_addr, info.col_idx, OutputCount(info));
+    kernels::write(result, config.output_addr, OutputOffset(info, config.output_stride), OutputCount(info));
   }
 
 private:
   AddBiasAndWrite config;
 };
 
+/*
+ * AddPartialSums
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, AddPartialSums> {
+public:
+  CPU_ATTR CallbackImpl(const AddPartialSums& config) : config(config) {}
+
+  CPU_ATTR vi operator()(vi input, const OutputBufferInfo& info) {
+    return kernels::add_bias(input, config.partial_addr + info.row_idx * info.cols, info.col_idx, OutputCount(info));
+  }
+
+private:
+  AddPartialSums config;
+};
+
 /*
  * UnquantizeAndAddBiasAndWrite
  */
@@ -173,20 +220,267 @@ public:
   CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
     // Workaround gcc 5 internal compiler error that can't read register members in debug.
     vf mult_reg;
-#if !defined(__OPTIMIZE__) && (__GNUC__ == 5) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+#if !defined(__OPTIMIZE__) && (__GNUC__ == 5) && !defined(__clang__) && !defined(__INTEL_COMPILER) && !defined(CALLBACKS_THIS_IS_AVX512BW)
     asm ("vmovdqa %1, %0" : "=x" (mult_reg) : "m" (unquant_mult));
 #else
     mult_reg = unquant_mult;
 #endif
     auto result = kernels::unquantize(input, mult_reg);
-    result = kernels::add_bias(result, config.bias_addr, info.col_idx);
-    kernels::write(result, config.output_addr, info.row_idx * info.cols + info.col_idx);
+    result = kernels::add_bias(result, config.bias_addr, info.col_idx, OutputCount(info));
+    kernels::write(result, config.output_addr, OutputOffset(info, config.output_stride), OutputCount(info));
   }
 private:
   vf unquant_mult;
   UnquantizeAndAddBiasAndWrite config;
 };
 
+/*
+ * UnquantizeAndAddBiasAndResidualAndWrite
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndAddBiasAndResidualAndWrite> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndAddBiasAndResidualAndWrite& config) : config(config) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    const Index count = OutputCount(info);
+    auto result = kernels::unquantize(input, unquant_mult);
+    if (config.bias_addr) {
+      result = kernels::add_bias(result, config.bias_addr, info.col_idx, count);
+    }
+    result = kernels::add_bias(result, config.residual_addr, OutputOffset(info, config.residual_stride), count);
+    kernels::write(result, config.output_addr, OutputOffset(info, config.output_stride), count);
+    if (config.statistics_addr) {
+      kernels::row_statistics(result, config.statistics_addr + RowStatisticsSize(info.row_idx, info.cols), info.col_idx, count);
+    }
+  }
+
+private:
+  vf unquant_mult;
+  UnquantizeAndAddBiasAndResidualAndWrite config;
+};
+
+/*
+ * UnquantizeAndAddBiasAndWriteForSoftmax
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndAddBiasAndWriteForSoftmax> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndAddBiasAndWriteForSoftmax& config) : config(config) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    const Index count = OutputCount(info);
+    auto result = kernels::unquantize(input, unquant_mult);
+    if (config.bias_addr) {
+      result = kernels::add_bias(result, config.bias_addr, info.col_idx, count);
+    }
+    kernels::write(result, config.output_addr, OutputOffset(info, config.output_stride), count);
+    kernels::softmax_statistics(result, config.statistics_addr + RowStatisticsSize(info.row_idx, info.cols), info.col_idx, count);
+  }
+
+private:
+  vf unquant_mult;
+  UnquantizeAndAddBiasAndWriteForSoftmax config;
+};
+
+/*
+ * UnquantizeAndAddBiasAndTopK
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndAddBiasAndTopK> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndAddBiasAndTopK& config) : config(config), heaps(config.top_k->Claim()) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+  }
+
+  // The heaps go with the instance.
+  CPU_ATTR CallbackImpl(CallbackImpl&& from) : unquant_mult(from.unquant_mult), config(from.config), heaps(from.heaps) {
+    from.heaps = nullptr;
+  }
+
+  CallbackImpl(const CallbackImpl&) = delete;
+  CallbackImpl& operator=(const CallbackImpl&) = delete;
+
+  CPU_ATTR ~CallbackImpl() {
+    if (heaps) config.top_k->Release(heaps);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    const Index count = OutputCount(info);
+    auto result = kernels::unquantize(input, unquant_mult);
+    if (config.bias_addr) {
+      result = kernels::add_bias(result, config.bias_addr, info.col_idx, count);
+    }
+    unsigned candidates = kernels::at_least_mask(result, heaps->Threshold(info.row_idx), count);
+    if (!candidates) return;
+    alignas(sizeof(vf)) float scores[sizeof(vf) / sizeof(float)];
+    *reinterpret_cast<vf*>(scores) = result;
+    if (heaps->K() == 1) {
+      for (Index i = 0; candidates; ++i, candidates >>= 1) {
+        if (candidates & 1) heaps->InsertBest(info.row_idx, scores[i], info.col_idx + i);
+      }
+    } else {
+      for (Index i = 0; candidates; ++i, candidates >>= 1) {
+        if (candidates & 1) heaps->Insert(info.row_idx, scores[i], info.col_idx + i);
+      }
+    }
+  }
+
+private:
+  vf unquant_mult;
+  UnquantizeAndAddBiasAndTopK config;
+  TopK::Heaps* heaps;
+};
+
+/*
+ * UnquantizeAndAddBiasAndScore
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndAddBiasAndScore> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndAddBiasAndScore& config) : config(config), lanes(config.log_sum_exp->Claim()) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+  }
+
+  // The lanes go with the instance.
+  CPU_ATTR CallbackImpl(CallbackImpl&& from) : unquant_mult(from.unquant_mult), config(from.config), lanes(from.lanes) {
+    from.lanes = nullptr;
+  }
+
+  CallbackImpl(const CallbackImpl&) = delete;
+  CallbackImpl& operator=(const CallbackImpl&) = delete;
+
+  CPU_ATTR ~CallbackImpl() {
+    if (lanes) config.log_sum_exp->Release(lanes);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    constexpr Index kLanes = sizeof(vf) / sizeof(float);
+    const Index count = OutputCount(info);
+    auto result = kernels::unquantize(input, unquant_mult);
+    if (config.bias_addr) {
+      result = kernels::add_bias(result, config.bias_addr, info.col_idx, count);
+    }
+    kernels::online_log_sum_exp(result, lanes->Highest(info.row_idx), lanes->Sum(info.row_idx), count);
+    // Wraps around if the target is before this register.
+    const Index target = config.targets[info.row_idx] - info.col_idx;
+    if (target < kLanes && target < count) {
+      alignas(sizeof(vf)) float scores[kLanes];
+      *reinterpret_cast<vf*>(scores) = result;
+      config.target_scores[info.row_idx] = scores[target];
+    }
+  }
+
+private:
+  vf unquant_mult;
+  UnquantizeAndAddBiasAndScore config;
+  LogSumExp::Lanes* lanes;
+};
+
+/*
+ * AddBias
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, AddBias> {
+public:
+  CPU_ATTR CallbackImpl(const AddBias& config) : config(config) {}
+
+  CPU_ATTR vf operator()(vf input, const OutputBufferInfo& info) {
+    return kernels::add_bias(input, config.bias_addr, info.col_idx, OutputCount(info));
+  }
+
+private:
+  AddBias config;
+};
+
+/*
+ * ReLU
+ */
+template <> class CallbackImpl<CPUType::CPU_NAME, ReLU> {
+public:
+  CPU_ATTR CallbackImpl(const ReLU&) {}
+
+  CPU_ATTR vi operator()(vi input, const OutputBufferInfo&) {
+    return kernels::relu<int>(input);
+  }
+
+  CPU_ATTR vf operator()(vf input, const OutputBufferInfo&) {
+    return kernels::relu<float>(input);
+  }
+};
+
+/*
+ * Sigmoid, Tanh, GELU, SiLU
+ */
+#define INTGEMM_ACTIVATION_CALLBACK(Config, kernel) \
+template <> class CallbackImpl<CPUType::CPU_NAME, Config> { \
+public: \
+  CPU_ATTR CallbackImpl(const Config&) {} \
+  CPU_ATTR vf operator()(vf input, const OutputBufferInfo&) { \
+    return kernels::kernel(input); \
+  } \
+};
+
+INTGEMM_ACTIVATION_CALLBACK(Sigmoid, sigmoid)
+INTGEMM_ACTIVATION_CALLBACK(Tanh, tanh)
+INTGEMM_ACTIVATION_CALLBACK(GELU, gelu)
+INTGEMM_ACTIVATION_CALLBACK(SiLU, silu)
+#undef INTGEMM_ACTIVATION_CALLBACK
+
+/*
+ * UnquantizeAndRequantizeAndWrite
+ */
+CPU_ATTR static inline vi requantize8(vf input, vf quant_mult, int8_t*) {
+  return kernels::requantize8(input, quant_mult);
+}
+
+CPU_ATTR static inline vi requantize8(vf input, vf quant_mult, uint8_t*) {
+  return kernels::requantize8u(input, quant_mult);
+}
+
+template <typename Type>
+class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndRequantizeAndWrite<Type>> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndRequantizeAndWrite<Type>& config) : config(config) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+    quant_mult = set1_ps<vf>(config.quant_mult);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    auto result = kernels::unquantize(input, unquant_mult);
+    auto packed = requantize8(result, quant_mult, config.output_addr);
+    kernels::write_quarter(packed, config.output_addr, OutputOffset(info, config.output_stride), OutputCount(info));
+  }
+
+private:
+  vf unquant_mult;
+  vf quant_mult;
+  UnquantizeAndRequantizeAndWrite<Type> config;
+};
+
+/*
+ * UnquantizeAndAddBiasAndRequantizeAndWrite
+ */
+template <typename Type>
+class CallbackImpl<CPUType::CPU_NAME, UnquantizeAndAddBiasAndRequantizeAndWrite<Type>> {
+public:
+  CPU_ATTR CallbackImpl(const UnquantizeAndAddBiasAndRequantizeAndWrite<Type>& config) : config(config) {
+    unquant_mult = set1_ps<vf>(config.unquant_mult);
+    quant_mult = set1_ps<vf>(config.quant_mult);
+  }
+
+  CPU_ATTR void operator()(vi input, const OutputBufferInfo& info) {
+    auto result = kernels::unquantize(input, unquant_mult);
+    result = kernels::add_bias(result, config.bias_addr, info.col_idx, OutputCount(info));
+    auto packed = requantize8(result, quant_mult, config.output_addr);
+    kernels::write_quarter(packed, config.output_addr, OutputOffset(info, config.output_stride), OutputCount(info));
+  }
+
+private:
+  vf unquant_mult;
+  vf quant_mult;
+  UnquantizeAndAddBiasAndRequantizeAndWrite<Type> config;
+};
+
 }
 }
 
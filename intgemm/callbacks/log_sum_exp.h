@@ -0,0 +1,82 @@
+#pragma once
+
+#include "slots.h"
+#include "../aligned.h"
+#include "../types.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace intgemm {
+namespace callbacks {
+
+/*
+ * log sum_j e^(x_j) of each row of a multiply without its output, for the
+ * UnquantizeAndAddBiasAndScore callback.  Each callback instance claims a
+ * set of running maxes and sums (see Slots), a register of lanes per row,
+ * and Merge combines them after the multiply and empties them for the next.
+ * Not for use by two multiplies at once.
+ */
+class LogSumExp {
+  public:
+    // Lanes of the widest register.
+    static const Index kLanes = 16;
+
+    class Lanes {
+      public:
+        explicit Lanes(Index rows) : highest_(rows * kLanes), sum_(rows * kLanes) {
+          Clear();
+        }
+
+        // Registers of row, 64-byte aligned.
+        float *Highest(Index row) { return highest_.begin() + row * kLanes; }
+        float *Sum(Index row) { return sum_.begin() + row * kLanes; }
+
+      private:
+        friend class LogSumExp;
+
+        void Clear() {
+          std::fill(highest_.begin(), highest_.end(), -FLT_MAX);
+          std::fill(sum_.begin(), sum_.end(), 0.0f);
+        }
+
+        AlignedVector<float> highest_, sum_;
+    };
+
+    explicit LogSumExp(Index rows) : rows_(rows) {}
+
+    Index Rows() const { return rows_; }
+
+    // Lanes for a callback instance to fill.  Thread safe.
+    Lanes *Claim() { return lanes_.Claim(rows_); }
+    void Release(Lanes *lanes) { lanes_.Release(lanes); }
+
+    // log sum_j e^(x_j) of each row into log_sum_exp, rescaling every lane to
+    // the row's max and adding in double.
+    void Merge(float *log_sum_exp) {
+      for (Index r = 0; r < rows_; ++r) {
+        float row_max = -FLT_MAX;
+        for (Index l = 0; l < lanes_.size(); ++l) {
+          const float *highest = lanes_[l].Highest(r);
+          row_max = std::max(row_max, *std::max_element(highest, highest + kLanes));
+        }
+        double sum = 0.0;
+        for (Index l = 0; l < lanes_.size(); ++l) {
+          const float *highest = lanes_[l].Highest(r), *lane_sum = lanes_[l].Sum(r);
+          for (Index i = 0; i < kLanes; ++i) {
+            if (lane_sum[i] > 0.0f) sum += lane_sum[i] * std::exp(static_cast<double>(highest[i]) - row_max);
+          }
+        }
+        log_sum_exp[r] = static_cast<float>(row_max + std::log(sum));
+      }
+      for (Index l = 0; l < lanes_.size(); ++l) lanes_[l].Clear();
+    }
+
+  private:
+    const Index rows_;
+    Slots<Lanes> lanes_;
+};
+
+} // namespace callbacks
+} // namespace intgemm
@@ -10,11 +10,39 @@ struct OutputBufferInfo {
   Index col_idx;
 
   Index rows; // = A_rows
-  Index cols; // = B_cols
+  Index cols; // = B_cols, which need not be a multiple of the vector width.
+  Index col_end; // Callbacks must not touch columns at or past col_end.  This
+                 // is cols unless a block of columns ends inside the vector.
 
   OutputBufferInfo(Index row_idx, Index col_idx, Index rows, Index cols)
-    : row_idx(row_idx), col_idx(col_idx), rows(rows), cols(cols) {}
+    : OutputBufferInfo(row_idx, col_idx, rows, cols, cols) {}
+
+  OutputBufferInfo(Index row_idx, Index col_idx, Index rows, Index cols, Index col_end)
+    : row_idx(row_idx), col_idx(col_idx), rows(rows), cols(cols), col_end(col_end) {}
 };
 
+/*
+ * Columns from col_idx that a callback may touch.
+ */
+inline Index OutputCount(const OutputBufferInfo& info) {
+  return info.col_end - info.col_idx;
+}
+
+/*
+ * Offset of the first output element of info in a row-major output whose rows
+ * start stride elements apart, or cols apart if stride is 0.
+ */
+inline Index OutputOffset(const OutputBufferInfo& info, Index stride) {
+  return info.row_idx * (stride ? stride : info.cols) + info.col_idx;
+}
+
+/*
+ * Distance between columns of a column-major output, stride or rows if stride
+ * is 0.
+ */
+inline Index TransposedOutputStride(const OutputBufferInfo& info, Index stride) {
+  return stride ? stride : info.rows;
+}
+
 }
 }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../types.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace intgemm {
+namespace callbacks {
+
+/*
+ * State that callback instances, one per thread and task, fill on their own
+ * and that is combined after the multiply.  An instance claims a T when it is
+ * constructed and releases it when destroyed; the next instance may continue
+ * filling it.  So no two threads share a T and there are about as many as
+ * threads, however the multiply is threaded.
+ */
+template <class T> class Slots {
+  public:
+    // A free T, or a new one from args.  Thread safe.
+    template <class... Args> T *Claim(const Args &... args) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_.empty()) {
+        all_.emplace_back(new T(args...));
+        return all_.back().get();
+      }
+      T *ret = free_.back();
+      free_.pop_back();
+      return ret;
+    }
+
+    void Release(T *slot) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(slot);
+    }
+
+    // Every T claimed so far, for combining once nothing holds one.
+    Index size() const { return static_cast<Index>(all_.size()); }
+    T &operator[](Index i) { return *all_[i]; }
+    const T &operator[](Index i) const { return *all_[i]; }
+
+  private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<T>> all_;
+    std::vector<T*> free_;
+};
+
+} // namespace callbacks
+} // namespace intgemm
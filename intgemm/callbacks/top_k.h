@@ -0,0 +1,162 @@
+#pragma once
+
+#include "slots.h"
+#include "../types.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace intgemm {
+namespace callbacks {
+
+/*
+ * The k highest scores of each row of a multiply and their columns, for the
+ * UnquantizeAndAddBiasAndTopK callback.  Each callback instance claims a set
+ * of per-row heaps (see Slots), so threads never share a heap.  Merge then
+ * combines the sets.  Ties go to the lower column, so the result doesn't
+ * depend on how the multiply was threaded.  k = 1 is argmax.
+ *
+ *   TopK top_k(A_rows, k);
+ *   Int8::Multiply(A, B, A_rows, width, B_cols, UnquantizeAndAddBiasAndTopK(unquant_mult, bias, &top_k));
+ *   top_k.Merge();
+ *   top_k.Scores(row)[0 .. top_k.Found()) and top_k.Columns(row), best first.
+ *
+ * Merge empties the heaps for the next multiply.  Not for use by two
+ * multiplies at once.
+ */
+class TopK {
+  public:
+    // Heaps for every row, worst candidate at the front of each.
+    class Heaps {
+      public:
+        Heaps(Index rows, Index k)
+          : k_(k), score_(rows * k), column_(rows * k), size_(rows, 0), threshold_(rows, -INFINITY) {}
+
+        Index K() const { return k_; }
+
+        // Scores below this can't get into the row's heap.
+        float Threshold(Index row) const { return threshold_[row]; }
+
+        void Insert(Index row, float score, Index column) {
+          float *scores = &score_[row * k_];
+          Index *columns = &column_[row * k_];
+          Index &size = size_[row];
+          if (size < k_) {
+            // Sift up.
+            Index at = size++;
+            while (at && Worse(score, column, scores[(at - 1) / 2], columns[(at - 1) / 2])) {
+              scores[at] = scores[(at - 1) / 2];
+              columns[at] = columns[(at - 1) / 2];
+              at = (at - 1) / 2;
+            }
+            scores[at] = score;
+            columns[at] = column;
+            if (size == k_) threshold_[row] = scores[0];
+            return;
+          }
+          if (!Worse(scores[0], columns[0], score, column)) return;
+          // Replace the worst and sift down.
+          Index at = 0;
+          while (true) {
+            Index child = at * 2 + 1;
+            if (child >= k_) break;
+            if (child + 1 < k_ && Worse(scores[child + 1], columns[child + 1], scores[child], columns[child])) ++child;
+            if (!Worse(scores[child], columns[child], score, column)) break;
+            scores[at] = scores[child];
+            columns[at] = columns[child];
+            at = child;
+          }
+          scores[at] = score;
+          columns[at] = column;
+          threshold_[row] = scores[0];
+        }
+
+        // Argmax without the heap.
+        void InsertBest(Index row, float score, Index column) {
+          if (!size_[row] || Worse(score_[row], column_[row], score, column)) {
+            score_[row] = score;
+            column_[row] = column;
+            size_[row] = 1;
+            threshold_[row] = score;
+          }
+        }
+
+      private:
+        friend class TopK;
+
+        void Clear() {
+          std::fill(size_.begin(), size_.end(), 0);
+          std::fill(threshold_.begin(), threshold_.end(), -INFINITY);
+        }
+
+        Index k_;
+        std::vector<float> score_;
+        std::vector<Index> column_;
+        std::vector<Index> size_;
+        std::vector<float> threshold_;
+    };
+
+    TopK(Index rows, Index k) : rows_(rows), k_(k), found_(0), score_(rows * k), column_(rows * k) {
+      assert(k > 0);
+    }
+
+    Index Rows() const { return rows_; }
+    Index K() const { return k_; }
+
+    // Heaps for a callback instance to fill.  Thread safe.
+    Heaps *Claim() { return heaps_.Claim(rows_, k_); }
+    void Release(Heaps *heaps) { heaps_.Release(heaps); }
+
+    // Combine the heaps once the multiply is done.
+    void Merge() {
+      std::vector<Index> order;
+      found_ = k_;
+      for (Index r = 0; r < rows_; ++r) {
+        order.clear();
+        for (Index h = 0; h < heaps_.size(); ++h) {
+          for (Index i = 0; i < heaps_[h].size_[r]; ++i) {
+            order.push_back(h * k_ + i);
+          }
+        }
+        const Index found = std::min<Index>(k_, static_cast<Index>(order.size()));
+        found_ = std::min(found_, found);
+        auto better = [&](Index a, Index b) {
+          return Worse(Score(b, r), Column(b, r), Score(a, r), Column(a, r));
+        };
+        std::partial_sort(order.begin(), order.begin() + found, order.end(), better);
+        for (Index i = 0; i < found; ++i) {
+          score_[r * k_ + i] = Score(order[i], r);
+          column_[r * k_ + i] = Column(order[i], r);
+        }
+      }
+      for (Index h = 0; h < heaps_.size(); ++h) heaps_[h].Clear();
+    }
+
+    // Entries per row after Merge, min(k, B_cols).
+    Index Found() const { return found_; }
+    const float *Scores(Index row) const { return &score_[row * k_]; }
+    const Index *Columns(Index row) const { return &column_[row * k_]; }
+    Index ArgMax(Index row) const { return column_[row * k_]; }
+
+  private:
+    // Order of candidates: lower score, then higher column, is worse.
+    static bool Worse(float score, Index column, float than_score, Index than_column) {
+      return score < than_score || (score == than_score && column > than_column);
+    }
+
+    // Entry i of the heap set at index / k_ for row.
+    float Score(Index index, Index row) const { return heaps_[index / k_].score_[row * k_ + index % k_]; }
+    Index Column(Index index, Index row) const { return heaps_[index / k_].column_[row * k_ + index % k_]; }
+
+    const Index rows_, k_;
+    Index found_;
+    std::vector<float> score_;
+    std::vector<Index> column_;
+
+    Slots<Heaps> heaps_;
+};
+
+} // namespace callbacks
+} // namespace intgemm
@@ -3,6 +3,76 @@
 
 namespace intgemm {
 
+namespace {
+
+void CPUIDCount(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(__INTEL_COMPILER)
+  // Cache sizes are only a tuning hint; fall back to defaults.
+  (void)leaf; (void)subleaf;
+  regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#elif defined(_MSC_VER)
+  __cpuidex(reinterpret_cast<int*>(regs), leaf, subleaf);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Walk deterministic cache parameters: leaf 4 on Intel, 0x8000001D on AMD.
+void CacheSizesFromLeaf(unsigned int leaf, CacheSizes &ret) {
+  unsigned int regs[4];
+  for (unsigned int subleaf = 0; subleaf < 16; ++subleaf) {
+    CPUIDCount(leaf, subleaf, regs);
+    unsigned int type = regs[0] & 0x1f;
+    if (type == 0) break;
+    // Skip instruction caches.
+    if (type != 1 && type != 3) continue;
+    unsigned int level = (regs[0] >> 5) & 0x7;
+    std::size_t size = static_cast<std::size_t>((regs[1] >> 22) + 1)
+      * (((regs[1] >> 12) & 0x3ff) + 1)
+      * ((regs[1] & 0xfff) + 1)
+      * (static_cast<std::size_t>(regs[2]) + 1);
+    switch (level) {
+      case 1: ret.l1 = size; break;
+      case 2: ret.l2 = size; break;
+      case 3: ret.l3 = size; break;
+    }
+  }
+}
+
+CacheSizes DetectCacheSizes() {
+  CacheSizes ret = {0, 0, 0};
+  unsigned int regs[4];
+  CPUIDCount(0, 0, regs);
+  const unsigned int max_leaf = regs[0];
+  CPUIDCount(0x80000000, 0, regs);
+  const unsigned int max_extended = regs[0];
+  if (max_leaf >= 4) {
+    CacheSizesFromLeaf(4, ret);
+  }
+  if (!ret.l1 && max_extended >= 0x8000001D) {
+    CacheSizesFromLeaf(0x8000001D, ret);
+  }
+  // Legacy AMD leaves, in KB.
+  if (!ret.l1 && max_extended >= 0x80000005) {
+    CPUIDCount(0x80000005, 0, regs);
+    ret.l1 = static_cast<std::size_t>(regs[2] >> 24) * 1024;
+  }
+  if (!ret.l2 && max_extended >= 0x80000006) {
+    CPUIDCount(0x80000006, 0, regs);
+    ret.l2 = static_cast<std::size_t>(regs[2] >> 16) * 1024;
+    ret.l3 = static_cast<std::size_t>(regs[3] >> 18) * 512 * 1024;
+  }
+  return ret;
+}
+
+} // namespace
+
+const CacheSizes kCacheSizes = DetectCacheSizes();
+
+// 2 KB ahead gained 10-30% multiplying a few rows by cold B on an AVX512 Xeon
+// and was within noise when B was in cache.
+PrefetchConfig SoftwarePrefetch = {2048, false};
+
 float Unsupported_MaxAbsolute(const float * /*begin*/, const float * /*end*/) {
   throw UnsupportedCPU();
 }
@@ -11,37 +81,47 @@ MeanStd Unsupported_VectorMeanStd(const float * /*begin*/, const float * /*end*/
   throw UnsupportedCPU();
 }
 
-void (*Int16::Quantize)(const float *input, int16_t *output, float quant_mult, Index size) = ChooseCPU(avx512bw::Kernels16::Quantize, avx512bw::Kernels16::Quantize, avx2::Kernels16::Quantize, sse2::Kernels16::Quantize, sse2::Kernels16::Quantize, Unsupported_16bit::Quantize);
+void (*Int16::Quantize)(const float *input, int16_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels16::Quantize, avx512bw::Kernels16::Quantize, avx2::Kernels16::Quantize, avx2::Kernels16::Quantize, sse2::Kernels16::Quantize, sse2::Kernels16::Quantize, Unsupported_16bit::Quantize);
+
+void (*Int16::PrepareA)(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(PrepareAPadded<avx512vnni::Kernels16>, PrepareAPadded<avx512bw::Kernels16>, PrepareAPadded<avx2::Kernels16>, PrepareAPadded<avx2::Kernels16>, PrepareAPadded<sse2::Kernels16>, PrepareAPadded<sse2::Kernels16>, Unsupported_16bit::PrepareA);
+
+void (*Int16::PrepareB)(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(PrepareBPadded<avx512vnni::Kernels16>, PrepareBPadded<avx512bw::Kernels16>, PrepareBPadded<avx2::Kernels16>, PrepareBPadded<avx2::Kernels16>, PrepareBPadded<sse2::Kernels16>, PrepareBPadded<sse2::Kernels16>, Unsupported_16bit::PrepareB);
 
-void (*Int16::PrepareB)(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(avx512bw::Kernels16::PrepareB, avx512bw::Kernels16::PrepareB, avx2::Kernels16::PrepareB, sse2::Kernels16::PrepareB, sse2::Kernels16::PrepareB, Unsupported_16bit::PrepareB);
+void (*Int16::PrepareAPanels)(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(intgemm::PrepareAPanels<avx512vnni::Kernels16>, intgemm::PrepareAPanels<avx512bw::Kernels16>, intgemm::PrepareAPanels<avx2::Kernels16>, intgemm::PrepareAPanels<avx2::Kernels16>, intgemm::PrepareAPanels<sse2::Kernels16>, intgemm::PrepareAPanels<sse2::Kernels16>, Unsupported_16bit::PrepareB);
 
-void (*Int16::PrepareBQuantizedTransposed)(const int16_t *input, int16_t *output, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512bw::Kernels16::PrepareBQuantizedTransposed, avx512bw::Kernels16::PrepareBQuantizedTransposed, avx2::Kernels16::PrepareBQuantizedTransposed, sse2::Kernels16::PrepareBQuantizedTransposed, sse2::Kernels16::PrepareBQuantizedTransposed, Unsupported_16bit::PrepareBQuantizedTransposed);
+void (*Int16::PrepareBQuantizedTransposed)(const int16_t *input, int16_t *output, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512vnni::Kernels16::PrepareBQuantizedTransposed, avx512bw::Kernels16::PrepareBQuantizedTransposed, avx2::Kernels16::PrepareBQuantizedTransposed, avx2::Kernels16::PrepareBQuantizedTransposed, sse2::Kernels16::PrepareBQuantizedTransposed, sse2::Kernels16::PrepareBQuantizedTransposed, Unsupported_16bit::PrepareBQuantizedTransposed);
 
-void (*Int16::PrepareBTransposed)(const float *input, int16_t *output, float quant_mult, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512bw::Kernels16::PrepareBTransposed, avx512bw::Kernels16::PrepareBTransposed, avx2::Kernels16::PrepareBTransposed, sse2::Kernels16::PrepareBTransposed, sse2::Kernels16::PrepareBTransposed, Unsupported_16bit::PrepareBTransposed);
+void (*Int16::PrepareBTransposed)(const float *input, int16_t *output, float quant_mult, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512vnni::Kernels16::PrepareBTransposed, avx512bw::Kernels16::PrepareBTransposed, avx2::Kernels16::PrepareBTransposed, avx2::Kernels16::PrepareBTransposed, sse2::Kernels16::PrepareBTransposed, sse2::Kernels16::PrepareBTransposed, Unsupported_16bit::PrepareBTransposed);
 
-void (*Int16::SelectColumnsB)(const int16_t *input, int16_t *output, Index rows, const Index *cols_begin, const Index *cols_end) = ChooseCPU(avx512bw::Kernels16::SelectColumnsB, avx512bw::Kernels16::SelectColumnsB, avx2::Kernels16::SelectColumnsB, sse2::Kernels16::SelectColumnsB, sse2::Kernels16::SelectColumnsB, Unsupported_16bit::SelectColumnsB);
+void (*Int16::SelectColumnsB)(const int16_t *input, int16_t *output, Index rows, const Index *cols_begin, const Index *cols_end) = ChooseCPU(avx512vnni::Kernels16::SelectColumnsB, avx512bw::Kernels16::SelectColumnsB, avx2::Kernels16::SelectColumnsB, avx2::Kernels16::SelectColumnsB, sse2::Kernels16::SelectColumnsB, sse2::Kernels16::SelectColumnsB, Unsupported_16bit::SelectColumnsB);
 
-const char *const Int16::kName = ChooseCPU(avx512bw::Kernels16::kName, avx512bw::Kernels16::kName, avx2::Kernels16::kName, sse2::Kernels16::kName, sse2::Kernels16::kName, Unsupported_16bit::kName);
+const char *const Int16::kName = ChooseCPU(avx512vnni::Kernels16::kName, avx512bw::Kernels16::kName, avx2::Kernels16::kName, avx2::Kernels16::kName, sse2::Kernels16::kName, sse2::Kernels16::kName, Unsupported_16bit::kName);
 
-void (*Int8::Quantize)(const float *input, int8_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels8::Quantize, avx512bw::Kernels8::Quantize, avx2::Kernels8::Quantize, ssse3::Kernels8::Quantize, Unsupported_8bit::Quantize, Unsupported_8bit::Quantize);
+void (*Int8::Quantize)(const float *input, int8_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels8::Quantize, avx512bw::Kernels8::Quantize, avxvnni::Kernels8::Quantize, avx2::Kernels8::Quantize, ssse3::Kernels8::Quantize, Unsupported_8bit::Quantize, Unsupported_8bit::Quantize);
 
-void (*Int8::QuantizeU)(const float *input, uint8_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels8::QuantizeU, avx512bw::Kernels8::QuantizeU, avx2::Kernels8::QuantizeU, ssse3::Kernels8::QuantizeU, Unsupported_8bit::QuantizeU, Unsupported_8bit::QuantizeU);
+void (*Int8::PrepareA)(const float *input, int8_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(PrepareAPadded<avx512vnni::Kernels8>, PrepareAPadded<avx512bw::Kernels8>, PrepareAPadded<avxvnni::Kernels8>, PrepareAPadded<avx2::Kernels8>, PrepareAPadded<ssse3::Kernels8>, Unsupported_8bit::PrepareA, Unsupported_8bit::PrepareA);
 
-void (*Int8::PrepareB)(const float *input, int8_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(avx512vnni::Kernels8::PrepareB, avx512bw::Kernels8::PrepareB, avx2::Kernels8::PrepareB, ssse3::Kernels8::PrepareB, Unsupported_8bit::PrepareB, Unsupported_8bit::PrepareB);
+float (*Int8::PrepareADynamic)(const float *input, int8_t *output, Index rows, Index cols) = ChooseCPU(intgemm::PrepareADynamic<avx512vnni::Kernels8>, intgemm::PrepareADynamic<avx512bw::Kernels8>, intgemm::PrepareADynamic<avxvnni::Kernels8>, intgemm::PrepareADynamic<avx2::Kernels8>, intgemm::PrepareADynamic<ssse3::Kernels8>, Unsupported_8bit::PrepareADynamic, Unsupported_8bit::PrepareADynamic);
 
-void (*Int8::PrepareBQuantizedTransposed)(const int8_t *input, int8_t *output, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512bw::Kernels8::PrepareBQuantizedTransposed, avx512bw::Kernels8::PrepareBQuantizedTransposed, avx2::Kernels8::PrepareBQuantizedTransposed, ssse3::Kernels8::PrepareBQuantizedTransposed, Unsupported_8bit::PrepareBQuantizedTransposed, Unsupported_8bit::PrepareBQuantizedTransposed);
+void (*Int8::QuantizeU)(const float *input, uint8_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels8::QuantizeU, avx512bw::Kernels8::QuantizeU, avxvnni::Kernels8::QuantizeU, avx2::Kernels8::QuantizeU, ssse3::Kernels8::QuantizeU, Unsupported_8bit::QuantizeU, Unsupported_8bit::QuantizeU);
 
-void (*Int8::PrepareBTransposed)(const float *input, int8_t *output, float quant_mult, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512bw::Kernels8::PrepareBTransposed, avx512bw::Kernels8::PrepareBTransposed, avx2::Kernels8::PrepareBTransposed, ssse3::Kernels8::PrepareBTransposed, Unsupported_8bit::PrepareBTransposed, Unsupported_8bit::PrepareBTransposed);
+void (*Int8::PrepareB)(const float *input, int8_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(PrepareBPadded<avx512vnni::Kernels8>, PrepareBPadded<avx512bw::Kernels8>, PrepareBPadded<avxvnni::Kernels8>, PrepareBPadded<avx2::Kernels8>, PrepareBPadded<ssse3::Kernels8>, Unsupported_8bit::PrepareB, Unsupported_8bit::PrepareB);
 
-void (*Int8::SelectColumnsB)(const int8_t *input, int8_t *output, Index rows, const Index *cols_begin, const Index *cols_end) = ChooseCPU(avx512vnni::Kernels8::SelectColumnsB, avx512bw::Kernels8::SelectColumnsB, avx2::Kernels8::SelectColumnsB, ssse3::Kernels8::SelectColumnsB, Unsupported_8bit::SelectColumnsB, Unsupported_8bit::SelectColumnsB);
+void (*Int8::PrepareAPanels)(const float *input, int8_t *output, float quant_mult, Index rows, Index cols) = ChooseCPU(intgemm::PrepareAPanels<avx512vnni::Kernels8>, intgemm::PrepareAPanels<avx512bw::Kernels8>, intgemm::PrepareAPanels<avxvnni::Kernels8>, intgemm::PrepareAPanels<avx2::Kernels8>, intgemm::PrepareAPanels<ssse3::Kernels8>, Unsupported_8bit::PrepareB, Unsupported_8bit::PrepareB);
 
-const char *const Int8::kName = ChooseCPU(avx512vnni::Kernels8::kName, avx512bw::Kernels8::kName, avx2::Kernels8::kName, ssse3::Kernels8::kName, Unsupported_8bit::kName, Unsupported_8bit::kName);
+void (*Int8::PrepareBQuantizedTransposed)(const int8_t *input, int8_t *output, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512bw::Kernels8::PrepareBQuantizedTransposed, avx512bw::Kernels8::PrepareBQuantizedTransposed, avxvnni::Kernels8::PrepareBQuantizedTransposed, avx2::Kernels8::PrepareBQuantizedTransposed, ssse3::Kernels8::PrepareBQuantizedTransposed, Unsupported_8bit::PrepareBQuantizedTransposed, Unsupported_8bit::PrepareBQuantizedTransposed);
 
-void (*Int8Shift::QuantizeU)(const float *input, uint8_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels8::QuantizeU, avx512bw::Kernels8::QuantizeU, avx2::Kernels8::QuantizeU, ssse3::Kernels8::QuantizeU, Unsupported_8bit::QuantizeU, Unsupported_8bit::QuantizeU);
+void (*Int8::PrepareBTransposed)(const float *input, int8_t *output, float quant_mult, Index inner, Index B_untransposed_cols) = ChooseCPU(avx512bw::Kernels8::PrepareBTransposed, avx512bw::Kernels8::PrepareBTransposed, avxvnni::Kernels8::PrepareBTransposed, avx2::Kernels8::PrepareBTransposed, ssse3::Kernels8::PrepareBTransposed, Unsupported_8bit::PrepareBTransposed, Unsupported_8bit::PrepareBTransposed);
 
-const char *const Int8Shift::kName = ChooseCPU(avx512vnni::Kernels8::kName, avx512bw::Kernels8::kName, avx2::Kernels8::kName, ssse3::Kernels8::kName, Unsupported_8bit::kName, Unsupported_8bit::kName);
+void (*Int8::SelectColumnsB)(const int8_t *input, int8_t *output, Index rows, const Index *cols_begin, const Index *cols_end) = ChooseCPU(avx512vnni::Kernels8::SelectColumnsB, avx512bw::Kernels8::SelectColumnsB, avxvnni::Kernels8::SelectColumnsB, avx2::Kernels8::SelectColumnsB, ssse3::Kernels8::SelectColumnsB, Unsupported_8bit::SelectColumnsB, Unsupported_8bit::SelectColumnsB);
 
-const CPUType kCPU = ChooseCPU(CPUType::AVX512VNNI, CPUType::AVX512BW, CPUType::AVX2, CPUType::SSSE3, CPUType::SSE2, CPUType::UNSUPPORTED);
+const char *const Int8::kName = ChooseCPU(avx512vnni::Kernels8::kName, avx512bw::Kernels8::kName, avxvnni::Kernels8::kName, avx2::Kernels8::kName, ssse3::Kernels8::kName, Unsupported_8bit::kName, Unsupported_8bit::kName);
+
+void (*Int8Shift::QuantizeU)(const float *input, uint8_t *output, float quant_mult, Index size) = ChooseCPU(avx512vnni::Kernels8::QuantizeU, avx512bw::Kernels8::QuantizeU, avxvnni::Kernels8::QuantizeU, avx2::Kernels8::QuantizeU, ssse3::Kernels8::QuantizeU, Unsupported_8bit::QuantizeU, Unsupported_8bit::QuantizeU);
+
+const char *const Int8Shift::kName = ChooseCPU(avx512vnni::Kernels8::kName, avx512bw::Kernels8::kName, avxvnni::Kernels8::kName, avx2::Kernels8::kName, ssse3::Kernels8::kName, Unsupported_8bit::kName, Unsupported_8bit::kName);
+
+const CPUType kCPU = ChooseCPU(CPUType::AVX512VNNI, CPUType::AVX512BW, CPUType::AVXVNNI, CPUType::AVX2, CPUType::SSSE3, CPUType::SSE2, CPUType::UNSUPPORTED);
 
 #if !defined(INTGEMM_COMPILER_SUPPORTS_AVX512BW)
 namespace avx512bw {
@@ -50,9 +130,9 @@ using avx2::VectorMeanStd;
 } // namespace avx512bw
 #endif
 
-float (*MaxAbsolute)(const float *begin, const float *end) = ChooseCPU(avx512bw::MaxAbsolute, avx512bw::MaxAbsolute, avx2::MaxAbsolute, sse2::MaxAbsolute, sse2::MaxAbsolute, Unsupported_MaxAbsolute);
+float (*MaxAbsolute)(const float *begin, const float *end) = ChooseCPU(avx512bw::MaxAbsolute, avx512bw::MaxAbsolute, avx2::MaxAbsolute, avx2::MaxAbsolute, sse2::MaxAbsolute, sse2::MaxAbsolute, Unsupported_MaxAbsolute);
 
-MeanStd (*VectorMeanStd)(const float *begin, const float *end, bool absolute) = ChooseCPU(avx512bw::VectorMeanStd, avx512bw::VectorMeanStd, avx2::VectorMeanStd, sse2::VectorMeanStd, sse2::VectorMeanStd, Unsupported_VectorMeanStd);
+MeanStd (*VectorMeanStd)(const float *begin, const float *end, bool absolute) = ChooseCPU(avx512bw::VectorMeanStd, avx512bw::VectorMeanStd, avx2::VectorMeanStd, avx2::VectorMeanStd, sse2::VectorMeanStd, sse2::VectorMeanStd, Unsupported_VectorMeanStd);
 
 constexpr const char *const Unsupported_16bit::kName;
 constexpr const char *const Unsupported_8bit::kName;
@@ -60,12 +140,16 @@ constexpr const char *const sse2::Kernels16::kName;
 constexpr const char *const ssse3::Kernels8::kName;
 constexpr const char *const avx2::Kernels8::kName;
 constexpr const char *const avx2::Kernels16::kName;
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+constexpr const char *const avxvnni::Kernels8::kName;
+#endif
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
 constexpr const char *const avx512bw::Kernels8::kName;
 constexpr const char *const avx512bw::Kernels16::kName;
 #endif
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
 constexpr const char *const avx512vnni::Kernels8::kName;
+constexpr const char *const avx512vnni::Kernels16::kName;
 #endif
 
 }
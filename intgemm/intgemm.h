@@ -4,16 +4,20 @@
  * We are computing C = A * B with an optional scaling factor.
  *
  * A is typically activations.
- * Rows a multiple of 1 (no restriction)
- * Columns a multiple of 64 for 8-bit or 32 for 16-bit.
+ * Rows and columns can be anything.  PrepareA pads each row with zeros to the
+ * width the CPU's kernel multiplies, at most a multiple of 64 for 8-bit or 32
+ * for 16-bit, so allocate PreparedASize(rows, cols) elements for it.
  * Use PrepareA to prepare A for multiplication.  This is meant to be fast.
  *
  * B is typically fixed model parameters.
- * Rows a multiple of 64 for 8-bit or 32 for 16-bit.
- * Columns a multiple of: 8
+ * Rows and columns can be anything.  PrepareB pads B with zeros to a multiple
+ * of 64 rows for 8-bit or 32 for 16-bit and 8 columns, so allocate
+ * PreparedBSize(rows, cols) elements for it.
  * Use PrepareB to prepare B for multiplication.  This is slower, with the
  * intention that it will be prepared once and remembered.
  *
+ * Int8Shift still needs the multiples of its tile_info.
+ *
  * C is row major.
  *
  * Once both A and B are prepared, call Multiply.
@@ -46,6 +50,7 @@
 #include "sse2_gemm.h"
 #include "ssse3_gemm.h"
 #include "avx2_gemm.h"
+#include "avxvnni_gemm.h"
 #include "avx512_gemm.h"
 #include "avx512vnni_gemm.h"
 
@@ -65,6 +70,12 @@ struct Unsupported_16bit {
   static void Quantize(const float *, int16_t *, float, Index) {
     throw UnsupportedCPU();
   }
+  static void PrepareA(const float *, int16_t *, float, Index, Index) {
+    throw UnsupportedCPU();
+  }
+  static void QuantizeRows(const float *, int16_t *, float, Index, Index, Index, Index) {
+    throw UnsupportedCPU();
+  }
   static void PrepareB(const float *, int16_t *, float, Index, Index) {
     throw UnsupportedCPU();
   }
@@ -81,6 +92,32 @@ struct Unsupported_16bit {
   static void Multiply(const int16_t *, const int16_t *, Index, Index, Index, Callback) {
     throw UnsupportedCPU();
   }
+  template <typename Callback>
+  static void MultiplyBlock(const int16_t *, const int16_t *, Index, Index, Index, Index, Index, Index, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyWide(const int16_t *, const int16_t *, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyWideBlock(const int16_t *, const int16_t *, Index, Index, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyReplicated(const int16_t *, const ReplicatedB<int16_t> &, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyFloatA(const float *, Index, const int16_t *, float, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  using Integer = int16_t;
+  static const Index kBTileRow = 32;
+  static const Index kBTileCol = 8;
+  static const Index kMultiplyRows = 1;
+  static const Index kMultiplyCols = 8;
+  static const bool kSaturates = false;
   constexpr static const char *const kName = "16-bit Unsupported";
 };
 
@@ -94,6 +131,15 @@ struct Unsupported_8bit {
   static void PrepareA(const float *, int8_t *, float, Index, Index) {
     throw UnsupportedCPU();
   }
+  static void QuantizeRows(const float *, int8_t *, float, Index, Index, Index, Index) {
+    throw UnsupportedCPU();
+  }
+  static float MaxAbsoluteSerial(const float *, std::size_t) {
+    throw UnsupportedCPU();
+  }
+  static float PrepareADynamic(const float *, int8_t *, Index, Index) {
+    throw UnsupportedCPU();
+  }
   static void PrepareBQuantizedTransposed(const int8_t *, int8_t *, Index, Index) {
     throw UnsupportedCPU();
   }
@@ -118,6 +164,40 @@ struct Unsupported_8bit {
   static void Multiply8Shift(const uint8_t *, const int8_t *, Index, Index, Index, Callback) {
     throw UnsupportedCPU();
   }
+  template<class Callback>
+  static void Multiply8ShiftBlock(const uint8_t *, const int8_t *, Index, Index, Index, Index, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyBlock(const int8_t *, const int8_t *, Index, Index, Index, Index, Index, Index, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyWide(const int8_t *, const int8_t *, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyWideBlock(const int8_t *, const int8_t *, Index, Index, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyReplicated(const int8_t *, const ReplicatedB<int8_t> &, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void MultiplyFloatA(const float *, Index, const int8_t *, float, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  template <typename Callback>
+  static void Multiply8ShiftReplicated(const uint8_t *, const ReplicatedB<int8_t> &, Index, Index, Index, Callback) {
+    throw UnsupportedCPU();
+  }
+  using Integer = int8_t;
+  static const Index kBTileRow = 64;
+  static const Index kBTileCol = 8;
+  static const Index kMultiplyRows = 1;
+  static const Index kMultiplyCols = 8;
+  static const bool kSaturates = true;
 
   constexpr static const char *const kName = "8-bit Unsupported";
 };
@@ -126,6 +206,7 @@ struct Unsupported_8bit {
 // These won't ever be called in this capacity, but it does let the code below compile.
 namespace avx512vnni {
 typedef Unsupported_8bit Kernels8;
+typedef Unsupported_16bit Kernels16;
 } // namespace avx512vnni
 #endif
 #ifndef INTGEMM_COMPILER_SUPPORTS_AVX512BW
@@ -134,12 +215,48 @@ typedef Unsupported_8bit Kernels8;
 typedef Unsupported_16bit Kernels16;
 } // namespace avx512bw
 #endif
+#ifndef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+namespace avxvnni {
+typedef Unsupported_8bit Kernels8;
+} // namespace avxvnni
+#endif
+
+/* Whether the CPU has AVX-VNNI: AVX2 plus CPUID leaf 7, subleaf 1, EAX bit 4.
+ * Always false if the compiler can't build the avxvnni kernels.  This is a
+ * separate check because AVX512 CPUs may or may not have it.
+ */
+inline bool CPUSupportsAVXVNNI() {
+#if !defined(INTGEMM_COMPILER_SUPPORTS_AVXVNNI) || defined(__INTEL_COMPILER)
+  // The Intel compiler's _may_i_use_cpu_feature has no flag for AVX-VNNI.
+  return false;
+#elif defined(_MSC_VER)
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7) return false;
+  __cpuidex(regs, 7, 0);
+  // regs[0] is the highest subleaf; regs[1] bit 5 is AVX2.
+  if (regs[0] < 1 || !(regs[1] & (1 << 5))) return false;
+  __cpuidex(regs, 7, 1);
+  return regs[0] & (1 << 4);
+#else
+  // gcc and clang.
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0, 0) < 7) return false;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  // eax is the highest subleaf; ebx bit 5 is AVX2.
+  if (eax < 1 || !(ebx & (1 << 5))) return false;
+  __cpuid_count(7, 1, eax, ebx, ecx, edx);
+  return eax & (1 << 4);
+#endif
+}
 
 /* Returns:
  * axx512vnni if the CPU supports AVX512VNNI
  *
  * avx512bw if the CPU supports AVX512BW
  *
+ * avxvnni if the CPU supports AVX-VNNI
+ *
  * avx2 if the CPU supports AVX2
  *
  * ssse3 if the CPU supports SSSE3 (this distinction from SSE2 matters for 8-bit)
@@ -155,6 +272,10 @@ template <class T> T ChooseCPU(T
     , T
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
     avx512bw
+#endif
+    , T
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+    avxvnni
 #endif
     , T avx2, T ssse3, T sse2, T unsupported) {
 #if defined(__INTEL_COMPILER)
@@ -163,6 +284,10 @@ template <class T> T ChooseCPU(T
 #  endif
 #  ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
   if (_may_i_use_cpu_feature(_FEATURE_AVX512BW)) return avx512bw;
+#  endif
+#  ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+  // See CPUSupportsAVXVNNI.
+  (void)avxvnni;
 #  endif
   if (_may_i_use_cpu_feature(_FEATURE_AVX2)) return avx2;
   if (_may_i_use_cpu_feature(_FEATURE_SSSE3)) return ssse3;
@@ -200,6 +325,9 @@ template <class T> T ChooseCPU(T
 #  endif
 #  ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
     if (ebx & (1 << 30)) return avx512bw;
+#  endif
+#  ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+    if (CPUSupportsAVXVNNI()) return avxvnni;
 #  endif
     if (ebx & (1 << 5)) return avx2;
   }
@@ -229,16 +357,32 @@ struct TileInfo {
 struct Int8 {
   using Integer = int8_t;
 
-  // A's size must be a multiple of 1x64, B's size must be a multiple of 64x8.
+  // Multiply is fastest when A's size is a multiple of 1x64 and B's size is a
+  // multiple of 64x8, but any size works.
   static constexpr TileInfo tile_info{1, 64, 64, 8};
 
-  // Currently A is prepared by quantization but this could theoretically change.
-  // A's columns must be a multiple of 8.
-  // The number of rows is anything.
-  static inline void PrepareA(const float *input, int8_t *output, float quant_mult, Index rows, Index cols) {
-    Quantize(input, output, quant_mult, rows * cols);
+  // Elements to allocate for the output of PrepareB on any CPU.
+  static constexpr Index PreparedBSize(Index rows, Index cols) {
+    return round_up(rows, tile_info.b_rows) * round_up(cols, tile_info.b_cols);
+  }
+
+  // Elements to allocate for the output of PrepareA on any CPU.
+  static constexpr Index PreparedASize(Index rows, Index cols) {
+    return rows * round_up(cols, tile_info.a_cols);
   }
 
+  // Currently A is prepared by quantization but this could theoretically change.
+  // Any number of rows and columns.  Rows are padded with zeros, so the output
+  // depends on the CPU like that of PrepareB; see PreparedASize.
+  static void (*PrepareA)(const float *input, int8_t *output, float quant_mult, Index rows, Index cols);
+
+  // PrepareA with quant_mult = 127 / (largest absolute value in input), for
+  // quantizing activations on the fly.  Each thread quantizes the part of
+  // input it searched, still in its cache only if that part fits; see
+  // PrepareADynamic in multiply.h.  The output takes PreparedASize(rows, cols)
+  // elements.  Returns quant_mult.  input and output must be 64-byte aligned.
+  static float (*PrepareADynamic)(const float *input, int8_t *output, Index rows, Index cols);
+
   // Multiply floats by quant_mult then convert to 8-bit integers with saturation.
   static void (*Quantize)(const float *input, int8_t *output, float quant_mult, Index size);
 
@@ -265,9 +409,59 @@ struct Int8 {
   static void (*SelectColumnsB)(const int8_t *input, int8_t *output, Index rows, const Index *cols_begin, const Index *cols_end);
 
   // Multiply C = A * B, presuming A and B have been prepared.
+  // Accumulation::Wide avoids saturation at some cost in speed.
   template <typename Callback>
-  static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
-    MultiplyImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+  static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback, Accumulation accumulation = Accumulation::Native) {
+    if (accumulation == Accumulation::Wide) {
+      MultiplyWideImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+    } else {
+      MultiplyImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+    }
+  }
+
+  // PrepareA writing A in panels of the rows the CPU's kernel multiplies at
+  // once, for MultiplyPanels (see PrepareAPanels in multiply.h).  The output
+  // has rows * cols elements and cols must be a multiple of 64.
+  static void (*PrepareAPanels)(const float *input, int8_t *output, float quant_mult, Index rows, Index cols);
+
+  // Multiply C = A * B with A from PrepareAPanels on the same CPU.  width must
+  // be a multiple of 64.
+  template <typename Callback>
+  static void MultiplyPanels(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyPanelsImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+  }
+
+  // Multiply C = A * B with B copied to every NUMA node by ReplicatedB.  Each
+  // thread reads the copy on its node.  Any shape, as for Multiply.
+  template <typename Callback>
+  static void Multiply(const int8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyReplicatedImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+  }
+
+  // Multiply C = A * B with float A, quantized with quant_mult as it is
+  // multiplied rather than by PrepareA into a buffer first.  Same results as
+  // PrepareA then Multiply.  Any shape, as for Multiply.
+  template <typename Callback>
+  static void Multiply(const float *A, const int8_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyFloatAImpl<Callback>::run(A, width, B, quant_mult, A_rows, width, B_cols, callback);
+  }
+
+  // As above with rows of A starting A_stride >= width floats apart, so A can
+  // be columns of a larger matrix.  A needn't be aligned.  Pass the callback
+  // an output_stride to write into columns of a larger output too.
+  template <typename Callback>
+  static void Multiply(const float *A, Index A_stride, const int8_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyFloatAImpl<Callback>::run(A, A_stride, B, quant_mult, A_rows, width, B_cols, callback);
+  }
+
+  // For forced decoding and rescoring: the score of column targets[row] and
+  // log sum_j e^(C[row][j]) of each row of C = unquant_mult * A * B + bias,
+  // without writing C.  bias may be nullptr.  The target's log probability is
+  // target_scores[row] - log_sum_exp[row].
+  static void Score(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, float unquant_mult, const float *bias, const Index *targets, float *target_scores, float *log_sum_exp) {
+    callbacks::LogSumExp state(A_rows);
+    Multiply(A, B, A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndScore(unquant_mult, bias, targets, target_scores, &state));
+    state.Merge(log_sum_exp);
   }
 
   static const char *const kName;
@@ -277,10 +471,42 @@ private:
   struct MultiplyImpl {
     static void (*run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
   };
+
+  template <typename Callback>
+  struct MultiplyWideImpl {
+    static void (*run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
+  template <typename Callback>
+  struct MultiplyPanelsImpl {
+    static void (*run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
+  template <typename Callback>
+  struct MultiplyReplicatedImpl {
+    static void (*run)(const int8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
+  template <typename Callback>
+  struct MultiplyFloatAImpl {
+    static void (*run)(const float *A, Index A_stride, const int8_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
 };
 
 template <typename Callback>
-void (*Int8::MultiplyImpl<Callback>::run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrap<Callback, avx512vnni::Kernels8>, OMPParallelWrap<Callback, avx512bw::Kernels8>, OMPParallelWrap<Callback, avx2::Kernels8>, OMPParallelWrap<Callback, ssse3::Kernels8>, Unsupported_8bit::Multiply<Callback>, Unsupported_8bit::Multiply<Callback>);
+void (*Int8::MultiplyImpl<Callback>::run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapBlocked<Callback, avx512vnni::Kernels8>, OMPParallelWrapBlocked<Callback, avx512bw::Kernels8>, OMPParallelWrapBlocked<Callback, avxvnni::Kernels8>, OMPParallelWrapBlocked<Callback, avx2::Kernels8>, OMPParallelWrapBlocked<Callback, ssse3::Kernels8>, Unsupported_8bit::Multiply<Callback>, Unsupported_8bit::Multiply<Callback>);
+
+template <typename Callback>
+void (*Int8::MultiplyWideImpl<Callback>::run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapWide<Callback, avx512vnni::Kernels8>, OMPParallelWrapWide<Callback, avx512bw::Kernels8>, OMPParallelWrapWide<Callback, avxvnni::Kernels8>, OMPParallelWrapWide<Callback, avx2::Kernels8>, OMPParallelWrapWide<Callback, ssse3::Kernels8>, Unsupported_8bit::Multiply<Callback>, Unsupported_8bit::Multiply<Callback>);
+
+template <typename Callback>
+void (*Int8::MultiplyPanelsImpl<Callback>::run)(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapPanels<Callback, avx512vnni::Kernels8>, OMPParallelWrapPanels<Callback, avx512bw::Kernels8>, OMPParallelWrapPanels<Callback, avxvnni::Kernels8>, OMPParallelWrapPanels<Callback, avx2::Kernels8>, OMPParallelWrapPanels<Callback, ssse3::Kernels8>, Unsupported_8bit::Multiply<Callback>, Unsupported_8bit::Multiply<Callback>);
+
+template <typename Callback>
+void (*Int8::MultiplyReplicatedImpl<Callback>::run)(const int8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapReplicated<Callback, avx512vnni::Kernels8>, OMPParallelWrapReplicated<Callback, avx512bw::Kernels8>, OMPParallelWrapReplicated<Callback, avxvnni::Kernels8>, OMPParallelWrapReplicated<Callback, avx2::Kernels8>, OMPParallelWrapReplicated<Callback, ssse3::Kernels8>, Unsupported_8bit::MultiplyReplicated<Callback>, Unsupported_8bit::MultiplyReplicated<Callback>);
+
+template <typename Callback>
+void (*Int8::MultiplyFloatAImpl<Callback>::run)(const float *A, Index A_stride, const int8_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(MultiplyFloatA<Callback, avx512vnni::Kernels8>, MultiplyFloatA<Callback, avx512bw::Kernels8>, MultiplyFloatA<Callback, avxvnni::Kernels8>, MultiplyFloatA<Callback, avx2::Kernels8>, MultiplyFloatA<Callback, ssse3::Kernels8>, Unsupported_8bit::MultiplyFloatA<Callback>, Unsupported_8bit::MultiplyFloatA<Callback>);
 
 /*
  * 8-bit matrix multiplication with shifting A by 127
@@ -318,6 +544,13 @@ struct Int8Shift {
     MultiplyImpl<Callback>::run((const uint8_t *)A, B, A_rows, width, B_cols, callback);
   }
 
+  // Multiply with B, and the bias if given, copied to every NUMA node by
+  // ReplicatedB.  Each thread reads the copies on its node.
+  template<class Callback>
+  static void Multiply(const int8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyReplicatedImpl<Callback>::run((const uint8_t *)A, B, A_rows, width, B_cols, callback);
+  }
+
   // This function prepares the bias for the Multiply routine that does unsigned * signed multiplication.
   // The function takes:
   // a preparedB matrix, width, B_cols and
@@ -336,6 +569,11 @@ private:
     static void (*run)(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
   };
 
+  template <typename Callback>
+  struct MultiplyReplicatedImpl {
+    static void (*run)(const uint8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
   template <typename Callback>
   struct PrepareBiasImpl {
     static void (*run)(const int8_t *B, Index width, Index B_cols, Callback callback);
@@ -346,12 +584,22 @@ template <class Callback>
 void (*Int8Shift::MultiplyImpl<Callback>::run)(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(
     OMPParallelWrap8Shift<Callback, avx512vnni::Kernels8>,
     OMPParallelWrap8Shift<Callback, avx512bw::Kernels8>,
+    OMPParallelWrap8Shift<Callback, avxvnni::Kernels8>,
     OMPParallelWrap8Shift<Callback, avx2::Kernels8>,
     OMPParallelWrap8Shift<Callback, ssse3::Kernels8>, 
     Unsupported_8bit::Multiply8Shift<Callback>, Unsupported_8bit::Multiply8Shift<Callback>);
 
 template <class Callback>
-void (*Int8Shift::PrepareBiasImpl<Callback>::run)(const int8_t *B, Index width, Index B_cols, Callback callback) = ChooseCPU(avx512vnni::Kernels8::PrepareBias<Callback>, avx512bw::Kernels8::PrepareBias<Callback>, avx2::Kernels8::PrepareBias<Callback>, ssse3::Kernels8::PrepareBias<Callback>, ssse3::Kernels8::PrepareBias<Callback>, Unsupported_8bit::PrepareBias);
+void (*Int8Shift::MultiplyReplicatedImpl<Callback>::run)(const uint8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(
+    OMPParallelWrap8ShiftReplicated<Callback, avx512vnni::Kernels8>,
+    OMPParallelWrap8ShiftReplicated<Callback, avx512bw::Kernels8>,
+    OMPParallelWrap8ShiftReplicated<Callback, avxvnni::Kernels8>,
+    OMPParallelWrap8ShiftReplicated<Callback, avx2::Kernels8>,
+    OMPParallelWrap8ShiftReplicated<Callback, ssse3::Kernels8>,
+    Unsupported_8bit::Multiply8ShiftReplicated<Callback>, Unsupported_8bit::Multiply8ShiftReplicated<Callback>);
+
+template <class Callback>
+void (*Int8Shift::PrepareBiasImpl<Callback>::run)(const int8_t *B, Index width, Index B_cols, Callback callback) = ChooseCPU(avx512vnni::Kernels8::PrepareBias<Callback>, avx512bw::Kernels8::PrepareBias<Callback>, avxvnni::Kernels8::PrepareBias<Callback>, avx2::Kernels8::PrepareBias<Callback>, ssse3::Kernels8::PrepareBias<Callback>, ssse3::Kernels8::PrepareBias<Callback>, Unsupported_8bit::PrepareBias);
 
 /*
  * 16-bit matrix multiplication
@@ -359,16 +607,25 @@ void (*Int8Shift::PrepareBiasImpl<Callback>::run)(const int8_t *B, Index width,
 struct Int16 {
   using Integer = int16_t;
 
-  // A's size must be a multiple of 1x32, B's size must be a multiple of 32x8.
+  // Multiply is fastest when A's size is a multiple of 1x32 and B's size is a
+  // multiple of 32x8, but any size works.
   static constexpr TileInfo tile_info{1, 32, 32, 8};
 
-  // Currently A is prepared by quantization but this could theoretically change.
-  // A's columns must be a multiple of 8.
-  // The number of rows is anything.
-  static inline void PrepareA(const float *input, int16_t *output, float quant_mult, Index rows, Index cols) {
-    Quantize(input, output, quant_mult, rows * cols);
+  // Elements to allocate for the output of PrepareB on any CPU.
+  static constexpr Index PreparedBSize(Index rows, Index cols) {
+    return round_up(rows, tile_info.b_rows) * round_up(cols, tile_info.b_cols);
   }
 
+  // Elements to allocate for the output of PrepareA on any CPU.
+  static constexpr Index PreparedASize(Index rows, Index cols) {
+    return rows * round_up(cols, tile_info.a_cols);
+  }
+
+  // Currently A is prepared by quantization but this could theoretically change.
+  // Any number of rows and columns.  Rows are padded with zeros, so the output
+  // depends on the CPU like that of PrepareB; see PreparedASize.
+  static void (*PrepareA)(const float *input, int16_t *output, float quant_mult, Index rows, Index cols);
+
   // Multiply floats by quant_mult then convert to 16-bit integers with saturation.
   // input
   static void (*Quantize)(const float *input, int16_t *output, float quant_mult, Index size);
@@ -392,9 +649,59 @@ struct Int16 {
   static void (*SelectColumnsB)(const int16_t *input, int16_t *output, Index rows, const Index *cols_begin, const Index *cols_end);
 
   // Multiply C = A * B, presuming A and B have been prepared.
+  // Accumulation::Wide avoids overflow at some cost in speed.
+  template <typename Callback>
+  static void Multiply(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback, Accumulation accumulation = Accumulation::Native) {
+    if (accumulation == Accumulation::Wide) {
+      MultiplyWideImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+    } else {
+      MultiplyImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+    }
+  }
+
+  // PrepareA writing A in panels of the rows the CPU's kernel multiplies at
+  // once, for MultiplyPanels (see PrepareAPanels in multiply.h).  The output
+  // has rows * cols elements and cols must be a multiple of 32.
+  static void (*PrepareAPanels)(const float *input, int16_t *output, float quant_mult, Index rows, Index cols);
+
+  // Multiply C = A * B with A from PrepareAPanels on the same CPU.  width must
+  // be a multiple of 32.
+  template <typename Callback>
+  static void MultiplyPanels(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyPanelsImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+  }
+
+  // Multiply C = A * B with B copied to every NUMA node by ReplicatedB.  Each
+  // thread reads the copy on its node.  Any shape, as for Multiply.
   template <typename Callback>
-  static void Multiply(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
-    MultiplyImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+  static void Multiply(const int16_t *A, const ReplicatedB<int16_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyReplicatedImpl<Callback>::run(A, B, A_rows, width, B_cols, callback);
+  }
+
+  // Multiply C = A * B with float A, quantized with quant_mult as it is
+  // multiplied rather than by PrepareA into a buffer first.  Same results as
+  // PrepareA then Multiply.  Any shape, as for Multiply.
+  template <typename Callback>
+  static void Multiply(const float *A, const int16_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyFloatAImpl<Callback>::run(A, width, B, quant_mult, A_rows, width, B_cols, callback);
+  }
+
+  // As above with rows of A starting A_stride >= width floats apart, so A can
+  // be columns of a larger matrix.  A needn't be aligned.  Pass the callback
+  // an output_stride to write into columns of a larger output too.
+  template <typename Callback>
+  static void Multiply(const float *A, Index A_stride, const int16_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback) {
+    MultiplyFloatAImpl<Callback>::run(A, A_stride, B, quant_mult, A_rows, width, B_cols, callback);
+  }
+
+  // For forced decoding and rescoring: the score of column targets[row] and
+  // log sum_j e^(C[row][j]) of each row of C = unquant_mult * A * B + bias,
+  // without writing C.  bias may be nullptr.  The target's log probability is
+  // target_scores[row] - log_sum_exp[row].
+  static void Score(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, float unquant_mult, const float *bias, const Index *targets, float *target_scores, float *log_sum_exp) {
+    callbacks::LogSumExp state(A_rows);
+    Multiply(A, B, A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndScore(unquant_mult, bias, targets, target_scores, &state));
+    state.Merge(log_sum_exp);
   }
 
   static const char *const kName;
@@ -404,10 +711,42 @@ private:
   struct MultiplyImpl {
     static void (*run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
   };
+
+  template <typename Callback>
+  struct MultiplyWideImpl {
+    static void (*run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
+  template <typename Callback>
+  struct MultiplyPanelsImpl {
+    static void (*run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
+  template <typename Callback>
+  struct MultiplyReplicatedImpl {
+    static void (*run)(const int16_t *A, const ReplicatedB<int16_t> &B, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
+
+  template <typename Callback>
+  struct MultiplyFloatAImpl {
+    static void (*run)(const float *A, Index A_stride, const int16_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback);
+  };
 };
 
 template <typename Callback>
-void (*Int16::MultiplyImpl<Callback>::run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrap<Callback, avx512bw::Kernels16> /*TODO VNNI 16-bit. */, OMPParallelWrap<Callback, avx512bw::Kernels16>, OMPParallelWrap<Callback, avx2::Kernels16>, OMPParallelWrap<Callback, sse2::Kernels16>, OMPParallelWrap<Callback, sse2::Kernels16>, Unsupported_16bit::Multiply<Callback>);
+void (*Int16::MultiplyImpl<Callback>::run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapBlocked<Callback, avx512vnni::Kernels16>, OMPParallelWrapBlocked<Callback, avx512bw::Kernels16>, OMPParallelWrapBlocked<Callback, avx2::Kernels16>, OMPParallelWrapBlocked<Callback, avx2::Kernels16>, OMPParallelWrapBlocked<Callback, sse2::Kernels16>, OMPParallelWrapBlocked<Callback, sse2::Kernels16>, Unsupported_16bit::Multiply<Callback>);
+
+template <typename Callback>
+void (*Int16::MultiplyWideImpl<Callback>::run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapWide<Callback, avx512vnni::Kernels16>, OMPParallelWrapWide<Callback, avx512bw::Kernels16>, OMPParallelWrapWide<Callback, avx2::Kernels16>, OMPParallelWrapWide<Callback, avx2::Kernels16>, OMPParallelWrapWide<Callback, sse2::Kernels16>, OMPParallelWrapWide<Callback, sse2::Kernels16>, Unsupported_16bit::Multiply<Callback>);
+
+template <typename Callback>
+void (*Int16::MultiplyPanelsImpl<Callback>::run)(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapPanels<Callback, avx512vnni::Kernels16>, OMPParallelWrapPanels<Callback, avx512bw::Kernels16>, OMPParallelWrapPanels<Callback, avx2::Kernels16>, OMPParallelWrapPanels<Callback, avx2::Kernels16>, OMPParallelWrapPanels<Callback, sse2::Kernels16>, OMPParallelWrapPanels<Callback, sse2::Kernels16>, Unsupported_16bit::Multiply<Callback>);
+
+template <typename Callback>
+void (*Int16::MultiplyReplicatedImpl<Callback>::run)(const int16_t *A, const ReplicatedB<int16_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(OMPParallelWrapReplicated<Callback, avx512vnni::Kernels16>, OMPParallelWrapReplicated<Callback, avx512bw::Kernels16>, OMPParallelWrapReplicated<Callback, avx2::Kernels16>, OMPParallelWrapReplicated<Callback, avx2::Kernels16>, OMPParallelWrapReplicated<Callback, sse2::Kernels16>, OMPParallelWrapReplicated<Callback, sse2::Kernels16>, Unsupported_16bit::MultiplyReplicated<Callback>);
+
+template <typename Callback>
+void (*Int16::MultiplyFloatAImpl<Callback>::run)(const float *A, Index A_stride, const int16_t *B, float quant_mult, Index A_rows, Index width, Index B_cols, Callback callback) = ChooseCPU(MultiplyFloatA<Callback, avx512vnni::Kernels16>, MultiplyFloatA<Callback, avx512bw::Kernels16>, MultiplyFloatA<Callback, avx2::Kernels16>, MultiplyFloatA<Callback, avx2::Kernels16>, MultiplyFloatA<Callback, sse2::Kernels16>, MultiplyFloatA<Callback, sse2::Kernels16>, Unsupported_16bit::MultiplyFloatA<Callback>);
 
 extern const CPUType kCPU;
 
@@ -164,6 +164,9 @@ INTGEMM_SSSE3 static inline __m128i sign_epi8(__m128i first, __m128i second) {
 template <int imm8> INTGEMM_SSE2 static inline __m128i slli_epi16(__m128i a) {
   return _mm_slli_epi16(a, imm8);
 }
+template <int imm8> INTGEMM_SSE2 static inline __m128i slli_epi32(__m128i a) {
+  return _mm_slli_epi32(a, imm8);
+}
 template <int imm8> INTGEMM_SSE2 static inline __m128i srai_epi16(__m128i a) {
   return _mm_srai_epi16(a, imm8);
 }
@@ -176,6 +179,9 @@ template <int imm8> INTGEMM_SSE2 static inline __m128i srli_epi16(__m128i a) {
 INTGEMM_SSE2 static inline void storeu_ps(float* mem_addr, __m128 a) {
   _mm_storeu_ps(mem_addr, a);
 }
+INTGEMM_SSE2 static inline __m128i sub_epi32(__m128i a, __m128i b) {
+  return _mm_sub_epi32(a, b);
+}
 INTGEMM_SSE2 static inline __m128d sub_pd(__m128d a, __m128d b) {
   return _mm_sub_pd(a, b);
 }
@@ -345,6 +351,9 @@ INTGEMM_AVX2 static inline __m256i sign_epi8(__m256i first, __m256i second) {
 template <int imm8> INTGEMM_AVX2 static inline __m256i slli_epi16(__m256i a) {
   return _mm256_slli_epi16(a, imm8);
 }
+template <int imm8> INTGEMM_AVX2 static inline __m256i slli_epi32(__m256i a) {
+  return _mm256_slli_epi32(a, imm8);
+}
 template <int imm8> INTGEMM_AVX2 static inline __m256i srai_epi16(__m256i a) {
   return _mm256_srai_epi16(a, imm8);
 }
@@ -357,6 +366,9 @@ template <int imm8> INTGEMM_AVX2 static inline __m256i srli_epi16(__m256i a) {
 INTGEMM_AVX2 static inline void storeu_ps(float* mem_addr, __m256 a) {
   _mm256_storeu_ps(mem_addr, a);
 }
+INTGEMM_AVX2 static inline __m256i sub_epi32(__m256i a, __m256i b) {
+  return _mm256_sub_epi32(a, b);
+}
 INTGEMM_AVX2 static inline __m256d sub_pd(__m256d a, __m256d b) {
   return _mm256_sub_pd(a, b);
 }
@@ -542,6 +554,9 @@ template <> INTGEMM_AVX512BW inline __m512 load_ps<__m512>(const float* from) {
 template <int imm8> INTGEMM_AVX512BW static inline __m512i slli_epi16(__m512i a) {
   return _mm512_slli_epi16(a, imm8);
 }
+template <int imm8> INTGEMM_AVX512BW static inline __m512i slli_epi32(__m512i a) {
+  return _mm512_slli_epi32(a, imm8);
+}
 template <int imm8> INTGEMM_AVX512BW static inline __m512i srai_epi16(__m512i a) {
   return _mm512_srai_epi16(a, imm8);
 }
@@ -554,6 +569,9 @@ template <int imm8> INTGEMM_AVX512BW static inline __m512i srli_epi16(__m512i a)
 INTGEMM_AVX512BW static inline void storeu_ps(float* mem_addr, __m512 a) {
   _mm512_storeu_ps(mem_addr, a);
 }
+INTGEMM_AVX512BW static inline __m512i sub_epi32(__m512i a, __m512i b) {
+  return _mm512_sub_epi32(a, b);
+}
 INTGEMM_AVX512BW static inline __m512d sub_pd(__m512d a, __m512d b) {
   return _mm512_sub_pd(a, b);
 }
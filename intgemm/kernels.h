@@ -6,7 +6,12 @@
 #include "utils.h"
 #include "vec_traits.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 
 #define KERNELS_THIS_IS_SSE2
 #include "kernels/implementations.inl"
@@ -46,6 +46,117 @@ CPU_ATTR static inline void write(vd input, double* output, Index offset) {
   *reinterpret_cast<vd*>(output + offset) = input;
 }
 
+/*
+ * Write only the first count elements (all of them if count is larger), without
+ * alignment.  Used at the right edge of an output whose number of columns is
+ * not a multiple of the register size.
+ */
+#define INTGEMM_WRITE_FIRST(Register, Type) \
+CPU_ATTR static inline void write(Register input, Type* output, Index offset, Index count) { \
+  if (count >= sizeof(Register) / sizeof(Type)) { \
+    std::memcpy(output + offset, &input, sizeof(Register)); \
+  } else { \
+    std::memcpy(output + offset, &input, count * sizeof(Type)); \
+  } \
+}
+
+INTGEMM_WRITE_FIRST(vi, int8_t)
+INTGEMM_WRITE_FIRST(vi, int16_t)
+INTGEMM_WRITE_FIRST(vd, double)
+#if defined(KERNELS_THIS_IS_SSE2)
+INTGEMM_WRITE_FIRST(vi, int)
+INTGEMM_WRITE_FIRST(vf, float)
+#elif defined(KERNELS_THIS_IS_AVX2)
+// Mask of 32-bit lanes below count.
+CPU_ATTR static inline __m256i first_mask(Index count) {
+  return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(std::min<Index>(count, 8))), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+CPU_ATTR static inline void write(vi input, int* output, Index offset, Index count) {
+  if (count >= 8) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + offset), input);
+  } else {
+    _mm256_maskstore_epi32(output + offset, first_mask(count), input);
+  }
+}
+
+CPU_ATTR static inline void write(vf input, float* output, Index offset, Index count) {
+  if (count >= 8) {
+    _mm256_storeu_ps(output + offset, input);
+  } else {
+    _mm256_maskstore_ps(output + offset, first_mask(count), input);
+  }
+}
+#else
+// Mask of 32-bit lanes below count.
+CPU_ATTR static inline __mmask16 first_kmask(Index count) {
+  return count >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << count) - 1);
+}
+
+CPU_ATTR static inline void write(vi input, int* output, Index offset, Index count) {
+  _mm512_mask_storeu_epi32(output + offset, first_kmask(count), input);
+}
+
+CPU_ATTR static inline void write(vf input, float* output, Index offset, Index count) {
+  _mm512_mask_storeu_ps(output + offset, first_kmask(count), input);
+}
+#endif
+#undef INTGEMM_WRITE_FIRST
+
+/*
+ * Write the first count elements (all of them if count is larger) stride
+ * elements apart, so that a row of output lands in a column of a column-major
+ * output.  AVX512 scatters; SSE2 and AVX2 have no scatter, so elements are
+ * stored one at a time.
+ */
+#if defined(KERNELS_THIS_IS_AVX512BW)
+// Offsets of the 16 lanes.  They are 32-bit, so 15 * stride must fit.
+CPU_ATTR static inline __m512i scatter_offsets(Index stride) {
+  assert(stride <= 0x7fffffff / 15);
+  return _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(static_cast<int>(stride)));
+}
+
+CPU_ATTR static inline void write_transposed(vi input, int* output, Index offset, Index stride, Index count) {
+  _mm512_mask_i32scatter_epi32(output + offset, first_kmask(count), scatter_offsets(stride), input, sizeof(int));
+}
+
+CPU_ATTR static inline void write_transposed(vf input, float* output, Index offset, Index stride, Index count) {
+  _mm512_mask_i32scatter_ps(output + offset, first_kmask(count), scatter_offsets(stride), input, sizeof(float));
+}
+#else
+#define INTGEMM_WRITE_TRANSPOSED(Register, Type) \
+CPU_ATTR static inline void write_transposed(Register input, Type* output, Index offset, Index stride, Index count) { \
+  Type values[sizeof(Register) / sizeof(Type)]; \
+  std::memcpy(values, &input, sizeof(Register)); \
+  const Index end = std::min<Index>(count, sizeof(Register) / sizeof(Type)); \
+  output += offset; \
+  for (Index i = 0; i < end; ++i, output += stride) { \
+    *output = values[i]; \
+  } \
+}
+
+INTGEMM_WRITE_TRANSPOSED(vi, int)
+INTGEMM_WRITE_TRANSPOSED(vf, float)
+#undef INTGEMM_WRITE_TRANSPOSED
+#endif
+
+/*
+ * Write the 8-bit integers in the first quarter of input, as left by
+ * requantize8, or only the first count of them, without alignment.
+ */
+#define INTGEMM_WRITE_QUARTER(Type) \
+CPU_ATTR static inline void write_quarter(vi input, Type* output, Index offset, Index count) { \
+  if (count >= sizeof(vi) / sizeof(int)) { \
+    std::memcpy(output + offset, &input, sizeof(vi) / sizeof(int)); \
+  } else { \
+    std::memcpy(output + offset, &input, count); \
+  } \
+}
+
+INTGEMM_WRITE_QUARTER(int8_t)
+INTGEMM_WRITE_QUARTER(uint8_t)
+#undef INTGEMM_WRITE_QUARTER
+
 /*
  * Quantize
  */
@@ -88,6 +199,110 @@ CPU_ATTR static inline vd add_bias(vd input, const double* bias_addr, Index bias
   return add_pd(input, bias_term);
 }
 
+/*
+ * Add a bias term without alignment, reading only its first count elements
+ * (all of them if count is larger).  Lanes at or past count get zero.
+ */
+#if defined(KERNELS_THIS_IS_SSE2)
+CPU_ATTR static inline vi add_bias(vi input, const int* bias_addr, Index bias_offset, Index count) {
+  if (count >= 4) {
+    return add_epi32(input, _mm_loadu_si128(reinterpret_cast<const __m128i*>(bias_addr + bias_offset)));
+  }
+  vi bias_term = setzero_si<vi>();
+  std::memcpy(&bias_term, bias_addr + bias_offset, count * sizeof(int));
+  return add_epi32(input, bias_term);
+}
+
+CPU_ATTR static inline vf add_bias(vf input, const float* bias_addr, Index bias_offset, Index count) {
+  if (count >= 4) {
+    return add_ps(input, _mm_loadu_ps(bias_addr + bias_offset));
+  }
+  vf bias_term = setzero_ps<vf>();
+  std::memcpy(&bias_term, bias_addr + bias_offset, count * sizeof(float));
+  return add_ps(input, bias_term);
+}
+#elif defined(KERNELS_THIS_IS_AVX2)
+CPU_ATTR static inline vi add_bias(vi input, const int* bias_addr, Index bias_offset, Index count) {
+  if (count >= 8) {
+    return add_epi32(input, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bias_addr + bias_offset)));
+  }
+  return add_epi32(input, _mm256_maskload_epi32(bias_addr + bias_offset, first_mask(count)));
+}
+
+CPU_ATTR static inline vf add_bias(vf input, const float* bias_addr, Index bias_offset, Index count) {
+  if (count >= 8) {
+    return add_ps(input, _mm256_loadu_ps(bias_addr + bias_offset));
+  }
+  return add_ps(input, _mm256_maskload_ps(bias_addr + bias_offset, first_mask(count)));
+}
+#else
+CPU_ATTR static inline vi add_bias(vi input, const int* bias_addr, Index bias_offset, Index count) {
+  return add_epi32(input, _mm512_maskz_loadu_epi32(first_kmask(count), bias_addr + bias_offset));
+}
+
+CPU_ATTR static inline vf add_bias(vf input, const float* bias_addr, Index bias_offset, Index count) {
+  return add_ps(input, _mm512_maskz_loadu_ps(first_kmask(count), bias_addr + bias_offset));
+}
+#endif
+
+/*
+ * Row statistics for layer norm.  statistics holds a sum and a sum of squares
+ * for each group of 8 columns of a row, in pairs.  Store those of the first
+ * count lanes of input (all of them if count is larger), which start at column
+ * col_idx.  Sums and squares are reduced together into one register.  SSE2
+ * covers a group in two calls, which come in order from the same thread, so
+ * the second adds to the first.
+ */
+#if defined(KERNELS_THIS_IS_SSE2)
+CPU_ATTR static inline void row_statistics(vf input, float* statistics, Index col_idx, Index count) {
+  if (count < 4) {
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    input = and_ps(input, _mm_castsi128_ps(_mm_cmplt_epi32(lanes, _mm_set1_epi32(static_cast<int>(count)))));
+  }
+  const vf squares = mul_ps(input, input);
+  // sum, square, sum, square
+  vf pairs = add_ps(_mm_unpacklo_ps(input, squares), _mm_unpackhi_ps(input, squares));
+  pairs = add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+  __m64* group = reinterpret_cast<__m64*>(statistics + (col_idx / 8) * 2);
+  if (col_idx % 8) {
+    pairs = add_ps(pairs, _mm_loadl_pi(setzero_ps<vf>(), group));
+  }
+  _mm_storel_pi(group, pairs);
+}
+#elif defined(KERNELS_THIS_IS_AVX2)
+CPU_ATTR static inline void row_statistics(vf input, float* statistics, Index col_idx, Index count) {
+  if (count < 8) {
+    input = and_ps(input, _mm256_castsi256_ps(first_mask(count)));
+  }
+  // Within 128-bit lanes: sum, sum, square, square.
+  vf pairs = _mm256_hadd_ps(input, mul_ps(input, input));
+  // Within 128-bit lanes: sum, square, sum, square.
+  pairs = _mm256_hadd_ps(pairs, pairs);
+  const __m128 total = _mm_add_ps(_mm256_castps256_ps128(pairs), _mm256_extractf128_ps(pairs, 1));
+  _mm_storel_pi(reinterpret_cast<__m64*>(statistics + (col_idx / 8) * 2), total);
+}
+#else
+CPU_ATTR static inline void row_statistics(vf input, float* statistics, Index col_idx, Index count) {
+  input = _mm512_maskz_mov_ps(first_kmask(count), input);
+  // Within 128-bit lanes: sum, sum, square, square then sum, square, sum, square.
+  __m256 lower = _mm512_castps512_ps256(input);
+  __m256 upper = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(input), 1));
+  lower = _mm256_hadd_ps(lower, _mm256_mul_ps(lower, lower));
+  upper = _mm256_hadd_ps(upper, _mm256_mul_ps(upper, upper));
+  // Groups: lower sum, lower square, upper sum, upper square in each 128-bit lane.
+  const __m256 both = _mm256_hadd_ps(lower, upper);
+  // Same order as the group pairs in memory.
+  const __m128 total = _mm_add_ps(_mm256_castps256_ps128(both), _mm256_extractf128_ps(both, 1));
+  float* group = statistics + (col_idx / 8) * 2;
+  // The second group is this call's only if count goes past it.
+  if (count > 8) {
+    _mm_storeu_ps(group, total);
+  } else {
+    _mm_storel_pi(reinterpret_cast<__m64*>(group), total);
+  }
+}
+#endif
+
 /*
  * ReLU
  */
@@ -219,6 +434,27 @@ CPU_ATTR static inline vi downcast16to8(vi input1, vi input2) {
 #endif
 }
 
+/*
+ * Requantize
+ *
+ * Multiply by quant_mult and saturate to 8-bit integers in [-127, 127], as
+ * Quantize does, leaving them in order in the first quarter of the register.
+ * Sums come one register at a time, so downcast32to8 packs it four times.
+ * Clamping the floats at -127 takes the place of _mm_max_epi8, which SSE2
+ * lacks, with the same results.
+ */
+CPU_ATTR static inline vi requantize8(vf input, vf quant_mult) {
+  auto rounded = cvtps_epi32(max_ps(mul_ps(input, quant_mult), set1_ps<vf>(-127.0f)));
+  return downcast32to8(rounded, rounded, rounded, rounded);
+}
+
+/*
+ * requantize8 plus 127, in [0, 254] like QuantizeU, for Int8Shift.
+ */
+CPU_ATTR static inline vi requantize8u(vf input, vf quant_mult) {
+  return add_epi8(requantize8(input, quant_mult), set1_epi8<vi>(127));
+}
+
 /*
  * Upcast
  */
@@ -328,11 +564,6 @@ CPU_ATTR static inline vf floor(vf input) {
 /*
  * Calculate approximation of e^x using Taylor series and lookup table
  */
-#if defined(KERNELS_THIS_IS_SSE2)
-CPU_ATTR static inline vf exp_approx_taylor(vf) {
-  std::abort();
-}
-#else
 CPU_ATTR static inline vf exp_approx_taylor(vf x) {
   static constexpr int EXP_MIN = -20;
   static constexpr int EXP_MAX = 20;
@@ -382,22 +613,21 @@ CPU_ATTR static inline vf exp_approx_taylor(vf x) {
 
   result = add_ps(result, const_one);
 
+#if defined(KERNELS_THIS_IS_SSE2)
+  // No gather before AVX2; look the four up one at a time.
+  alignas(16) int32_t indices[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(indices), cvtps_epi32(a));
+  auto ea = _mm_setr_ps(EXP_LOOKUP[indices[0] + EXP_MAX], EXP_LOOKUP[indices[1] + EXP_MAX], EXP_LOOKUP[indices[2] + EXP_MAX], EXP_LOOKUP[indices[3] + EXP_MAX]);
+#else
   auto ea = i32gather_ps<4>(EXP_LOOKUP + EXP_MAX, cvtps_epi32(a));
+#endif
   return mul_ps(ea, result);
 }
-#endif
 
 /*
  * Sigmoid
  */
-CPU_ATTR static inline vf sigmoid(vf
-#ifndef KERNELS_THIS_IS_SSE2
-    input
-#endif
-    ) {
-#if defined(KERNELS_THIS_IS_SSE2)
-  std::abort(); // TODO: missing exp_approx_taylor for SSE2
-#elif defined(KERNELS_THIS_IS_AVX2)
+CPU_ATTR static inline vf sigmoid(vf input) {
   static const auto vconst_zero = setzero_ps<vf>();
   static const auto vconst_one = set1_ps<vf>(1.f);
 
@@ -406,20 +636,19 @@ CPU_ATTR static inline vf sigmoid(vf
   auto e_x = exp_approx_taylor(x);
   auto e_minus_x = exp_approx_taylor(minus_x);
 
+#if defined(KERNELS_THIS_IS_SSE2)
+  auto sigmoid_case1 = _mm_rcp_ps(add_ps(vconst_one, e_minus_x));
+  auto sigmoid_case2 = mul_ps(e_x, _mm_rcp_ps(add_ps(vconst_one, e_x)));
+
+  auto nonnegative_x_mask = _mm_cmplt_ps(vconst_zero, x);
+  return _mm_or_ps(and_ps(nonnegative_x_mask, sigmoid_case2), andnot_ps(nonnegative_x_mask, sigmoid_case1));
+#elif defined(KERNELS_THIS_IS_AVX2)
   auto sigmoid_case1 = _mm256_rcp_ps(add_ps(vconst_one, e_minus_x));
   auto sigmoid_case2 = mul_ps(e_x, _mm256_rcp_ps(add_ps(vconst_one, e_x)));
 
   auto nonnegative_x_mask = _mm256_cmp_ps(vconst_zero, x, _CMP_LT_OS);
   return _mm256_blendv_ps(sigmoid_case1, sigmoid_case2, nonnegative_x_mask);
 #else
-  static const auto vconst_zero = setzero_ps<vf>();
-  static const auto vconst_one = set1_ps<vf>(1.f);
-
-  auto x = input;
-  auto minus_x = sub_ps(vconst_zero, x);
-  auto e_x = exp_approx_taylor(x);
-  auto e_minus_x = exp_approx_taylor(minus_x);
-
   auto sigmoid_case1 = _mm512_rcp14_ps(add_ps(vconst_one, e_minus_x));
   auto sigmoid_case2 = mul_ps(e_x, _mm512_rcp14_ps(add_ps(vconst_one, e_x)));
 
@@ -431,11 +660,6 @@ CPU_ATTR static inline vf sigmoid(vf
 /*
  * Tanh
  */
-#if defined(KERNELS_THIS_IS_SSE2)
-CPU_ATTR static inline vf tanh(vf) {
-  std::abort(); // TODO: missing exp_approx_taylor for SSE2
-}
-#else
 CPU_ATTR static inline vf tanh(vf input) {
   const static auto vconst_zero = setzero_ps<vf>();
 
@@ -444,6 +668,161 @@ CPU_ATTR static inline vf tanh(vf input) {
 
   return div_ps(sub_ps(e_x, e_minus_x), add_ps(e_x, e_minus_x));
 }
+
+/*
+ * GELU, tanh approximation: 0.5 x (1 + tanh(sqrt(2 / pi) (x + 0.044715 x^3))),
+ * computed as x sigmoid(2 sqrt(2 / pi) (x + 0.044715 x^3)).
+ */
+CPU_ATTR static inline vf gelu(vf input) {
+  static const auto vconst_outer = set1_ps<vf>(1.5957691216057308f /* 2 sqrt(2 / pi) */);
+  static const auto vconst_cubic = set1_ps<vf>(0.044715f);
+
+  auto inner = mul_ps(input, add_ps(set1_ps<vf>(1.f), mul_ps(vconst_cubic, mul_ps(input, input))));
+  return mul_ps(input, sigmoid(mul_ps(vconst_outer, inner)));
+}
+
+/*
+ * SiLU (swish): x sigmoid(x)
+ */
+CPU_ATTR static inline vf silu(vf input) {
+  return mul_ps(input, sigmoid(input));
+}
+
+/*
+ * Softmax statistics.  As row_statistics, but the pair for each group of 8
+ * columns is the group's max and the sum of e^(x - max) over the group, so
+ * groups rescale to a common max when combined.  SSE2's second call for a
+ * group rescales the first's sum or its own to the larger max.
+ */
+#if defined(KERNELS_THIS_IS_SSE2)
+CPU_ATTR static inline void softmax_statistics(vf input, float* statistics, Index col_idx, Index count) {
+  const __m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(std::min<Index>(count, 4)))));
+  input = _mm_or_ps(and_ps(valid, input), andnot_ps(valid, set1_ps<vf>(-FLT_MAX)));
+  // Max in every lane.
+  vf highest = max_ps(input, _mm_shuffle_ps(input, input, 0x4e));
+  highest = max_ps(highest, _mm_shuffle_ps(highest, highest, 0xb1));
+  vf sum = and_ps(valid, exp_approx_taylor(sub_ps(input, highest)));
+  sum = add_ps(sum, _mm_shuffle_ps(sum, sum, 0x4e));
+  sum = add_ps(sum, _mm_shuffle_ps(sum, sum, 0xb1));
+  float* group = statistics + (col_idx / 8) * 2;
+  float group_max = _mm_cvtss_f32(highest), group_sum = _mm_cvtss_f32(sum);
+  if (col_idx % 8) {
+    // e^-|difference| scales the sum with the smaller max.
+    const float difference = group[0] - group_max;
+    const float scale = std::exp(-std::fabs(difference));
+    if (difference > 0) {
+      group_sum = group_sum * scale + group[1];
+      group_max = group[0];
+    } else {
+      group_sum += group[1] * scale;
+    }
+  }
+  group[0] = group_max;
+  group[1] = group_sum;
+}
+#elif defined(KERNELS_THIS_IS_AVX2)
+CPU_ATTR static inline void softmax_statistics(vf input, float* statistics, Index col_idx, Index count) {
+  const __m256 valid = _mm256_castsi256_ps(first_mask(count));
+  input = _mm256_blendv_ps(set1_ps<vf>(-FLT_MAX), input, valid);
+  // Max in every lane.
+  vf highest = max_ps(input, _mm256_permute2f128_ps(input, input, 1));
+  highest = max_ps(highest, _mm256_shuffle_ps(highest, highest, 0x4e));
+  highest = max_ps(highest, _mm256_shuffle_ps(highest, highest, 0xb1));
+  vf sum = and_ps(valid, exp_approx_taylor(sub_ps(input, highest)));
+  sum = add_ps(sum, _mm256_permute2f128_ps(sum, sum, 1));
+  sum = add_ps(sum, _mm256_shuffle_ps(sum, sum, 0x4e));
+  sum = add_ps(sum, _mm256_shuffle_ps(sum, sum, 0xb1));
+  float* group = statistics + (col_idx / 8) * 2;
+  group[0] = _mm256_cvtss_f32(highest);
+  group[1] = _mm256_cvtss_f32(sum);
+}
+#else
+CPU_ATTR static inline void softmax_statistics(vf input, float* statistics, Index col_idx, Index count) {
+  const __mmask16 valid = first_kmask(count);
+  input = _mm512_mask_mov_ps(set1_ps<vf>(-FLT_MAX), valid, input);
+  // Max of each group of 8 in each of its lanes.
+  vf highest = max_ps(input, _mm512_shuffle_f32x4(input, input, 0xb1));
+  highest = max_ps(highest, _mm512_shuffle_ps(highest, highest, 0x4e));
+  highest = max_ps(highest, _mm512_shuffle_ps(highest, highest, 0xb1));
+  vf sum = _mm512_maskz_mov_ps(valid, exp_approx_taylor(sub_ps(input, highest)));
+  sum = add_ps(sum, _mm512_shuffle_f32x4(sum, sum, 0xb1));
+  sum = add_ps(sum, _mm512_shuffle_ps(sum, sum, 0x4e));
+  sum = add_ps(sum, _mm512_shuffle_ps(sum, sum, 0xb1));
+  float* group = statistics + (col_idx / 8) * 2;
+  group[0] = _mm512_cvtss_f32(highest);
+  group[1] = _mm512_cvtss_f32(sum);
+  // The second group is this call's only if count goes past it.
+  if (count > 8) {
+    group[2] = _mm_cvtss_f32(_mm512_extractf32x4_ps(highest, 2));
+    group[3] = _mm_cvtss_f32(_mm512_extractf32x4_ps(sum, 2));
+  }
+}
+#endif
+
+/*
+ * Bit i is set if lane i is at least threshold, for lanes below count.  Top k
+ * selection filters a register with it so only candidates leave registers.
+ */
+#if defined(KERNELS_THIS_IS_SSE2)
+CPU_ATTR static inline unsigned at_least_mask(vf input, float threshold, Index count) {
+  const unsigned valid = count >= 4 ? 0xf : (1u << count) - 1;
+  return static_cast<unsigned>(_mm_movemask_ps(_mm_cmpge_ps(input, set1_ps<vf>(threshold)))) & valid;
+}
+#elif defined(KERNELS_THIS_IS_AVX2)
+CPU_ATTR static inline unsigned at_least_mask(vf input, float threshold, Index count) {
+  const unsigned valid = count >= 8 ? 0xff : (1u << count) - 1;
+  return static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(input, set1_ps<vf>(threshold), _CMP_GE_OQ))) & valid;
+}
+#else
+CPU_ATTR static inline unsigned at_least_mask(vf input, float threshold, Index count) {
+  return _mm512_mask_cmp_ps_mask(first_kmask(count), input, set1_ps<vf>(threshold), _CMP_GE_OQ);
+}
+#endif
+
+/*
+ * Online log-sum-exp, lane by lane.  highest and sum hold a register each of
+ * the running max and sum of e^(x - max); lanes at or past count are left
+ * out.  The sum is rescaled only when a max goes up, which gets rare as a row
+ * goes on, so it usually costs one exp per register.  Start with highest at
+ * -FLT_MAX and sum at 0.
+ */
+#if defined(KERNELS_THIS_IS_SSE2)
+CPU_ATTR static inline void online_log_sum_exp(vf input, float* highest, float* sum, Index count) {
+  const __m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(std::min<Index>(count, 4)))));
+  input = _mm_or_ps(and_ps(valid, input), andnot_ps(valid, set1_ps<vf>(-FLT_MAX)));
+  vf running_max = load_ps<vf>(highest), running_sum = load_ps<vf>(sum);
+  if (_mm_movemask_ps(_mm_cmpgt_ps(input, running_max))) {
+    const vf new_max = max_ps(running_max, input);
+    running_sum = mul_ps(running_sum, exp_approx_taylor(sub_ps(running_max, new_max)));
+    running_max = new_max;
+    *reinterpret_cast<vf*>(highest) = running_max;
+  }
+  *reinterpret_cast<vf*>(sum) = add_ps(running_sum, and_ps(valid, exp_approx_taylor(sub_ps(input, running_max))));
+}
+#elif defined(KERNELS_THIS_IS_AVX2)
+CPU_ATTR static inline void online_log_sum_exp(vf input, float* highest, float* sum, Index count) {
+  const __m256 valid = _mm256_castsi256_ps(first_mask(count));
+  input = _mm256_blendv_ps(set1_ps<vf>(-FLT_MAX), input, valid);
+  vf running_max = load_ps<vf>(highest), running_sum = load_ps<vf>(sum);
+  if (_mm256_movemask_ps(_mm256_cmp_ps(input, running_max, _CMP_GT_OQ))) {
+    const vf new_max = max_ps(running_max, input);
+    running_sum = mul_ps(running_sum, exp_approx_taylor(sub_ps(running_max, new_max)));
+    running_max = new_max;
+    *reinterpret_cast<vf*>(highest) = running_max;
+  }
+  *reinterpret_cast<vf*>(sum) = add_ps(running_sum, and_ps(valid, exp_approx_taylor(sub_ps(input, running_max))));
+}
+#else
+CPU_ATTR static inline void online_log_sum_exp(vf input, float* highest, float* sum, Index count) {
+  const __mmask16 valid = first_kmask(count);
+  vf running_max = load_ps<vf>(highest), running_sum = load_ps<vf>(sum);
+  if (_mm512_mask_cmp_ps_mask(valid, input, running_max, _CMP_GT_OQ)) {
+    running_max = _mm512_mask_max_ps(running_max, valid, running_max, input);
+    running_sum = mul_ps(running_sum, exp_approx_taylor(sub_ps(load_ps<vf>(highest), running_max)));
+    *reinterpret_cast<vf*>(highest) = running_max;
+  }
+  *reinterpret_cast<vf*>(sum) = _mm512_mask_add_ps(running_sum, valid, running_sum, exp_approx_taylor(sub_ps(input, running_max)));
+}
 #endif
 
 }
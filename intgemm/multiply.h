@@ -5,9 +5,76 @@
 #include "intrinsics.h"
 #include "vec_traits.h"
 #include "callbacks.h"
+#include "aligned.h"
+#include "numa.h"
+#include "thread_pool.h"
+#include "workspace.h"
+#include "stats.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 namespace intgemm {
 
+/* Software prefetch in the inner loops of Multiply, set at run time through
+ * SoftwarePrefetch.  While the first rows of A go over a strip of B, each step
+ * (8 registers of B against a register of each row) prefetches the step
+ * B_distance bytes further on, which runs into the next strip at the end of
+ * this one.  Later rows find the strip in cache.  Hardware prefetchers stop at
+ * page boundaries, so this pays off when B is cold, mostly with few rows of A.
+ * With A_next_row, a step also prefetches the same step of the row of A after
+ * the ones being multiplied.  Multiply reads the settings once per call.
+ * The defaults are in intgemm.cc.
+ */
+struct PrefetchConfig {
+  // Bytes ahead in B, 0 for none.  Rounded down to whole steps of a strip.
+  Index B_distance;
+  bool A_next_row;
+};
+extern PrefetchConfig SoftwarePrefetch;
+
+/* What one row block prefetches each step. */
+class Prefetcher {
+  public:
+    // first_rows says whether these are the first rows of A to multiply by
+    // the strip.  B_step is the bytes of B per step.  A_next is how far the
+    // next row of A is from the current one in bytes, 0 if there isn't one.
+    Prefetcher(const PrefetchConfig &config, bool first_rows, std::size_t B_step, std::size_t A_next)
+      : B_ahead_(first_rows ? config.B_distance / B_step * B_step : 0), A_ahead_(config.A_next_row ? A_next : 0) {}
+
+    // Whether Step does anything.  Otherwise pass NoPrefetch to keep the
+    // checks out of the loop.
+    bool Any() const { return B_ahead_ || A_ahead_; }
+
+    template <class Register> INTGEMM_INLINE void Step(const Register *B_live, const Register *A_live) const {
+      if (B_ahead_) {
+        const char *B_at = reinterpret_cast<const char*>(B_live) + B_ahead_;
+        for (std::size_t line = 0; line < 8 * sizeof(Register); line += 64) {
+          _mm_prefetch(B_at + line, _MM_HINT_T0);
+        }
+      }
+      if (A_ahead_) {
+        _mm_prefetch(reinterpret_cast<const char*>(A_live) + A_ahead_, _MM_HINT_T0);
+      }
+    }
+
+  private:
+    std::size_t B_ahead_;
+    std::size_t A_ahead_;
+};
+
+/* Stands in for a Prefetcher with nothing to do. */
+struct NoPrefetch {
+  template <class Register> INTGEMM_INLINE void Step(const Register *, const Register *) const {}
+};
+
 INTGEMM_SSE2 static inline dvector_t<CPUType::SSE2, int> PermuteSummer(__m128i pack0123, __m128i pack4567) {
   // No op for 128 bits: already reduced fully.
   return { pack0123, pack4567 };
@@ -34,6 +101,18 @@ INTGEMM_AVX512BW static inline __m256i PermuteSummer(__m512i pack0123, __m512i p
   // Fold register over itself.
   return _mm256_add_epi32(_mm512_castsi512_si256(added), _mm512_extracti64x4_epi64(added, 1));
 }
+
+/* Reduce 16 columns to one register for the 512-bit callbacks.  Each pack has
+ * four columns in every 128-bit lane from Pack0123.  Transposing lanes while
+ * adding takes fewer instructions than two calls of the 8-column version.
+ */
+INTGEMM_AVX512BW static inline __m512i PermuteSummer(__m512i pack0123, __m512i pack4567, __m512i pack89ab, __m512i packcdef) {
+  // Lanes 0 and 1 of two packs plus their lanes 2 and 3.
+  __m512i mix0 = _mm512_add_epi32(_mm512_shuffle_i32x4(pack0123, pack4567, 0x44), _mm512_shuffle_i32x4(pack0123, pack4567, 0xee));
+  __m512i mix1 = _mm512_add_epi32(_mm512_shuffle_i32x4(pack89ab, packcdef, 0x44), _mm512_shuffle_i32x4(pack89ab, packcdef, 0xee));
+  // Even lanes plus odd lanes, leaving the packs in order.
+  return _mm512_add_epi32(_mm512_shuffle_i32x4(mix0, mix1, 0x88), _mm512_shuffle_i32x4(mix0, mix1, 0xdd));
+}
 #endif
 
 #ifdef _MSC_VER
@@ -56,15 +135,27 @@ target static void QuantizeThread(const float *input, int8_t *output, float quan
   } \
 }
 
+/* Floats per task when Quantize runs on SharedThreadPool, a multiple of every
+ * batch.
+ */
+static const std::size_t kQuantizeChunk = 16384;
+
 #define INTGEMM_QUANTIZE(target) \
 target static void Quantize(const float *const input, int8_t *const output, float quant_mult, Index size) { \
   assert(reinterpret_cast<uintptr_t>(input) % sizeof(Register) == 0); \
   assert(reinterpret_cast<uintptr_t>(output) % sizeof(Register) == 0); \
   const std::size_t kBatch = sizeof(Register); \
   const std::size_t fast_end = size & ~(kBatch - 1); \
-  INTGEMM_OMP_PARALLEL \
-  { \
-    QuantizeThread(input, output, quant_mult, fast_end); \
+  if (ThreadPool *pool = SharedThreadPool) { \
+    pool->ParallelFor(static_cast<Index>((fast_end + kQuantizeChunk - 1) / kQuantizeChunk), [=](Index chunk) { \
+      const std::size_t begin = chunk * kQuantizeChunk; \
+      QuantizeThread(input + begin, output + begin, quant_mult, std::min(kQuantizeChunk, fast_end - begin)); \
+    }); \
+  } else { \
+    INTGEMM_OMP_PARALLEL \
+    { \
+      QuantizeThread(input, output, quant_mult, fast_end); \
+    } \
   } \
   std::size_t overhang = size & (kBatch - 1); \
   if (!overhang) return; \
@@ -84,6 +175,62 @@ target static void Quantize(const float *const input, int8_t *const output, floa
   std::memcpy(output + (size & ~(kBatch - 1)), &result, overhang); \
 }
 
+/* Quantize rows of input, cols floats each starting input_stride floats
+ * apart, to output rows of padded_cols, a multiple of the register size, with
+ * QuantizeTile on one thread.  Columns past cols are zero, as in
+ * PrepareAPadded.
+ * Input needn't be aligned.  Used by MultiplyFloatA, which calls it from
+ * inside parallel regions.
+ */
+#define INTGEMM_QUANTIZE_ROWS(target, Integer, QuantizeTile) \
+target static void QuantizeRows(const float *input, Integer *output, float quant_mult, Index rows, Index cols, Index padded_cols, Index input_stride) { \
+  const Index kBatch = sizeof(Register) / sizeof(Integer); \
+  assert(padded_cols % kBatch == 0 && padded_cols >= cols); \
+  assert(input_stride >= cols); \
+  assert(reinterpret_cast<uintptr_t>(output) % sizeof(Register) == 0); \
+  const FRegister q = set1_ps<FRegister>(quant_mult); \
+  const Index fast_cols = cols - cols % kBatch; \
+  for (Index r = 0; r < rows; ++r, input += input_stride, output += padded_cols) { \
+    Register *out = reinterpret_cast<Register*>(output); \
+    Index c = 0; \
+    for (; c < fast_cols; c += kBatch) { \
+      *out++ = QuantizeTile::Consecutive(q, input + c); \
+    } \
+    if (c < cols) { \
+      alignas(64) float padded[kBatch] = {0}; \
+      std::memcpy(padded, input + c, (cols - c) * sizeof(float)); \
+      *out++ = QuantizeTile::Consecutive(q, padded); \
+      c += kBatch; \
+    } \
+    for (; c < padded_cols; c += kBatch) { \
+      *out++ = setzero_si<Register>(); \
+    } \
+  } \
+}
+
+/* Largest absolute value of count floats on the calling thread alone, for
+ * PrepareADynamic, which shards the work itself.  input must be aligned to the
+ * register size.  max(x, -x) rather than masking the sign keeps AVX512 to
+ * AVX512F.
+ */
+#define INTGEMM_MAX_ABSOLUTE_SERIAL(target) \
+target static float MaxAbsoluteSerial(const float *input, std::size_t count) { \
+  assert(reinterpret_cast<uintptr_t>(input) % sizeof(FRegister) == 0); \
+  const std::size_t kBatch = sizeof(FRegister) / sizeof(float); \
+  const std::size_t fast_end = count & ~(kBatch - 1); \
+  const FRegister zero = setzero_ps<FRegister>(); \
+  FRegister highest = zero; \
+  for (std::size_t i = 0; i < fast_end; i += kBatch) { \
+    const FRegister value = *reinterpret_cast<const FRegister*>(input + i); \
+    highest = max_ps(highest, max_ps(value, sub_ps(zero, value))); \
+  } \
+  float ret = MaxFloat32(highest); \
+  for (std::size_t i = fast_end; i < count; ++i) { \
+    ret = std::max(ret, std::fabs(input[i])); \
+  } \
+  return ret; \
+}
+
 /* Take 4 registers with 32-bit values to be horizontally added.  Reduce them
  * to one register with 32-bit values in the pattern 1 2 3 4 1 2 3 4, leaving
  * the final addition (which crosses 128-bit lanes) to the caller. 
@@ -108,7 +255,10 @@ INTGEMM_PACK0123(INTGEMM_AVX512BW, __m512i)
 template <typename Callback>
 INTGEMM_SSE2 static inline void RunCallback(Callback& callback_impl, dvector_t<CPUType::SSE2, int> total, Index row_idx, Index col_idx, Index rows, Index cols) {
   callback_impl(total.first, callbacks::OutputBufferInfo(row_idx, col_idx, rows, cols));
-  callback_impl(total.second, callbacks::OutputBufferInfo(row_idx, col_idx + 4, rows, cols));
+  // The second half may be entirely past the last column.
+  if (col_idx + 4 < cols) {
+    callback_impl(total.second, callbacks::OutputBufferInfo(row_idx, col_idx + 4, rows, cols));
+  }
 }
 
 template <typename Callback>
@@ -116,7 +266,182 @@ INTGEMM_AVX2 static inline void RunCallback(Callback& callback_impl, vector_t<CP
   callback_impl(total, callbacks::OutputBufferInfo(row_idx, col_idx, rows, cols));
 }
 
-// 16-bit multiplier for INTGEMM_SSE2, INTGEMM_AVX2, and AVX512.
+/* Move 8 sums between memory and the type RunCallback takes. */
+INTGEMM_SSE2 static inline void StoreTotal(dvector_t<CPUType::SSE2, int> from, int32_t *to) {
+  *reinterpret_cast<__m128i*>(to) = from.first;
+  *reinterpret_cast<__m128i*>(to + 4) = from.second;
+}
+INTGEMM_AVX2 static inline void StoreTotal(__m256i from, int32_t *to) {
+  *reinterpret_cast<__m256i*>(to) = from;
+}
+INTGEMM_SSE2 static inline void LoadTotal(const int32_t *from, dvector_t<CPUType::SSE2, int> &to) {
+  to.first = *reinterpret_cast<const __m128i*>(from);
+  to.second = *reinterpret_cast<const __m128i*>(from + 4);
+}
+INTGEMM_AVX2 static inline void LoadTotal(const int32_t *from, __m256i &to) {
+  to = *reinterpret_cast<const __m256i*>(from);
+}
+
+/* Multiply rows [A_rowidx_begin, A_rowidx_end) of A by columns
+ * [B_colidx_begin, B_colidx_end) of B, summing only over
+ * [width_begin, width_end) of the inner dimension.  This is single-threaded;
+ * MultiplyBlocked calls it on cache-sized blocks.  Callbacks see the same
+ * OutputBufferInfo as Multiply.
+ *
+ * Column bounds must be multiples of 8 (or B_cols) and width bounds multiples
+ * of the register size.  Uses the kernel's MultiplyRowBlock and kMultiplyRows.
+ * Blocks are sized to stay in cache, so there is no software prefetch.
+ */
+#define INTGEMM_MULTIPLY_BLOCK(Integer, Register, target, cpu_type) \
+template <typename Callback> target static void MultiplyBlock(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B_colidx_begin, Index B_colidx_end, Index width_begin, Index width_end, Callback callback) { \
+  assert(width % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(width_begin % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(width_end % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(B_colidx_begin % 8 == 0); \
+  assert(B_colidx_end % 8 == 0 || B_colidx_end == B_cols); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index simd_width = width / (sizeof(Register) / sizeof(Integer)); \
+  const Index k_begin = width_begin / (sizeof(Register) / sizeof(Integer)); \
+  const Index k_count = (width_end - width_begin) / (sizeof(Register) / sizeof(Integer)); \
+  auto callback_impl = callbacks::CallbackImpl<cpu_type, Callback>(callback); \
+  for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) { \
+    const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx + k_begin * 8; \
+    Index A_rowidx = A_rowidx_begin; \
+    for (; A_rowidx + kMultiplyRows <= A_rowidx_end; A_rowidx += kMultiplyRows) { \
+      MultiplyRowBlock<kMultiplyRows>(reinterpret_cast<const Register*>(A + A_rowidx * width) + k_begin, simd_width, B0_col, k_count, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+    } \
+    for (; A_rowidx < A_rowidx_end; ++A_rowidx) { \
+      MultiplyRowBlock<1>(reinterpret_cast<const Register*>(A + A_rowidx * width) + k_begin, simd_width, B0_col, k_count, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+    } \
+  } \
+} \
+
+/* Multiply and MultiplyBlock for AVX512 kernels, which work on tiles of 16
+ * columns: two strips of 8 columns in the layout of PrepareB.  Both strips are
+ * reduced to one __m512i with one call per row to the 512-bit callbacks,
+ * halving the epilogue of two 256-bit callbacks.  If the columns or a block of
+ * them end 8 past a tile, the last tile has just the first strip; its upper
+ * half is zero and the callback gets OutputBufferInfo::col_end so it touches
+ * only the first 8 columns.  MultiplyPanels is Multiply for A from
+ * PrepareAPanels.
+ *
+ * The kernel defines kMultiplyRows, MultiplyRows<kRows> with Zero, Stash
+ * (reduce the first strip) and Finish (reduce the second and run the
+ * callback), and AccumulateStrip to sum one strip of B into the rows.  It
+ * reads register k of row r at A_row[r * A_stride + k * A_step]: A_stride is
+ * the row width and A_step 1 in row-major order, and the other way around in
+ * panels.  It calls Step on the Prefetcher or NoPrefetch once per step.
+ */
+#define INTGEMM_MULTIPLY_TILE16(Integer, target) \
+/* Multiply kRows rows of A by the strips of B at B0_col and B1_col, or only \
+   B0_col if B1_col is null.  The callback touches columns below B_colidx_end. */ \
+template <Index kRows, class Prefetch, typename CallbackImpl> target static inline void MultiplyRowBlock(const Register *A_row, Index A_stride, Index A_step, const Register *B0_col, const Register *B1_col, Index k_count, const Prefetch &prefetch, Index A_rowidx, Index A_rows, Index B0_colidx, Index B_cols, Index B_colidx_end, CallbackImpl &callback_impl) { \
+  MultiplyRows<kRows> rows; \
+  AccumulateStrip(rows, A_row, A_stride, A_step, B0_col, k_count, prefetch); \
+  rows.Stash(); \
+  if (B1_col) { \
+    AccumulateStrip(rows, A_row, A_stride, A_step, B1_col, k_count, prefetch); \
+  } else { \
+    rows.Zero(setzero_si<Register>()); \
+  } \
+  rows.Finish(callback_impl, A_rowidx, B0_colidx, A_rows, B_cols, B_colidx_end); \
+} \
+/* Rows [A_rowidx_begin, A_rowidx_end) of A by the tile of B at B0_colidx, \
+   summing k_count registers from k_begin.  With kPanels, A is in panels and \
+   the rows must be all of A; panels are one stream, so there is no prefetch \
+   of the next row. */ \
+template <bool kPanels, typename CallbackImpl> target static inline void MultiplyTile(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B0_colidx, Index B_colidx_end, Index k_begin, Index k_count, const PrefetchConfig &prefetch_config, CallbackImpl &callback_impl) { \
+  const Index simd_width = width / (sizeof(Register) / sizeof(Integer)); \
+  const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx + k_begin * 8; \
+  const Register *B1_col = B0_colidx + 8 < B_colidx_end ? B0_col + simd_width * 8 : nullptr; \
+  /* Callbacks stop here even if the tile goes on into the next block. */ \
+  const Index col_end = std::min(B_colidx_end, B_cols); \
+  /* Process kMultiplyRows rows of A at a time so they share each load of B, then finish the leftover rows one at a time.*/ \
+  Index A_rowidx = A_rowidx_begin; \
+  for (; A_rowidx + kMultiplyRows <= A_rowidx_end; A_rowidx += kMultiplyRows) { \
+    const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width) + (kPanels ? k_begin * kMultiplyRows : k_begin); \
+    const Index A_stride = kPanels ? 1 : simd_width; \
+    const Index A_step = kPanels ? kMultiplyRows : 1; \
+    const Prefetcher prefetch(prefetch_config, A_rowidx == A_rowidx_begin, 8 * sizeof(Register), !kPanels && A_rowidx + kMultiplyRows < A_rowidx_end ? kMultiplyRows * width * sizeof(Integer) : 0); \
+    if (prefetch.Any()) { \
+      MultiplyRowBlock<kMultiplyRows>(A_row, A_stride, A_step, B0_col, B1_col, k_count, prefetch, A_rowidx, A_rows, B0_colidx, B_cols, col_end, callback_impl); \
+    } else { \
+      MultiplyRowBlock<kMultiplyRows>(A_row, A_stride, A_step, B0_col, B1_col, k_count, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, col_end, callback_impl); \
+    } \
+  } \
+  /* The last panel interleaves however many rows are left. */ \
+  const Index A_left = A_rowidx_end - A_rowidx; \
+  const Register *A_last = reinterpret_cast<const Register*>(A + A_rowidx * width); \
+  for (Index r = 0; r < A_left; ++r) { \
+    const Register *A_row = kPanels ? A_last + r + k_begin * A_left : A_last + r * simd_width + k_begin; \
+    const Index A_stride = kPanels ? 1 : simd_width; \
+    const Index A_step = kPanels ? A_left : 1; \
+    const Prefetcher prefetch(prefetch_config, A_rowidx + r == A_rowidx_begin, 8 * sizeof(Register), !kPanels && r + 1 < A_left ? width * sizeof(Integer) : 0); \
+    if (prefetch.Any()) { \
+      MultiplyRowBlock<1>(A_row, A_stride, A_step, B0_col, B1_col, k_count, prefetch, A_rowidx + r, A_rows, B0_colidx, B_cols, col_end, callback_impl); \
+    } else { \
+      MultiplyRowBlock<1>(A_row, A_stride, A_step, B0_col, B1_col, k_count, NoPrefetch(), A_rowidx + r, A_rows, B0_colidx, B_cols, col_end, callback_impl); \
+    } \
+  } \
+} \
+template <typename Callback> target static void Multiply(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+  assert(width % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index simd_width = width / (sizeof(Register) / sizeof(Integer)); \
+  auto callback_impl = callbacks::CallbackImpl<CPUType::AVX512BW, Callback>(callback); \
+  const PrefetchConfig prefetch_config = SoftwarePrefetch; \
+  INTGEMM_OMP_FOR \
+  for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 16) { \
+    MultiplyTile<false>(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B_cols, 0, simd_width, prefetch_config, callback_impl); \
+  } \
+} \
+template <typename Callback> target static void MultiplyPanels(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+  assert(width % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index simd_width = width / (sizeof(Register) / sizeof(Integer)); \
+  auto callback_impl = callbacks::CallbackImpl<CPUType::AVX512BW, Callback>(callback); \
+  const PrefetchConfig prefetch_config = SoftwarePrefetch; \
+  INTGEMM_OMP_FOR \
+  for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 16) { \
+    MultiplyTile<true>(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B_cols, 0, simd_width, prefetch_config, callback_impl); \
+  } \
+} \
+/* MultiplyPanels for columns [B_colidx_begin, B_colidx_end) of B on one \
+   thread, with the same bounds as MultiplyBlock. */ \
+template <typename Callback> target static void MultiplyPanelsBlock(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) { \
+  assert(width % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(B_colidx_begin % 8 == 0); \
+  assert(B_colidx_end % 8 == 0 || B_colidx_end == B_cols); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index simd_width = width / (sizeof(Register) / sizeof(Integer)); \
+  auto callback_impl = callbacks::CallbackImpl<CPUType::AVX512BW, Callback>(callback); \
+  const PrefetchConfig prefetch_config = SoftwarePrefetch; \
+  for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 16) { \
+    MultiplyTile<true>(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B_colidx_end, 0, simd_width, prefetch_config, callback_impl); \
+  } \
+} \
+/* Same contract as INTGEMM_MULTIPLY_BLOCK. */ \
+template <typename Callback> target static void MultiplyBlock(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B_colidx_begin, Index B_colidx_end, Index width_begin, Index width_end, Callback callback) { \
+  assert(width % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(width_begin % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(width_end % (sizeof(Register) / sizeof(Integer)) == 0); \
+  assert(B_colidx_begin % 8 == 0); \
+  assert(B_colidx_end % 8 == 0 || B_colidx_end == B_cols); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index k_begin = width_begin / (sizeof(Register) / sizeof(Integer)); \
+  const Index k_count = (width_end - width_begin) / (sizeof(Register) / sizeof(Integer)); \
+  auto callback_impl = callbacks::CallbackImpl<CPUType::AVX512BW, Callback>(callback); \
+  for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 16) { \
+    MultiplyTile<false>(A, B, A_rows, width, B_cols, A_rowidx_begin, A_rowidx_end, B0_colidx, B_colidx_end, k_begin, k_count, PrefetchConfig(), callback_impl); \
+  } \
+} \
+
+// 16-bit multiplier for INTGEMM_SSE2 and INTGEMM_AVX2.
 // C = A * B * unquant_mult
 //
 // This has been substantially revised from Jacob Devlin's SSE code which is:
@@ -151,64 +476,178 @@ INTGEMM_AVX2 static inline void RunCallback(Callback& callback_impl, vector_t<CP
 //
 // A_rows can be anything non-negative.
 // width must be a multiple of the register size.
-// B_cols must be a multiple of 8.
+// B_cols can be anything: B is prepared with its columns padded to a multiple of
+// 8 and callbacks only write columns below B_cols.
 // Multiply16
 #define INTGEMM_MULTIPLY16(Register, target, cpu_type) \
+/* Sums for one row of A against 8 columns of B.  These will be packed 32-bit \
+   integers containing sums for each row of B multiplied by the row of A. */ \
+struct MultiplyRowSums { \
+  Register a; \
+  Register sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7; \
+}; \
+/* kRows consecutive rows of A that share every load of B.  Rows are nested \
+   members rather than an array so the compiler keeps the sums in registers. */ \
+template <Index kRows, bool kMore = (kRows > 0)> struct MultiplyRows { \
+  MultiplyRowSums row; \
+  MultiplyRows<kRows - 1> rest; \
+  target inline void Load(const Register *A_live, Index A_stride) { \
+    row.a = *A_live; \
+    rest.Load(A_live + A_stride, A_stride); \
+  } \
+  target inline void Start(Register MultiplyRowSums::*sum, Register b) { \
+    row.*sum = madd_epi16(row.a, b); \
+    rest.Start(sum, b); \
+  } \
+  target inline void Accumulate(Register MultiplyRowSums::*sum, Register b) { \
+    /* Multiply 16-bit, horizontally add to packed 32-bit integers. \
+       Sum packed 32-bit integers with danger of overflow.  TODO: accumulate in 64-bit every so often.*/ \
+    row.*sum = add_epi32(row.*sum, madd_epi16(row.a, b)); \
+    rest.Accumulate(sum, b); \
+  } \
+  template <typename CallbackImpl> target inline void Finish(CallbackImpl &callback_impl, Index A_rowidx, Index B0_colidx, Index A_rows, Index B_cols) { \
+    /* Reduce sums within 128-bit lanes.*/ \
+    Register pack0123 = Pack0123(row.sum0, row.sum1, row.sum2, row.sum3); \
+    Register pack4567 = Pack0123(row.sum4, row.sum5, row.sum6, row.sum7); \
+    /*The specific implementation may need to reduce further.*/ \
+    auto total = PermuteSummer(pack0123, pack4567); \
+    RunCallback(callback_impl, total, A_rowidx, B0_colidx, A_rows, B_cols); \
+    rest.Finish(callback_impl, A_rowidx + 1, B0_colidx, A_rows, B_cols); \
+  } \
+}; \
+template <Index kRows> struct MultiplyRows<kRows, false> { \
+  target inline void Load(const Register *, Index) {} \
+  target inline void Start(Register MultiplyRowSums::*, Register) {} \
+  target inline void Accumulate(Register MultiplyRowSums::*, Register) {} \
+  template <typename CallbackImpl> target inline void Finish(CallbackImpl &, Index, Index, Index, Index) {} \
+}; \
+/* Multiply kRows consecutive rows of A by 8 columns of B.  Each register of B \
+   is loaded once and applied to all the rows before moving to the next. */ \
+template <Index kRows, class Prefetch, typename CallbackImpl> target static inline void MultiplyRowBlock(const Register *A_row, Index A_stride, const Register *B0_col, Index k_count, const Prefetch &prefetch, Index A_rowidx, Index A_rows, Index B0_colidx, Index B_cols, CallbackImpl &callback_impl) { \
+  MultiplyRows<kRows> rows; \
+  rows.Load(A_row, A_stride); \
+  rows.Start(&MultiplyRowSums::sum0, *B0_col); \
+  rows.Start(&MultiplyRowSums::sum1, *(B0_col + 1)); \
+  rows.Start(&MultiplyRowSums::sum2, *(B0_col + 2)); \
+  rows.Start(&MultiplyRowSums::sum3, *(B0_col + 3)); \
+  rows.Start(&MultiplyRowSums::sum4, *(B0_col + 4)); \
+  rows.Start(&MultiplyRowSums::sum5, *(B0_col + 5)); \
+  rows.Start(&MultiplyRowSums::sum6, *(B0_col + 6)); \
+  rows.Start(&MultiplyRowSums::sum7, *(B0_col + 7)); \
+  /* Iterate over shared (inner) dimension.*/ \
+  for (Index k = 1; k < k_count; ++k) { \
+    const Register *B_live = B0_col + k * 8; \
+    prefetch.Step(B_live, A_row + k); \
+    rows.Load(A_row + k, A_stride); \
+    rows.Accumulate(&MultiplyRowSums::sum0, *B_live); \
+    rows.Accumulate(&MultiplyRowSums::sum1, *(B_live + 1)); \
+    rows.Accumulate(&MultiplyRowSums::sum2, *(B_live + 2)); \
+    rows.Accumulate(&MultiplyRowSums::sum3, *(B_live + 3)); \
+    rows.Accumulate(&MultiplyRowSums::sum4, *(B_live + 4)); \
+    rows.Accumulate(&MultiplyRowSums::sum5, *(B_live + 5)); \
+    rows.Accumulate(&MultiplyRowSums::sum6, *(B_live + 6)); \
+    rows.Accumulate(&MultiplyRowSums::sum7, *(B_live + 7)); \
+  } \
+  rows.Finish(callback_impl, A_rowidx, B0_colidx, A_rows, B_cols); \
+} \
 template <typename Callback> target static void Multiply(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
   assert(width % (sizeof(Register) / sizeof(int16_t)) == 0); \
-  assert(B_cols % 8 == 0); \
   assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
   assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
   const Index simd_width = width / (sizeof(Register) / sizeof(int16_t)); \
   auto callback_impl = callbacks::CallbackImpl<cpu_type, Callback>(callback); \
+  const PrefetchConfig prefetch_config = SoftwarePrefetch; \
   INTGEMM_OMP_FOR \
   for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) { \
     const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx; \
-    /* Process one row of A at a time.  Doesn't seem to be faster to do multiple rows of A at once.*/ \
+    /* Process kMultiplyRows rows of A at a time so they share each load of B, then finish the leftover rows one at a time.*/ \
+    Index A_rowidx = 0; \
+    for (; A_rowidx + kMultiplyRows <= A_rows; A_rowidx += kMultiplyRows) { \
+      const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width); \
+      const Prefetcher prefetch(prefetch_config, A_rowidx == 0, 8 * sizeof(Register), A_rowidx + kMultiplyRows < A_rows ? kMultiplyRows * width * sizeof(int16_t) : 0); \
+      if (prefetch.Any()) { \
+        MultiplyRowBlock<kMultiplyRows>(A_row, simd_width, B0_col, simd_width, prefetch, A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+      } else { \
+        MultiplyRowBlock<kMultiplyRows>(A_row, simd_width, B0_col, simd_width, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+      } \
+    } \
+    for (; A_rowidx < A_rows; ++A_rowidx) { \
+      const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width); \
+      const Prefetcher prefetch(prefetch_config, A_rowidx == 0, 8 * sizeof(Register), A_rowidx + 1 < A_rows ? width * sizeof(int16_t) : 0); \
+      if (prefetch.Any()) { \
+        MultiplyRowBlock<1>(A_row, simd_width, B0_col, simd_width, prefetch, A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+      } else { \
+        MultiplyRowBlock<1>(A_row, simd_width, B0_col, simd_width, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+      } \
+    } \
+  } \
+} \
+INTGEMM_MULTIPLY_BLOCK(int16_t, Register, target, cpu_type)
+
+/* Multiply16 without overflow.  A single madd_epi16 can reach 2 * 32767^2,
+ * so 32-bit sums wrap.  Alongside them, accumulate each 32-bit product shifted
+ * right by 16 ("high").  The total is then 2^16 * high plus the sum of the low
+ * 16 bits of each product, which is non-negative and below 2^32 for width up
+ * to 65536, so it can be recovered from the wrapped sum.  Both are reduced
+ * across lanes in 32 bits; only the final 8 totals are computed in 64 bits and
+ * saturated to 32 bits for the callback.  One row of A at a time.
+ * MultiplyWideBlock does columns [B_colidx_begin, B_colidx_end) of B on one
+ * thread, with the same bounds as MultiplyBlock.
+ */
+#define INTGEMM_MULTIPLY16WIDE(Register, target, cpu_type) \
+template <typename Callback> target static void MultiplyWideBlock(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) { \
+  assert(width % (sizeof(Register) / sizeof(int16_t)) == 0); \
+  assert(width <= 65536); \
+  assert(B_colidx_begin % 8 == 0); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index simd_width = width / (sizeof(Register) / sizeof(int16_t)); \
+  auto callback_impl = callbacks::CallbackImpl<cpu_type, Callback>(callback); \
+  for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) { \
+    const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx; \
     for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) { \
       const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width); \
-      /* These will be packed 32-bit integers containing sums for each row of B multiplied by the row of A. \
-         Iterate over shared (inner) dimension.*/ \
-      Index k = 0; \
-      Register a = *(A_row + k); \
-      Register sum0 = madd_epi16(a, *(B0_col + k * 8)); \
-      Register sum1 = madd_epi16(a, *(B0_col + k * 8 + 1)); \
-      Register sum2 = madd_epi16(a, *(B0_col + k * 8 + 2)); \
-      Register sum3 = madd_epi16(a, *(B0_col + k * 8 + 3)); \
-      Register sum4 = madd_epi16(a, *(B0_col + k * 8 + 4)); \
-      Register sum5 = madd_epi16(a, *(B0_col + k * 8 + 5)); \
-      Register sum6 = madd_epi16(a, *(B0_col + k * 8 + 6)); \
-      Register sum7 = madd_epi16(a, *(B0_col + k * 8 + 7)); \
-      for (k = 1; k < simd_width; ++k) { \
-        a = *(A_row + k); \
-        /* Multiply 16-bit, horizontally add to packed 32-bit integers.*/ \
-        Register mult0 = madd_epi16(a, *(B0_col + k * 8)); \
-        Register mult1 = madd_epi16(a, *(B0_col + k * 8 + 1)); \
-        Register mult2 = madd_epi16(a, *(B0_col + k * 8 + 2)); \
-        Register mult3 = madd_epi16(a, *(B0_col + k * 8 + 3)); \
-        Register mult4 = madd_epi16(a, *(B0_col + k * 8 + 4)); \
-        Register mult5 = madd_epi16(a, *(B0_col + k * 8 + 5)); \
-        Register mult6 = madd_epi16(a, *(B0_col + k * 8 + 6)); \
-        Register mult7 = madd_epi16(a, *(B0_col + k * 8 + 7)); \
-        /* Sum packed 32-bit integers with danger of overflow.  TODO: accumulate in 64-bit every so often.*/ \
-        sum0 = add_epi32(sum0, mult0); \
-        sum1 = add_epi32(sum1, mult1); \
-        sum2 = add_epi32(sum2, mult2); \
-        sum3 = add_epi32(sum3, mult3); \
-        sum4 = add_epi32(sum4, mult4); \
-        sum5 = add_epi32(sum5, mult5); \
-        sum6 = add_epi32(sum6, mult6); \
-        sum7 = add_epi32(sum7, mult7); \
+      Register sum0 = setzero_si<Register>(), sum1 = sum0, sum2 = sum0, sum3 = sum0, sum4 = sum0, sum5 = sum0, sum6 = sum0, sum7 = sum0; \
+      Register high0 = sum0, high1 = sum0, high2 = sum0, high3 = sum0, high4 = sum0, high5 = sum0, high6 = sum0, high7 = sum0; \
+      for (Index k = 0; k < simd_width; ++k) { \
+        Register a = A_row[k]; \
+        const Register *B_live = B0_col + k * 8; \
+        Register product; \
+        product = madd_epi16(a, B_live[0]); sum0 = add_epi32(sum0, product); high0 = add_epi32(high0, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[1]); sum1 = add_epi32(sum1, product); high1 = add_epi32(high1, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[2]); sum2 = add_epi32(sum2, product); high2 = add_epi32(high2, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[3]); sum3 = add_epi32(sum3, product); high3 = add_epi32(high3, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[4]); sum4 = add_epi32(sum4, product); high4 = add_epi32(high4, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[5]); sum5 = add_epi32(sum5, product); high5 = add_epi32(high5, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[6]); sum6 = add_epi32(sum6, product); high6 = add_epi32(high6, srai_epi32<16>(product)); \
+        product = madd_epi16(a, B_live[7]); sum7 = add_epi32(sum7, product); high7 = add_epi32(high7, srai_epi32<16>(product)); \
       } \
-      /* Reduce sums within 128-bit lanes.*/ \
-      Register pack0123 = Pack0123(sum0, sum1, sum2, sum3); \
-      Register pack4567 = Pack0123(sum4, sum5, sum6, sum7); \
-      /*The specific implementation may need to reduce further.*/ \
-      auto total = PermuteSummer(pack0123, pack4567); \
+      /* Sum of low 16 bits, modulo 2^32 but known to be less than 2^32. */ \
+      Register pack0123 = Pack0123(sub_epi32(sum0, slli_epi32<16>(high0)), sub_epi32(sum1, slli_epi32<16>(high1)), sub_epi32(sum2, slli_epi32<16>(high2)), sub_epi32(sum3, slli_epi32<16>(high3))); \
+      Register pack4567 = Pack0123(sub_epi32(sum4, slli_epi32<16>(high4)), sub_epi32(sum5, slli_epi32<16>(high5)), sub_epi32(sum6, slli_epi32<16>(high6)), sub_epi32(sum7, slli_epi32<16>(high7))); \
+      alignas(32) int32_t low[8]; \
+      StoreTotal(PermuteSummer(pack0123, pack4567), low); \
+      pack0123 = Pack0123(high0, high1, high2, high3); \
+      pack4567 = Pack0123(high4, high5, high6, high7); \
+      alignas(32) int32_t totals[8]; \
+      StoreTotal(PermuteSummer(pack0123, pack4567), totals); \
+      for (std::size_t i = 0; i < 8; ++i) { \
+        int64_t exact = static_cast<int64_t>(totals[i]) * 65536 + static_cast<uint32_t>(low[i]); \
+        exact = std::max<int64_t>(exact, std::numeric_limits<int32_t>::min()); \
+        totals[i] = static_cast<int32_t>(std::min<int64_t>(exact, std::numeric_limits<int32_t>::max())); \
+      } \
+      decltype(PermuteSummer(sum0, sum0)) total; \
+      LoadTotal(totals, total); \
       RunCallback(callback_impl, total, A_rowidx, B0_colidx, A_rows, B_cols); \
     } \
   } \
 } \
+template <typename Callback> target static void MultiplyWide(const int16_t *A, const int16_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+  INTGEMM_OMP_FOR \
+  for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) { \
+    MultiplyWideBlock<Callback>(A, B, A_rows, width, B_cols, B0_colidx, std::min<Index>(B0_colidx + 8, B_cols), callback); \
+  } \
+} \
 
 //An int8_prepbias version of the above code, using the add 127 technique
 #define INTGEMM_PREPAREBIASFOR8(Register, target, cpu_type) \
@@ -285,19 +724,23 @@ template <typename Callback> target static void Multiply(const int16_t *A, const
 } \
 
 //An int8 version of the above code, using the add 127 technique
+/* Multiply8ShiftBlock does rows [A_rowidx_begin, A_rowidx_end) against
+ * columns [B_colidx_begin, B_colidx_end) of B, which start on a multiple of 8,
+ * without threading.  Multiply8Shift shares strips of B among threads.
+ */
 #define INTGEMM_MULTIPLY8SHIFT(Register, target, cpu_type) \
-  template <class Callback> target static void Multiply8Shift(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+  template <class Callback> target static void Multiply8ShiftBlock(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index A_rowidx_begin, Index A_rowidx_end, Index B_colidx_begin, Index B_colidx_end, Callback callback) { \
   assert(width % (sizeof(Register) / sizeof(int8_t)) == 0); \
   assert(B_cols % 8 == 0); \
+  assert(B_colidx_begin % 8 == 0); \
   assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
   assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
   const Index simd_width = width / (sizeof(Register) / sizeof(int8_t)); \
   auto callback_impl = callbacks::CallbackImpl<cpu_type, Callback>(callback); \
-  INTGEMM_OMP_FOR \
-  for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) { \
+  for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) { \
     const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx; \
     /* Process one row of A at a time.  Doesn't seem to be faster to do multiple rows of A at once.*/ \
-    for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) { \
+    for (Index A_rowidx = A_rowidx_begin; A_rowidx < A_rowidx_end; ++A_rowidx) { \
       const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width); \
       /* These will be packed 16-bit integers containing sums for each row of B multiplied by the row of A. \
          Iterate over shared (inner) dimension.*/ \
@@ -361,6 +804,12 @@ template <typename Callback> target static void Multiply(const int16_t *A, const
     } \
   } \
 } \
+  template <class Callback> target static void Multiply8Shift(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+  INTGEMM_OMP_FOR \
+  for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) { \
+    Multiply8ShiftBlock(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B0_colidx + 8, callback); \
+  } \
+} \
 
 /* 8-bit matrix multiply used by AVX and AVX2.
  * These have two peculiar properties:
@@ -533,71 +982,191 @@ INTGEMM_SSSE3 inline static void InnerINTGEMM_SSSE3(
 }
 //INTGEMM_AVX2 or INTGEMM_SSSE3 multiply
 #define INTGEMM_MULTIPLY8(Register, target, cpu_type) \
-  template <typename Callback> target static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+/* Multiply one row of A by 8 columns of B.  There aren't enough registers for \
+   the sums of another row, so kRows must be 1. */ \
+template <Index kRows, class Prefetch, typename CallbackImpl> target static inline void MultiplyRowBlock(const Register *A_live, Index /*A_stride*/, const Register *B_live, Index k_count, const Prefetch &prefetch, Index A_rowidx, Index A_rows, Index B0_colidx, Index B_cols, CallbackImpl &callback_impl) { \
+  static_assert(kRows == 1, "Only one row of A at a time"); \
+  /*Iterate over shared (inner) dimension.*/ \
+  const Register *A_end = A_live + k_count; \
+  /* Rather than initializing as zeros and adding, just initialize the first.*/ \
+  Register a = *(A_live++); \
+  Register a_positive = abs_epi8(a); \
+  /* These will be packed 16-bit integers containing sums for each column of B multiplied by the row of A.*/ \
+  Register sum0 = maddubs_epi16(a_positive, sign_epi8(B_live[0], a)); \
+  Register sum1 = maddubs_epi16(a_positive, sign_epi8(B_live[1], a)); \
+  Register sum2 = maddubs_epi16(a_positive, sign_epi8(B_live[2], a)); \
+  Register sum3 = maddubs_epi16(a_positive, sign_epi8(B_live[3], a)); \
+  Register sum4 = maddubs_epi16(a_positive, sign_epi8(B_live[4], a)); \
+  Register sum5 = maddubs_epi16(a_positive, sign_epi8(B_live[5], a)); \
+  Register sum6 = maddubs_epi16(a_positive, sign_epi8(B_live[6], a)); \
+  Register sum7 = maddubs_epi16(a_positive, sign_epi8(B_live[7], a)); \
+  B_live += 8; \
+  /* Use A as the loop variable so the add can be done where gcc likes it for branch prediction.*/ \
+  for (; A_live != A_end; ++A_live, B_live += 8) { \
+    prefetch.Step(B_live, A_live); \
+    Inner##target(*A_live, B_live, sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7); \
+  } \
+  /* Convert 16-bit to 32-bit and add, not caring what parts are added.
+   * Implementations:
+   * 1. https://github.com/tesseract-ocr/tesseract/blob/master/src/arch/intsimdmatrixavx2.cpp#L67 under Apache license:
+   *   This does a multiply by 1 and horizontal add:
+   *    _mm512_madd_epi16(sum, _mm512_set1_epi16(1))
+   *   Current fastest.
+   *
+   * 2. Signed extension and fold halves:
+   *    sum = _mm512_add_epi32(
+   *      _mm512_cvtepi16_epi32(_mm512_castsi512_si256(sum)),
+   *      _mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(sum, 1)));
+   *
+   * 3. Sign extend by abuse of bitshift, then add.
+   * sum = _mm512_add_epi32(
+   *      _mm512_srai_epi32(_mm512_slli_epi32(sum, 16), 16),
+   *      _mm512_srai_epi32(sum, 16));
+   */ \
+  Register ones = set1_epi16<Register>(1); \
+  sum0 = madd_epi16(sum0, ones); \
+  sum1 = madd_epi16(sum1, ones); \
+  sum2 = madd_epi16(sum2, ones); \
+  sum3 = madd_epi16(sum3, ones); \
+  sum4 = madd_epi16(sum4, ones); \
+  sum5 = madd_epi16(sum5, ones); \
+  sum6 = madd_epi16(sum6, ones); \
+  sum7 = madd_epi16(sum7, ones); \
+  Register pack0123 = Pack0123(sum0, sum1, sum2, sum3); \
+  Register pack4567 = Pack0123(sum4, sum5, sum6, sum7); \
+  auto total = PermuteSummer(pack0123, pack4567); \
+  RunCallback(callback_impl, total, A_rowidx, B0_colidx, A_rows, B_cols); \
+} \
+template <typename Callback> target static void Multiply(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
   assert(width % sizeof(Register) == 0); \
-  assert(B_cols % 8 == 0); \
   assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
   assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
   const Index simd_width = width / sizeof(Register); \
   auto callback_impl = callbacks::CallbackImpl<cpu_type, Callback>(callback); \
+  const PrefetchConfig prefetch_config = SoftwarePrefetch; \
   INTGEMM_OMP_FOR \
   for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) { \
     const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx; \
     /*Process one row of A at a time.  Doesn't seem to be faster to do multiple rows of A at once.*/ \
     for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) { \
-      /*Iterate over shared (inner) dimension.*/ \
-      const Register *A_live = reinterpret_cast<const Register *>(A + A_rowidx * width); \
-      const Register *A_end = A_live + simd_width; \
-      const Register *B_live = B0_col; \
-      /* Rather than initializing as zeros and adding, just initialize the first.*/ \
-      Register a = *(A_live++); \
-      Register a_positive = abs_epi8(a); \
-      /* These will be packed 16-bit integers containing sums for each column of B multiplied by the row of A.*/ \
-      Register sum0 = maddubs_epi16(a_positive, sign_epi8(B_live[0], a)); \
-      Register sum1 = maddubs_epi16(a_positive, sign_epi8(B_live[1], a)); \
-      Register sum2 = maddubs_epi16(a_positive, sign_epi8(B_live[2], a)); \
-      Register sum3 = maddubs_epi16(a_positive, sign_epi8(B_live[3], a)); \
-      Register sum4 = maddubs_epi16(a_positive, sign_epi8(B_live[4], a)); \
-      Register sum5 = maddubs_epi16(a_positive, sign_epi8(B_live[5], a)); \
-      Register sum6 = maddubs_epi16(a_positive, sign_epi8(B_live[6], a)); \
-      Register sum7 = maddubs_epi16(a_positive, sign_epi8(B_live[7], a)); \
-      B_live += 8; \
-      /* Use A as the loop variable so the add can be done where gcc likes it for branch prediction.*/ \
-      for (; A_live != A_end; ++A_live, B_live += 8) { \
-        Inner##target(*A_live, B_live, sum0, sum1, sum2, sum3, sum4, sum5, sum6, sum7); \
+      const Register *A_row = reinterpret_cast<const Register *>(A + A_rowidx * width); \
+      const Prefetcher prefetch(prefetch_config, A_rowidx == 0, 8 * sizeof(Register), A_rowidx + 1 < A_rows ? width : 0); \
+      if (prefetch.Any()) { \
+        MultiplyRowBlock<1>(A_row, simd_width, B0_col, simd_width, prefetch, A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+      } else { \
+        MultiplyRowBlock<1>(A_row, simd_width, B0_col, simd_width, NoPrefetch(), A_rowidx, A_rows, B0_colidx, B_cols, callback_impl); \
+      } \
+    } \
+  } \
+} \
+INTGEMM_MULTIPLY_BLOCK(int8_t, Register, target, cpu_type)
+
+/* Multiply8 without saturation: a single maddubs_epi16 can reach 2 * 127^2, so
+ * 16-bit sums are widened to 32 bits with madd_epi16 every step instead of
+ * being added with saturation.  One row of A at a time.  MultiplyWideBlock as
+ * in INTGEMM_MULTIPLY16WIDE.
+ */
+#define INTGEMM_MULTIPLY8WIDE(Register, target, cpu_type) \
+template <typename Callback> target static void MultiplyWideBlock(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) { \
+  assert(width % sizeof(Register) == 0); \
+  assert(B_colidx_begin % 8 == 0); \
+  assert(reinterpret_cast<uintptr_t>(A) % sizeof(Register) == 0); \
+  assert(reinterpret_cast<uintptr_t>(B) % sizeof(Register) == 0); \
+  const Index simd_width = width / sizeof(Register); \
+  auto callback_impl = callbacks::CallbackImpl<cpu_type, Callback>(callback); \
+  const Register ones = set1_epi16<Register>(1); \
+  for (Index B0_colidx = B_colidx_begin; B0_colidx < B_colidx_end; B0_colidx += 8) { \
+    const Register *B0_col = reinterpret_cast<const Register *>(B) + simd_width * B0_colidx; \
+    for (Index A_rowidx = 0; A_rowidx < A_rows; ++A_rowidx) { \
+      const Register *A_row = reinterpret_cast<const Register*>(A + A_rowidx * width); \
+      /* Packed 32-bit integers. */ \
+      Register sum0 = setzero_si<Register>(), sum1 = sum0, sum2 = sum0, sum3 = sum0, sum4 = sum0, sum5 = sum0, sum6 = sum0, sum7 = sum0; \
+      for (Index k = 0; k < simd_width; ++k) { \
+        Register a = A_row[k]; \
+        Register a_positive = abs_epi8(a); \
+        const Register *B_live = B0_col + k * 8; \
+        sum0 = add_epi32(sum0, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[0], a)), ones)); \
+        sum1 = add_epi32(sum1, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[1], a)), ones)); \
+        sum2 = add_epi32(sum2, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[2], a)), ones)); \
+        sum3 = add_epi32(sum3, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[3], a)), ones)); \
+        sum4 = add_epi32(sum4, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[4], a)), ones)); \
+        sum5 = add_epi32(sum5, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[5], a)), ones)); \
+        sum6 = add_epi32(sum6, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[6], a)), ones)); \
+        sum7 = add_epi32(sum7, madd_epi16(maddubs_epi16(a_positive, sign_epi8(B_live[7], a)), ones)); \
       } \
-      /* Convert 16-bit to 32-bit and add, not caring what parts are added.
-       * Implementations:
-       * 1. https://github.com/tesseract-ocr/tesseract/blob/master/src/arch/intsimdmatrixavx2.cpp#L67 under Apache license:
-       *   This does a multiply by 1 and horizontal add:
-       *    _mm512_madd_epi16(sum, _mm512_set1_epi16(1))
-       *   Current fastest.
-       *
-       * 2. Signed extension and fold halves:
-       *    sum = _mm512_add_epi32(
-       *      _mm512_cvtepi16_epi32(_mm512_castsi512_si256(sum)),
-       *      _mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(sum, 1)));
-       *
-       * 3. Sign extend by abuse of bitshift, then add.
-       * sum = _mm512_add_epi32(
-       *      _mm512_srai_epi32(_mm512_slli_epi32(sum, 16), 16),
-       *      _mm512_srai_epi32(sum, 16));
-       */ \
-      Register ones = set1_epi16<Register>(1); \
-      sum0 = madd_epi16(sum0, ones); \
-      sum1 = madd_epi16(sum1, ones); \
-      sum2 = madd_epi16(sum2, ones); \
-      sum3 = madd_epi16(sum3, ones); \
-      sum4 = madd_epi16(sum4, ones); \
-      sum5 = madd_epi16(sum5, ones); \
-      sum6 = madd_epi16(sum6, ones); \
-      sum7 = madd_epi16(sum7, ones); \
       Register pack0123 = Pack0123(sum0, sum1, sum2, sum3); \
       Register pack4567 = Pack0123(sum4, sum5, sum6, sum7); \
       auto total = PermuteSummer(pack0123, pack4567); \
       RunCallback(callback_impl, total, A_rowidx, B0_colidx, A_rows, B_cols); \
     } \
   } \
+} \
+template <typename Callback> target static void MultiplyWide(const int8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) { \
+  INTGEMM_OMP_FOR \
+  for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += 8) { \
+    MultiplyWideBlock<Callback>(A, B, A_rows, width, B_cols, B0_colidx, std::min<Index>(B0_colidx + 8, B_cols), callback); \
+  } \
+} \
+
+/* Elements PrepareBPadded<Backend> writes for a rows x cols B: rows rounded up
+ * to Backend::kBTileRow times cols rounded up to 8.
+ */
+template <class Backend> static inline Index PreparedBSize(Index rows, Index cols) {
+  return round_up(rows, Backend::kBTileRow) * round_up(cols, 8);
+}
+
+/* Elements PrepareAPadded<Backend> writes for a rows x cols A: cols rounded
+ * up to Backend::kBTileRow, the rows PrepareBPadded pads B to, times rows.
+ */
+template <class Backend> static inline Index PreparedASize(Index rows, Index cols) {
+  return rows * round_up(cols, Backend::kBTileRow);
+}
+
+/* PrepareA for any shape.  Each row is padded with zeros to a multiple of
+ * Backend::kBTileRow, like the extra rows of B, so it needs
+ * PreparedASize<Backend>(rows, cols) elements and Multiply reads it in place.
+ * Widths that are already multiples go straight to Backend::PrepareA.
+ */
+template <class Backend, class Integer = typename Backend::Integer> static inline void PrepareAPadded(const float *input, Integer *output, float quant_mult, Index rows, Index cols) {
+  const Index padded_cols = round_up(cols, Backend::kBTileRow);
+  if (padded_cols == cols) {
+    Backend::PrepareA(input, output, quant_mult, rows, cols);
+  } else {
+    Backend::QuantizeRows(input, output, quant_mult, rows, cols, padded_cols, cols);
+  }
+}
+
+/* PrepareB for any shape.  The output is laid out as if B had zero rows
+ * appended up to a multiple of Backend::kBTileRow and zero columns up to a
+ * multiple of 8, so it needs PreparedBSize<Backend>(rows, cols) elements.
+ * Shapes that are already multiples go straight to Backend::PrepareB;
+ * otherwise B is first copied to a zero-padded buffer.
+ */
+template <class Backend, class Integer = typename Backend::Integer> static inline void PrepareBPadded(const float *input, Integer *output, float quant_mult, Index rows, Index cols) {
+  const Index padded_rows = round_up(rows, Backend::kBTileRow);
+  const Index padded_cols = round_up(cols, 8);
+  if (padded_rows == rows && padded_cols == cols) {
+    Backend::PrepareB(input, output, quant_mult, rows, cols);
+    return;
+  }
+  ScratchBuffer<float> padded(padded_rows * padded_cols);
+  std::fill(padded.begin(), padded.end(), 0.0f);
+  for (Index r = 0; r < rows; ++r) {
+    std::copy(input + r * cols, input + (r + 1) * cols, padded.begin() + r * padded_cols);
+  }
+  Backend::PrepareB(padded.begin(), output, quant_mult, padded_rows, padded_cols);
+}
+
+/* Threads in SharedThreadPool if set, else threads that #pragma omp parallel
+ * would start, 1 without OpenMP.
+ */
+static inline Index MaxThreads() {
+  if (const ThreadPool *pool = SharedThreadPool) return pool->Threads();
+#ifdef _OPENMP
+  return static_cast<Index>(omp_get_max_threads());
+#else
+  return 1;
+#endif
 }
 
 /* Wrap a multiply call in OMP parallelism.  Here it launches threads then
@@ -608,14 +1177,547 @@ INTGEMM_SSSE3 inline static void InnerINTGEMM_SSSE3(
  * Also, gcc 7 is unable to deduce the function pointer type (for ChooseCPU) if
  * I use typename Backend::Integer directly in the arguments.  As a workaround,
  * have a default template argument Integer then use that so it's resolved.
+ *
+ * With SharedThreadPool set, tasks of Backend::kMultiplyCols columns of B go
+ * to the pool instead, through MultiplyBlock.  Unlike Multiply, that doesn't
+ * software prefetch, so SoftwarePrefetch has no effect on the pool path.
  */
 template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void OMPParallelWrap(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor((B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols, [&](Index strip) {
+      const Index B0_colidx = strip * Backend::kMultiplyCols;
+      Backend::template MultiplyBlock<Callback>(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, std::min(B0_colidx + Backend::kMultiplyCols, B_cols), 0, width, callback);
+    });
+    return;
+  }
 #pragma omp parallel
   Backend::template Multiply<Callback>(A, B, A_rows, width, B_cols, callback);
 }
+
+/* Like OMPParallelWrap for MultiplyWide, taking any width with A from
+ * PrepareAPadded.  The pool path runs MultiplyWideBlock on strips of B.
+ */
+template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void OMPParallelWrapWide(const Integer *A, const Integer *B, Index A_rows, Index width_unpadded, Index B_cols, Callback callback) {
+  const Index width = round_up(width_unpadded, Backend::kBTileRow);
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor((B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols, [&](Index strip) {
+      const Index B0_colidx = strip * Backend::kMultiplyCols;
+      Backend::template MultiplyWideBlock<Callback>(A, B, A_rows, width, B_cols, B0_colidx, std::min(B0_colidx + Backend::kMultiplyCols, B_cols), callback);
+    });
+    return;
+  }
+#pragma omp parallel
+  Backend::template MultiplyWide<Callback>(A, B, A_rows, width, B_cols, callback);
+}
+
+/* PrepareA writing A in panels of Backend::kMultiplyRows rows, the rows the
+ * kernel multiplies at once.  Within a panel of n rows, register k of row r
+ * is register k * n + r, so the kernel reads the panel front to back instead
+ * of n streams a row apart.  The last panel has the leftover rows.  The
+ * output has the same size as PrepareA's; for kernels that multiply one row
+ * at a time it is the same layout.  cols must be a multiple of
+ * Backend::kBTileRow.
+ */
+template <class Backend, class Integer = typename Backend::Integer> static inline void PrepareAPanels(const float *input, Integer *output, float quant_mult, Index rows, Index cols) {
+  assert(cols % Backend::kBTileRow == 0);
+  if (Backend::kMultiplyRows == 1) {
+    Backend::PrepareA(input, output, quant_mult, rows, cols);
+    return;
+  }
+  const Index simd_width = cols / Backend::kBTileRow;
+  for (Index panel = 0; panel < rows; panel += Backend::kMultiplyRows) {
+    const Index n = std::min<Index>(Backend::kMultiplyRows, rows - panel);
+    // Register k of the panel's n rows goes to n consecutive registers.
+    for (Index k = 0; k < simd_width; ++k) {
+      Backend::QuantizeRows(input + panel * cols + k * Backend::kBTileRow, output + (panel * simd_width + k * n) * Backend::kBTileRow, quant_mult, n, Backend::kBTileRow, Backend::kBTileRow, cols);
+    }
+  }
+}
+
+namespace detail {
+template <bool kPanels> struct MultiplyPanelsDispatch;
+template <> struct MultiplyPanelsDispatch<true> {
+  template <class Callback, class Backend, class Integer> static inline void run(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    Backend::template MultiplyPanels<Callback>(A, B, A_rows, width, B_cols, callback);
+  }
+  template <class Callback, class Backend, class Integer> static inline void block(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
+    Backend::template MultiplyPanelsBlock<Callback>(A, B, A_rows, width, B_cols, B_colidx_begin, B_colidx_end, callback);
+  }
+};
+// Panels of one row are row-major A.
+template <> struct MultiplyPanelsDispatch<false> {
+  template <class Callback, class Backend, class Integer> static inline void run(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+    Backend::template Multiply<Callback>(A, B, A_rows, width, B_cols, callback);
+  }
+  template <class Callback, class Backend, class Integer> static inline void block(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Index B_colidx_begin, Index B_colidx_end, Callback callback) {
+    Backend::template MultiplyBlock<Callback>(A, B, A_rows, width, B_cols, 0, A_rows, B_colidx_begin, B_colidx_end, 0, width, callback);
+  }
+};
+} // namespace detail
+
+/* Like OMPParallelWrap for A from PrepareAPanels, with strips of B going to
+ * SharedThreadPool if set.
+ */
+template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void OMPParallelWrapPanels(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor((B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols, [&](Index strip) {
+      const Index B0_colidx = strip * Backend::kMultiplyCols;
+      detail::MultiplyPanelsDispatch<(Backend::kMultiplyRows > 1)>::template block<Callback, Backend, Integer>(A, B, A_rows, width, B_cols, B0_colidx, std::min(B0_colidx + Backend::kMultiplyCols, B_cols), callback);
+    });
+    return;
+  }
+#pragma omp parallel
+  detail::MultiplyPanelsDispatch<(Backend::kMultiplyRows > 1)>::template run<Callback, Backend, Integer>(A, B, A_rows, width, B_cols, callback);
+}
+
+/* Sizes of data caches in bytes, 0 if unknown.  Detected once by CPUID. */
+struct CacheSizes {
+  std::size_t l1;
+  std::size_t l2;
+  std::size_t l3;
+};
+extern const CacheSizes kCacheSizes;
+
+/* Block sizes for MultiplyBlocked: how much of the inner dimension, how many
+ * rows of A, and how many columns of B to do at a time.
+ */
+struct BlockSizes {
+  Index width;
+  Index A_rows;
+  Index B_cols;
+};
+
+/* Split size into the fewest blocks of at most max_block, making the blocks
+ * about equal and multiples of multiple.
+ */
+static inline Index BalanceBlock(Index size, Index max_block, Index multiple) {
+  max_block = std::max(max_block - max_block % multiple, multiple);
+  if (max_block >= size) return size;
+  const Index count = (size + max_block - 1) / max_block;
+  Index block = (size + count - 1) / count;
+  return (block + multiple - 1) / multiple * multiple;
+}
+
+/* Rows of A per task when tasks are a block of rows by Backend::kMultiplyCols
+ * columns of B.  Splitting only the strips of B leaves threads idle when there
+ * are fewer strips than threads, as for tall and skinny products, or unevenly
+ * loaded when there are a few more.  Then rows are split too, so the number of
+ * tasks is a multiple of the threads.  Row blocks are multiples of multiple.
+ */
+static inline Index ChooseRowBlock(Index A_rows, Index strips, Index threads, Index multiple) {
+  if (strips % threads == 0 || strips >= 4 * threads) return A_rows;
+  Index common = strips, rest = threads;
+  while (rest) {
+    const Index next = common % rest;
+    common = rest;
+    rest = next;
+  }
+  const Index row_blocks = threads / common;
+  return BalanceBlock(A_rows, (A_rows + row_blocks - 1) / row_blocks, multiple);
+}
+
+/* Pick blocks so a tile of B (kMultiplyCols columns by the width block) fits
+ * in L1, the A block fits in half of L2, and a panel of B fits in half of the
+ * last level cache.  The width isn't split if Backend::kSaturates.
+ */
+template <class Backend> static inline BlockSizes ChooseBlockSizes(const CacheSizes &caches, Index A_rows, Index width, Index B_cols) {
+  typedef typename Backend::Integer Integer;
+  const std::size_t l1 = caches.l1 ? caches.l1 : 32768;
+  const std::size_t l2 = caches.l2 ? caches.l2 : 262144;
+  const std::size_t llc = caches.l3 ? caches.l3 : l2;
+  BlockSizes ret;
+  ret.width = Backend::kSaturates ? width : BalanceBlock(width, static_cast<Index>(l1 / (Backend::kMultiplyCols * sizeof(Integer))), Backend::kBTileRow);
+  const std::size_t row_bytes = ret.width * sizeof(Integer);
+  ret.A_rows = BalanceBlock(A_rows, static_cast<Index>(std::min<std::size_t>(l2 / 2 / row_bytes, A_rows)), 1);
+  ret.B_cols = BalanceBlock(B_cols, static_cast<Index>(std::min<std::size_t>(llc / 2 / row_bytes, B_cols)), Backend::kMultiplyCols);
+  return ret;
+}
+
+/* Multiply in cache-sized blocks.  B is processed in panels of blocks.B_cols
+ * columns.  Within a panel, the inner dimension is split into blocks of
+ * blocks.width; threads share tasks of one row block of A by
+ * Backend::kMultiplyCols columns of B, assigned in row-major order so
+ * neighbouring threads reuse the A block.  With SharedThreadPool set, the
+ * pool runs the tasks of each block.
+ *
+ * If the inner dimension is split, 32-bit partial sums go to a temporary
+ * buffer (from ScratchWorkspace if set) and the callback only runs on the
+ * last block.  Backends that saturate (Backend::kSaturates) would then give
+ * sums that depend on the split, so for them blocks.width is ignored and the
+ * sums match Multiply.  blocks.width must be a multiple of Backend::kBTileRow
+ * and blocks.B_cols a multiple of 8 unless it covers all of B_cols.
+ */
+template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void MultiplyBlocked(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback, BlockSizes blocks) {
+  assert(blocks.width > 0 && blocks.width % Backend::kBTileRow == 0);
+  assert(blocks.A_rows > 0);
+  assert(blocks.B_cols > 0 && (blocks.B_cols % 8 == 0 || blocks.B_cols >= B_cols));
+  const Index row_blocks = (A_rows + blocks.A_rows - 1) / blocks.A_rows;
+  if (Backend::kSaturates) blocks.width = width;
+  const bool split_width = blocks.width < width;
+  ScratchBuffer<int> partial(split_width ? A_rows * B_cols : 0);
+  int *const partial_addr = partial.begin();
+  auto run = [&](Index B_colidx_begin, Index B_colidx_end, Index width_begin, Index width_end, Index task) {
+    const Index strips = (B_colidx_end - B_colidx_begin + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+    const Index A_rowidx_begin = (task / strips) * blocks.A_rows;
+    const Index A_rowidx_end = std::min(A_rowidx_begin + blocks.A_rows, A_rows);
+    const Index B0_colidx = B_colidx_begin + (task % strips) * Backend::kMultiplyCols;
+    const Index B0_colidx_end = std::min(B0_colidx + Backend::kMultiplyCols, B_colidx_end);
+    if (!split_width) {
+      Backend::template MultiplyBlock<Callback>(A, B, A_rows, width, B_cols, A_rowidx_begin, A_rowidx_end, B0_colidx, B0_colidx_end, width_begin, width_end, callback);
+    } else if (width_begin == 0) {
+      Backend::MultiplyBlock(A, B, A_rows, width, B_cols, A_rowidx_begin, A_rowidx_end, B0_colidx, B0_colidx_end, width_begin, width_end, callbacks::Write<int>(partial_addr));
+    } else if (width_end == width) {
+      Backend::MultiplyBlock(A, B, A_rows, width, B_cols, A_rowidx_begin, A_rowidx_end, B0_colidx, B0_colidx_end, width_begin, width_end, callbacks::Sequence(callbacks::AddPartialSums(partial_addr), callback));
+    } else {
+      Backend::MultiplyBlock(A, B, A_rows, width, B_cols, A_rowidx_begin, A_rowidx_end, B0_colidx, B0_colidx_end, width_begin, width_end, callbacks::Sequence(callbacks::AddPartialSums(partial_addr), callbacks::Write<int>(partial_addr)));
+    }
+  };
+  ThreadPool *const pool = SharedThreadPool;
+#pragma omp parallel if(!pool)
+  for (Index B_colidx_begin = 0; B_colidx_begin < B_cols; B_colidx_begin += blocks.B_cols) {
+    const Index B_colidx_end = std::min(B_colidx_begin + blocks.B_cols, B_cols);
+    const Index strips = (B_colidx_end - B_colidx_begin + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+    const Index tasks = row_blocks * strips;
+    for (Index width_begin = 0; width_begin < width; width_begin += blocks.width) {
+      const Index width_end = std::min(width_begin + blocks.width, width);
+      if (pool) {
+        pool->ParallelFor(tasks, [&](Index task) { run(B_colidx_begin, B_colidx_end, width_begin, width_end, task); });
+        continue;
+      }
+      INTGEMM_OMP_FOR
+      for (Index task = 0; task < tasks; ++task) {
+        run(B_colidx_begin, B_colidx_end, width_begin, width_end, task);
+      }
+    }
+  }
+}
+
+/* Matrix-vector products: with at most kGEMVMaxRows rows of A, splitting only
+ * the columns of B leaves threads idle when B_cols is small, so the inner
+ * dimension is split too.  Before multiplying a tile of B, the first
+ * kGEMVPrefetchBytes of each strip in the next tile are prefetched to hide the
+ * jump between strips.
+ */
+static const Index kGEMVMaxRows = 4;
+static const std::size_t kGEMVPrefetchBytes = 512;
+
+/* Prefetch the start of the slice [width_begin, width_end) in the strips of B
+ * for columns [B0_colidx, B0_colidx_end).
+ */
+template <class Backend, class Integer = typename Backend::Integer> static inline void PrefetchBTile(const Integer *B, Index width, Index B0_colidx, Index B0_colidx_end, Index width_begin, Index width_end) {
+  const std::size_t bytes = std::min<std::size_t>((width_end - width_begin) * 8 * sizeof(Integer), kGEMVPrefetchBytes);
+  for (Index c = B0_colidx; c < B0_colidx_end; c += 8) {
+    const char *strip = reinterpret_cast<const char*>(B + c * width + width_begin * 8);
+    for (std::size_t i = 0; i < bytes; i += 64) {
+      _mm_prefetch(strip + i, _MM_HINT_T0);
+    }
+  }
+}
+
+/* Multiply for a few rows of A, splitting the inner dimension into slices
+ * multiples of Backend::kBTileRow.  Slices 1 to slices - 1 are shared by
+ * threads, each writing 32-bit sums for all of B to its own buffer.  The
+ * buffers are added together, then slice 0 is shared out by columns of B and
+ * adds the total before the callback.  Run it with one slice more than
+ * threads.  Sums are the same as Multiply unless Backend::kSaturates, when
+ * they depend on the slices.
+ */
+template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void MultiplyGEMV(const Integer *A, const Integer *B, Index A_rows, Index width, Index B_cols, Callback callback, Index slices) {
+  assert(width % Backend::kBTileRow == 0);
+  const Index tiles = width / Backend::kBTileRow;
+  assert(slices >= 2 && slices <= tiles);
+  const Index size = A_rows * B_cols;
+  const Index strips = (B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  ScratchBuffer<int> partial((slices - 1) * size);
+  int *const partial_addr = partial.begin();
+  auto slice_task = [&](Index slice) {
+    const Index width_begin = tiles * slice / slices * Backend::kBTileRow;
+    const Index width_end = tiles * (slice + 1) / slices * Backend::kBTileRow;
+    int *const slice_addr = partial_addr + (slice - 1) * size;
+    for (Index B0_colidx = 0; B0_colidx < B_cols; B0_colidx += Backend::kMultiplyCols) {
+      const Index B0_colidx_end = std::min(B0_colidx + Backend::kMultiplyCols, B_cols);
+      PrefetchBTile<Backend>(B, width, B0_colidx_end, std::min(B0_colidx_end + Backend::kMultiplyCols, B_cols), width_begin, width_end);
+      Backend::MultiplyBlock(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B0_colidx_end, width_begin, width_end, callbacks::Write<int>(slice_addr));
+    }
+  };
+  // Sums wrap like the 32-bit adds in Multiply.
+  auto sum_task = [&](Index i) {
+    uint32_t sum = static_cast<uint32_t>(partial_addr[i]);
+    for (Index slice = 2; slice < slices; ++slice) {
+      sum += static_cast<uint32_t>(partial_addr[(slice - 1) * size + i]);
+    }
+    partial_addr[i] = static_cast<int>(sum);
+  };
+  const Index width_end = tiles / slices * Backend::kBTileRow;
+  auto strip_task = [&](Index strip) {
+    const Index B0_colidx = strip * Backend::kMultiplyCols;
+    const Index B0_colidx_end = std::min(B0_colidx + Backend::kMultiplyCols, B_cols);
+    PrefetchBTile<Backend>(B, width, B0_colidx_end, std::min(B0_colidx_end + Backend::kMultiplyCols, B_cols), 0, width_end);
+    Backend::MultiplyBlock(A, B, A_rows, width, B_cols, 0, A_rows, B0_colidx, B0_colidx_end, 0, width_end, callbacks::Sequence(callbacks::AddPartialSums(partial_addr), callback));
+  };
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor(slices - 1, [&](Index slice) { slice_task(slice + 1); });
+    // Sum in chunks of 1024 sums (4 KB) per task.
+    const Index kChunk = 1024;
+    pool->ParallelFor((size + kChunk - 1) / kChunk, [&](Index chunk) {
+      for (Index i = chunk * kChunk; i < std::min(size, (chunk + 1) * kChunk); ++i) sum_task(i);
+    });
+    pool->ParallelFor(strips, strip_task);
+    return;
+  }
+#pragma omp parallel
+  {
+    INTGEMM_OMP_FOR
+    for (Index slice = 1; slice < slices; ++slice) slice_task(slice);
+    INTGEMM_OMP_FOR
+    for (Index i = 0; i < size; ++i) sum_task(i);
+    INTGEMM_OMP_FOR
+    for (Index strip = 0; strip < strips; ++strip) strip_task(strip);
+  }
+}
+
+/* Same signature as OMPParallelWrap, for dispatch.  Uses MultiplyGEMV for up
+ * to kGEMVMaxRows rows of A when there are threads to split the inner
+ * dimension over and the backend doesn't saturate, else MultiplyBlocked with
+ * blocks from the detected caches when the problem doesn't fit in them or
+ * rows of A need splitting across threads (see ChooseRowBlock), else the plain
+ * Multiply.  Saturating backends (the 8-bit ones without VNNI) therefore never
+ * split the inner dimension, even for one row of A.  Takes any width with A
+ * from PrepareAPadded.
+ */
+template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void OMPParallelWrapBlocked(const Integer *A, const Integer *B, Index A_rows, Index width_unpadded, Index B_cols, Callback callback) {
+  const Index width = round_up(width_unpadded, Backend::kBTileRow);
+  if (!Backend::kSaturates && A_rows <= kGEMVMaxRows) {
+    const Index threads = MaxThreads();
+    const Index slices = std::min(threads + 1, width / Backend::kBTileRow);
+    if (threads > 1 && slices > 2) {
+      MultiplyGEMV<Callback, Backend>(A, B, A_rows, width, B_cols, callback, slices);
+      return;
+    }
+  }
+  BlockSizes blocks = ChooseBlockSizes<Backend>(kCacheSizes, A_rows, width, B_cols);
+  const Index strips = (std::min(blocks.B_cols, B_cols) + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  blocks.A_rows = std::min(blocks.A_rows, ChooseRowBlock(A_rows, strips, MaxThreads(), Backend::kMultiplyRows));
+  if (blocks.width >= width && blocks.A_rows >= A_rows) {
+    OMPParallelWrap<Callback, Backend>(A, B, A_rows, width, B_cols, callback);
+  } else {
+    MultiplyBlocked<Callback, Backend>(A, B, A_rows, width, B_cols, callback, blocks);
+  }
+}
+
+/* PrepareA for 8-bit with quant_mult chosen from A: 127 over the largest
+ * absolute value of A, or 1 if A is all zeros.  Returns quant_mult.  A is
+ * split into a contiguous shard per thread; each thread takes the maximum of
+ * its shard, the maxima are combined, then each thread quantizes the same
+ * shard.  If the shard fits in the thread's cache, A comes from memory once
+ * rather than twice as with MaxAbsolute then PrepareA.  On one thread, or
+ * with larger shards, it is read twice.  The output matches PrepareAPadded with
+ * the returned quant_mult, so it needs PreparedASize<Backend>(rows, cols)
+ * elements.  Threads as for MaxAbsolute, on SharedThreadPool if set.  input
+ * and output must be aligned to the register size.
+ */
+template <class Backend> static inline float PrepareADynamic(const float *input, int8_t *output, Index rows, Index cols) {
+  const std::size_t size = static_cast<std::size_t>(rows) * cols;
+  const std::size_t kBatch = Backend::kBTileRow;
+  const std::size_t fast_end = size - size % kBatch;
+  const Index shards = static_cast<Index>(std::max<std::size_t>(1, std::min<std::size_t>(MaxThreads(), size / kQuantizeChunk)));
+  auto shard_begin = [=](Index shard) -> std::size_t {
+    return fast_end / kBatch * shard / shards * kBatch;
+  };
+  auto choose = [](float highest) {
+    return highest > 0.0f ? 127.0f / highest : 1.0f;
+  };
+  const Index padded_cols = round_up(cols, Backend::kBTileRow);
+  auto quantize = [=](Index shard, float quant_mult) {
+    if (padded_cols != cols) {
+      // Padded rows, as PrepareAPadded writes them.
+      const Index row_begin = rows * shard / shards, row_end = rows * (shard + 1) / shards;
+      Backend::QuantizeRows(input + row_begin * cols, output + row_begin * padded_cols, quant_mult, row_end - row_begin, cols, padded_cols, cols);
+      return;
+    }
+    const std::size_t begin = shard_begin(shard), count = shard_begin(shard + 1) - begin;
+    Backend::QuantizeRows(input + begin, output + begin, quant_mult, 1, static_cast<Index>(count), static_cast<Index>(count), static_cast<Index>(count));
+  };
+  // The overhang past the last whole register.
+  float highest = 0.0f;
+  for (std::size_t i = fast_end; i < size; ++i) {
+    highest = std::max(highest, std::fabs(input[i]));
+  }
+  if (ThreadPool *pool = SharedThreadPool) {
+    std::vector<float> maxima(shards);
+    pool->ParallelFor(shards, [&](Index shard) {
+      maxima[shard] = Backend::MaxAbsoluteSerial(input + shard_begin(shard), shard_begin(shard + 1) - shard_begin(shard));
+    });
+    highest = std::max(highest, *std::max_element(maxima.begin(), maxima.end()));
+    const float quant_mult = choose(highest);
+    pool->ParallelFor(shards, [&](Index shard) { quantize(shard, quant_mult); });
+  } else {
+#pragma omp parallel num_threads(shards)
+    {
+      // Static schedules hand each thread the same shards in both loops.
+#pragma omp for schedule(static) reduction(max:highest)
+      for (Index shard = 0; shard < shards; ++shard) {
+        highest = std::max(highest, Backend::MaxAbsoluteSerial(input + shard_begin(shard), shard_begin(shard + 1) - shard_begin(shard)));
+      }
+      const float quant_mult = choose(highest);
+#pragma omp for schedule(static)
+      for (Index shard = 0; shard < shards; ++shard) {
+        quantize(shard, quant_mult);
+      }
+    }
+  }
+  const float quant_mult = choose(highest);
+  if (fast_end != size && padded_cols == cols) {
+    Backend::Quantize(input + fast_end, output + fast_end, quant_mult, static_cast<Index>(size - fast_end));
+  }
+  return quant_mult;
+}
+
+/* A up to this many bytes once quantized is quantized by MultiplyFloatA on
+ * every thread, small enough to stay in L2 while B streams past.
+ */
+static const std::size_t kFloatABytes = 65536;
+/* Fewest columns of B per thread in MultiplyFloatA, so quantizing A again on
+ * each thread costs little next to multiplying it.
+ */
+static const Index kFloatAMinCols = 256;
+
+/* Multiply with float A, quantized with quant_mult, instead of prepared A.
+ * The sums are those of PrepareA then Multiply.  For small A, as in
+ * small-batch inference, there is no separate pass: each thread takes a range
+ * of columns of B, quantizes A with Backend::QuantizeRows into a buffer that
+ * stays in cache, and multiplies it by its columns with MultiplyBlock.  Larger
+ * A is quantized once into a scratch buffer then goes to
+ * OMPParallelWrapBlocked.  Buffers come from ScratchWorkspace if set on the
+ * thread.  Any width; rows of A start A_stride >= width floats apart, so A
+ * can be columns of a larger matrix, and A needn't be aligned.
+ */
+template <class Callback, class Backend> static inline void MultiplyFloatA(const float *A, Index A_stride, const typename Backend::Integer *B, float quant_mult, Index A_rows, Index width_unpadded, Index B_cols, Callback callback) {
+  typedef typename Backend::Integer Integer;
+  assert(A_stride >= width_unpadded);
+  const Index width = round_up(width_unpadded, Backend::kBTileRow);
+  if (A_rows * width * sizeof(Integer) > kFloatABytes) {
+    ScratchBuffer<Integer> prepared(A_rows * width);
+    // PrepareA's Quantize needs dense, aligned input.
+    if (width == width_unpadded && A_stride == width && reinterpret_cast<uintptr_t>(A) % 64 == 0) {
+      Backend::PrepareA(A, prepared.begin(), quant_mult, A_rows, width);
+    } else {
+      Backend::QuantizeRows(A, prepared.begin(), quant_mult, A_rows, width_unpadded, width, A_stride);
+    }
+    OMPParallelWrapBlocked<Callback, Backend>(prepared.begin(), B, A_rows, width, B_cols, callback);
+    return;
+  }
+  const Index strips = (B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  const Index min_strips = std::max<Index>(1, kFloatAMinCols / Backend::kMultiplyCols);
+  const Index chunks = std::max<Index>(1, std::min(MaxThreads(), strips / min_strips));
+  auto run = [&](Index chunk) {
+    const Index B_colidx_begin = strips * chunk / chunks * Backend::kMultiplyCols;
+    const Index B_colidx_end = std::min(strips * (chunk + 1) / chunks * Backend::kMultiplyCols, B_cols);
+    ScratchBuffer<Integer> quantized(A_rows * width);
+    Backend::QuantizeRows(A, quantized.begin(), quant_mult, A_rows, width_unpadded, width, A_stride);
+    Backend::MultiplyBlock(quantized.begin(), B, A_rows, width, B_cols, 0, A_rows, B_colidx_begin, B_colidx_end, 0, width, callback);
+  };
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor(chunks, run);
+    return;
+  }
+#pragma omp parallel if(chunks > 1)
+  {
+    INTGEMM_OMP_FOR
+    for (Index chunk = 0; chunk < chunks; ++chunk) run(chunk);
+  }
+}
+
+/* Multiply8Shift in tasks of row_block rows of A by Backend::kMultiplyCols
+ * columns of B, run on SharedThreadPool if set.
+ */
+template <class Callback, class Backend> static inline void Multiply8ShiftBlocked(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback, Index row_block) {
+  assert(row_block > 0);
+  const Index row_blocks = (A_rows + row_block - 1) / row_block;
+  const Index strips = (B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  const Index tasks = row_blocks * strips;
+  auto run = [&](Index task) {
+    const Index A_rowidx_begin = (task / strips) * row_block;
+    const Index A_rowidx_end = std::min(A_rowidx_begin + row_block, A_rows);
+    const Index B0_colidx = (task % strips) * Backend::kMultiplyCols;
+    const Index B0_colidx_end = std::min(B0_colidx + Backend::kMultiplyCols, B_cols);
+    Backend::template Multiply8ShiftBlock<Callback>(A, B, A_rows, width, B_cols, A_rowidx_begin, A_rowidx_end, B0_colidx, B0_colidx_end, callback);
+  };
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor(tasks, run);
+    return;
+  }
+#pragma omp parallel
+  {
+    INTGEMM_OMP_FOR
+    for (Index task = 0; task < tasks; ++task) run(task);
+  }
+}
+
+/* Multiply8Shift wrapped in OMP parallelism, or SharedThreadPool if set,
+ * splitting rows of A as well as columns of B when that keeps more threads
+ * busy (see ChooseRowBlock).
+ */
 template <class Callback, class Backend> static inline void OMPParallelWrap8Shift(const uint8_t *A, const int8_t *B, Index A_rows, Index width, Index B_cols, Callback callback) {
+  const Index strips = (B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  const Index row_block = ChooseRowBlock(A_rows, strips, MaxThreads(), 1);
+  if (row_block < A_rows || SharedThreadPool) {
+    Multiply8ShiftBlocked<Callback, Backend>(A, B, A_rows, width, B_cols, callback, row_block);
+    return;
+  }
 #pragma omp parallel
   Backend::template Multiply8Shift<Callback>(A, B, A_rows, width, B_cols, callback);
 }
 
+/* Multiply with B copied to every NUMA node (see ReplicatedB): each thread
+ * reads the copy on its node, and so does WithBias for the bias if B carries
+ * one.  Tasks are a column strip of Backend::kMultiplyCols by a block of rows
+ * (see ChooseRowBlock), numbered strip by strip so a strip's tasks are
+ * consecutive and land on one node when OpenMP or a pinned SharedThreadPool
+ * hands out contiguous ranges.  Takes any width with A from PrepareAPadded.
+ */
+template <class Callback, class Backend, class Integer = typename Backend::Integer> static inline void OMPParallelWrapReplicated(const Integer *A, const ReplicatedB<Integer> &B, Index A_rows, Index width_unpadded, Index B_cols, Callback callback) {
+  const Index width = round_up(width_unpadded, Backend::kBTileRow);
+  const Index strips = (B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  const Index row_block = ChooseRowBlock(A_rows, strips, MaxThreads(), Backend::kMultiplyRows);
+  const Index row_blocks = (A_rows + row_block - 1) / row_block;
+  const Index tasks = strips * row_blocks;
+  auto run = [&](Index task) {
+    const Index A_rowidx_begin = (task % row_blocks) * row_block;
+    const Index B0_colidx = (task / row_blocks) * Backend::kMultiplyCols;
+    Backend::MultiplyBlock(A, B.Local(), A_rows, width, B_cols, A_rowidx_begin, std::min(A_rowidx_begin + row_block, A_rows), B0_colidx, std::min(B0_colidx + Backend::kMultiplyCols, B_cols), 0, width, callbacks::WithBias(callback, B.LocalBias()));
+  };
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor(tasks, run);
+    return;
+  }
+#pragma omp parallel
+  {
+    INTGEMM_OMP_FOR
+    for (Index task = 0; task < tasks; ++task) run(task);
+  }
+}
+
+/* Like OMPParallelWrapReplicated for Multiply8Shift. */
+template <class Callback, class Backend> static inline void OMPParallelWrap8ShiftReplicated(const uint8_t *A, const ReplicatedB<int8_t> &B, Index A_rows, Index width, Index B_cols, Callback callback) {
+  const Index strips = (B_cols + Backend::kMultiplyCols - 1) / Backend::kMultiplyCols;
+  const Index row_block = ChooseRowBlock(A_rows, strips, MaxThreads(), 1);
+  const Index row_blocks = (A_rows + row_block - 1) / row_block;
+  const Index tasks = strips * row_blocks;
+  auto run = [&](Index task) {
+    const Index A_rowidx_begin = (task % row_blocks) * row_block;
+    const Index B0_colidx = (task / row_blocks) * Backend::kMultiplyCols;
+    Backend::Multiply8ShiftBlock(A, B.Local(), A_rows, width, B_cols, A_rowidx_begin, std::min(A_rowidx_begin + row_block, A_rows), B0_colidx, std::min(B0_colidx + Backend::kMultiplyCols, B_cols), callbacks::WithBias(callback, B.LocalBias()));
+  };
+  if (ThreadPool *pool = SharedThreadPool) {
+    pool->ParallelFor(tasks, run);
+    return;
+  }
+#pragma omp parallel
+  {
+    INTGEMM_OMP_FOR
+    for (Index task = 0; task < tasks; ++task) run(task);
+  }
+}
+
 } // namespace intgemm
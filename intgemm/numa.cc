@@ -0,0 +1,122 @@
+#include "numa.h"
+
+#include <cstdlib>
+#include <exception>
+#include <thread>
+
+#ifdef __linux__
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace intgemm {
+
+namespace {
+
+struct Topology {
+  // CPUs of each node, in node order.  Empty lists if unknown.
+  std::vector<std::vector<int>> cpus;
+  // Node index of each CPU.
+  std::vector<Index> node_of_cpu;
+};
+
+#ifdef __linux__
+// Parse a list like "0-3,8,10-11".
+std::vector<int> ParseList(const std::string &list) {
+  std::vector<int> ret;
+  std::istringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    std::size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int i = first; i <= last; ++i) ret.push_back(i);
+  }
+  return ret;
+}
+
+std::string ReadLine(const std::string &path) {
+  std::ifstream in(path.c_str());
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+#endif
+
+Topology ReadTopology() {
+  Topology ret;
+#ifdef __linux__
+  for (int node : ParseList(ReadLine("/sys/devices/system/node/online"))) {
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::vector<int> cpus = ParseList(ReadLine(path.str()));
+    // Memory-only nodes have no CPUs to copy from.
+    if (cpus.empty()) continue;
+    for (int cpu : cpus) {
+      if (static_cast<std::size_t>(cpu) >= ret.node_of_cpu.size()) ret.node_of_cpu.resize(cpu + 1, 0);
+      ret.node_of_cpu[cpu] = static_cast<Index>(ret.cpus.size());
+    }
+    ret.cpus.push_back(cpus);
+  }
+#endif
+  if (ret.cpus.empty()) ret.cpus.resize(1);
+  return ret;
+}
+
+const Topology &GetTopology() {
+  static const Topology topology = ReadTopology();
+  return topology;
+}
+
+} // namespace
+
+Index NumaNodes() {
+  return static_cast<Index>(GetTopology().cpus.size());
+}
+
+Index NumaNodeOfCPU(int cpu) {
+  const Topology &topology = GetTopology();
+  if (cpu < 0 || static_cast<std::size_t>(cpu) >= topology.node_of_cpu.size()) return 0;
+  return topology.node_of_cpu[cpu];
+}
+
+Index CurrentNumaNode() {
+  if (NumaNodes() == 1) return 0;
+#ifdef __linux__
+  return NumaNodeOfCPU(sched_getcpu());
+#else
+  return 0;
+#endif
+}
+
+void RunOnNumaNode(Index node, const std::function<void()> &task) {
+  const std::vector<int> &cpus = GetTopology().cpus[node];
+  if (cpus.empty()) {
+    task();
+    return;
+  }
+  std::exception_ptr error;
+  std::thread worker([&] {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  });
+  worker.join();
+  if (error) std::rethrow_exception(error);
+}
+
+} // namespace intgemm
@@ -0,0 +1,91 @@
+#pragma once
+#include "aligned.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/* NUMA placement without libnuma.  Nodes and their CPUs are read once from
+ * /sys/devices/system/node on Linux; elsewhere there is one node.
+ */
+namespace intgemm {
+
+// Number of NUMA nodes, at least 1.
+Index NumaNodes();
+
+// Node of cpu, 0 if unknown.
+Index NumaNodeOfCPU(int cpu);
+
+// Node of the CPU the calling thread is running on, 0 if unknown.
+Index CurrentNumaNode();
+
+/* Run task on a thread bound to the CPUs of node, or on the calling thread if
+ * they're unknown.  Memory the task allocates and writes first is placed on
+ * node by the kernel's first-touch policy.  Exceptions from task are rethrown
+ * in the caller.
+ */
+void RunOnNumaNode(Index node, const std::function<void()> &task);
+
+/* A copy of an array on every NUMA node, allocated and written from that node
+ * so its pages live there.  Local() returns the copy on the calling thread's
+ * node.  Each copy is allocated with policy.
+ */
+template <class T> class NumaReplicas {
+  public:
+    NumaReplicas() : size_(0) {}
+
+    NumaReplicas(const T *data, std::size_t size, PagePolicy policy = PagePolicy::Default) : size_(size) {
+      replicas_.resize(NumaNodes());
+      for (Index node = 0; node < NumaNodes(); ++node) {
+        // Allocated on the copying thread so its pages are fresh: huge pages
+        // and large sizes come straight from mmap.
+        RunOnNumaNode(node, [&] {
+          replicas_[node].reset(new AlignedVector<T>(size, policy));
+          std::memcpy(replicas_[node]->begin(), data, size * sizeof(T));
+        });
+      }
+    }
+
+    bool empty() const { return replicas_.empty(); }
+    std::size_t size() const { return size_; }
+
+    const T *OnNode(Index node) const { return replicas_[node]->begin(); }
+    const T *Local() const { return OnNode(CurrentNumaNode()); }
+
+    // What the copies got after any huge page fallback.
+    PagePolicy policy() const { return replicas_.empty() ? PagePolicy::Default : replicas_.front()->policy(); }
+
+  private:
+    std::size_t size_;
+    std::vector<std::unique_ptr<AlignedVector<T>>> replicas_;
+};
+
+/* A prepared B on every NUMA node for Int8::Multiply, Int16::Multiply and
+ * Int8Shift::Multiply, so threads stream B from local memory.  B_size is the
+ * number of elements PrepareB wrote (see PreparedBSize).  With a bias of
+ * B_cols floats, such as the one from Int8Shift::PrepareBias, multiplies
+ * with UnquantizeAndAddBiasAndWrite read the local copy of it in place of
+ * the callback's bias_addr.  policy applies to the copies of B; huge pages
+ * pay off once B is several MB, so the bias keeps ordinary pages.
+ */
+template <class Integer> class ReplicatedB {
+  public:
+    ReplicatedB(const Integer *B, std::size_t B_size, const float *bias = nullptr, Index B_cols = 0, PagePolicy policy = PagePolicy::Default)
+      : B_(B, B_size, policy), bias_(bias ? NumaReplicas<float>(bias, B_cols) : NumaReplicas<float>()) {}
+
+    const Integer *Local() const { return B_.Local(); }
+    const Integer *OnNode(Index node) const { return B_.OnNode(node); }
+    PagePolicy policy() const { return B_.policy(); }
+
+    // nullptr without a bias.
+    const float *LocalBias() const { return bias_.empty() ? nullptr : bias_.Local(); }
+
+  private:
+    NumaReplicas<Integer> B_;
+    NumaReplicas<float> bias_;
+};
+
+} // namespace intgemm
@@ -51,20 +51,28 @@ struct Kernels16 {
   }
 
   INTGEMM_SSE2 static void Quantize(const float *input, int16_t *output, float quant_mult, Index size) {
-    assert(size % 8 == 0);
     assert(reinterpret_cast<uintptr_t>(input) % 16 == 0);
     assert(reinterpret_cast<uintptr_t>(output) % 16 == 0);
     FRegister q = set1_ps<FRegister>(quant_mult);
-    const float *end = input + size;
+    const float *end = input + (size & ~7);
     for (; input != end; input += 8, output += 8) {
       *reinterpret_cast<__m128i*>(output) = QuantizeTile16::Consecutive(q, input);
     }
+    // Quantize the remainder from a zero-padded copy.
+    const Index overhang = size & 7;
+    if (!overhang) return;
+    alignas(16) float padded[8] = {0};
+    std::memcpy(padded, input, overhang * sizeof(float));
+    __m128i result = QuantizeTile16::Consecutive(q, padded);
+    std::memcpy(output, &result, overhang * sizeof(int16_t));
   }
 
   // Tile size for B; B must be a multiple of this block size.
   static const Index kBTileRow = 8;
   static const Index kBTileCol = 8;
 
+  INTGEMM_QUANTIZE_ROWS(INTGEMM_SSE2, int16_t, QuantizeTile16)
+
   INTGEMM_PREPARE_B_16(INTGEMM_SSE2, QuantizeTile16)
   INTGEMM_PREPARE_B_QUANTIZED_TRANSPOSED(INTGEMM_SSE2, int16_t)
   INTGEMM_PREPARE_B_TRANSPOSED(INTGEMM_SSE2, QuantizeTile16, int16_t)
@@ -73,8 +81,18 @@ struct Kernels16 {
     //TODO #DEFINE
     SelectColumnsOfB((const __m128i*)input, (__m128i*)output, rows * 2, cols_begin, cols_end);
   }
+  // Rows of A that share each load of B in Multiply.  Two rows of sums don't
+  // fit in 16 registers.
+  static const Index kMultiplyRows = 1;
+  // Columns of B in each tile of the output that Multiply passes to callbacks.
+  static const Index kMultiplyCols = 8;
+  // Multiply adds in 32 bits, which wrap, so the inner dimension may be split.
+  static const bool kSaturates = false;
+
   INTGEMM_MULTIPLY16(__m128i, INTGEMM_SSE2, CPUType::SSE2)
 
+  INTGEMM_MULTIPLY16WIDE(__m128i, INTGEMM_SSE2, CPUType::SSE2)
+
   constexpr static const char *const kName = "16-bit SSE2";
 
   static const CPUType kUses = CPUType::SSE2;
@@ -131,6 +131,9 @@ struct Kernels8 {
   static const Index kBTileRow = 16;
   static const Index kBTileCol = 8;
 
+  INTGEMM_QUANTIZE_ROWS(INTGEMM_SSSE3, int8_t, QuantizeTile8)
+  INTGEMM_MAX_ABSOLUTE_SERIAL(INTGEMM_SSSE3)
+
   INTGEMM_PREPARE_B_8(INTGEMM_SSSE3, ssse3::QuantizeTile8)
   INTGEMM_PREPARE_B_QUANTIZED_TRANSPOSED(INTGEMM_SSSE3, int8_t)
   INTGEMM_PREPARE_B_TRANSPOSED(INTGEMM_SSSE3, QuantizeTile8, int8_t)
@@ -139,8 +142,20 @@ struct Kernels8 {
     ssse3::SelectColumnsOfB((const __m128i*)input, (__m128i*)output, rows, cols_begin, cols_end);
   }
 
+  // Rows of A that share each load of B in Multiply.  Two rows of sums don't
+  // fit in 16 registers.
+  static const Index kMultiplyRows = 1;
+  // Columns of B in each tile of the output that Multiply passes to callbacks.
+  static const Index kMultiplyCols = 8;
+  // Multiply adds 8-bit products in saturating 16-bit lanes, so its sums
+  // depend on where the inner dimension is split.  Split-width paths check
+  // this.
+  static const bool kSaturates = true;
+
   INTGEMM_MULTIPLY8(__m128i, INTGEMM_SSSE3, CPUType::SSE2)
 
+  INTGEMM_MULTIPLY8WIDE(__m128i, INTGEMM_SSSE3, CPUType::SSE2)
+
   INTGEMM_MULTIPLY8SHIFT(__m128i, INTGEMM_SSSE3, CPUType::SSE2)
 
   INTGEMM_PREPAREBIASFOR8(__m128i, INTGEMM_SSSE3, CPUType::SSE2)
@@ -0,0 +1,173 @@
+#include "thread_pool.h"
+#include "numa.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace intgemm {
+
+ThreadPool *SharedThreadPool = nullptr;
+
+thread_local bool ThreadPool::in_job_ = false;
+
+namespace {
+
+inline uint64_t Pack(Index begin, Index end) {
+  return (static_cast<uint64_t>(begin) << 32) | end;
+}
+inline Index Begin(uint64_t range) { return static_cast<Index>(range >> 32); }
+inline Index End(uint64_t range) { return static_cast<Index>(range); }
+
+#ifdef __linux__
+// Pin thread to the index-th CPU (mod how many) this process may run on.
+// Returns the CPU, -1 on failure.
+int Pin(std::thread &thread, Index index) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed)) return -1;
+  const int count = CPU_COUNT(&allowed);
+  if (!count) return -1;
+  int skip = static_cast<int>(index % count);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed) || skip--) continue;
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(one), &one) ? -1 : cpu;
+  }
+  return -1;
+}
+#endif
+
+} // namespace
+
+ThreadPool::ThreadPool(Index threads, bool pin, unsigned int spin_us)
+  : threads_(threads ? threads : 1), spin_us_(spin_us), queues_(new Queue[threads_]),
+    numa_(pin && NumaNodes() > 1), nodes_(threads_, 0), order_(threads_),
+    call_(nullptr), task_(nullptr), pending_(0), open_(0), busy_(0),
+    generation_(0), sleeping_(0), stop_(false) {
+  for (Index i = 0; i < threads_; ++i) {
+    queues_[i].range.store(0, std::memory_order_relaxed);
+    order_[i] = i;
+  }
+  workers_.reserve(threads_ - 1);
+  for (Index i = 1; i < threads_; ++i) {
+    workers_.emplace_back(&ThreadPool::Worker, this, i);
+#ifdef __linux__
+    if (pin) {
+      const int cpu = Pin(workers_.back(), i);
+      if (numa_ && cpu >= 0) nodes_[i] = NumaNodeOfCPU(cpu);
+    }
+#else
+    (void)pin;
+#endif
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  stop_.store(true);
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    generation_.fetch_add(1);
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_) worker.join();
+}
+
+void ThreadPool::Run(Index tasks, void (*call)(const void *, Index), const void *task) {
+  if (numa_) {
+    nodes_[0] = CurrentNumaNode();
+    std::stable_sort(order_.begin(), order_.end(), [this](Index a, Index b) { return nodes_[a] < nodes_[b]; });
+  }
+  for (Index i = 0; i < threads_; ++i) {
+    queues_[order_[i]].range.store(Pack(static_cast<Index>(uint64_t(tasks) * i / threads_), static_cast<Index>(uint64_t(tasks) * (i + 1) / threads_)), std::memory_order_relaxed);
+  }
+  call_ = call;
+  task_ = task;
+  pending_.store(tasks, std::memory_order_relaxed);
+  const uint64_t generation = generation_.load(std::memory_order_relaxed) + 1;
+  open_.store(generation);
+  generation_.store(generation);
+  if (sleeping_.load()) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    wake_.notify_all();
+  }
+  in_job_ = true;
+  Work(0);
+  in_job_ = false;
+  // Tasks taken by workers may still be running.
+  while (pending_.load(std::memory_order_acquire)) _mm_pause();
+  // Close the job and wait for workers still looking at it to leave.
+  open_.store(0);
+  while (busy_.load()) _mm_pause();
+}
+
+bool ThreadPool::Pop(Queue &queue, Index &task) {
+  uint64_t range = queue.range.load(std::memory_order_relaxed);
+  while (Begin(range) < End(range)) {
+    if (queue.range.compare_exchange_weak(range, Pack(Begin(range) + 1, End(range)), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+      task = Begin(range);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Move the back half of victim's tasks to self, which must be empty.
+bool ThreadPool::Steal(Queue &victim, Queue &self) {
+  uint64_t range = victim.range.load(std::memory_order_relaxed);
+  while (Begin(range) < End(range)) {
+    const Index split = End(range) - (End(range) - Begin(range) + 1) / 2;
+    if (victim.range.compare_exchange_weak(range, Pack(Begin(range), split), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+      self.range.store(Pack(split, End(range)), std::memory_order_release);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::Work(Index self) {
+  Queue &mine = queues_[self];
+  Index task;
+  bool stole;
+  do {
+    while (Pop(mine, task)) {
+      call_(task_, task);
+      pending_.fetch_sub(1, std::memory_order_release);
+    }
+    stole = false;
+    for (Index offset = 1; offset < threads_ && !stole; ++offset) {
+      const Index victim = (self + offset) % threads_;
+      if (nodes_[victim] == nodes_[self]) stole = Steal(queues_[victim], mine);
+    }
+  } while (stole);
+}
+
+void ThreadPool::Worker(Index self) {
+  in_job_ = true;
+  uint64_t seen = 0;
+  while (true) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(spin_us_);
+    for (unsigned int spins = 1; generation_.load(std::memory_order_acquire) == seen; ++spins) {
+      _mm_pause();
+      if (spins % 64 == 0 && std::chrono::steady_clock::now() > deadline) {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleeping_.fetch_add(1);
+        wake_.wait(lock, [this, seen] { return generation_.load() != seen; });
+        sleeping_.fetch_sub(1);
+        break;
+      }
+    }
+    if (stop_.load()) return;
+    seen = generation_.load();
+    busy_.fetch_add(1);
+    if (open_.load() == seen) Work(self);
+    busy_.fetch_sub(1);
+  }
+}
+
+} // namespace intgemm
@@ -0,0 +1,127 @@
+#pragma once
+#include "types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace intgemm {
+
+/* Persistent threads for the Multiply wrappers and Quantize, an alternative to
+ * OpenMP that needs no compiler support and keeps its threads between calls.
+ *
+ * ParallelFor runs tasks numbered 0 to tasks - 1.  Each thread starts with a
+ * contiguous range of them and takes tasks from the front; a thread that runs
+ * out steals the back half of another thread's range.  The calling thread
+ * works as thread 0 so the pool starts threads - 1 workers.  Between calls
+ * workers spin for spin_us microseconds, so back-to-back small multiplies
+ * don't pay the latency of waking them, then sleep.  Spinning takes cores
+ * from other work, so use spin_us = 0 when threads outnumber cores.  With
+ * pin, worker i is pinned to the i-th CPU the process may run on (Linux only);
+ * the calling thread is left alone.
+ *
+ * A pinned pool spanning NUMA nodes hands out ranges so each node's threads
+ * get consecutive tasks, and threads only steal from threads on their node,
+ * so a column strip of B stays on one node (see ReplicatedB).
+ *
+ * Calls from a task (of any pool) or from another thread while the pool is
+ * busy run their tasks in order on the calling thread.  Tasks must not throw.
+ */
+class ThreadPool {
+  public:
+    explicit ThreadPool(Index threads, bool pin = false, unsigned int spin_us = 100);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    Index Threads() const { return threads_; }
+
+    // Call task(i) for i in [0, tasks), returning when all are done.
+    template <class Task> void ParallelFor(Index tasks, const Task &task) {
+      // A task's thread may already hold run_mutex_, so check in_job_ before
+      // locking.  try_lock only fails for calls from other threads.
+      std::unique_lock<std::mutex> lock;
+      if (threads_ == 1 || tasks < 2 || in_job_ || !(lock = std::unique_lock<std::mutex>(run_mutex_, std::try_to_lock))) {
+        for (Index i = 0; i < tasks; ++i) task(i);
+        return;
+      }
+      Run(tasks, &CallTask<Task>, &task);
+    }
+
+  private:
+    template <class Task> static void CallTask(const void *task, Index i) {
+      (*static_cast<const Task*>(task))(i);
+    }
+
+    // Range of tasks owned by a thread as begin << 32 | end.  Padded to a
+    // cache line so owners taking tasks don't contend.
+    struct Queue {
+      std::atomic<uint64_t> range;
+      char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    void Run(Index tasks, void (*call)(const void *, Index), const void *task);
+    void Work(Index self);
+    bool Pop(Queue &queue, Index &task);
+    bool Steal(Queue &victim, Queue &self);
+    void Worker(Index self);
+
+    const Index threads_;
+    const unsigned int spin_us_;
+    std::unique_ptr<Queue[]> queues_;
+
+    // NUMA node of each thread if pinned across nodes, else all 0.  The
+    // calling thread's is looked up for each job.
+    bool numa_;
+    std::vector<Index> nodes_;
+    // Threads by node, the order ranges are handed out in.
+    std::vector<Index> order_;
+
+    // The current job.
+    void (*call_)(const void *, Index);
+    const void *task_;
+    std::atomic<Index> pending_;
+    // Generation of the job workers may join, 0 once it is closed.
+    std::atomic<uint64_t> open_;
+    // Workers that might be looking at the job.
+    std::atomic<Index> busy_;
+
+    std::atomic<uint64_t> generation_;
+    std::atomic<Index> sleeping_;
+    std::atomic<bool> stop_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+
+    // Held while a job runs.
+    std::mutex run_mutex_;
+    // Set on workers and on a calling thread while it runs a job.
+    static thread_local bool in_job_;
+    std::vector<std::thread> workers_;
+};
+
+/* Pool used by the Multiply wrappers, Quantize and PrepareA, nullptr (the
+ * default) for OpenMP if compiled with it.  Set it while nothing multiplies.
+ */
+extern ThreadPool *SharedThreadPool;
+
+// Set SharedThreadPool for the lifetime of the object.
+class ScopedThreadPool {
+  public:
+    explicit ScopedThreadPool(ThreadPool &pool) : previous_(SharedThreadPool) {
+      SharedThreadPool = &pool;
+    }
+    ~ScopedThreadPool() { SharedThreadPool = previous_; }
+
+    ScopedThreadPool(const ScopedThreadPool&) = delete;
+    ScopedThreadPool& operator=(const ScopedThreadPool&) = delete;
+
+  private:
+    ThreadPool *previous_;
+};
+
+} // namespace intgemm
@@ -9,6 +9,7 @@
   #define INTGEMM_SSE2
   #define INTGEMM_SSSE3
   #define INTGEMM_AVX2
+  #define INTGEMM_AVXVNNI
   #define INTGEMM_AVX512F
   #define INTGEMM_AVX512BW
   #define INTGEMM_AVX512DQ
@@ -20,18 +21,29 @@
   #define INTGEMM_AVX2 __attribute__ ((target ("avx2")))
   #if defined(__INTEL_COMPILER)
     /* Intel compiler might not have AVX512 flavors but lets you use them anyway */
+    #define INTGEMM_AVXVNNI __attribute__ ((target ("avx2")))
     #define INTGEMM_AVX512F __attribute__ ((target ("avx512f")))
     #define INTGEMM_AVX512BW __attribute__ ((target ("avx512f")))
     #define INTGEMM_AVX512DQ __attribute__ ((target ("avx512f")))
     #define INTGEMM_AVX512VNNI __attribute__ ((target ("avx512f")))
   #else
     /* gcc and clang take lists of all the flavors */
+    #define INTGEMM_AVXVNNI __attribute__ ((target ("avx2,avxvnni")))
     #define INTGEMM_AVX512F __attribute__ ((target ("avx512f")))
     #define INTGEMM_AVX512BW __attribute__ ((target ("avx512f,avx512bw,avx512dq")))
     #define INTGEMM_AVX512DQ __attribute__ ((target ("avx512f,avx512bw,avx512dq")))
     #define INTGEMM_AVX512VNNI __attribute__ ((target ("avx512f,avx512bw,avx512dq,avx512vnni")))
   #endif
 #endif
+
+/* Force inlining where a helper takes sums by reference, so they stay in
+ * registers instead of going through memory.
+ */
+#if defined(_MSC_VER)
+  #define INTGEMM_INLINE __forceinline
+#else
+  #define INTGEMM_INLINE inline __attribute__ ((always_inline))
+#endif
 namespace intgemm {
 
 // This will be thrown if a CPU isn't supported by the routines (16-bit without SSE2 or 8-bit without SSSE3).
@@ -54,6 +66,9 @@ enum class CPUType {
   SSE2,
   SSSE3,
   AVX2,
+  // 256-bit VNNI without AVX512.  AVX512 CPUs need not support it, so check
+  // CPUSupportsAVXVNNI() rather than comparing kCPU against this.
+  AVXVNNI,
   AVX512BW,
   AVX512VNNI
 };
@@ -61,6 +76,15 @@ enum class CPUType {
 // Running CPU type.  This is defined in intgemm.cc (as the dispatcher).
 extern const CPUType kCPU;
 
+// How Int8::Multiply and Int16::Multiply accumulate.
+enum class Accumulation {
+  // Fastest.  8-bit sums saturate at 16 bits; 16-bit sums wrap at 32 bits.
+  Native,
+  // Sums are widened every step so they neither saturate nor wrap.  16-bit
+  // totals are saturated to 32 bits for the callback.
+  Wide
+};
+
 struct MeanStd {
   float mean;
   float stddev;
@@ -78,6 +102,12 @@ typedef __m512i Register;
 typedef __m512 FRegister;
 } // namespace avx512bw
 #endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+namespace avxvnni {
+typedef __m256i Register;
+typedef __m256 FRegister;
+} // namespace avxvnni
+#endif
 namespace avx2 {
 typedef __m256i Register;
 typedef __m256 FRegister;
@@ -0,0 +1,83 @@
+#include "workspace.h"
+
+#include <algorithm>
+
+namespace intgemm {
+
+thread_local Workspace *ScratchWorkspace = nullptr;
+
+namespace {
+const std::size_t kAlign = 64;
+// Smallest block added when the workspace runs out.
+const std::size_t kMinBlock = 64 * 1024;
+} // namespace
+
+Workspace::Workspace(std::size_t bytes, PagePolicy policy)
+  : policy_(policy), current_(0), used_(0), high_water_(0), capacity_(0) {
+  if (bytes) AddBlock(bytes);
+}
+
+void Workspace::AddBlock(std::size_t bytes) {
+  bytes = (bytes + kAlign - 1) & ~(kAlign - 1);
+  blocks_.emplace_back(new Block(bytes, policy_));
+  capacity_ += bytes;
+  current_ = blocks_.size() - 1;
+}
+
+void *Workspace::AllocateBytes(std::size_t bytes) {
+  bytes = (bytes + kAlign - 1) & ~(kAlign - 1);
+  while (true) {
+    if (current_ < blocks_.size()) {
+      Block &block = *blocks_[current_];
+      if (block.memory.size() - block.used >= bytes) {
+        void *ret = block.memory.begin() + block.used;
+        block.used += bytes;
+        used_ += bytes;
+        high_water_ = std::max(high_water_, used_);
+        return ret;
+      }
+      if (current_ + 1 < blocks_.size()) {
+        ++current_;
+        continue;
+      }
+    }
+    AddBlock(std::max(std::max(bytes, kMinBlock), 2 * capacity_));
+  }
+}
+
+Workspace::Mark Workspace::Position() const {
+  Mark ret;
+  ret.block = current_;
+  ret.used = current_ < blocks_.size() ? blocks_[current_]->used : 0;
+  return ret;
+}
+
+void Workspace::Rewind(Mark mark) {
+  if (blocks_.empty()) return;
+  for (std::size_t i = mark.block + 1; i < blocks_.size(); ++i) {
+    used_ -= blocks_[i]->used;
+    blocks_[i]->used = 0;
+  }
+  used_ -= blocks_[mark.block]->used - mark.used;
+  blocks_[mark.block]->used = mark.used;
+  current_ = mark.block;
+}
+
+void Workspace::Reset() {
+  if (blocks_.size() > 1) {
+    blocks_.clear();
+    capacity_ = 0;
+    AddBlock(high_water_);
+  } else if (!blocks_.empty()) {
+    blocks_.front()->used = 0;
+  }
+  current_ = 0;
+  used_ = 0;
+}
+
+Workspace &ThreadWorkspace() {
+  static thread_local Workspace workspace;
+  return workspace;
+}
+
+} // namespace intgemm
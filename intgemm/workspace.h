@@ -0,0 +1,133 @@
+#pragma once
+#include "aligned.h"
+#include "types.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace intgemm {
+
+/* Arena for scratch memory such as prepared A and output buffers that live
+ * for one request.  Allocations are 64-byte aligned and carved from blocks
+ * that are kept across Reset, so a steady state of requests doesn't call
+ * malloc or fault in pages.  When a request outgrows the blocks, another block
+ * at least twice as large as all before it is added; Reset then replaces them
+ * with one block of the high-water mark.
+ *
+ * Not thread safe: use one per thread, such as ThreadWorkspace().
+ */
+class Workspace {
+  public:
+    // Start with bytes of capacity, allocating blocks with policy.
+    explicit Workspace(std::size_t bytes = 0, PagePolicy policy = PagePolicy::Default);
+
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    // Uninitialized space for count objects of T, valid until Reset or a
+    // Rewind to before it.
+    template <class T> T *Allocate(std::size_t count) {
+      return static_cast<T*>(AllocateBytes(count * sizeof(T)));
+    }
+    void *AllocateBytes(std::size_t bytes);
+
+    // Position to Rewind to, freeing everything allocated since.
+    struct Mark {
+      std::size_t block;
+      std::size_t used;
+    };
+    Mark Position() const;
+    void Rewind(Mark mark);
+
+    // Free all allocations.
+    void Reset();
+
+    // Bytes allocated now, including alignment padding.
+    std::size_t Used() const { return used_; }
+    // Most bytes allocated at once since construction.
+    std::size_t HighWater() const { return high_water_; }
+    // Bytes in blocks.
+    std::size_t Capacity() const { return capacity_; }
+
+  private:
+    struct Block {
+      Block(std::size_t bytes, PagePolicy policy) : memory(bytes, policy), used(0) {}
+      AlignedVector<char> memory;
+      std::size_t used;
+    };
+
+    void AddBlock(std::size_t bytes);
+
+    const PagePolicy policy_;
+    // Blocks after current_ are empty.
+    std::vector<std::unique_ptr<Block>> blocks_;
+    std::size_t current_;
+    std::size_t used_, high_water_, capacity_;
+};
+
+// The calling thread's own Workspace, for concurrent callers.
+Workspace &ThreadWorkspace();
+
+/* If set, temporaries inside intgemm calls on this thread, like the partial
+ * sums of MultiplyBlocked and padded copies of A, come from this workspace
+ * and are rewound before the call returns.  Otherwise they are allocated.
+ */
+extern thread_local Workspace *ScratchWorkspace;
+
+// Set ScratchWorkspace on this thread for the lifetime of the object.
+class ScopedWorkspace {
+  public:
+    explicit ScopedWorkspace(Workspace &workspace) : previous_(ScratchWorkspace) {
+      ScratchWorkspace = &workspace;
+    }
+    ~ScopedWorkspace() { ScratchWorkspace = previous_; }
+
+    ScopedWorkspace(const ScopedWorkspace&) = delete;
+    ScopedWorkspace& operator=(const ScopedWorkspace&) = delete;
+
+  private:
+    Workspace *previous_;
+};
+
+/* Temporary array from ScratchWorkspace when set, otherwise an AlignedVector.
+ * Must be destroyed in reverse order of construction, as locals are.
+ */
+template <class T> class ScratchBuffer {
+  public:
+    explicit ScratchBuffer(std::size_t size)
+      : workspace_(ScratchWorkspace), owned_(workspace_ ? 0 : size), size_(size) {
+      if (workspace_) {
+        mark_ = workspace_->Position();
+        begin_ = workspace_->Allocate<T>(size);
+      } else {
+        begin_ = owned_.begin();
+      }
+    }
+
+    ~ScratchBuffer() {
+      if (workspace_) workspace_->Rewind(mark_);
+    }
+
+    ScratchBuffer(const ScratchBuffer&) = delete;
+    ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+    std::size_t size() const { return size_; }
+
+    T &operator[](std::size_t offset) { return begin_[offset]; }
+    const T &operator[](std::size_t offset) const { return begin_[offset]; }
+
+    T *begin() { return begin_; }
+    const T *begin() const { return begin_; }
+    T *end() { return begin_ + size_; }
+    const T *end() const { return begin_ + size_; }
+
+  private:
+    Workspace *const workspace_;
+    Workspace::Mark mark_;
+    AlignedVector<T> owned_;
+    T *begin_;
+    std::size_t size_;
+};
+
+} // namespace intgemm
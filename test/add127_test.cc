@@ -279,6 +279,56 @@ template <class Routine> void TestMultiplyShiftInt(Index A_rows, Index width, In
 }
 
 
+// Splitting rows of A across tasks should give exactly the same 32-bit sums.
+template <class Routine> void TestMultiply8ShiftBlocked(Index A_rows, Index width, Index B_cols, Index row_block) {
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\trow block " << row_block << '\n';
+
+  AlignedVector<float> A(A_rows * width);
+  AlignedVector<float> B(width * B_cols);
+  std::mt19937 gen;
+  FillUniform(A, gen);
+  FillUniform(B, gen);
+
+  float quant_mult = 127.0f / 2.0f;
+  AlignedVector<uint8_t> A_prep(A.size());
+  AlignedVector<int8_t> B_prep(B.size());
+  Routine::PrepareA(A.begin(), A_prep.begin(), quant_mult, A_rows, width);
+  Routine::PrepareB(B.begin(), B_prep.begin(), quant_mult, width, B_cols);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols);
+  Routine::Multiply8Shift(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  AlignedVector<int32_t> test_C(A_rows * B_cols);
+  Multiply8ShiftBlocked<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin()), row_block);
+
+  // The wrapper picks its own split from the threads.
+  AlignedVector<int32_t> wrapped_C(A_rows * B_cols);
+  OMPParallelWrap8Shift<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(wrapped_C.begin()));
+
+  // And on a thread pool.
+  AlignedVector<int32_t> pool_C(A_rows * B_cols);
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrap8Shift<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(pool_C.begin()));
+  }
+
+  for (std::size_t i = 0; i < test_C.size(); ++i) {
+    INFO(info.str() << "Index " << i);
+    CHECK(test_C[i] == expected[i]);
+    CHECK(wrapped_C[i] == expected[i]);
+    CHECK(pool_C[i] == expected[i]);
+  }
+}
+
+template <class Routine> void TestMultiply8ShiftBlockedShapes() {
+  // Rows only, as for a tall and skinny product.
+  TestMultiply8ShiftBlocked<Routine>(37, 128, 8, 5);
+  // Rows and columns, ending halfway through a 16-column tile.
+  TestMultiply8ShiftBlocked<Routine>(11, 64, 40, 3);
+  TestMultiply8ShiftBlocked<Routine>(4, 256, 24, 1);
+}
+
 // Bias
 TEST_CASE("PrepareBias SSSE3", "[Add127]") {
 	if (kCPU < CPUType::SSSE3) return;
@@ -294,6 +344,15 @@ TEST_CASE("PrepareBias AVX2", "[Add127]") {
 	TestPrepareBias<avx2::Kernels8>(512,512);
 }
 
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+TEST_CASE("PrepareBias AVXVNNI", "[Add127]") {
+	if (!CPUSupportsAVXVNNI()) return;
+	TestPrepareBias<avxvnni::Kernels8>(256,256);
+	TestPrepareBias<avxvnni::Kernels8>(2048,256);
+	TestPrepareBias<avxvnni::Kernels8>(512,512);
+}
+#endif
+
 TEST_CASE("PrepareBias AVX512F", "[Add127]") {
 	if (kCPU < CPUType::AVX512BW) return;
 	#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
@@ -353,6 +412,19 @@ TEST_CASE ("Multiply AVX2 8bit Shift with bias", "[Add127]") {
   TestMultiplyBiasNew<avx2::Kernels8>(248, 256, 256, 0.48f, 0.64f, 0.16f, 0.15f);
   TestMultiplyBiasNew<avx2::Kernels8>(200, 256, 256, 0.55f, 0.74f, 0.17f, 0.16f);
 }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+TEST_CASE ("Multiply AVXVNNI 8bit Shift with bias", "[Add127]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyBiasNew<avxvnni::Kernels8>(1, 64, 8, 0.0001f, 0.11f, 0.06f, 0.001f);
+  TestMultiplyBiasNew<avxvnni::Kernels8>(8, 256, 256, 0.0001f, 0.54f, 0.17f, 0.001f);
+  TestMultiplyBiasNew<avxvnni::Kernels8>(8, 2048, 256, 0.0001f, 1.66f, 0.46f, 0.001f);
+  TestMultiplyBiasNew<avxvnni::Kernels8>(320, 256, 256, 0.0001f, 0.64f, 0.16f, 0.001f);
+  TestMultiplyBiasNew<avxvnni::Kernels8>(472, 256, 256, 0.0001f, 0.62f, 0.17f, 0.001f);
+  TestMultiplyBiasNew<avxvnni::Kernels8>(248, 256, 256, 0.0001f, 0.64f, 0.16f, 0.001f);
+  TestMultiplyBiasNew<avxvnni::Kernels8>(200, 256, 256, 0.0001f, 0.74f, 0.17f, 0.001f);
+}
+#endif
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
 TEST_CASE ("Multiply AVX512F 8bit Shift with bias", "[Add127]") {
   if (kCPU < CPUType::AVX512BW) return;
@@ -370,6 +442,7 @@ TEST_CASE ("Multiply AVX512F 8bit Shift with bias", "[Add127]") {
   TEST_CASE ("Multiply AVX512VNNI 8bit Shift with bias", "[Add127]") {
     if (kCPU < CPUType::AVX512VNNI) return;
     TestMultiplyBiasNew<avx512vnni::Kernels8>(1, 64, 8, 0.0001f, 0.05f, 0.03f, 0.001f);
+    TestMultiplyBiasNew<avx512vnni::Kernels8>(3, 64, 24, 0.0001f, 0.2f, 0.06f, 0.001f);
     TestMultiplyBiasNew<avx512vnni::Kernels8>(8, 256, 256, 0.0001f, 0.22f, 0.06f, 0.001f);
     TestMultiplyBiasNew<avx512vnni::Kernels8>(8, 2048, 256, 0.0001f, 0.61f, 0.17f, 0.001f);
     TestMultiplyBiasNew<avx512vnni::Kernels8>(320, 256, 256, 0.0001f, 0.27f, 0.06f, 0.001f);
@@ -401,6 +474,19 @@ TEST_CASE ("Multiply AVX2 8bit Shift vs nonshift", "[Add127]") {
   TestMultiplyShiftNonShift<avx2::Kernels8>(248, 256, 256, 0.0001f, 0.64f, 0.16f, 0.0001f);
   TestMultiplyShiftNonShift<avx2::Kernels8>(200, 256, 256, 0.0001f, 0.74f, 0.17f, 0.0001f);
 }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+TEST_CASE ("Multiply AVXVNNI 8bit Shift vs nonshift", "[Add127]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(1, 64, 8, 0.00001f, 0.11f, 0.06f, 0.00001f);
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(8, 256, 256, 0.00001f, 0.54f, 0.17f, 0.00001f);
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(8, 2048, 256, 0.0001f, 1.66f, 0.46f, 0.0001f);
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(320, 256, 256, 0.00001f, 0.64f, 0.16f, 0.00001f);
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(472, 256, 256, 0.00001f, 0.62f, 0.17f, 0.00001f);
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(248, 256, 256, 0.00001f, 0.64f, 0.16f, 0.00001f);
+  TestMultiplyShiftNonShift<avxvnni::Kernels8>(200, 256, 256, 0.00001f, 0.74f, 0.17f, 0.00001f);
+}
+#endif
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
 TEST_CASE ("Multiply AVX512F 8bit Shift vs nonshift", "[Add127]") {
   if (kCPU < CPUType::AVX512BW) return;
@@ -449,6 +535,19 @@ TEST_CASE ("Multiply AVX2 8bit Shift vs Int", "[Add127]") {
   TestMultiplyShiftInt<avx2::Kernels8>(248, 256, 256, 0.0001f, 0.64f, 0.16f, 0.0001f);
   TestMultiplyShiftInt<avx2::Kernels8>(200, 256, 256, 0.0001f, 0.74f, 0.17f, 0.0001f);
 }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+TEST_CASE ("Multiply AVXVNNI 8bit Shift vs Int", "[Add127]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyShiftInt<avxvnni::Kernels8>(1, 64, 8, 0.0001f, 0.11f, 0.06f, 0.0001f);
+  TestMultiplyShiftInt<avxvnni::Kernels8>(8, 256, 256, 0.0001f, 0.54f, 0.17f, 0.0001f);
+  TestMultiplyShiftInt<avxvnni::Kernels8>(8, 2048, 256, 0.0001f, 1.66f, 0.46f, 0.0001f);
+  TestMultiplyShiftInt<avxvnni::Kernels8>(320, 256, 256, 0.0001f, 0.64f, 0.16f, 0.0001f);
+  TestMultiplyShiftInt<avxvnni::Kernels8>(472, 256, 256, 0.0001f, 0.62f, 0.17f, 0.0001f);
+  TestMultiplyShiftInt<avxvnni::Kernels8>(248, 256, 256, 0.0001f, 0.64f, 0.16f, 0.0001f);
+  TestMultiplyShiftInt<avxvnni::Kernels8>(200, 256, 256, 0.0001f, 0.74f, 0.17f, 0.0001f);
+}
+#endif
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
 TEST_CASE ("Multiply AVX512F 8bit Shift vs Int", "[Add127]") {
   if (kCPU < CPUType::AVX512BW) return;
@@ -475,5 +574,36 @@ TEST_CASE ("Multiply AVX512VNNI 8bit Shift vs Int", "[Add127]") {
 }
 #endif
 
+TEST_CASE ("Multiply SSSE3 8bit Shift blocked", "[Add127]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiply8ShiftBlockedShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply AVX2 8bit Shift blocked", "[Add127]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiply8ShiftBlockedShapes<avx2::Kernels8>();
+}
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+TEST_CASE ("Multiply AVXVNNI 8bit Shift blocked", "[Add127]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiply8ShiftBlockedShapes<avxvnni::Kernels8>();
+}
+#endif
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+TEST_CASE ("Multiply AVX512F 8bit Shift blocked", "[Add127]") {
+  if (kCPU < CPUType::AVX512BW) return;
+  TestMultiply8ShiftBlockedShapes<avx512bw::Kernels8>();
+}
+#endif
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+TEST_CASE ("Multiply AVX512VNNI 8bit Shift blocked", "[Add127]") {
+  if (kCPU < CPUType::AVX512VNNI) return;
+  TestMultiply8ShiftBlockedShapes<avx512vnni::Kernels8>();
+}
+#endif
+
 } // namespace
 } // namespace intgemm
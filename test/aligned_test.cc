@@ -0,0 +1,41 @@
+#include "test.h"
+#include "../intgemm/aligned.h"
+
+#include <cstdint>
+
+namespace intgemm {
+namespace {
+
+// Every policy should give writable, aligned memory whether or not huge pages
+// are available.
+void TestPagePolicy(std::size_t size, PagePolicy policy) {
+  INFO("Size " << size << " policy " << static_cast<int>(policy));
+  AlignedVector<int32_t> vec(size, policy);
+  CHECK(vec.size() == size);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(vec.begin());
+  CHECK(address % 64 == 0);
+  if (vec.policy() != PagePolicy::Default) {
+    CHECK(address % (2 << 20) == 0);
+  }
+  for (std::size_t i = 0; i < size; ++i) vec[i] = static_cast<int32_t>(i);
+  for (std::size_t i = 0; i < size; ++i) {
+    if (vec[i] != static_cast<int32_t>(i)) {
+      CHECK(vec[i] == static_cast<int32_t>(i));
+      break;
+    }
+  }
+}
+
+TEST_CASE("AlignedVector page policies", "[aligned]") {
+  const PagePolicy policies[] = {PagePolicy::Default, PagePolicy::TransparentHuge, PagePolicy::ExplicitHuge};
+  for (PagePolicy policy : policies) {
+    TestPagePolicy(100, policy);
+    TestPagePolicy(1 << 20, policy);
+    TestPagePolicy((3 << 20) / 4 + 5, policy);
+  }
+  // Small allocations aren't worth a huge page.
+  CHECK(AlignedVector<char>(4096, PagePolicy::TransparentHuge).policy() == PagePolicy::Default);
+}
+
+} // namespace
+} // namespace intgemm
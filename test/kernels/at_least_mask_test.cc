@@ -0,0 +1,43 @@
+#include "../test.h"
+#include "../../intgemm/aligned.h"
+#include "../../intgemm/kernels.h"
+
+#include <numeric>
+
+namespace intgemm {
+
+template <CPUType CPUType_>
+void kernel_at_least_mask_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using vec_t = vector_t<CPUType_, float>;
+  constexpr static std::size_t VECTOR_LENGTH = sizeof(vec_t) / sizeof(float);
+
+  AlignedVector<float> input(VECTOR_LENGTH);
+  std::iota(input.begin(), input.end(), -2.0f);
+
+  for (std::size_t count = 1; count <= VECTOR_LENGTH + 1; ++count) {
+    for (float threshold = -3.0f; threshold <= VECTOR_LENGTH; threshold += 0.5f) {
+      unsigned expected = 0;
+      for (std::size_t i = 0; i < std::min(count, VECTOR_LENGTH); ++i) {
+        if (input[i] >= threshold) expected |= 1u << i;
+      }
+      INFO("Count " << count << " threshold " << threshold);
+      CHECK(kernels::at_least_mask(*input.template as<vec_t>(), threshold, count) == expected);
+    }
+  }
+}
+
+template INTGEMM_SSE2 void kernel_at_least_mask_test<CPUType::SSE2>();
+KERNEL_TEST_CASE("at_least_mask SSE2") { return kernel_at_least_mask_test<CPUType::SSE2>(); }
+
+template INTGEMM_AVX2 void kernel_at_least_mask_test<CPUType::AVX2>();
+KERNEL_TEST_CASE("at_least_mask AVX2") { return kernel_at_least_mask_test<CPUType::AVX2>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_at_least_mask_test<CPUType::AVX512BW>();
+KERNEL_TEST_CASE("at_least_mask AVX512BW") { return kernel_at_least_mask_test<CPUType::AVX512BW>(); }
+#endif
+
+}
@@ -25,6 +25,9 @@ void kernel_exp_approx_taylor_test() {
     CHECK_EPS(output[i], exp(input[i]), 0.001f);
 }
 
+template INTGEMM_SSE2 void kernel_exp_approx_taylor_test<CPUType::SSE2>();
+KERNEL_TEST_CASE("exp_approx_taylor SSE2") { return kernel_exp_approx_taylor_test<CPUType::SSE2>(); }
+
 template INTGEMM_AVX2 void kernel_exp_approx_taylor_test<CPUType::AVX2>();
 KERNEL_TEST_CASE("exp_approx_taylor AVX2") { return kernel_exp_approx_taylor_test<CPUType::AVX2>(); }
 
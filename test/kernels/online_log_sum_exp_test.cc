@@ -0,0 +1,56 @@
+#include "../test.h"
+#include "../../intgemm/aligned.h"
+#include "../../intgemm/kernels.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace intgemm {
+
+template <CPUType CPUType_>
+void kernel_online_log_sum_exp_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using vec_t = vector_t<CPUType_, float>;
+  constexpr static std::size_t VECTOR_LENGTH = sizeof(vec_t) / sizeof(float);
+  constexpr static std::size_t REGISTERS = 5;
+
+  // Maxes that go up, down and stay, and a partial last register.
+  AlignedVector<float> input(VECTOR_LENGTH * REGISTERS);
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    input[i] = static_cast<float>((i * 7) % 11) * 0.75f - 3.0f + static_cast<float>(i / VECTOR_LENGTH % 3);
+  }
+  const std::size_t cols = input.size() - VECTOR_LENGTH / 2;
+
+  AlignedVector<float> highest(VECTOR_LENGTH), sum(VECTOR_LENGTH);
+  std::fill(highest.begin(), highest.end(), -FLT_MAX);
+  std::fill(sum.begin(), sum.end(), 0.0f);
+  for (std::size_t col = 0; col < cols; col += VECTOR_LENGTH) {
+    kernels::online_log_sum_exp(*reinterpret_cast<const vec_t*>(input.begin() + col), highest.begin(), sum.begin(), cols - col);
+  }
+
+  for (std::size_t lane = 0; lane < VECTOR_LENGTH; ++lane) {
+    float expected_max = -FLT_MAX;
+    for (std::size_t i = lane; i < cols; i += VECTOR_LENGTH) expected_max = std::max(expected_max, input[i]);
+    double expected_sum = 0.0;
+    for (std::size_t i = lane; i < cols; i += VECTOR_LENGTH) expected_sum += std::exp(input[i] - expected_max);
+    INFO("Lane " << lane);
+    CHECK(highest[lane] == expected_max);
+    CHECK_EPS(sum[lane], expected_sum, 0.001 * expected_sum);
+  }
+}
+
+template INTGEMM_SSE2 void kernel_online_log_sum_exp_test<CPUType::SSE2>();
+KERNEL_TEST_CASE("online_log_sum_exp SSE2") { return kernel_online_log_sum_exp_test<CPUType::SSE2>(); }
+
+template INTGEMM_AVX2 void kernel_online_log_sum_exp_test<CPUType::AVX2>();
+KERNEL_TEST_CASE("online_log_sum_exp AVX2") { return kernel_online_log_sum_exp_test<CPUType::AVX2>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_online_log_sum_exp_test<CPUType::AVX512BW>();
+KERNEL_TEST_CASE("online_log_sum_exp AVX512BW") { return kernel_online_log_sum_exp_test<CPUType::AVX512BW>(); }
+#endif
+
+}
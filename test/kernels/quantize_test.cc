@@ -2,6 +2,8 @@
 #include "../../intgemm/aligned.h"
 #include "../../intgemm/kernels.h"
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 
 namespace intgemm {
@@ -36,4 +38,41 @@ template INTGEMM_AVX512BW void kernel_quantize_test<CPUType::AVX512BW>();
 KERNEL_TEST_CASE("quantize AVX512BW") { return kernel_quantize_test<CPUType::AVX512BW>(); }
 #endif
 
+template <CPUType CPUType_>
+void kernel_requantize8_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using input_vec_t = vector_t<CPUType_, float>;
+  using output_vec_t = vector_t<CPUType_, int>;
+  constexpr int LENGTH = sizeof(input_vec_t) / sizeof(float);
+
+  AlignedVector<float> input(LENGTH);
+  AlignedVector<int8_t> output(sizeof(output_vec_t));
+  AlignedVector<uint8_t> output_u(sizeof(output_vec_t));
+
+  // Saturates at both ends and rounds half to even in between.
+  std::iota(input.begin(), input.end(), static_cast<float>(-LENGTH / 2));
+  auto quant_mult = set1_ps<input_vec_t>(20.25f);
+
+  *output.template as<output_vec_t>() = kernels::requantize8(*input.template as<input_vec_t>(), quant_mult);
+  *output_u.template as<output_vec_t>() = kernels::requantize8u(*input.template as<input_vec_t>(), quant_mult);
+  for (int i = 0; i < LENGTH; ++i) {
+    const float expected = std::max(-127.0f, std::min(127.0f, std::nearbyint(input[i] * 20.25f)));
+    CHECK(output[i] == static_cast<int8_t>(expected));
+    CHECK(output_u[i] == static_cast<uint8_t>(expected + 127.0f));
+  }
+}
+
+template INTGEMM_SSE2 void kernel_requantize8_test<CPUType::SSE2>();
+KERNEL_TEST_CASE("requantize8 SSE2") { return kernel_requantize8_test<CPUType::SSE2>(); }
+
+template INTGEMM_AVX2 void kernel_requantize8_test<CPUType::AVX2>();
+KERNEL_TEST_CASE("requantize8 AVX2") { return kernel_requantize8_test<CPUType::AVX2>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_requantize8_test<CPUType::AVX512BW>();
+KERNEL_TEST_CASE("requantize8 AVX512BW") { return kernel_requantize8_test<CPUType::AVX512BW>(); }
+#endif
+
 }
@@ -0,0 +1,54 @@
+#include "../test.h"
+#include "../../intgemm/aligned.h"
+#include "../../intgemm/kernels.h"
+
+#include <numeric>
+
+namespace intgemm {
+
+template <CPUType CPUType_>
+void kernel_row_statistics_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using vec_t = vector_t<CPUType_, float>;
+  constexpr static std::size_t VECTOR_LENGTH = sizeof(vec_t) / sizeof(float);
+
+  AlignedVector<float> input(VECTOR_LENGTH);
+  std::iota(input.begin(), input.end(), 1.0f);
+
+  // Registers at column 8 of a row, so into the second group.
+  for (std::size_t count = 1; count <= VECTOR_LENGTH; ++count) {
+    float statistics[6] = {-1, -1, -1, -1, -1, -1};
+    kernels::row_statistics(*input.template as<vec_t>(), statistics, 8, count);
+    float sum[2] = {0, 0}, squares[2] = {0, 0};
+    for (std::size_t i = 0; i < count; ++i) {
+      sum[i / 8] += input[i];
+      squares[i / 8] += input[i] * input[i];
+    }
+    CHECK(statistics[0] == -1);
+    CHECK(statistics[1] == -1);
+    CHECK(statistics[2] == sum[0]);
+    CHECK(statistics[3] == squares[0]);
+    if (count > 8) {
+      CHECK(statistics[4] == sum[1]);
+      CHECK(statistics[5] == squares[1]);
+    } else {
+      CHECK(statistics[4] == -1);
+      CHECK(statistics[5] == -1);
+    }
+  }
+}
+
+template INTGEMM_SSE2 void kernel_row_statistics_test<CPUType::SSE2>();
+KERNEL_TEST_CASE("row_statistics SSE2") { return kernel_row_statistics_test<CPUType::SSE2>(); }
+
+template INTGEMM_AVX2 void kernel_row_statistics_test<CPUType::AVX2>();
+KERNEL_TEST_CASE("row_statistics AVX2") { return kernel_row_statistics_test<CPUType::AVX2>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_row_statistics_test<CPUType::AVX512BW>();
+KERNEL_TEST_CASE("row_statistics AVX512BW") { return kernel_row_statistics_test<CPUType::AVX512BW>(); }
+#endif
+
+}
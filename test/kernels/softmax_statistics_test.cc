@@ -0,0 +1,62 @@
+#include "../test.h"
+#include "../../intgemm/aligned.h"
+#include "../../intgemm/kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace intgemm {
+
+template <CPUType CPUType_>
+void kernel_softmax_statistics_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using vec_t = vector_t<CPUType_, float>;
+  constexpr static std::size_t VECTOR_LENGTH = sizeof(vec_t) / sizeof(float);
+
+  // Two groups, neither with its max in the first lane.
+  const float values[16] = {0.5f, -1.0f, 3.0f, 2.0f, -4.0f, 1.0f, 2.5f, -0.5f, -3.0f, 1.5f, -2.0f, 0.0f, 4.5f, -1.5f, 2.0f, 3.5f};
+  AlignedVector<float> input(16);
+  std::copy(values, values + 16, input.begin());
+
+  // Rows ending total columns past column 8, so the registers go into the
+  // second and third groups.  A group takes several registers on SSE2.
+  for (std::size_t total = 1; total <= 16; ++total) {
+    INFO("Total " << total);
+    float statistics[6] = {-1, -1, -1, -1, -1, -1};
+    for (std::size_t offset = 0; offset < total && offset < 16; offset += VECTOR_LENGTH) {
+      kernels::softmax_statistics(*reinterpret_cast<const vec_t*>(input.begin() + offset), statistics, 8 + offset, total - offset);
+    }
+    CHECK(statistics[0] == -1);
+    CHECK(statistics[1] == -1);
+    for (std::size_t group = 0; group < 2; ++group) {
+      const std::size_t begin = group * 8, end = std::min<std::size_t>(total, begin + 8);
+      if (begin >= end) {
+        CHECK(statistics[2 + group * 2] == -1);
+        CHECK(statistics[3 + group * 2] == -1);
+        continue;
+      }
+      const float highest = *std::max_element(values + begin, values + end);
+      float sum = 0.0f;
+      for (std::size_t i = begin; i < end; ++i) {
+        sum += std::exp(values[i] - highest);
+      }
+      CHECK(statistics[2 + group * 2] == highest);
+      CHECK_EPS(statistics[3 + group * 2], sum, 0.001f * sum);
+    }
+  }
+}
+
+template INTGEMM_SSE2 void kernel_softmax_statistics_test<CPUType::SSE2>();
+KERNEL_TEST_CASE("softmax_statistics SSE2") { return kernel_softmax_statistics_test<CPUType::SSE2>(); }
+
+template INTGEMM_AVX2 void kernel_softmax_statistics_test<CPUType::AVX2>();
+KERNEL_TEST_CASE("softmax_statistics AVX2") { return kernel_softmax_statistics_test<CPUType::AVX2>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_softmax_statistics_test<CPUType::AVX512BW>();
+KERNEL_TEST_CASE("softmax_statistics AVX512BW") { return kernel_softmax_statistics_test<CPUType::AVX512BW>(); }
+#endif
+
+}
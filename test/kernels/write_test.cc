@@ -60,4 +60,85 @@ KERNEL_TEST_CASE("write/float AVX512BW") { return kernel_write_test<CPUType::AVX
 KERNEL_TEST_CASE("write/double AVX512BW") { return kernel_write_test<CPUType::AVX512BW, double>(); }
 #endif
 
+template <CPUType CPUType_, typename ElemType_>
+void kernel_write_first_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using vec_t = vector_t<CPUType_, ElemType_>;
+  constexpr static std::size_t VECTOR_LENGTH = sizeof(vec_t) / sizeof(ElemType_);
+
+  AlignedVector<ElemType_> input(VECTOR_LENGTH);
+  // One more so the write is unaligned.
+  AlignedVector<ElemType_> output(VECTOR_LENGTH + 1);
+
+  std::iota(input.begin(), input.end(), static_cast<ElemType_>(0));
+
+  for (std::size_t count = 0; count <= VECTOR_LENGTH; ++count) {
+    std::fill(output.begin(), output.end(), static_cast<ElemType_>(-1));
+    kernels::write(*input.template as<vec_t>(), output.begin(), 1, count);
+    CHECK(output[0] == ElemType_(-1));
+    for (std::size_t i = 0; i < VECTOR_LENGTH; ++i)
+      CHECK(output[i + 1] == (i < count ? ElemType_(i) : ElemType_(-1)));
+  }
+}
+
+template INTGEMM_SSE2 void kernel_write_first_test<CPUType::SSE2, int>();
+template INTGEMM_SSE2 void kernel_write_first_test<CPUType::SSE2, float>();
+KERNEL_TEST_CASE("write first/int SSE2") { return kernel_write_first_test<CPUType::SSE2, int>(); }
+KERNEL_TEST_CASE("write first/float SSE2") { return kernel_write_first_test<CPUType::SSE2, float>(); }
+
+template INTGEMM_AVX2 void kernel_write_first_test<CPUType::AVX2, int>();
+template INTGEMM_AVX2 void kernel_write_first_test<CPUType::AVX2, float>();
+KERNEL_TEST_CASE("write first/int AVX2") { return kernel_write_first_test<CPUType::AVX2, int>(); }
+KERNEL_TEST_CASE("write first/float AVX2") { return kernel_write_first_test<CPUType::AVX2, float>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_write_first_test<CPUType::AVX512BW, int>();
+template INTGEMM_AVX512BW void kernel_write_first_test<CPUType::AVX512BW, float>();
+KERNEL_TEST_CASE("write first/int AVX512BW") { return kernel_write_first_test<CPUType::AVX512BW, int>(); }
+KERNEL_TEST_CASE("write first/float AVX512BW") { return kernel_write_first_test<CPUType::AVX512BW, float>(); }
+#endif
+
+template <CPUType CPUType_, typename ElemType_>
+void kernel_write_transposed_test() {
+  if (kCPU < CPUType_)
+    return;
+
+  using vec_t = vector_t<CPUType_, ElemType_>;
+  constexpr static std::size_t VECTOR_LENGTH = sizeof(vec_t) / sizeof(ElemType_);
+  const Index stride = 3;
+
+  AlignedVector<ElemType_> input(VECTOR_LENGTH);
+  AlignedVector<ElemType_> output(VECTOR_LENGTH * stride + 1);
+
+  std::iota(input.begin(), input.end(), static_cast<ElemType_>(0));
+
+  for (std::size_t count = 0; count <= VECTOR_LENGTH; ++count) {
+    std::fill(output.begin(), output.end(), static_cast<ElemType_>(-1));
+    kernels::write_transposed(*input.template as<vec_t>(), output.begin(), 1, stride, count);
+    for (std::size_t i = 0; i < output.size(); ++i) {
+      const bool written = i >= 1 && (i - 1) % stride == 0 && (i - 1) / stride < count;
+      CHECK(output[i] == (written ? ElemType_((i - 1) / stride) : ElemType_(-1)));
+    }
+  }
+}
+
+template INTGEMM_SSE2 void kernel_write_transposed_test<CPUType::SSE2, int>();
+template INTGEMM_SSE2 void kernel_write_transposed_test<CPUType::SSE2, float>();
+KERNEL_TEST_CASE("write transposed/int SSE2") { return kernel_write_transposed_test<CPUType::SSE2, int>(); }
+KERNEL_TEST_CASE("write transposed/float SSE2") { return kernel_write_transposed_test<CPUType::SSE2, float>(); }
+
+template INTGEMM_AVX2 void kernel_write_transposed_test<CPUType::AVX2, int>();
+template INTGEMM_AVX2 void kernel_write_transposed_test<CPUType::AVX2, float>();
+KERNEL_TEST_CASE("write transposed/int AVX2") { return kernel_write_transposed_test<CPUType::AVX2, int>(); }
+KERNEL_TEST_CASE("write transposed/float AVX2") { return kernel_write_transposed_test<CPUType::AVX2, float>(); }
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+template INTGEMM_AVX512BW void kernel_write_transposed_test<CPUType::AVX512BW, int>();
+template INTGEMM_AVX512BW void kernel_write_transposed_test<CPUType::AVX512BW, float>();
+KERNEL_TEST_CASE("write transposed/int AVX512BW") { return kernel_write_transposed_test<CPUType::AVX512BW, int>(); }
+KERNEL_TEST_CASE("write transposed/float AVX512BW") { return kernel_write_transposed_test<CPUType::AVX512BW, float>(); }
+#endif
+
 }
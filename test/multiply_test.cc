@@ -5,6 +5,7 @@
 #include "../intgemm/intgemm.h"
 #include "../intgemm/multiply.h"
 #include "../intgemm/stats.h"
+#include "../intgemm/thread_pool.h"
 
 #include <algorithm>
 #include <cassert>
@@ -14,9 +15,11 @@
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <random>
+#include <string>
 
 namespace intgemm {
 
@@ -356,6 +359,468 @@ template <class Routine> void TestMultiplyBias(Index A_rows, Index width, Index
    int_tolerance, float_tolerance, MSE_float_tolerance, MSE_int_tolerance);
 }
 
+// Random A and B, quantized with quant_mult and padded to whole tiles: A by
+// PrepareAPadded and B by PrepareBPadded.  gen continues for other inputs.
+template <class Routine> struct RandomAB {
+  using Integer = typename Routine::Integer;
+  RandomAB(Index A_rows, Index width, Index B_cols, float quant_mult)
+    : A(A_rows * width), B(width * B_cols), A_prep(PreparedASize<Routine>(A_rows, width)), B_prep(PreparedBSize<Routine>(width, B_cols)) {
+    FillUniform(A, gen);
+    FillUniform(B, gen);
+    PrepareAPadded<Routine>(A.begin(), A_prep.begin(), quant_mult, A_rows, width);
+    PrepareBPadded<Routine>(B.begin(), B_prep.begin(), quant_mult, width, B_cols);
+  }
+
+  std::mt19937 gen;
+  AlignedVector<float> A, B;
+  AlignedVector<Integer> A_prep, B_prep;
+};
+
+// Splitting the work (blocked or matrix-vector) should give exactly the same
+// 32-bit sums as Multiply.
+template <class Routine, class Multiply> void TestMultiplySplit(Index A_rows, Index width, Index B_cols, const std::string &info, Multiply multiply) {
+  // Small enough that 8-bit doesn't saturate.
+  const RandomAB<Routine> ab(A_rows, width, B_cols, 16);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols);
+  OMPParallelWrap<callbacks::Write<int32_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  AlignedVector<int32_t> test_C(A_rows * B_cols);
+  multiply(ab.A_prep.begin(), ab.B_prep.begin(), callbacks::Write<int32_t>(test_C.begin()));
+
+  for (std::size_t i = 0; i < test_C.size(); ++i) {
+    INFO(info << "Index " << i);
+    CHECK(test_C[i] == expected[i]);
+  }
+}
+
+template <class Routine> void TestMultiplyBlocked(Index A_rows, Index width, Index B_cols, BlockSizes blocks) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols
+    << "\tblocks " << blocks.A_rows << '\t' << blocks.width << '\t' << blocks.B_cols << '\n';
+  TestMultiplySplit<Routine>(A_rows, width, B_cols, info.str(), [=](const Integer *A, const Integer *B, callbacks::Write<int32_t> callback) {
+    MultiplyBlocked<callbacks::Write<int32_t>, Routine>(A, B, A_rows, width, B_cols, callback, blocks);
+  });
+}
+
+template <class Routine> void TestMultiplyGEMV(Index A_rows, Index width, Index B_cols, Index slices) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tslices " << slices << '\n';
+  TestMultiplySplit<Routine>(A_rows, width, B_cols, info.str(), [=](const Integer *A, const Integer *B, callbacks::Write<int32_t> callback) {
+    MultiplyGEMV<callbacks::Write<int32_t>, Routine>(A, B, A_rows, width, B_cols, callback, slices);
+  });
+}
+
+template <class Routine> void TestMultiplyBlockedShapes() {
+  const Index tile = Routine::kBTileRow;
+  // Split the inner dimension into first, middle, and a short last block.
+  TestMultiplyBlocked<Routine>(11, 7 * tile, 40, BlockSizes{2 * tile, 5, 16});
+  // Inner dimension in one block, rows and columns split.
+  TestMultiplyBlocked<Routine>(11, 7 * tile, 40, BlockSizes{7 * tile, 3, 8});
+  // Tall and skinny, split only by rows.
+  TestMultiplyBlocked<Routine>(37, 2 * tile, 8, BlockSizes{2 * tile, 4, 8});
+  // Everything in one block.
+  TestMultiplyBlocked<Routine>(3, 2 * tile, 16, BlockSizes{2 * tile, 3, 16});
+  // Columns not a multiple of 8.
+  TestMultiplyBlocked<Routine>(11, 7 * tile, 37, BlockSizes{2 * tile, 5, 16});
+  // Panels that end halfway through a 16-column tile.
+  TestMultiplyBlocked<Routine>(11, 7 * tile, 44, BlockSizes{2 * tile, 5, 24});
+  // Matrix-vector: one row, slices of unequal width, ragged columns.
+  TestMultiplyGEMV<Routine>(1, 7 * tile, 40, 3);
+  TestMultiplyGEMV<Routine>(1, 7 * tile, 37, 7);
+  TestMultiplyGEMV<Routine>(3, 5 * tile, 44, 2);
+}
+
+// Large positive inputs saturate the 16-bit sums of the 8-bit kernels, which
+// then depend on where the inner dimension is split.  Blocked and
+// matrix-vector multiplies must still match Multiply; 16-bit kernels must give
+// the exact sums.
+template <class Routine> void TestMultiplySaturating(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tsaturating");
+  // Integers as floats so that quantizing with 1 is exact.
+  AlignedVector<float> A(A_rows * width), B(width * B_cols);
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dist(64, 127);
+  for (auto& it : A) {
+    it = static_cast<float>(dist(gen));
+  }
+  for (auto& it : B) {
+    it = static_cast<float>(dist(gen));
+  }
+  AlignedVector<Integer> A_prep(PreparedASize<Routine>(A_rows, width)), B_prep(PreparedBSize<Routine>(width, B_cols));
+  PrepareAPadded<Routine>(A.begin(), A_prep.begin(), 1, A_rows, width);
+  PrepareBPadded<Routine>(B.begin(), B_prep.begin(), 1, width, B_cols);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols), blocked(A_rows * B_cols), chosen(A_rows * B_cols), pool_C(A_rows * B_cols);
+  OMPParallelWrap<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  MultiplyBlocked<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(blocked.begin()), BlockSizes{2 * Routine::kBTileRow, 3, 16});
+  OMPParallelWrapBlocked<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(chosen.begin()));
+  {
+    // Threads to split a few rows over, as MultiplyGEMV would.
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapBlocked<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(pool_C.begin()));
+  }
+
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < B_cols; ++c) {
+      int32_t exact = 0;
+      for (Index k = 0; k < width; ++k) {
+        exact += static_cast<int32_t>(A[r * width + k]) * static_cast<int32_t>(B[k * B_cols + c]);
+      }
+      INFO("Row " << r << " column " << c);
+      const int32_t sum = expected[r * B_cols + c];
+      // Otherwise the test doesn't test anything.
+      if (Routine::kSaturates) CHECK(sum < exact);
+      else CHECK(sum == exact);
+      CHECK(blocked[r * B_cols + c] == sum);
+      CHECK(chosen[r * B_cols + c] == sum);
+      CHECK(pool_C[r * B_cols + c] == sum);
+    }
+  }
+}
+
+template <class Routine> void TestMultiplySaturatingShapes() {
+  const Index tile = Routine::kBTileRow;
+  TestMultiplySaturating<Routine>(9, 7 * tile, 40);
+  // Few enough rows for the matrix-vector path.
+  TestMultiplySaturating<Routine>(1, 7 * tile, 40);
+  // Wide enough that ChooseBlockSizes would split it to fit a tile in L1.
+  TestMultiplySaturating<Routine>(9, 4096, 24);
+}
+
+TEST_CASE ("Multiply blocked saturating", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplySaturatingShapes<sse2::Kernels16>();
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplySaturatingShapes<ssse3::Kernels8>();
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplySaturatingShapes<avx2::Kernels8>();
+  TestMultiplySaturatingShapes<avx2::Kernels16>();
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+  if (CPUSupportsAVXVNNI()) TestMultiplySaturatingShapes<avxvnni::Kernels8>();
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestMultiplySaturatingShapes<avx512bw::Kernels8>();
+  TestMultiplySaturatingShapes<avx512bw::Kernels16>();
+#endif
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+  if (kCPU < CPUType::AVX512VNNI) return;
+  TestMultiplySaturatingShapes<avx512vnni::Kernels8>();
+  TestMultiplySaturatingShapes<avx512vnni::Kernels16>();
+#endif
+}
+
+// A in panels should give exactly the same 32-bit sums as row-major A.
+template <class Routine> void TestMultiplyPanels(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tpanels\n";
+
+  const float quant_mult = 16;
+  const RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<Integer> A_panels(ab.A.size());
+  PrepareAPanels<Routine>(ab.A.begin(), A_panels.begin(), quant_mult, A_rows, width);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols);
+  OMPParallelWrap<callbacks::Write<int32_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  AlignedVector<int32_t> test_C(A_rows * B_cols), pool_C(A_rows * B_cols);
+  OMPParallelWrapPanels<callbacks::Write<int32_t>, Routine>(A_panels.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin()));
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapPanels<callbacks::Write<int32_t>, Routine>(A_panels.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(pool_C.begin()));
+  }
+
+  for (std::size_t i = 0; i < test_C.size(); ++i) {
+    INFO(info.str() << "Index " << i);
+    CHECK(test_C[i] == expected[i]);
+    CHECK(pool_C[i] == expected[i]);
+  }
+}
+
+template <class Routine> void TestMultiplyPanelsShapes() {
+  const Index tile = Routine::kBTileRow;
+  // A last panel of leftover rows for multi-row kernels.
+  TestMultiplyPanels<Routine>(12, 3 * tile, 40);
+  TestMultiplyPanels<Routine>(11, 3 * tile, 37);
+  TestMultiplyPanels<Routine>(1, tile, 8);
+}
+
+// Software prefetch mustn't change the sums.
+template <class Routine> void TestMultiplyPrefetch(Index A_rows, Index width, Index B_cols, PrefetchConfig config) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols
+    << "\tprefetch " << config.B_distance << '\t' << config.A_next_row << '\n';
+  TestMultiplySplit<Routine>(A_rows, width, B_cols, info.str(), [=](const Integer *A, const Integer *B, callbacks::Write<int32_t> callback) {
+    const PrefetchConfig saved = SoftwarePrefetch;
+    SoftwarePrefetch = config;
+    OMPParallelWrap<callbacks::Write<int32_t>, Routine>(A, B, A_rows, width, B_cols, callback);
+    SoftwarePrefetch = saved;
+  });
+}
+
+template <class Routine> void TestMultiplyPrefetchShapes() {
+  const Index tile = Routine::kBTileRow;
+  // Off, and far enough ahead to cross strips.
+  TestMultiplyPrefetch<Routine>(11, 5 * tile, 40, PrefetchConfig{0, false});
+  TestMultiplyPrefetch<Routine>(11, 5 * tile, 40, PrefetchConfig{static_cast<Index>(7 * tile * 8 * sizeof(typename Routine::Integer)), true});
+}
+
+// Running on a ThreadPool instead of OpenMP mustn't change the sums.
+template <class Routine> void TestMultiplyPool(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tpool\n";
+  ThreadPool pool(3);
+  TestMultiplySplit<Routine>(A_rows, width, B_cols, info.str(), [&pool, A_rows, width, B_cols](const Integer *A, const Integer *B, callbacks::Write<int32_t> callback) {
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrap<callbacks::Write<int32_t>, Routine>(A, B, A_rows, width, B_cols, callback);
+  });
+  TestMultiplySplit<Routine>(A_rows, width, B_cols, info.str(), [&pool, A_rows, width, B_cols](const Integer *A, const Integer *B, callbacks::Write<int32_t> callback) {
+    ScopedThreadPool scoped(pool);
+    MultiplyBlocked<callbacks::Write<int32_t>, Routine>(A, B, A_rows, width, B_cols, callback, BlockSizes{2 * Routine::kBTileRow, 4, 16});
+  });
+  TestMultiplySplit<Routine>(A_rows, width, B_cols, info.str(), [&pool, A_rows, width, B_cols](const Integer *A, const Integer *B, callbacks::Write<int32_t> callback) {
+    ScopedThreadPool scoped(pool);
+    MultiplyGEMV<callbacks::Write<int32_t>, Routine>(A, B, A_rows, width, B_cols, callback, 4);
+  });
+}
+
+template <class Routine> void TestMultiplyPoolShapes() {
+  const Index tile = Routine::kBTileRow;
+  // Ragged columns.
+  TestMultiplyPool<Routine>(11, 5 * tile, 40);
+  TestMultiplyPool<Routine>(3, 5 * tile, 37);
+}
+
+// Float A quantized inside the multiply should give the same sums as
+// PrepareA then Multiply, on one thread and on a pool.
+template <class Routine> void TestMultiplyFloatA(Index A_rows, Index width, Index B_cols) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tfloat A");
+  const float quant_mult = 64;
+  const RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols), test_C(A_rows * B_cols), pool_C(A_rows * B_cols);
+  OMPParallelWrapBlocked<callbacks::Write<int32_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  MultiplyFloatA<callbacks::Write<int32_t>, Routine>(ab.A.begin(), width, ab.B_prep.begin(), quant_mult, A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin()));
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    MultiplyFloatA<callbacks::Write<int32_t>, Routine>(ab.A.begin(), width, ab.B_prep.begin(), quant_mult, A_rows, width, B_cols, callbacks::Write<int32_t>(pool_C.begin()));
+  }
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(test_C[i] == expected[i]);
+    CHECK(pool_C[i] == expected[i]);
+  }
+}
+
+// Float A in columns of a larger matrix, at an unaligned offset, multiplied
+// into columns of a larger output should match dense A and dense output,
+// leaving the other columns alone.
+template <class Routine> void TestMultiplyStrided(Index A_rows, Index width, Index B_cols) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tstrided");
+  const Index A_offset = 3, A_stride = width + 7;
+  const Index C_offset = 5, C_stride = B_cols + 13;
+  const float quant_mult = 64;
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> A_big(A_rows * A_stride), bias(B_cols);
+  FillUniform(bias, ab.gen);
+  std::fill(A_big.begin(), A_big.end(), 1000.0f);
+  for (Index r = 0; r < A_rows; ++r) {
+    std::copy(ab.A.begin() + r * width, ab.A.begin() + (r + 1) * width, A_big.begin() + r * A_stride + A_offset);
+  }
+
+  AlignedVector<int32_t> expected(A_rows * B_cols);
+  MultiplyFloatA<callbacks::Write<int32_t>, Routine>(ab.A.begin(), width, ab.B_prep.begin(), quant_mult, A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  const int32_t kUntouched = -12345;
+  AlignedVector<int32_t> test_C(A_rows * C_stride), pool_C(A_rows * C_stride);
+  std::fill(test_C.begin(), test_C.end(), kUntouched);
+  std::fill(pool_C.begin(), pool_C.end(), kUntouched);
+  MultiplyFloatA<callbacks::Write<int32_t>, Routine>(A_big.begin() + A_offset, A_stride, ab.B_prep.begin(), quant_mult, A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin() + C_offset, C_stride));
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    MultiplyFloatA<callbacks::Write<int32_t>, Routine>(A_big.begin() + A_offset, A_stride, ab.B_prep.begin(), quant_mult, A_rows, width, B_cols, callbacks::Write<int32_t>(pool_C.begin() + C_offset, C_stride));
+  }
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < C_stride; ++c) {
+      INFO("Row " << r << " column " << c);
+      const bool inside = c >= C_offset && c < C_offset + B_cols;
+      const int32_t want = inside ? expected[r * B_cols + c - C_offset] : kUntouched;
+      CHECK(test_C[r * C_stride + c] == want);
+      CHECK(pool_C[r * C_stride + c] == want);
+    }
+  }
+
+  // Float output with a bias through the prepared A path.
+  if (width % Routine::kBTileRow) return;
+  const float unquant_mult = 1.0f / (quant_mult * quant_mult);
+  AlignedVector<float> float_expected(A_rows * B_cols), float_C(A_rows * C_stride);
+  std::fill(float_C.begin(), float_C.end(), 1000.0f);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), float_expected.begin()));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), float_C.begin() + C_offset, C_stride));
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < C_stride; ++c) {
+      INFO("Row " << r << " column " << c);
+      const bool inside = c >= C_offset && c < C_offset + B_cols;
+      CHECK(float_C[r * C_stride + c] == (inside ? float_expected[r * B_cols + c - C_offset] : 1000.0f));
+    }
+  }
+}
+
+template <class Routine> void TestMultiplyFloatAShapes() {
+  const Index tile = Routine::kBTileRow;
+  // Whole registers, a ragged width, columns for several threads, and A too
+  // big to quantize on every thread.
+  TestMultiplyFloatA<Routine>(1, 4 * tile, 40);
+  TestMultiplyFloatA<Routine>(3, 3 * tile + 5, 37);
+  TestMultiplyFloatA<Routine>(5, 2 * tile, 1000);
+  TestMultiplyFloatA<Routine>(300, 256, 24);
+  // Strided and unaligned A and output, including A too big to quantize on
+  // every thread.
+  TestMultiplyStrided<Routine>(1, 4 * tile, 40);
+  TestMultiplyStrided<Routine>(5, 3 * tile + 5, 37);
+  TestMultiplyStrided<Routine>(300, 256, 24);
+}
+
+// Wide accumulation should match exact 64-bit sums, saturated to 32 bits.
+template <class Routine> void TestMultiplyWide(Index A_rows, Index width, Index B_cols, int max_value) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tmax " << max_value << '\n';
+
+  // Integers as floats so that quantizing with 1 is exact.
+  AlignedVector<float> A(A_rows * width);
+  AlignedVector<float> B(width * B_cols);
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dist(-max_value, max_value);
+  for (auto& it : A) {
+    it = static_cast<float>(dist(gen));
+  }
+  for (auto& it : B) {
+    it = static_cast<float>(dist(gen));
+  }
+
+  AlignedVector<Integer> A_prep(A.size());
+  AlignedVector<Integer> B_prep(B.size());
+  Routine::PrepareA(A.begin(), A_prep.begin(), 1, A_rows, width);
+  Routine::PrepareB(B.begin(), B_prep.begin(), 1, width, B_cols);
+
+  AlignedVector<int32_t> test_C(A_rows * B_cols);
+  OMPParallelWrapWide<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin()));
+
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < B_cols; ++c) {
+      int64_t sum = 0;
+      for (Index k = 0; k < width; ++k) {
+        sum += static_cast<int64_t>(A[r * width + k]) * static_cast<int64_t>(B[k * B_cols + c]);
+      }
+      sum = std::min<int64_t>(std::max<int64_t>(sum, std::numeric_limits<int32_t>::min()), std::numeric_limits<int32_t>::max());
+      INFO(info.str() << "Row " << r << " column " << c);
+      CHECK(test_C[r * B_cols + c] == sum);
+    }
+  }
+}
+
+template <class Routine> void TestMultiplyWideShapes() {
+  const int max_value = (sizeof(typename Routine::Integer) == 1) ? 127 : 32767;
+  // Large enough that Multiply saturates or overflows.
+  TestMultiplyWide<Routine>(5, 2048, 16, max_value);
+  // Totals fit in 32 bits.
+  TestMultiplyWide<Routine>(3, 1024, 8, max_value / 16);
+}
+
+// Any width and B_cols: exact sums through the dispatched multiply, with
+// nothing written past the last column.
+template <class Routine> void TestMultiplyAnyShape(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << '\n';
+
+  // Small integers as floats so that quantizing with 1 is exact and 8-bit
+  // doesn't saturate.
+  AlignedVector<float> A(A_rows * width);
+  AlignedVector<float> B(width * B_cols);
+  AlignedVector<float> bias(B_cols);
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dist(-8, 8);
+  for (auto& it : A) {
+    it = static_cast<float>(dist(gen));
+  }
+  for (auto& it : B) {
+    it = static_cast<float>(dist(gen));
+  }
+  for (auto& it : bias) {
+    it = static_cast<float>(dist(gen));
+  }
+
+  AlignedVector<Integer> A_prep(PreparedASize<Routine>(A_rows, width));
+  AlignedVector<Integer> B_prep(PreparedBSize<Routine>(width, B_cols));
+  PrepareAPadded<Routine>(A.begin(), A_prep.begin(), 1, A_rows, width);
+  PrepareBPadded<Routine>(B.begin(), B_prep.begin(), 1, width, B_cols);
+
+  // Extra space after the output to catch writes past the end.
+  const Index kGuard = 16;
+  const int32_t kSentinel = 0x5eadbeef;
+  AlignedVector<int32_t> test_C(A_rows * B_cols + kGuard);
+  AlignedVector<int32_t> wide_C(A_rows * B_cols + kGuard);
+  AlignedVector<int32_t> wide_pool_C(A_rows * B_cols + kGuard);
+  AlignedVector<float> bias_C(A_rows * B_cols + kGuard);
+  std::fill(test_C.begin(), test_C.end(), kSentinel);
+  std::fill(wide_C.begin(), wide_C.end(), kSentinel);
+  std::fill(wide_pool_C.begin(), wide_pool_C.end(), kSentinel);
+  std::fill(bias_C.begin(), bias_C.end(), static_cast<float>(kSentinel));
+  OMPParallelWrapBlocked<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin()));
+  OMPParallelWrapWide<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(wide_C.begin()));
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapWide<callbacks::Write<int32_t>, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(wide_pool_C.begin()));
+  }
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(1, bias.begin(), bias_C.begin()));
+
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < B_cols; ++c) {
+      int32_t sum = 0;
+      for (Index k = 0; k < width; ++k) {
+        sum += static_cast<int32_t>(A[r * width + k]) * static_cast<int32_t>(B[k * B_cols + c]);
+      }
+      INFO(info.str() << "Row " << r << " column " << c);
+      CHECK(test_C[r * B_cols + c] == sum);
+      CHECK(wide_C[r * B_cols + c] == sum);
+      CHECK(wide_pool_C[r * B_cols + c] == sum);
+      CHECK(bias_C[r * B_cols + c] == static_cast<float>(sum) + bias[c]);
+    }
+  }
+  for (Index i = A_rows * B_cols; i < A_rows * B_cols + kGuard; ++i) {
+    INFO(info.str() << "Guard " << i);
+    CHECK(test_C[i] == kSentinel);
+    CHECK(wide_C[i] == kSentinel);
+    CHECK(wide_pool_C[i] == kSentinel);
+    CHECK(bias_C[i] == static_cast<float>(kSentinel));
+  }
+}
+
+template <class Routine> void TestMultiplyAnyShapes() {
+  const Index tile = Routine::kBTileRow;
+  TestMultiplyAnyShape<Routine>(1, 1, 1);
+  TestMultiplyAnyShape<Routine>(5, 7, 3);
+  TestMultiplyAnyShape<Routine>(3, tile + 5, 13);
+  TestMultiplyAnyShape<Routine>(9, 3 * tile - 1, 21);
+  // Ends in a single strip of 8 columns for kernels with 16-column tiles.
+  TestMultiplyAnyShape<Routine>(5, 2 * tile, 44);
+  // One row of A, which goes to MultiplyGEMV when there are threads.
+  TestMultiplyAnyShape<Routine>(1, 5 * tile + 3, 21);
+  // Multiples, for comparison.
+  TestMultiplyAnyShape<Routine>(4, 2 * tile, 16);
+}
+
 TEST_CASE ("Multiply SSE2 16bit", "[multiply]") {
   if (kCPU < CPUType::SSE2) return;
   TestMultiply<sse2::Kernels16>(8, 256, 256, .1f, 1, 0.01f);
@@ -436,10 +901,754 @@ TEST_CASE ("Multiply AVX2 16bit with bias", "[biased_multiply]") {
   TestMultiplyBias<avx2::Kernels16>(200, 256, 256, .1f, 1, 0.01f);
 }
 
+TEST_CASE ("Multiply wide SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyWideShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply wide SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyWideShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply wide AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyWideShapes<avx2::Kernels8>();
+  TestMultiplyWideShapes<avx2::Kernels16>();
+}
+
+TEST_CASE ("Multiply any shape SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyAnyShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply any shape SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyAnyShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply any shape AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyAnyShapes<avx2::Kernels8>();
+  TestMultiplyAnyShapes<avx2::Kernels16>();
+}
+
+// The requantizing callbacks should write what Quantize and QuantizeU make of
+// the float output, with nothing past the last column.
+template <class Routine> void TestRequantize(Index A_rows, Index width, Index B_cols) {
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << '\n';
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult), next_mult = 20.0f;
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> bias(B_cols);
+  FillUniform(bias, ab.gen);
+
+  // Padded so QuantizeU takes whole registers.
+  const Index size = A_rows * B_cols, padded = round_up(size, 64);
+  AlignedVector<float> C(padded), C_bias(padded);
+  std::fill(C.begin(), C.end(), 0.0f);
+  std::fill(C_bias.begin(), C_bias.end(), 0.0f);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndWrite(unquant_mult, C.begin()));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), C_bias.begin()));
+  AlignedVector<int8_t> expected(padded), expected_bias(padded);
+  AlignedVector<uint8_t> expected_u(padded);
+  Routine::Quantize(C.begin(), expected.begin(), next_mult, size);
+  Routine::Quantize(C_bias.begin(), expected_bias.begin(), next_mult, size);
+  Routine::QuantizeU(C_bias.begin(), expected_u.begin(), next_mult, padded);
+
+  const Index kGuard = 16;
+  const uint8_t kSentinel = 0x5a;
+  AlignedVector<int8_t> test(size + kGuard), test_bias(size + kGuard);
+  AlignedVector<uint8_t> test_u(size + kGuard);
+  std::fill(test.begin(), test.end(), static_cast<int8_t>(kSentinel));
+  std::fill(test_bias.begin(), test_bias.end(), static_cast<int8_t>(kSentinel));
+  std::fill(test_u.begin(), test_u.end(), kSentinel);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndRequantizeAndWrite<int8_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndRequantizeAndWrite<int8_t>(unquant_mult, next_mult, test.begin()));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndRequantizeAndWrite<int8_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndRequantizeAndWrite<int8_t>(unquant_mult, bias.begin(), next_mult, test_bias.begin()));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndRequantizeAndWrite<uint8_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndRequantizeAndWrite<uint8_t>(unquant_mult, bias.begin(), next_mult, test_u.begin()));
+  for (Index i = 0; i < size; ++i) {
+    INFO(info.str() << "Index " << i << " float " << C_bias[i]);
+    CHECK(test[i] == expected[i]);
+    CHECK(test_bias[i] == expected_bias[i]);
+    CHECK(test_u[i] == expected_u[i]);
+  }
+  for (Index i = size; i < size + kGuard; ++i) {
+    INFO(info.str() << "Guard " << i);
+    CHECK(test[i] == static_cast<int8_t>(kSentinel));
+    CHECK(test_bias[i] == static_cast<int8_t>(kSentinel));
+    CHECK(test_u[i] == kSentinel);
+  }
+}
+
+template <class Routine> void TestRequantizeShapes() {
+  const Index tile = Routine::kBTileRow;
+  TestRequantize<Routine>(1, tile, 8);
+  TestRequantize<Routine>(5, 100, 37);
+  TestRequantize<Routine>(9, 3 * tile, 21);
+  TestRequantize<Routine>(40, 256, 130);
+}
+
+TEST_CASE ("Multiply requantize 8bit", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestRequantizeShapes<ssse3::Kernels8>();
+  if (kCPU < CPUType::AVX2) return;
+  TestRequantizeShapes<avx2::Kernels8>();
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestRequantizeShapes<avx512bw::Kernels8>();
+#endif
+}
+
+// Activation stages chained in a Sequence should match applying the
+// activation to the float output.
+template <class Routine, class Activation> void TestActivation(const Activation &activation, float (*reference)(float), Index A_rows, Index width, Index B_cols) {
+  std::ostringstream info;
+  info << Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << '\n';
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> bias(B_cols);
+  FillUniform(bias, ab.gen);
+
+  const Index kGuard = 16;
+  AlignedVector<float> expected(A_rows * B_cols), test_C(A_rows * B_cols + kGuard);
+  std::fill(test_C.begin(), test_C.end(), 12345.0f);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), expected.begin()));
+  auto sequence = callbacks::Sequence(callbacks::Unquantize(unquant_mult), callbacks::AddBias(bias.begin()), activation, callbacks::Write<float>(test_C.begin()));
+  OMPParallelWrapBlocked<decltype(sequence), Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, sequence);
+  for (Index i = 0; i < A_rows * B_cols; ++i) {
+    INFO(info.str() << "Index " << i << " input " << expected[i]);
+    const float ref = reference(expected[i]);
+    CHECK(std::fabs(test_C[i] - ref) <= 2e-3f * std::max(1.0f, std::fabs(ref)));
+  }
+  for (Index i = A_rows * B_cols; i < A_rows * B_cols + kGuard; ++i) {
+    INFO(info.str() << "Guard " << i);
+    CHECK(test_C[i] == 12345.0f);
+  }
+}
+
+float ReLURef(float x) { return std::max(x, 0.0f); }
+float SigmoidRef(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+float TanhRef(float x) { return std::tanh(x); }
+float GELURef(float x) { return 0.5f * x * (1.0f + std::tanh(0.7978845608f * (x + 0.044715f * x * x * x))); }
+float SiLURef(float x) { return x / (1.0f + std::exp(-x)); }
+
+template <class Routine> void TestActivations(Index A_rows, Index width, Index B_cols) {
+  TestActivation<Routine>(callbacks::ReLU(), ReLURef, A_rows, width, B_cols);
+  TestActivation<Routine>(callbacks::Sigmoid(), SigmoidRef, A_rows, width, B_cols);
+  TestActivation<Routine>(callbacks::Tanh(), TanhRef, A_rows, width, B_cols);
+  TestActivation<Routine>(callbacks::GELU(), GELURef, A_rows, width, B_cols);
+  TestActivation<Routine>(callbacks::SiLU(), SiLURef, A_rows, width, B_cols);
+}
+
+TEST_CASE ("Multiply activation epilogue", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestActivations<sse2::Kernels16>(5, 100, 37);
+  if (kCPU < CPUType::SSSE3) return;
+  TestActivations<ssse3::Kernels8>(5, 100, 37);
+  if (kCPU < CPUType::AVX2) return;
+  TestActivations<avx2::Kernels8>(3, 256, 130);
+  TestActivations<avx2::Kernels16>(3, 256, 130);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestActivations<avx512bw::Kernels8>(3, 256, 130);
+  TestActivations<avx512bw::Kernels16>(1, 128, 21);
+#endif
+}
+
+// Transposed writes should put row r, column c of the output at
+// c * stride + r, leaving the padding between columns alone.
+template <class Routine> void TestWriteTransposed(Index A_rows, Index width, Index B_cols) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\ttransposed");
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  const RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols), dense(A_rows * B_cols);
+  AlignedVector<float> expected_float(A_rows * B_cols);
+  OMPParallelWrapBlocked<callbacks::Write<int32_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndWrite(unquant_mult, expected_float.begin()));
+  OMPParallelWrapBlocked<callbacks::WriteTransposed<int32_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::WriteTransposed<int32_t>(dense.begin()));
+
+  const Index stride = A_rows + 3;
+  AlignedVector<int32_t> strided(B_cols * stride);
+  AlignedVector<float> strided_float(B_cols * stride);
+  std::fill(strided.begin(), strided.end(), -1);
+  std::fill(strided_float.begin(), strided_float.end(), -1.0f);
+  OMPParallelWrapBlocked<callbacks::WriteTransposed<int32_t>, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::WriteTransposed<int32_t>(strided.begin(), stride));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndWriteTransposed, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndWriteTransposed(unquant_mult, strided_float.begin(), stride));
+  for (Index c = 0; c < B_cols; ++c) {
+    for (Index r = 0; r < stride; ++r) {
+      INFO("Row " << r << " column " << c);
+      if (r < A_rows) {
+        CHECK(dense[c * A_rows + r] == expected[r * B_cols + c]);
+        CHECK(strided[c * stride + r] == expected[r * B_cols + c]);
+        CHECK(strided_float[c * stride + r] == expected_float[r * B_cols + c]);
+      } else {
+        CHECK(strided[c * stride + r] == -1);
+        CHECK(strided_float[c * stride + r] == -1.0f);
+      }
+    }
+  }
+}
+
+TEST_CASE ("Multiply write transposed", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestWriteTransposed<sse2::Kernels16>(5, 64, 37);
+  if (kCPU < CPUType::SSSE3) return;
+  TestWriteTransposed<ssse3::Kernels8>(5, 64, 37);
+  if (kCPU < CPUType::AVX2) return;
+  TestWriteTransposed<avx2::Kernels8>(9, 64, 130);
+  TestWriteTransposed<avx2::Kernels16>(9, 64, 130);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestWriteTransposed<avx512bw::Kernels8>(9, 128, 130);
+  TestWriteTransposed<avx512bw::Kernels16>(1, 64, 21);
+#endif
+}
+
+// Adding a residual should match adding it to UnquantizeAndAddBiasAndWrite's
+// output, and the row statistics should match the mean and variance of what
+// was written, threaded or not.
+template <class Routine> void TestResidual(Index A_rows, Index width, Index B_cols) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tresidual");
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> bias(B_cols), residual(A_rows * B_cols);
+  FillUniform(bias, ab.gen);
+  FillUniform(residual, ab.gen, 1.0f, 3.0f);
+
+  AlignedVector<float> expected(A_rows * B_cols);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), expected.begin()));
+  for (Index i = 0; i < expected.size(); ++i) {
+    expected[i] += residual[i];
+  }
+
+  AlignedVector<float> test_C(A_rows * B_cols), pool_C(A_rows * B_cols);
+  AlignedVector<float> statistics(callbacks::RowStatisticsSize(A_rows, B_cols)), pool_statistics(statistics.size());
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndResidualAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndResidualAndWrite(unquant_mult, bias.begin(), residual.begin(), test_C.begin(), statistics.begin()));
+  // In place on a pool.
+  std::copy(residual.begin(), residual.end(), pool_C.begin());
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndResidualAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndResidualAndWrite(unquant_mult, bias.begin(), pool_C.begin(), pool_C.begin(), pool_statistics.begin()));
+  }
+  // Into columns 1 to B_cols of a wider output: from the dense residual, and
+  // in place, where the residual takes output_stride.
+  const Index stride = B_cols + 3;
+  AlignedVector<float> strided_C(A_rows * stride), in_place_C(A_rows * stride);
+  std::fill(strided_C.begin(), strided_C.end(), -1.0f);
+  std::fill(in_place_C.begin(), in_place_C.end(), -1.0f);
+  for (Index r = 0; r < A_rows; ++r) {
+    std::copy(residual.begin() + r * B_cols, residual.begin() + (r + 1) * B_cols, in_place_C.begin() + r * stride + 1);
+  }
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndResidualAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndResidualAndWrite(unquant_mult, bias.begin(), residual.begin(), strided_C.begin() + 1, nullptr, stride, B_cols));
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndResidualAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndResidualAndWrite(unquant_mult, bias.begin(), in_place_C.begin() + 1, in_place_C.begin() + 1, nullptr, stride));
+
+  for (Index i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(test_C[i] == expected[i]);
+    CHECK(pool_C[i] == expected[i]);
+  }
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < stride; ++c) {
+      INFO("Row " << r << " column " << c << " of strided output");
+      const float want = c >= 1 && c <= B_cols ? expected[r * B_cols + c - 1] : -1.0f;
+      CHECK(strided_C[r * stride + c] == want);
+      CHECK(in_place_C[r * stride + c] == want);
+    }
+  }
+  // Each group has one writer, so threading doesn't change the statistics.
+  for (Index i = 0; i < statistics.size(); ++i) {
+    CHECK(pool_statistics[i] == statistics[i]);
+  }
+
+  AlignedVector<float> mean(A_rows), variance(A_rows);
+  callbacks::RowMeanAndVariance(statistics.begin(), A_rows, B_cols, mean.begin(), variance.begin());
+  for (Index r = 0; r < A_rows; ++r) {
+    double sum = 0.0, squares = 0.0;
+    for (Index c = 0; c < B_cols; ++c) {
+      sum += expected[r * B_cols + c];
+    }
+    const double ref_mean = sum / B_cols;
+    for (Index c = 0; c < B_cols; ++c) {
+      const double diff = expected[r * B_cols + c] - ref_mean;
+      squares += diff * diff;
+    }
+    const double ref_variance = squares / B_cols;
+    INFO("Row " << r);
+    CHECK(mean[r] == Approx(ref_mean).epsilon(1e-5));
+    CHECK(variance[r] == Approx(ref_variance).epsilon(1e-4));
+  }
+}
+
+TEST_CASE ("Multiply residual and row statistics", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestResidual<sse2::Kernels16>(5, 64, 37);
+  TestResidual<sse2::Kernels16>(3, 64, 8);
+  if (kCPU < CPUType::SSSE3) return;
+  TestResidual<ssse3::Kernels8>(5, 64, 37);
+  if (kCPU < CPUType::AVX2) return;
+  TestResidual<avx2::Kernels8>(9, 64, 130);
+  TestResidual<avx2::Kernels16>(9, 64, 130);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestResidual<avx512bw::Kernels8>(9, 128, 130);
+  TestResidual<avx512bw::Kernels8>(4, 128, 24);
+  TestResidual<avx512bw::Kernels16>(1, 64, 21);
+#endif
+}
+
+template <class Routine> void TestSoftmax(Index A_rows, Index width, Index B_cols) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tsoftmax");
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> bias(B_cols);
+  FillUniform(bias, ab.gen, -4.0f, 4.0f);
+
+  AlignedVector<float> expected(A_rows * B_cols);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), expected.begin()));
+
+  AlignedVector<float> test_C(A_rows * B_cols), pool_C(A_rows * B_cols);
+  AlignedVector<float> statistics(callbacks::RowStatisticsSize(A_rows, B_cols)), pool_statistics(statistics.size());
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWriteForSoftmax, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWriteForSoftmax(unquant_mult, bias.begin(), test_C.begin(), statistics.begin()));
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWriteForSoftmax, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWriteForSoftmax(unquant_mult, bias.begin(), pool_C.begin(), pool_statistics.begin()));
+  }
+  // Into columns 1 to B_cols of a wider output.
+  const Index stride = B_cols + 3;
+  AlignedVector<float> strided_C(A_rows * stride), strided_statistics(statistics.size());
+  std::fill(strided_C.begin(), strided_C.end(), -1.0f);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWriteForSoftmax, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWriteForSoftmax(unquant_mult, bias.begin(), strided_C.begin() + 1, strided_statistics.begin(), stride));
+  for (Index i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(test_C[i] == expected[i]);
+    CHECK(pool_C[i] == expected[i]);
+  }
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < stride; ++c) {
+      INFO("Row " << r << " column " << c << " of strided output");
+      CHECK(strided_C[r * stride + c] == (c >= 1 && c <= B_cols ? expected[r * B_cols + c - 1] : -1.0f));
+    }
+  }
+  for (Index i = 0; i < statistics.size(); ++i) {
+    CHECK(strided_statistics[i] == statistics[i]);
+  }
+  // Each group has one writer, so threading doesn't change the statistics.
+  for (Index i = 0; i < statistics.size(); ++i) {
+    CHECK(pool_statistics[i] == statistics[i]);
+  }
+
+  AlignedVector<float> log_sum_exp(A_rows);
+  callbacks::RowLogSumExp(statistics.begin(), A_rows, B_cols, log_sum_exp.begin());
+  AlignedVector<float> log_softmax(A_rows * B_cols);
+  std::copy(test_C.begin(), test_C.end(), log_softmax.begin());
+  callbacks::ApplyLogSoftmax(log_softmax.begin(), A_rows, B_cols, log_sum_exp.begin());
+  callbacks::ApplySoftmax(test_C.begin(), A_rows, B_cols, log_sum_exp.begin());
+  callbacks::ApplySoftmax(strided_C.begin() + 1, A_rows, B_cols, log_sum_exp.begin(), stride);
+  for (Index r = 0; r < A_rows; ++r) {
+    for (Index c = 0; c < B_cols; ++c) {
+      CHECK(strided_C[r * stride + c + 1] == test_C[r * B_cols + c]);
+    }
+    CHECK(strided_C[r * stride] == -1.0f);
+  }
+  for (Index r = 0; r < A_rows; ++r) {
+    const float *row = expected.begin() + r * B_cols;
+    const double highest = *std::max_element(row, row + B_cols);
+    double sum = 0.0;
+    for (Index c = 0; c < B_cols; ++c) {
+      sum += std::exp(row[c] - highest);
+    }
+    const double ref_log_sum_exp = highest + std::log(sum);
+    INFO("Row " << r);
+    CHECK(log_sum_exp[r] == Approx(ref_log_sum_exp).epsilon(1e-4));
+    double total = 0.0;
+    for (Index c = 0; c < B_cols; ++c) {
+      INFO("Column " << c);
+      CHECK(log_softmax[r * B_cols + c] == Approx(row[c] - ref_log_sum_exp).margin(1e-3));
+      total += test_C[r * B_cols + c];
+    }
+    CHECK(total == Approx(1.0).epsilon(1e-3));
+  }
+}
+
+TEST_CASE ("Multiply softmax statistics", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestSoftmax<sse2::Kernels16>(5, 64, 37);
+  TestSoftmax<sse2::Kernels16>(3, 64, 8);
+  if (kCPU < CPUType::SSSE3) return;
+  TestSoftmax<ssse3::Kernels8>(5, 64, 1000);
+  if (kCPU < CPUType::AVX2) return;
+  TestSoftmax<avx2::Kernels8>(9, 64, 130);
+  TestSoftmax<avx2::Kernels16>(9, 64, 130);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestSoftmax<avx512bw::Kernels8>(9, 128, 1000);
+  TestSoftmax<avx512bw::Kernels8>(4, 128, 24);
+  TestSoftmax<avx512bw::Kernels16>(1, 64, 21);
+#endif
+}
+
+template <class Routine> void TestTopK(Index A_rows, Index width, Index B_cols, Index k) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\ttop " << k);
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> bias(B_cols);
+  FillUniform(bias, ab.gen);
+
+  AlignedVector<float> C(A_rows * B_cols);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), C.begin()));
+
+  callbacks::TopK top_k(A_rows, k), pool_top_k(A_rows, k);
+  OMPParallelWrap<callbacks::UnquantizeAndAddBiasAndTopK, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndTopK(unquant_mult, bias.begin(), &top_k));
+  top_k.Merge();
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndTopK, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndTopK(unquant_mult, bias.begin(), &pool_top_k));
+  }
+  pool_top_k.Merge();
+  // Blocks of 24 columns end halfway through a 16-column tile.
+  callbacks::TopK blocked_top_k(A_rows, k);
+  MultiplyBlocked<callbacks::UnquantizeAndAddBiasAndTopK, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndTopK(unquant_mult, bias.begin(), &blocked_top_k), BlockSizes{width, A_rows, 24});
+  blocked_top_k.Merge();
+
+  const Index found = std::min(k, B_cols);
+  CHECK(top_k.Found() == found);
+  CHECK(pool_top_k.Found() == found);
+  CHECK(blocked_top_k.Found() == found);
+  std::vector<Index> order(B_cols);
+  for (Index r = 0; r < A_rows; ++r) {
+    const float *row = C.begin() + r * B_cols;
+    for (Index c = 0; c < B_cols; ++c) order[c] = c;
+    // Ties go to the lower column.
+    std::stable_sort(order.begin(), order.end(), [row](Index a, Index b) { return row[a] > row[b]; });
+    for (Index i = 0; i < found; ++i) {
+      INFO("Row " << r << " rank " << i);
+      CHECK(top_k.Columns(r)[i] == order[i]);
+      CHECK(top_k.Scores(r)[i] == row[order[i]]);
+      CHECK(pool_top_k.Columns(r)[i] == order[i]);
+      CHECK(pool_top_k.Scores(r)[i] == row[order[i]]);
+      CHECK(blocked_top_k.Columns(r)[i] == order[i]);
+      CHECK(blocked_top_k.Scores(r)[i] == row[order[i]]);
+    }
+    CHECK(top_k.ArgMax(r) == order[0]);
+  }
+
+  // The heaps are empty again for the next multiply.
+  OMPParallelWrap<callbacks::UnquantizeAndAddBiasAndTopK, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndTopK(unquant_mult, nullptr, &top_k));
+  top_k.Merge();
+  for (Index r = 0; r < A_rows; ++r) {
+    const float *row = C.begin() + r * B_cols;
+    for (Index i = 0; i < found; ++i) {
+      CHECK(top_k.Scores(r)[i] == Approx(row[top_k.Columns(r)[i]] - bias[top_k.Columns(r)[i]]).margin(1e-5));
+    }
+  }
+}
+
+TEST_CASE ("Multiply top k", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestTopK<sse2::Kernels16>(5, 64, 37, 4);
+  TestTopK<sse2::Kernels16>(3, 64, 8, 1);
+  TestTopK<sse2::Kernels16>(3, 64, 5, 8);
+  if (kCPU < CPUType::SSSE3) return;
+  TestTopK<ssse3::Kernels8>(5, 64, 1000, 5);
+  TestTopK<ssse3::Kernels8>(5, 64, 1000, 1);
+  if (kCPU < CPUType::AVX2) return;
+  TestTopK<avx2::Kernels8>(9, 64, 130, 8);
+  TestTopK<avx2::Kernels8>(9, 64, 1000, 1);
+  TestTopK<avx2::Kernels16>(9, 64, 130, 3);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestTopK<avx512bw::Kernels8>(9, 128, 1000, 10);
+  TestTopK<avx512bw::Kernels8>(4, 128, 24, 1);
+  TestTopK<avx512bw::Kernels16>(1, 64, 21, 16);
+#endif
+}
+
+template <class Routine> void TestScore(Index A_rows, Index width, Index B_cols) {
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols << "\tscore");
+  const float quant_mult = 64.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  RandomAB<Routine> ab(A_rows, width, B_cols, quant_mult);
+  AlignedVector<float> bias(B_cols);
+  FillUniform(bias, ab.gen, -4.0f, 4.0f);
+  std::vector<Index> targets(A_rows);
+  for (Index r = 0; r < A_rows; ++r) {
+    targets[r] = (r * 37 + 5) % B_cols;
+  }
+
+  AlignedVector<float> C(A_rows * B_cols);
+  OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndWrite, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), C.begin()));
+
+  callbacks::LogSumExp state(A_rows);
+  std::vector<float> target_scores(A_rows), log_sum_exp(A_rows), pool_target_scores(A_rows), pool_log_sum_exp(A_rows);
+  OMPParallelWrap<callbacks::UnquantizeAndAddBiasAndScore, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndScore(unquant_mult, bias.begin(), targets.data(), target_scores.data(), &state));
+  state.Merge(log_sum_exp.data());
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    OMPParallelWrapBlocked<callbacks::UnquantizeAndAddBiasAndScore, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndScore(unquant_mult, bias.begin(), targets.data(), pool_target_scores.data(), &state));
+  }
+  state.Merge(pool_log_sum_exp.data());
+  // Blocks of 24 columns end halfway through a 16-column tile.
+  std::vector<float> blocked_target_scores(A_rows), blocked_log_sum_exp(A_rows);
+  MultiplyBlocked<callbacks::UnquantizeAndAddBiasAndScore, Routine>(ab.A_prep.begin(), ab.B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndScore(unquant_mult, bias.begin(), targets.data(), blocked_target_scores.data(), &state), BlockSizes{width, A_rows, 24});
+  state.Merge(blocked_log_sum_exp.data());
+
+  for (Index r = 0; r < A_rows; ++r) {
+    const float *row = C.begin() + r * B_cols;
+    const double highest = *std::max_element(row, row + B_cols);
+    double sum = 0.0;
+    for (Index c = 0; c < B_cols; ++c) {
+      sum += std::exp(row[c] - highest);
+    }
+    INFO("Row " << r);
+    CHECK(target_scores[r] == row[targets[r]]);
+    CHECK(pool_target_scores[r] == row[targets[r]]);
+    CHECK(blocked_target_scores[r] == row[targets[r]]);
+    CHECK(log_sum_exp[r] == Approx(highest + std::log(sum)).epsilon(1e-4));
+    CHECK(pool_log_sum_exp[r] == Approx(highest + std::log(sum)).epsilon(1e-4));
+    CHECK(blocked_log_sum_exp[r] == Approx(highest + std::log(sum)).epsilon(1e-4));
+  }
+}
+
+TEST_CASE ("Multiply score targets", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestScore<sse2::Kernels16>(5, 64, 37);
+  TestScore<sse2::Kernels16>(3, 64, 8);
+  if (kCPU < CPUType::SSSE3) return;
+  TestScore<ssse3::Kernels8>(5, 64, 1000);
+  if (kCPU < CPUType::AVX2) return;
+  TestScore<avx2::Kernels8>(9, 64, 130);
+  TestScore<avx2::Kernels16>(9, 64, 130);
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+  if (kCPU < CPUType::AVX512BW) return;
+  TestScore<avx512bw::Kernels8>(9, 128, 1000);
+  TestScore<avx512bw::Kernels8>(4, 128, 24);
+  TestScore<avx512bw::Kernels16>(1, 64, 21);
+#endif
+}
+
+// Int8::Score and Int16::Score against the log probabilities of a softmax.
+template <class Routine> void TestDispatchScore(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  INFO(Routine::kName << "\t" << A_rows << '\t' << width << '\t' << B_cols);
+  AlignedVector<float> A(A_rows * width), B(width * B_cols);
+  std::mt19937 gen;
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (auto& it : A) {
+    it = dist(gen);
+  }
+  for (auto& it : B) {
+    it = dist(gen);
+  }
+  std::vector<Index> targets(A_rows);
+  for (Index r = 0; r < A_rows; ++r) {
+    targets[r] = (r * 101) % B_cols;
+  }
+  const float quant_mult = 32.0f, unquant_mult = 1.0f / (quant_mult * quant_mult);
+  AlignedVector<Integer> A_prep(Routine::PreparedASize(A_rows, width)), B_prep(Routine::PreparedBSize(width, B_cols));
+  Routine::PrepareA(A.begin(), A_prep.begin(), quant_mult, A_rows, width);
+  Routine::PrepareB(B.begin(), B_prep.begin(), quant_mult, width, B_cols);
+
+  AlignedVector<float> C(A_rows * B_cols);
+  Routine::Multiply(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndWrite(unquant_mult, C.begin()));
+  std::vector<float> target_scores(A_rows), log_sum_exp(A_rows);
+  Routine::Score(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, unquant_mult, nullptr, targets.data(), target_scores.data(), log_sum_exp.data());
+  for (Index r = 0; r < A_rows; ++r) {
+    const float *row = C.begin() + r * B_cols;
+    double sum = 0.0;
+    for (Index c = 0; c < B_cols; ++c) {
+      sum += std::exp(row[c]);
+    }
+    INFO("Row " << r);
+    CHECK(target_scores[r] == row[targets[r]]);
+    CHECK(target_scores[r] - log_sum_exp[r] == Approx(row[targets[r]] - std::log(sum)).margin(1e-4));
+  }
+}
+
+TEST_CASE ("Score dispatch", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestDispatchScore<Int8>(7, 128, 1000);
+  TestDispatchScore<Int16>(7, 128, 1000);
+  TestDispatchScore<Int8>(1, 64, 16);
+}
+
+// The dispatched overloads taking float A.
+template <class Routine> void TestDispatchFloatA(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  AlignedVector<float> A(A_rows * width), B(width * B_cols);
+  std::mt19937 gen;
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (auto& it : A) {
+    it = dist(gen);
+  }
+  for (auto& it : B) {
+    it = dist(gen);
+  }
+  AlignedVector<Integer> A_prep(Routine::PreparedASize(A_rows, width)), B_prep(Routine::PreparedBSize(width, B_cols));
+  Routine::PrepareA(A.begin(), A_prep.begin(), 32.0f, A_rows, width);
+  Routine::PrepareB(B.begin(), B_prep.begin(), 32.0f, width, B_cols);
+  AlignedVector<float> expected(A_rows * B_cols), test_C(A_rows * B_cols);
+  Routine::Multiply(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndWrite(1.0f / 1024.0f, expected.begin()));
+  Routine::Multiply(A.begin(), B_prep.begin(), 32.0f, A_rows, width, B_cols, callbacks::UnquantizeAndWrite(1.0f / 1024.0f, test_C.begin()));
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(test_C[i] == expected[i]);
+  }
+}
+
+TEST_CASE ("Multiply float A", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestDispatchFloatA<Int8>(2, 100, 37);
+  TestDispatchFloatA<Int16>(2, 100, 37);
+}
+
+TEST_CASE ("Multiply blocked SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyBlockedShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply panels SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyPanelsShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply prefetch SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyPrefetchShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply pool SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyPoolShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply float A SSE2", "[multiply]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyFloatAShapes<sse2::Kernels16>();
+}
+
+TEST_CASE ("Multiply blocked SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyBlockedShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply panels SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyPanelsShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply prefetch SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyPrefetchShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply pool SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyPoolShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply float A SSSE3", "[multiply]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyFloatAShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE ("Multiply blocked AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyBlockedShapes<avx2::Kernels8>();
+  TestMultiplyBlockedShapes<avx2::Kernels16>();
+}
+
+TEST_CASE ("Multiply panels AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyPanelsShapes<avx2::Kernels8>();
+  TestMultiplyPanelsShapes<avx2::Kernels16>();
+}
+
+TEST_CASE ("Multiply prefetch AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyPrefetchShapes<avx2::Kernels8>();
+  TestMultiplyPrefetchShapes<avx2::Kernels16>();
+}
+
+TEST_CASE ("Multiply pool AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyPoolShapes<avx2::Kernels8>();
+  TestMultiplyPoolShapes<avx2::Kernels16>();
+}
+
+TEST_CASE ("Multiply float A AVX2", "[multiply]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestMultiplyFloatAShapes<avx2::Kernels8>();
+  TestMultiplyFloatAShapes<avx2::Kernels16>();
+}
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVXVNNI
+TEST_CASE ("Multiply AVXVNNI 8bit", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiply<avxvnni::Kernels8>(8, 256, 256, 0, 0.25f, 0.062f);
+  TestMultiply<avxvnni::Kernels8>(1, 256, 256, 0, 0.25f, 0.062f);
+  TestMultiply<avxvnni::Kernels8>(8, 2048, 256, 0, 0.55f, 0.25f);
+  TestMultiply<avxvnni::Kernels8>(320, 256, 256, 0, 0.26f, 0.059f);
+  TestMultiply<avxvnni::Kernels8>(472, 256, 256, 0, 0.29f, 0.059f);
+  TestMultiply<avxvnni::Kernels8>(248, 256, 256, 0, 0.29f, 0.059f);
+  TestMultiply<avxvnni::Kernels8>(200, 256, 256, 0, 0.28f, 0.06f);
+}
+
+TEST_CASE ("Multiply AVXVNNI 8bit with bias", "[biased_multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyBias<avxvnni::Kernels8>(8, 256, 256, 0, 0.25f, 0.062f);
+  TestMultiplyBias<avxvnni::Kernels8>(8, 2048, 256, 0, 0.55f, 0.25f);
+  TestMultiplyBias<avxvnni::Kernels8>(320, 256, 256, 0, 0.26f, 0.059f);
+  TestMultiplyBias<avxvnni::Kernels8>(472, 256, 256, 0, 0.29f, 0.059f);
+  TestMultiplyBias<avxvnni::Kernels8>(248, 256, 256, 0, 0.29f, 0.059f);
+  TestMultiplyBias<avxvnni::Kernels8>(200, 256, 256, 0, 0.28f, 0.06f);
+}
+
+TEST_CASE ("Multiply wide AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyWideShapes<avxvnni::Kernels8>();
+}
+
+TEST_CASE ("Multiply any shape AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyAnyShapes<avxvnni::Kernels8>();
+}
+
+TEST_CASE ("Multiply blocked AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyBlockedShapes<avxvnni::Kernels8>();
+}
+
+TEST_CASE ("Multiply panels AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyPanelsShapes<avxvnni::Kernels8>();
+}
+
+TEST_CASE ("Multiply prefetch AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyPrefetchShapes<avxvnni::Kernels8>();
+}
+
+TEST_CASE ("Multiply pool AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyPoolShapes<avxvnni::Kernels8>();
+}
+
+TEST_CASE ("Multiply float A AVXVNNI", "[multiply]") {
+  if (!CPUSupportsAVXVNNI()) return;
+  TestMultiplyFloatAShapes<avxvnni::Kernels8>();
+}
+#endif
+
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
   TEST_CASE ("Multiply AVX512 8bit", "[multiply]") {
     if (kCPU < CPUType::AVX512BW) return;
     TestMultiply<avx512bw::Kernels8>(8, 256, 256, 0, 0.25f, 0.062f);
+    TestMultiply<avx512bw::Kernels8>(1, 256, 256, 0, 0.25f, 0.062f);
+    TestMultiply<avx512bw::Kernels8>(7, 256, 256, 0, 0.25f, 0.062f);
     TestMultiply<avx512bw::Kernels8>(8, 2048, 256, 3.7f, 4, 0.37f, 0.33f);
     TestMultiply<avx512bw::Kernels8>(320, 256, 256, 0, 0.26f, 0.059f);
     TestMultiply<avx512bw::Kernels8>(472, 256, 256, 0, 0.29f, 0.059f);
@@ -461,6 +1670,8 @@ TEST_CASE ("Multiply AVX2 16bit with bias", "[biased_multiply]") {
     TEST_CASE ("Multiply AVX512VNNI 8bit", "[multiply]") {
       if (kCPU < CPUType::AVX512VNNI) return;
       TestMultiply<avx512vnni::Kernels8>(8, 256, 256, 0, 0.25f, 0.062f);
+      TestMultiply<avx512vnni::Kernels8>(1, 256, 256, 0, 0.25f, 0.062f);
+      TestMultiply<avx512vnni::Kernels8>(7, 256, 256, 0, 0.25f, 0.062f);
       TestMultiply<avx512vnni::Kernels8>(8, 2048, 256, 0, 0.55f, 0.25f);
       TestMultiply<avx512vnni::Kernels8>(320, 256, 256, 0, 0.26f, 0.059f);
       TestMultiply<avx512vnni::Kernels8>(472, 256, 256, 0, 0.29f, 0.059f);
@@ -482,6 +1693,8 @@ TEST_CASE ("Multiply AVX2 16bit with bias", "[biased_multiply]") {
   TEST_CASE ("Multiply AVX512 16bit", "[multiply]") {
     if (kCPU < CPUType::AVX512BW) return;
     TestMultiply<avx512bw::Kernels16>(8, 256, 256, .1f, 1, 0.01f);
+    TestMultiply<avx512bw::Kernels16>(1, 256, 256, .1f, 1, 0.01f);
+    TestMultiply<avx512bw::Kernels16>(7, 256, 256, .1f, 1, 0.01f);
     TestMultiply<avx512bw::Kernels16>(8, 2048, 256, .1f, 1, 0.011f);
     TestMultiply<avx512bw::Kernels16>(320, 256, 256, .1f, 1, 0.01f);
     TestMultiply<avx512bw::Kernels16>(472, 256, 256, .1f, 1, 0.01f);
@@ -489,6 +1702,120 @@ TEST_CASE ("Multiply AVX2 16bit with bias", "[biased_multiply]") {
     TestMultiply<avx512bw::Kernels16>(200, 256, 256, .1f, 1, 0.01f);
   }
 
+  #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+    TEST_CASE ("Multiply AVX512VNNI 16bit", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiply<avx512vnni::Kernels16>(8, 256, 256, .1f, 1, 0.01f);
+      TestMultiply<avx512vnni::Kernels16>(1, 256, 256, .1f, 1, 0.01f);
+      TestMultiply<avx512vnni::Kernels16>(7, 256, 256, .1f, 1, 0.01f);
+      TestMultiply<avx512vnni::Kernels16>(8, 2048, 256, .1f, 1, 0.011f);
+      TestMultiply<avx512vnni::Kernels16>(320, 256, 256, .1f, 1, 0.01f);
+      TestMultiply<avx512vnni::Kernels16>(472, 256, 256, .1f, 1, 0.01f);
+      TestMultiply<avx512vnni::Kernels16>(248, 256, 256, .1f, 1, 0.01f);
+      TestMultiply<avx512vnni::Kernels16>(200, 256, 256, .1f, 1, 0.01f);
+    }
+
+    TEST_CASE ("Multiply AVX512VNNI 16bit with bias", "[biased_multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyBias<avx512vnni::Kernels16>(8, 256, 256, .1f, 1, 0.01f);
+      TestMultiplyBias<avx512vnni::Kernels16>(8, 2048, 256, .1f, 1, 0.011f);
+      TestMultiplyBias<avx512vnni::Kernels16>(320, 256, 256, .1f, 1, 0.01f);
+      TestMultiplyBias<avx512vnni::Kernels16>(472, 256, 256, .1f, 1, 0.01f);
+      TestMultiplyBias<avx512vnni::Kernels16>(248, 256, 256, .1f, 1, 0.01f);
+      TestMultiplyBias<avx512vnni::Kernels16>(200, 256, 256, .1f, 1, 0.01f);
+    }
+  #endif
+
+  TEST_CASE ("Multiply wide AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyWideShapes<avx512bw::Kernels8>();
+    TestMultiplyWideShapes<avx512bw::Kernels16>();
+  }
+
+  #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+    TEST_CASE ("Multiply wide AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyWideShapes<avx512vnni::Kernels8>();
+      TestMultiplyWideShapes<avx512vnni::Kernels16>();
+    }
+  #endif
+
+  TEST_CASE ("Multiply any shape AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyAnyShapes<avx512bw::Kernels8>();
+    TestMultiplyAnyShapes<avx512bw::Kernels16>();
+  }
+
+  #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+    TEST_CASE ("Multiply any shape AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyAnyShapes<avx512vnni::Kernels8>();
+      TestMultiplyAnyShapes<avx512vnni::Kernels16>();
+    }
+  #endif
+
+  TEST_CASE ("Multiply blocked AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyBlockedShapes<avx512bw::Kernels8>();
+    TestMultiplyBlockedShapes<avx512bw::Kernels16>();
+  }
+
+  TEST_CASE ("Multiply panels AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyPanelsShapes<avx512bw::Kernels8>();
+    TestMultiplyPanelsShapes<avx512bw::Kernels16>();
+  }
+
+  TEST_CASE ("Multiply prefetch AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyPrefetchShapes<avx512bw::Kernels8>();
+    TestMultiplyPrefetchShapes<avx512bw::Kernels16>();
+  }
+
+  TEST_CASE ("Multiply pool AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyPoolShapes<avx512bw::Kernels8>();
+    TestMultiplyPoolShapes<avx512bw::Kernels16>();
+  }
+
+  TEST_CASE ("Multiply float A AVX512", "[multiply]") {
+    if (kCPU < CPUType::AVX512BW) return;
+    TestMultiplyFloatAShapes<avx512bw::Kernels8>();
+    TestMultiplyFloatAShapes<avx512bw::Kernels16>();
+  }
+
+  #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512VNNI
+    TEST_CASE ("Multiply blocked AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyBlockedShapes<avx512vnni::Kernels8>();
+      TestMultiplyBlockedShapes<avx512vnni::Kernels16>();
+    }
+
+    TEST_CASE ("Multiply panels AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyPanelsShapes<avx512vnni::Kernels8>();
+      TestMultiplyPanelsShapes<avx512vnni::Kernels16>();
+    }
+
+    TEST_CASE ("Multiply prefetch AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyPrefetchShapes<avx512vnni::Kernels8>();
+      TestMultiplyPrefetchShapes<avx512vnni::Kernels16>();
+    }
+
+    TEST_CASE ("Multiply pool AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyPoolShapes<avx512vnni::Kernels8>();
+      TestMultiplyPoolShapes<avx512vnni::Kernels16>();
+    }
+
+    TEST_CASE ("Multiply float A AVX512VNNI", "[multiply]") {
+      if (kCPU < CPUType::AVX512VNNI) return;
+      TestMultiplyFloatAShapes<avx512vnni::Kernels8>();
+      TestMultiplyFloatAShapes<avx512vnni::Kernels16>();
+    }
+  #endif
+
   TEST_CASE ("Multiply AVX512 16bit with bias", "[biased_multiply]") {
     if (kCPU < CPUType::AVX512BW) return;
     TestMultiplyBias<avx512bw::Kernels16>(8, 256, 256, .1f, 1, 0.01f);
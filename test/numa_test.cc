@@ -0,0 +1,117 @@
+#include "test.h"
+#include "../intgemm/aligned.h"
+#include "../intgemm/intgemm.h"
+#include "../intgemm/numa.h"
+#include "../intgemm/thread_pool.h"
+
+#include <algorithm>
+#include <random>
+
+namespace intgemm {
+namespace {
+
+TEST_CASE("NUMA topology", "[numa]") {
+  CHECK(NumaNodes() >= 1);
+  CHECK(CurrentNumaNode() < NumaNodes());
+}
+
+TEST_CASE("NumaReplicas copies to every node", "[numa]") {
+  AlignedVector<int> data(1000);
+  for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<int>(i * 7);
+  NumaReplicas<int> replicas(data.begin(), data.size());
+  CHECK(replicas.size() == data.size());
+  for (Index node = 0; node < NumaNodes(); ++node) {
+    for (std::size_t i = 0; i < data.size(); ++i) {
+      INFO("Node " << node << " index " << i);
+      CHECK(replicas.OnNode(node)[i] == data[i]);
+    }
+  }
+  CHECK(replicas.Local() == replicas.OnNode(CurrentNumaNode()));
+}
+
+TEST_CASE("NumaReplicas on huge pages", "[numa]") {
+  AlignedVector<int> data(1 << 20);
+  for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<int>(i * 3);
+  NumaReplicas<int> replicas(data.begin(), data.size(), PagePolicy::ExplicitHuge);
+  for (Index node = 0; node < NumaNodes(); ++node) {
+    CHECK(std::equal(data.begin(), data.end(), replicas.OnNode(node)));
+  }
+}
+
+// Multiplying by replicas of B should match multiplying by B, with and
+// without a thread pool.
+template <class Routine> void TestMultiplyReplicated(Index A_rows, Index width, Index B_cols) {
+  using Integer = typename Routine::Integer;
+  INFO(Routine::kName << '\t' << A_rows << '\t' << width << '\t' << B_cols);
+  AlignedVector<float> A(A_rows * width), B(width * B_cols);
+  std::mt19937 gen;
+  FillUniform(A, gen);
+  FillUniform(B, gen);
+  const float quant_mult = 16;
+  AlignedVector<Integer> A_prep(Routine::PreparedASize(A_rows, width)), B_prep(Routine::PreparedBSize(width, B_cols));
+  Routine::PrepareA(A.begin(), A_prep.begin(), quant_mult, A_rows, width);
+  Routine::PrepareB(B.begin(), B_prep.begin(), quant_mult, width, B_cols);
+  const ReplicatedB<Integer> replicated(B_prep.begin(), B_prep.size());
+
+  AlignedVector<int32_t> expected(A_rows * B_cols), test_C(A_rows * B_cols), pool_C(A_rows * B_cols);
+  Routine::Multiply(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  Routine::Multiply(A_prep.begin(), replicated, A_rows, width, B_cols, callbacks::Write<int32_t>(test_C.begin()));
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    Routine::Multiply(A_prep.begin(), replicated, A_rows, width, B_cols, callbacks::Write<int32_t>(pool_C.begin()));
+  }
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(test_C[i] == expected[i]);
+    CHECK(pool_C[i] == expected[i]);
+  }
+}
+
+TEST_CASE("Multiply replicated B 8bit", "[numa]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestMultiplyReplicated<Int8>(1, 64, 8);
+  TestMultiplyReplicated<Int8>(11, 100, 37);
+  TestMultiplyReplicated<Int8>(40, 256, 24);
+}
+
+TEST_CASE("Multiply replicated B 16bit", "[numa]") {
+  if (kCPU < CPUType::SSE2) return;
+  TestMultiplyReplicated<Int16>(1, 32, 8);
+  TestMultiplyReplicated<Int16>(11, 100, 37);
+  TestMultiplyReplicated<Int16>(40, 256, 24);
+}
+
+// The replicated bias should take the place of the callback's.
+TEST_CASE("Multiply replicated B and bias 8bit shift", "[numa]") {
+  if (kCPU < CPUType::SSSE3) return;
+  const Index A_rows = 9, width = 128, B_cols = 40;
+  AlignedVector<float> A(A_rows * width), B(width * B_cols), bias(B_cols);
+  std::mt19937 gen;
+  FillUniform(A, gen);
+  FillUniform(B, gen);
+  FillUniform(bias, gen);
+  const float alpha = 2.0f, quant_mult = 127.0f / alpha;
+  const float unquant_mult = 1.0f / (quant_mult * quant_mult);
+  AlignedVector<int8_t> A_prep(A.size()), B_prep(B.size());
+  Int8Shift::PrepareA(A.begin(), A_prep.begin(), quant_mult, A_rows, width);
+  Int8Shift::PrepareB(B.begin(), B_prep.begin(), quant_mult, width, B_cols);
+  Int8Shift::PrepareBias(B_prep.begin(), width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(-alpha * alpha / 127.0f, bias.begin(), bias.begin()));
+  const ReplicatedB<int8_t> replicated(B_prep.begin(), B_prep.size(), bias.begin(), B_cols);
+
+  AlignedVector<float> expected(A_rows * B_cols), test_C(A_rows * B_cols);
+  Int8Shift::Multiply(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, bias.begin(), expected.begin()));
+  // The bias in the callback is only a placeholder.
+  AlignedVector<float> zeros(B_cols);
+  for (auto& it : zeros) {
+    it = 0.0f;
+  }
+  Int8Shift::Multiply(A_prep.begin(), replicated, A_rows, width, B_cols, callbacks::UnquantizeAndAddBiasAndWrite(unquant_mult, zeros.begin(), test_C.begin()));
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(test_C[i] == expected[i]);
+  }
+}
+
+} // namespace
+} // namespace intgemm
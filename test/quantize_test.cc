@@ -5,10 +5,14 @@
 #include "../intgemm/sse2_gemm.h"
 #include "../intgemm/ssse3_gemm.h"
 #include "../intgemm/stats.h"
+#include "../intgemm/thread_pool.h"
+#include "../intgemm/intgemm.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <random>
 
 namespace intgemm {
 namespace {
@@ -120,7 +124,7 @@ template <class Backend> void TestMany(std::size_t grow) {
 
 TEST_CASE ("Quantize SSE2", "[quantize]") {
   if (kCPU < CPUType::SSE2) return;
-  TestMany<sse2::Kernels16>(8);
+  TestMany<sse2::Kernels16>(1);
 }
 
 TEST_CASE ("Quantize SSSE3", "[quantize]") {
@@ -131,16 +135,84 @@ TEST_CASE ("Quantize SSSE3", "[quantize]") {
 TEST_CASE ("Quantize AVX2", "[quantize]") {
   if (kCPU < CPUType::AVX2) return;
   TestMany<avx2::Kernels8>(1);
-  TestMany<avx2::Kernels16>(16);
+  TestMany<avx2::Kernels16>(1);
 }
 #ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
   TEST_CASE ("Quantize AVX512", "[quantize]") {
     if (kCPU < CPUType::AVX512BW) return;
     TestMany<avx512bw::Kernels8>(1);
-    TestMany<avx512bw::Kernels16>(16);
+    TestMany<avx512bw::Kernels16>(1);
   }
 #endif
 
+// PrepareADynamic should pick 127 over the largest absolute value and match
+// PrepareAPadded with it, alone and sharded on a thread pool.
+template <class Backend> void TestPrepareADynamic(Index rows, Index cols) {
+  INFO(Backend::kName << '\t' << rows << '\t' << cols);
+  const std::size_t size = static_cast<std::size_t>(rows) * cols;
+  AlignedVector<float> input(size);
+  std::mt19937 gen;
+  std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+  float largest = 0.0f;
+  for (auto& it : input) {
+    it = dist(gen);
+    largest = std::max(largest, std::fabs(it));
+  }
+  const float expected_mult = 127.0f / largest;
+  AlignedVector<int8_t> ref(PreparedASize<Backend>(rows, cols)), test(ref.size());
+  PrepareAPadded<Backend>(input.begin(), ref.begin(), expected_mult, rows, cols);
+  CHECK(PrepareADynamic<Backend>(input.begin(), test.begin(), rows, cols) == expected_mult);
+  CHECK(std::equal(ref.begin(), ref.end(), test.begin()));
+
+  std::fill(test.begin(), test.end(), 0);
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    CHECK(PrepareADynamic<Backend>(input.begin(), test.begin(), rows, cols) == expected_mult);
+  }
+  CHECK(std::equal(ref.begin(), ref.end(), test.begin()));
+}
+
+template <class Backend> void TestPrepareADynamicShapes() {
+  TestPrepareADynamic<Backend>(1, 1);
+  TestPrepareADynamic<Backend>(3, 17);
+  TestPrepareADynamic<Backend>(8, 64);
+  TestPrepareADynamic<Backend>(64, 1000);
+  TestPrepareADynamic<Backend>(7, 33333);
+}
+
+TEST_CASE("PrepareADynamic SSSE3", "[quantize]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestPrepareADynamicShapes<ssse3::Kernels8>();
+}
+
+TEST_CASE("PrepareADynamic AVX2", "[quantize]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestPrepareADynamicShapes<avx2::Kernels8>();
+}
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+TEST_CASE("PrepareADynamic AVX512BW", "[quantize]") {
+  if (kCPU < CPUType::AVX512BW) return;
+  TestPrepareADynamicShapes<avx512bw::Kernels8>();
+}
+#endif
+
+TEST_CASE("PrepareADynamic dispatch", "[quantize]") {
+  if (kCPU < CPUType::SSSE3) return;
+  AlignedVector<float> input(100);
+  AlignedVector<int8_t> output(Int8::PreparedASize(4, 25));
+  std::fill(input.begin(), input.end(), 0.0f);
+  std::fill(output.begin(), output.end(), 1);
+  CHECK(Int8::PrepareADynamic(input.begin(), output.begin(), 4, 25) == 1.0f);
+  // Rows are padded to the CPU's width, so the tail past it is untouched.
+  CHECK(std::count(output.begin(), output.end(), 0) >= 100);
+  CHECK(std::count(output.begin(), output.end(), 0) + std::count(output.begin(), output.end(), 1) == static_cast<std::ptrdiff_t>(output.size()));
+  input[37] = -0.5f;
+  CHECK(Int8::PrepareADynamic(input.begin(), output.begin(), 4, 25) == 254.0f);
+  CHECK(std::count(output.begin(), output.end(), -127) == 1);
+}
+
 TEST_CASE("QuantizeStd SSSE3", "[VectorMeanStd]") {
   if (kCPU < CPUType::SSSE3) return;
   testVectorMeanStd<sse2::VectorMeanStd>(64);
@@ -10,6 +10,7 @@
 #include <sstream>
 #include <iostream>
 #include <iomanip>
+#include <random>
 
 #define CHECK_MESSAGE(cond, msg) do { INFO(msg); CHECK(cond); } while(0)
 #define CHECK_FALSE_MESSAGE(cond, msg) do { INFO(msg); CHECK_FALSE(cond); } while(0)
@@ -44,6 +45,15 @@ void CompareEps(const Type* reference, const Type* actual, Index size, Type epsi
   }
 }
 
+// Fill with uniform random floats in [low, high), continuing gen.
+template <class Container>
+void FillUniform(Container &values, std::mt19937 &gen, float low = -1.0f, float high = 1.0f) {
+  std::uniform_real_distribution<float> dist(low, high);
+  for (auto& it : values) {
+    it = dist(gen);
+  }
+}
+
 void CompareMSE(const float *float_ref, const float *int_ref, const float *int_test,
                 std::size_t size, std::string test_info, float int_tolerance,
                 float float_tolerance, float MSE_float_tolerance, float MSE_int_tolerance);
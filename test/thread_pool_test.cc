@@ -0,0 +1,101 @@
+#include "test.h"
+#include "../intgemm/aligned.h"
+#include "../intgemm/avx2_gemm.h"
+#include "../intgemm/avx512_gemm.h"
+#include "../intgemm/ssse3_gemm.h"
+#include "../intgemm/thread_pool.h"
+
+#include <atomic>
+#include <memory>
+#include <random>
+
+namespace intgemm {
+namespace {
+
+void CheckEachTaskOnce(ThreadPool &pool, Index tasks) {
+  std::unique_ptr<std::atomic<int>[]> runs(new std::atomic<int>[tasks + 1]);
+  for (Index i = 0; i < tasks; ++i) runs[i] = 0;
+  pool.ParallelFor(tasks, [&](Index i) { ++runs[i]; });
+  for (Index i = 0; i < tasks; ++i) {
+    INFO("Threads " << pool.Threads() << " tasks " << tasks << " task " << i);
+    CHECK(runs[i] == 1);
+  }
+}
+
+TEST_CASE("ThreadPool runs each task once", "[thread_pool]") {
+  for (Index threads : {1, 2, 3, 5}) {
+    // Spinning between calls, and sleeping right away.
+    for (unsigned int spin_us : {100u, 0u}) {
+      ThreadPool pool(threads, false, spin_us);
+      for (Index tasks : {0, 1, 2, 7, 1000}) {
+        for (int repeat = 0; repeat < 20; ++repeat) CheckEachTaskOnce(pool, tasks);
+      }
+    }
+  }
+}
+
+TEST_CASE("ThreadPool pinned", "[thread_pool]") {
+  ThreadPool pool(3, true);
+  CheckEachTaskOnce(pool, 100);
+}
+
+TEST_CASE("ThreadPool nested ParallelFor runs inline", "[thread_pool]") {
+  ThreadPool pool(3);
+  std::atomic<int> inner(0);
+  pool.ParallelFor(8, [&](Index) {
+    pool.ParallelFor(10, [&](Index) { ++inner; });
+  });
+  CHECK(inner == 80);
+
+  // Through another pool back into the first, which the calling thread holds.
+  ThreadPool other(2);
+  inner = 0;
+  pool.ParallelFor(8, [&](Index) {
+    other.ParallelFor(3, [&](Index) {
+      pool.ParallelFor(10, [&](Index) { ++inner; });
+    });
+  });
+  CHECK(inner == 240);
+}
+
+// Quantize in chunks on the pool should match one pass.
+template <class Backend> void TestQuantizePool() {
+  const Index size = 3 * static_cast<Index>(kQuantizeChunk) + 37;
+  AlignedVector<float> input(size);
+  std::mt19937 gen;
+  FillUniform(input, gen, -2.0f, 2.0f);
+  AlignedVector<int8_t> expected(size);
+  Backend::Quantize(input.begin(), expected.begin(), 64.0f, size);
+
+  AlignedVector<int8_t> test(size);
+  {
+    ThreadPool pool(3);
+    ScopedThreadPool scoped(pool);
+    Backend::Quantize(input.begin(), test.begin(), 64.0f, size);
+  }
+
+  for (Index i = 0; i < size; ++i) {
+    INFO(Backend::kName << " index " << i);
+    CHECK(test[i] == expected[i]);
+  }
+}
+
+TEST_CASE("Quantize on ThreadPool SSSE3", "[thread_pool]") {
+  if (kCPU < CPUType::SSSE3) return;
+  TestQuantizePool<ssse3::Kernels8>();
+}
+
+TEST_CASE("Quantize on ThreadPool AVX2", "[thread_pool]") {
+  if (kCPU < CPUType::AVX2) return;
+  TestQuantizePool<avx2::Kernels8>();
+}
+
+#ifdef INTGEMM_COMPILER_SUPPORTS_AVX512BW
+TEST_CASE("Quantize on ThreadPool AVX512BW", "[thread_pool]") {
+  if (kCPU < CPUType::AVX512BW) return;
+  TestQuantizePool<avx512bw::Kernels8>();
+}
+#endif
+
+} // namespace
+} // namespace intgemm
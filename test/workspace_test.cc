@@ -0,0 +1,107 @@
+#include "test.h"
+#include "../intgemm/aligned.h"
+#include "../intgemm/multiply.h"
+#include "../intgemm/ssse3_gemm.h"
+#include "../intgemm/workspace.h"
+
+#include <cstdint>
+#include <random>
+#include <thread>
+
+namespace intgemm {
+namespace {
+
+bool Aligned(const void *ptr) {
+  return reinterpret_cast<uintptr_t>(ptr) % 64 == 0;
+}
+
+TEST_CASE("Workspace allocates aligned and tracks the high-water mark", "[workspace]") {
+  Workspace workspace(1024);
+  CHECK(workspace.Capacity() == 1024);
+  char *a = workspace.Allocate<char>(1);
+  float *b = workspace.Allocate<float>(100);
+  CHECK(Aligned(a));
+  CHECK(Aligned(b));
+  CHECK(reinterpret_cast<char*>(b) >= a + 1);
+  CHECK(workspace.Used() == 64 + 448);
+  for (int i = 0; i < 100; ++i) b[i] = static_cast<float>(i);
+
+  workspace.Reset();
+  CHECK(workspace.Used() == 0);
+  CHECK(workspace.HighWater() == 64 + 448);
+  // The same memory is handed out again.
+  CHECK(workspace.Allocate<char>(1) == a);
+}
+
+TEST_CASE("Workspace grows and coalesces on Reset", "[workspace]") {
+  Workspace workspace(256);
+  workspace.Allocate<char>(200);
+  int32_t *big = workspace.Allocate<int32_t>(100000);
+  CHECK(Aligned(big));
+  for (int i = 0; i < 100000; ++i) big[i] = i;
+  CHECK(workspace.Capacity() > 256);
+  CHECK(workspace.Used() == 256 + 400000);
+  workspace.Reset();
+  CHECK(workspace.Capacity() == workspace.HighWater());
+  // Everything now fits in one block.
+  char *first = workspace.Allocate<char>(200);
+  char *second = workspace.Allocate<char>(400000);
+  CHECK(second == first + 256);
+  CHECK(workspace.Capacity() == 256 + 400000);
+}
+
+TEST_CASE("Workspace rewinds to a mark", "[workspace]") {
+  Workspace workspace;
+  char *keep = workspace.Allocate<char>(100);
+  const Workspace::Mark mark = workspace.Position();
+  char *scratch = workspace.Allocate<char>(1000);
+  workspace.Allocate<char>(1 << 20);
+  workspace.Rewind(mark);
+  CHECK(workspace.Used() == 128);
+  CHECK(workspace.Allocate<char>(1000) == scratch);
+  CHECK(scratch != keep);
+}
+
+TEST_CASE("ThreadWorkspace is per thread", "[workspace]") {
+  Workspace *main_workspace = &ThreadWorkspace();
+  CHECK(&ThreadWorkspace() == main_workspace);
+  Workspace *other = nullptr;
+  std::thread thread([&other] { other = &ThreadWorkspace(); });
+  thread.join();
+  CHECK(other != main_workspace);
+}
+
+// Temporaries of MultiplyBlocked and MultiplyGEMV from a workspace mustn't
+// change the sums, and are rewound afterwards.
+TEST_CASE("Multiply scratch from a workspace", "[workspace]") {
+  if (kCPU < CPUType::SSSE3) return;
+  using Backend = ssse3::Kernels8;
+  const Index A_rows = 3, width = 256, B_cols = 24;
+  AlignedVector<float> A(A_rows * width), B(width * B_cols);
+  std::mt19937 gen;
+  FillUniform(A, gen);
+  FillUniform(B, gen);
+  AlignedVector<int8_t> A_prep(A.size()), B_prep(B.size());
+  Backend::PrepareA(A.begin(), A_prep.begin(), 64.0f, A_rows, width);
+  Backend::PrepareB(B.begin(), B_prep.begin(), 64.0f, width, B_cols);
+
+  AlignedVector<int32_t> expected(A_rows * B_cols), blocked(A_rows * B_cols), gemv(A_rows * B_cols);
+  Backend::Multiply(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(expected.begin()));
+  Workspace workspace;
+  {
+    ScopedWorkspace scoped(workspace);
+    MultiplyBlocked<callbacks::Write<int32_t>, Backend>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(blocked.begin()), BlockSizes{64, 2, 8});
+    MultiplyGEMV<callbacks::Write<int32_t>, Backend>(A_prep.begin(), B_prep.begin(), A_rows, width, B_cols, callbacks::Write<int32_t>(gemv.begin()), 3);
+  }
+  CHECK(ScratchWorkspace == nullptr);
+  CHECK(workspace.Used() == 0);
+  CHECK(workspace.HighWater() >= 2 * A_rows * B_cols * sizeof(int32_t));
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    INFO("Index " << i);
+    CHECK(blocked[i] == expected[i]);
+    CHECK(gemv[i] == expected[i]);
+  }
+}
+
+} // namespace
+} // namespace intgemm